@@ -1,4 +1,4 @@
-QT += core network
+QT += core network concurrent
 QT -= gui
 
 CONFIG += c++17 console
@@ -9,7 +9,7 @@ TEMPLATE = app
 
 # Windows特定配置
 win32 {
-    LIBS += -liphlpapi
+    LIBS += -liphlpapi -lws2_32 -lpsapi
     RC_FILE = client.rc
 }
 
@@ -17,15 +17,38 @@ SOURCES += \
     main.cpp \
     agent.cpp \
     sysinfo.cpp \
-    softmgr.cpp
+    softmgr.cpp \
+    inventorysource.cpp \
+    inventorywatcher.cpp \
+    jobrunner.cpp \
+    perfmon.cpp \
+    filewriter.cpp \
+    selfmonitor.cpp
 
 HEADERS += \
     agent.h \
     sysinfo.h \
     softmgr.h \
-    ../Common/protocol.h
+    inventorysource.h \
+    inventorywatcher.h \
+    jobrunner.h \
+    perfmon.h \
+    filewriter.h \
+    selfmonitor.h \
+    ../Common/protocol.h \
+    ../Common/telemetry.h \
+    ../Common/inventory.h \
+    ../Common/discovery.h \
+    ../Common/framescheduler.h \
+    ../Common/exec.h \
+    ../Common/trace.h \
+    ../Common/capture.h \
+    ../Common/logger.h
 
 INCLUDEPATH += ../Common
 
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../pgo.pri)
+
 # 输出目录
 DESTDIR = ../bin
@@ -1,47 +1,121 @@
 #include "agent.h"
 #include "sysinfo.h"
 #include "softmgr.h"
+#include "filewriter.h"
+#include "inventorywatcher.h"
+#include "jobrunner.h"
+#include "../Common/inventory.h"
+#include "../Common/logger.h"
 #include <QDir>
+#include <QFileInfo>
 #include <QStandardPaths>
 #include <QJsonArray>
+#include <QRandomGenerator>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 #include <QDebug>
 
+// 收到第一个服务器通告后继续等待其他服务器回复的时间(毫秒)
+#define DISCOVERY_COLLECT_WINDOW 300
+
+// 负载低于容量的该比例才会被选为目标服务器;当前服务器超过容量才迁出。
+// 两个阈值之间留出余量,避免客户端在服务器之间来回迁移
+#define REBALANCE_HIGH_WATERMARK 0.9
+
+// 连接后至少保持的时间,以及迁移前的随机延迟上限(毫秒)
+#define REBALANCE_MIN_AGE 60000
+#define REBALANCE_JITTER 15000
+
+// 心跳往返超过该值(毫秒)时记录日志,用于观察控制消息是否被大块数据阻塞
+#define HEARTBEAT_RTT_WARN 1000
+
+// 套接字的读缓冲上限(字节)。暂停读取后Qt最多缓存这么多,其余留在内核中由TCP流控让服务端放慢
+#define AGENT_READ_BUFFER_SIZE (256 * 1024)
+
+// 安装程序正常退出时在响应中带上退出码,服务端按它分组汇总结果
+static void setExitCode(QJsonObject& response, int exitCode)
+{
+    if (exitCode != NO_EXIT_CODE) {
+        response["exitCode"] = exitCode;
+    }
+}
+
+// 在线程池中执行耗时操作,完成后在 context 所在线程回调
+template <typename T, typename Work, typename Done>
+static void runAsync(QObject* context, QThreadPool* pool, Work work, Done done)
+{
+    QFutureWatcher<T>* watcher = new QFutureWatcher<T>(context);
+    QObject::connect(watcher, &QFutureWatcher<T>::finished, context, [watcher, done]() {
+        done(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run(pool, work));
+}
+
 Agent::Agent(QObject *parent)
     : QObject(parent)
     , m_socket(new QTcpSocket(this))
     , m_discoverySocket(new QUdpSocket(this))
     , m_heartbeatTimer(new QTimer(this))
     , m_reconnectTimer(new QTimer(this))
+    , m_lastHeartbeatRtt(-1)
     , m_serverPort(DEFAULT_PORT)
     , m_autoDiscovery(false)
-    , m_receiveFile(nullptr)
-    , m_expectedFileSize(0)
-    , m_receivedSize(0)
+    , m_probeTimer(new QTimer(this))
+    , m_chooseTimer(new QTimer(this))
+    , m_probeInterval(PROBE_MIN_INTERVAL)
+    , m_rebalanceTimer(new QTimer(this))
+    , m_pendingMove(false)
+    , m_readPaused(false)
+    , m_session(0)
+    , m_telemetryTimer(new QTimer(this))
+    , m_telemetryBatchSize(TELEMETRY_BATCH_SIZE)
+    , m_footprintTimer(new QTimer(this))
+    , m_inventoryWatcher(new InventoryWatcher(this))
+    , m_inventoryScanning(false)
+    , m_inventoryDirty(false)
 {
     connect(m_socket, &QTcpSocket::connected, this, &Agent::onConnected);
     connect(m_socket, &QTcpSocket::disconnected, this, &Agent::onDisconnected);
     connect(m_socket, &QTcpSocket::readyRead, this, &Agent::onReadyRead);
+    connect(m_socket, &QTcpSocket::bytesWritten, this, &Agent::onBytesWritten);
     connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
             this, &Agent::onError);
+    m_socket->setReadBufferSize(AGENT_READ_BUFFER_SIZE);
     connect(m_heartbeatTimer, &QTimer::timeout, this, &Agent::sendHeartbeat);
     connect(m_discoverySocket, &QUdpSocket::readyRead, this, &Agent::onBroadcastReceived);
     connect(m_reconnectTimer, &QTimer::timeout, this, &Agent::tryReconnect);
+    connect(m_telemetryTimer, &QTimer::timeout, this, &Agent::collectTelemetry);
+    connect(m_footprintTimer, &QTimer::timeout, this, &Agent::checkFootprint);
+    connect(m_probeTimer, &QTimer::timeout, this, &Agent::sendProbe);
+    connect(m_chooseTimer, &QTimer::timeout, this, &Agent::chooseServer);
+    connect(m_rebalanceTimer, &QTimer::timeout, this, &Agent::rebalance);
+    connect(m_inventoryWatcher, &InventoryWatcher::changed, this, &Agent::onInventoryChanged);
+    m_probeTimer->setSingleShot(true);
+    m_chooseTimer->setSingleShot(true);
+    m_rebalanceTimer->setSingleShot(true);
+    m_installPool.setMaxThreadCount(1);
+    
+    // 监视软件清单来源,变化时主动推送,服务端无需轮询
+    m_inventoryWatcher->watch(SoftwareManager::inventoryWatchPaths());
+    
+    // 自身占用的预算检查不依赖连接,未连接时也在进行
+    SelfMonitor::sample();
+    m_footprintTimer->start(SELF_CHECK_INTERVAL);
 }
 
 Agent::~Agent()
 {
     disconnect();
-    if (m_receiveFile) {
-        m_receiveFile->close();
-        delete m_receiveFile;
-    }
+    clearIncomingFiles();
+    clearJobs();
 }
 
 void Agent::connectToServer(const QString& host, quint16 port)
 {
     m_serverHost = host;
     m_serverPort = port;
-    emit logMessage(QString("正在连接服务器 %1:%2...").arg(host).arg(port));
+    LOG_INFO("agent", "正在连接服务器 %1:%2...", host, port);
     m_socket->connectToHost(host, port);
 }
 
@@ -51,51 +125,205 @@ void Agent::startAutoDiscovery()
     
     // 绑定UDP端口监听广播
     if (!m_discoverySocket->bind(BROADCAST_PORT, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
-        emit logMessage("无法绑定广播端口: " + m_discoverySocket->errorString());
+        LOG_WARN("agent", "无法绑定广播端口: %1", m_discoverySocket->errorString());
         return;
     }
     
-    emit logMessage("自动发现模式已启动,等待服务器...");
+    LOG_INFO("agent", "自动发现模式已启动,等待服务器...");
+    startProbing();
+}
+
+void Agent::startProbing()
+{
+    m_probeInterval = PROBE_MIN_INTERVAL;
+    sendProbe();
+}
+
+void Agent::sendProbe()
+{
+    if (!m_autoDiscovery || isConnected()) {
+        return;
+    }
+    
+    // 正在连接时只保留定时器,连接失败后继续探测
+    if (m_socket->state() == QAbstractSocket::UnconnectedState) {
+        QByteArray probe = Discovery::probe();
+        for (const QHostAddress& address : Discovery::broadcastAddresses()) {
+            m_discoverySocket->writeDatagram(probe, address, DISCOVERY_PORT);
+        }
+    }
+    
+    // 指数退避并加随机抖动,避免服务器重启时所有客户端同时探测
+    int jitter = QRandomGenerator::global()->bounded(m_probeInterval / 4 + 1);
+    m_probeTimer->start(m_probeInterval + jitter);
+    m_probeInterval = qMin(m_probeInterval * 2, PROBE_MAX_INTERVAL);
 }
 
 void Agent::onBroadcastReceived()
 {
+    // 已连接或正在连接时直接丢弃通告,不做解析
+    bool idle = m_socket->state() == QAbstractSocket::UnconnectedState;
+    
     while (m_discoverySocket->hasPendingDatagrams()) {
+        if (!idle) {
+            m_discoverySocket->readDatagram(nullptr, 0);
+            continue;
+        }
+        
         QByteArray data;
         QHostAddress sender;
         quint16 senderPort;
         
-        data.resize(m_discoverySocket->pendingDatagramSize());
+        data.resize(int(m_discoverySocket->pendingDatagramSize()));
         m_discoverySocket->readDatagram(data.data(), data.size(), &sender, &senderPort);
         
-        // 解析广播数据: LANMGR_SERVER:TCP端口
-        QString msg = QString::fromUtf8(data);
-        if (msg.startsWith(BROADCAST_MAGIC)) {
-            QStringList parts = msg.split(':');
-            if (parts.size() >= 2) {
-                QString serverIp = sender.toString();
-                // 移除IPv6前缀
-                if (serverIp.startsWith("::ffff:")) {
-                    serverIp = serverIp.mid(7);
-                }
-                quint16 tcpPort = parts[1].toUInt();
-                
-                emit logMessage(QString("发现服务器: %1:%2").arg(serverIp).arg(tcpPort));
-                emit serverDiscovered(serverIp, tcpPort);
-                
-                // 如果未连接,自动连接
-                if (!isConnected()) {
-                    connectToServer(serverIp, tcpPort);
-                }
-            }
+        // 服务器广播或探测回复: LANMGR_SERVER:TCP端口[:连接数:容量]
+        ServerAnnounce info;
+        if (!Discovery::parseAnnounce(data, info)) {
+            continue;
+        }
+        
+        QString serverIp = sender.toString();
+        // 移除IPv6前缀
+        if (serverIp.startsWith("::ffff:")) {
+            serverIp = serverIp.mid(7);
+        }
+        
+        info.host = serverIp;
+        
+        if (!m_candidates.contains(info.id())) {
+            LOG_INFO("agent", "发现服务器: %1 (连接数 %2/%3)", info.id(), info.load, info.capacity);
+            emit serverDiscovered(serverIp, info.port);
+        }
+        m_candidates.insert(info.id(), info);
+        
+        // 收集一小段时间内的所有回复,再统一选择
+        if (!m_chooseTimer->isActive()) {
+            m_chooseTimer->start(DISCOVERY_COLLECT_WINDOW);
         }
     }
 }
 
+void Agent::chooseServer()
+{
+    QList<ServerAnnounce> servers = m_candidates.values();
+    m_candidates.clear();
+    if (m_socket->state() == QAbstractSocket::UnconnectedState) {
+        connectToBest(servers);
+    }
+}
+
+void Agent::connectToCluster(const QList<ServerAnnounce>& servers)
+{
+    m_staticServers = servers;
+    connectToBest(servers);
+}
+
+bool Agent::connectToBest(const QList<ServerAnnounce>& servers)
+{
+    // 同一台电脑总是落到同一台服务器,跳过超载和刚连接失败的服务器
+    int index = Discovery::pickServer(agentKey(), servers, REBALANCE_HIGH_WATERMARK, m_failedServers);
+    if (index < 0) {
+        return false;
+    }
+    connectToServer(servers[index].host, servers[index].port);
+    return true;
+}
+
+QString Agent::currentServerId() const
+{
+    return m_serverHost + ':' + QString::number(m_serverPort);
+}
+
+QByteArray Agent::agentKey()
+{
+    if (m_agentKey.isEmpty()) {
+        m_agentKey = SysInfo::getMacAddress().toUpper().toUtf8();
+        if (m_agentKey.isEmpty()) {
+            m_agentKey = SysInfo::getComputerName().toUtf8();
+        }
+    }
+    return m_agentKey;
+}
+
+void Agent::handleClusterInfo(const QJsonObject& json)
+{
+    agentKey();
+    m_cluster.clear();
+    for (const QJsonValue& val : json["servers"].toArray()) {
+        QJsonObject obj = val.toObject();
+        ServerAnnounce info;
+        // 地址为空表示当前连接的服务器
+        info.host = obj["host"].toString();
+        if (info.host.isEmpty()) {
+            info.host = m_serverHost;
+        }
+        info.port = quint16(obj["port"].toInt());
+        info.load = obj["load"].toInt();
+        info.capacity = obj["capacity"].toInt();
+        if (info.port) {
+            m_cluster.append(info);
+        }
+    }
+    
+    // 需要迁移时随机延迟后再确认,避免大量客户端同时切换
+    if (rebalanceTarget() >= 0 && !m_rebalanceTimer->isActive()) {
+        m_rebalanceTimer->start(QRandomGenerator::global()->bounded(REBALANCE_JITTER));
+    }
+}
+
+int Agent::rebalanceTarget() const
+{
+    if (!isConnected() || m_cluster.size() < 2 || m_connectedTime.elapsed() < REBALANCE_MIN_AGE) {
+        return -1;
+    }
+    
+    int target = Discovery::pickServer(m_agentKey, m_cluster, REBALANCE_HIGH_WATERMARK);
+    if (target < 0 || m_cluster[target].id() == currentServerId()) {
+        return -1;
+    }
+    
+    // 目标本身也接近满载时不迁移
+    const ServerAnnounce& info = m_cluster[target];
+    if (info.capacity > 0 && info.load >= info.capacity * REBALANCE_HIGH_WATERMARK) {
+        return -1;
+    }
+    return target;
+}
+
+void Agent::rebalance()
+{
+    int target = rebalanceTarget();
+    if (target < 0) {
+        return;
+    }
+    
+    const ServerAnnounce& info = m_cluster[target];
+    LOG_INFO("agent", "迁移到服务器 %1 (连接数 %2/%3)", info.id(), info.load, info.capacity);
+    
+    // 告诉当前服务器这是主动迁移,它不必再等本机重新上线
+    QJsonObject json;
+    json["server"] = info.id();
+    sendJson(CMD_CLIENT_MOVING, json);
+    
+    m_serverHost = info.host;
+    m_serverPort = info.port;
+    m_pendingMove = true;
+    m_socket->disconnectFromHost();
+}
+
 void Agent::tryReconnect()
 {
-    if (!isConnected() && !m_serverHost.isEmpty()) {
-        emit logMessage("尝试重新连接...");
+    if (m_socket->state() != QAbstractSocket::UnconnectedState) {
+        return;
+    }
+    
+    // 指定了服务器列表时重新选择,原服务器失败会落到下一台
+    if (!m_staticServers.isEmpty()) {
+        LOG_INFO("agent", "尝试重新连接...");
+        connectToBest(m_staticServers + m_cluster);
+    } else if (!m_serverHost.isEmpty()) {
+        LOG_INFO("agent", "尝试重新连接...");
         connectToServer(m_serverHost, m_serverPort);
     }
 }
@@ -104,6 +332,12 @@ void Agent::disconnect()
 {
     m_heartbeatTimer->stop();
     m_reconnectTimer->stop();
+    m_telemetryTimer->stop();
+    m_probeTimer->stop();
+    m_chooseTimer->stop();
+    m_rebalanceTimer->stop();
+    m_candidates.clear();
+    m_staticServers.clear();
     m_autoDiscovery = false;
     if (m_socket->state() != QAbstractSocket::UnconnectedState) {
         m_socket->disconnectFromHost();
@@ -115,11 +349,28 @@ bool Agent::isConnected() const
     return m_socket->state() == QAbstractSocket::ConnectedState;
 }
 
+bool Agent::startCapture(const QString& path, bool full)
+{
+    if (!m_capture.open(path, CAPTURE_AGENT, full)) {
+        LOG_WARN("agent", "无法记录流量到 %1: %2", path, m_capture.errorString());
+        return false;
+    }
+    LOG_INFO("agent", "开始记录流量: %1", path);
+    return true;
+}
+
 void Agent::onConnected()
 {
-    emit logMessage("已连接到服务器");
+    LOG_INFO("agent", "已连接到服务器");
     emit connected();
     
+    // 已连接,停止探测
+    m_probeTimer->stop();
+    m_chooseTimer->stop();
+    m_candidates.clear();
+    m_failedServers.clear();
+    m_connectedTime.start();
+    
     // 发送客户端基本信息
     sendClientInfo();
     
@@ -129,112 +380,244 @@ void Agent::onConnected()
 
 void Agent::onDisconnected()
 {
-    emit logMessage("与服务器断开连接");
+    LOG_INFO("agent", "与服务器断开连接");
     m_heartbeatTimer->stop();
+    m_telemetryTimer->stop();
+    m_telemetryBatch.clear();
+    m_rebalanceTimer->stop();
     emit disconnected();
     
+    m_connectedTime.invalidate();
+    m_heartbeatSent.invalidate();
+    m_lastHeartbeatRtt = -1;
+    m_traces.clear();
+    m_scheduler.clear();
+    m_session++;
+    clearIncomingFiles();
+    clearJobs();
+    m_readPaused = false;
+    
+    // 主动迁移时立即连接新服务器
+    if (m_pendingMove) {
+        m_pendingMove = false;
+        connectToServer(m_serverHost, m_serverPort);
+    }
+    
     // 自动重连
     if (m_autoDiscovery || !m_serverHost.isEmpty()) {
-        emit logMessage("5秒后自动重连...");
+        LOG_INFO("agent", "5秒后自动重连...");
         m_reconnectTimer->start(5000);
     }
+    
+    // 同时重新探测,原服务器不可用时可以连接其他服务器
+    if (m_autoDiscovery) {
+        startProbing();
+    }
 }
 
 void Agent::onReadyRead()
 {
+    // 文件写入队列满时不读取,由 resumeReading 继续
+    if (m_readPaused) return;
+    
+    SelfMonitor::Scope footprint(SELF_OP_NETWORK);
     m_buffer.append(m_socket->readAll());
     
     // 循环处理完整的数据包
-    while (m_buffer.size() >= Protocol::headerSize()) {
+    while (!m_readPaused && m_buffer.size() >= Protocol::headerSize()) {
         ProtocolHeader header;
         if (!Protocol::parseHeader(m_buffer, header)) {
             break;
         }
         
-        int packetSize = Protocol::headerSize() + header.dataLength;
+        int packetSize = header.size + header.dataLength;
         if (m_buffer.size() < packetSize) {
             break; // 数据包不完整,等待更多数据
         }
         
         // 提取数据
-        QByteArray data = m_buffer.mid(Protocol::headerSize(), header.dataLength);
+        QByteArray data = m_buffer.mid(header.size, header.dataLength);
         m_buffer.remove(0, packetSize);
         
         // 处理命令
-        processCommand(static_cast<CommandType>(header.cmdType), data);
+        m_capture.write(m_session, CAPTURE_IN, header.cmdType, header.flags, header.requestId, data);
+        processCommand(header, data);
     }
 }
 
+void Agent::resumeReading()
+{
+    if (!m_readPaused) return;
+    
+    // 先处理已读入的数据,再继续读取套接字
+    m_readPaused = false;
+    onReadyRead();
+}
+
 void Agent::onError(QAbstractSocket::SocketError error)
 {
     Q_UNUSED(error)
     emit errorOccurred(m_socket->errorString());
-    emit logMessage("连接错误: " + m_socket->errorString());
+    LOG_WARN("agent", "连接错误: %1", m_socket->errorString());
+    
+    // 连接未建立就失败,下次选择服务器时跳过它
+    if (m_socket->state() != QAbstractSocket::ConnectedState && !m_connectedTime.isValid()) {
+        m_failedServers.insert(currentServerId());
+        if (!m_staticServers.isEmpty() && !m_reconnectTimer->isActive()) {
+            m_reconnectTimer->start(5000);
+        }
+    }
 }
 
 void Agent::sendHeartbeat()
 {
-    sendPacket(CMD_HEARTBEAT, QByteArray());
+    // 上一个心跳还没有响应时不重新计时,记录的是最长等待时间
+    if (!m_heartbeatSent.isValid()) {
+        m_heartbeatSent.start();
+    }
+    
+    // 带上上一次的往返时间供服务端统计,旧版服务端忽略心跳数据
+    if (m_lastHeartbeatRtt >= 0) {
+        QJsonObject json;
+        json["rtt"] = m_lastHeartbeatRtt;
+        m_lastHeartbeatRtt = -1;
+        sendJson(CMD_HEARTBEAT, json);
+    } else {
+        sendPacket(CMD_HEARTBEAT, QByteArray());
+    }
 }
 
-void Agent::sendPacket(CommandType cmd, const QByteArray& data)
+void Agent::sendPacket(CommandType cmd, const QByteArray& data, quint32 requestId)
 {
     if (m_socket->state() != QAbstractSocket::ConnectedState) {
         return;
     }
-    QByteArray packet = Protocol::pack(cmd, data);
-    m_socket->write(packet);
+    quint8 flags = requestId ? FLAG_RESPONSE : 0;
+    m_capture.write(m_session, CAPTURE_OUT, cmd, flags, requestId, data);
+    m_scheduler.enqueue(cmd, data, requestId, flags);
+    m_scheduler.flush(m_socket);
+}
+
+void Agent::onBytesWritten()
+{
+    m_scheduler.flush(m_socket);
 }
 
-void Agent::sendJson(CommandType cmd, const QJsonObject& json)
+void Agent::sendJson(CommandType cmd, const QJsonObject& json, quint32 requestId)
 {
+    if (requestId != 0 && m_traces.contains(requestId)) {
+        QJsonObject response = json;
+        attachTrace(cmd, requestId, response);
+        sendPacket(cmd, QJsonDocument(response).toJson(QJsonDocument::Compact), requestId);
+        return;
+    }
     QJsonDocument doc(json);
-    sendPacket(cmd, doc.toJson(QJsonDocument::Compact));
+    sendPacket(cmd, doc.toJson(QJsonDocument::Compact), requestId);
+}
+
+quint64 Agent::beginTrace(quint32 requestId, const QJsonObject& json)
+{
+    quint64 traceId = Trace::idFromString(json["traceId"].toString());
+    if (requestId == 0 || traceId == 0) {
+        return 0;
+    }
+    RequestTrace trace;
+    trace.traceId = traceId;
+    trace.receivedUs = Trace::now();
+    m_traces.insert(requestId, trace);
+    Trace::instant(traceId, "agent.received");
+    return traceId;
 }
 
-void Agent::processCommand(CommandType cmd, const QByteArray& data)
+void Agent::attachTrace(CommandType cmd, quint32 requestId, QJsonObject& response)
 {
+    // 中间的确认(准备接收、文件接收完成)不结束请求,失败的确认结束
+    bool final = cmd == CMD_SYSINFO_RESPONSE || cmd == CMD_SOFTWARE_RESPONSE ||
+                 cmd == CMD_INSTALL_RESPONSE || cmd == CMD_UNINSTALL_RESPONSE ||
+                 cmd == CMD_EXEC_RESULT ||
+                 (cmd == CMD_FILE_TRANSFER_ACK && !response["success"].toBool());
+    if (!final) return;
+    
+    RequestTrace trace = m_traces.take(requestId);
+    Trace::instant(trace.traceId, "agent.respond");
+    
+    // 时间相对于收到请求,服务端按往返时间换算到自己的时钟
+    QJsonObject json;
+    json["events"] = Trace::toJson(Trace::collect(trace.traceId), trace.receivedUs);
+    json["elapsed"] = Trace::now() - trace.receivedUs;
+    response["trace"] = json;
+}
+
+void Agent::processCommand(const ProtocolHeader& header, const QByteArray& data)
+{
+    CommandType cmd = static_cast<CommandType>(header.cmdType);
+    quint32 requestId = header.requestId;
+    
     switch (cmd) {
     case CMD_HEARTBEAT_ACK:
-        // 心跳响应,不需要处理
+        // 心跳响应,往返时间过长说明控制消息在排队
+        if (m_heartbeatSent.isValid()) {
+            qint64 rtt = m_heartbeatSent.elapsed();
+            m_heartbeatSent.invalidate();
+            m_lastHeartbeatRtt = rtt;
+            if (rtt >= HEARTBEAT_RTT_WARN) {
+                LOG_WARN("agent", "心跳往返时间 %1 ms", rtt);
+            }
+        }
         break;
         
     case CMD_GET_SYSINFO:
-        emit logMessage("收到系统信息请求");
-        handleGetSysInfo();
+        LOG_DEBUG("agent", "收到系统信息请求");
+        handleGetSysInfo(requestId, Protocol::parseJson(data));
         break;
         
     case CMD_GET_SOFTWARE:
-        emit logMessage("收到软件列表请求");
-        handleGetSoftware();
+        LOG_DEBUG("agent", "收到软件列表请求");
+        handleGetSoftware(requestId, Protocol::parseJson(data));
         break;
         
     case CMD_INSTALL_SOFTWARE:
-        emit logMessage("收到安装软件请求");
-        handleInstallSoftware(Protocol::parseJson(data));
+        LOG_DEBUG("agent", "收到安装软件请求");
+        handleInstallSoftware(requestId, Protocol::parseJson(data));
         break;
         
     case CMD_UNINSTALL_SOFTWARE:
-        emit logMessage("收到卸载软件请求");
-        handleUninstallSoftware(Protocol::parseJson(data));
+        LOG_DEBUG("agent", "收到卸载软件请求");
+        handleUninstallSoftware(requestId, Protocol::parseJson(data));
         break;
         
     case CMD_FILE_TRANSFER_START:
-        emit logMessage("收到文件传输开始");
-        handleFileTransferStart(Protocol::parseJson(data));
+        LOG_DEBUG("agent", "收到文件传输开始");
+        handleFileTransferStart(requestId, Protocol::parseJson(data));
         break;
         
     case CMD_FILE_TRANSFER_DATA:
-        handleFileTransferData(data);
+        handleFileTransferData(requestId, data);
         break;
         
     case CMD_FILE_TRANSFER_END:
-        emit logMessage("文件传输完成");
-        handleFileTransferEnd();
+        LOG_DEBUG("agent", "文件传输完成");
+        handleFileTransferEnd(requestId);
+        break;
+        
+    case CMD_TELEMETRY_CONFIG:
+        handleTelemetryConfig(Protocol::parseJson(data));
+        break;
+        
+    case CMD_CLUSTER_INFO:
+        handleClusterInfo(Protocol::parseJson(data));
+        break;
+        
+    case CMD_EXEC_START:
+        handleExecStart(requestId, Protocol::parseJson(data));
+        break;
+        
+    case CMD_EXEC_CANCEL:
+        handleExecCancel(requestId);
         break;
         
     default:
-        emit logMessage(QString("收到未知命令: 0x%1").arg(cmd, 4, 16, QChar('0')));
+        LOG_WARN("agent", "收到未知命令: 0x%1", QString("%1").arg(quint32(cmd), 4, 16, QChar('0')));
         break;
     }
 }
@@ -247,167 +630,450 @@ void Agent::sendClientInfo()
     json["ipAddress"] = sysInfo.ipAddress;
     json["macAddress"] = sysInfo.macAddress;
     json["osVersion"] = sysInfo.osVersion;
+    json["protocolVersion"] = PROTOCOL_VERSION;
+    // 自身占用和预算,之后随遥测批次更新
+    json["agent"] = SelfMonitor::report(m_footprint);
     sendJson(CMD_CLIENT_INFO, json);
 }
 
-void Agent::handleGetSysInfo()
+void Agent::handleGetSysInfo(quint32 requestId, const QJsonObject& json)
 {
-    SystemInfo sysInfo = SysInfo::getSystemInfo();
-    sendJson(CMD_SYSINFO_RESPONSE, sysInfo.toJson());
-    emit logMessage("已发送系统信息");
+    quint64 traceId = beginTrace(requestId, json);
+    quint32 session = m_session;
+    runAsync<SystemInfo>(this, QThreadPool::globalInstance(), [traceId]() {
+        SelfMonitor::Scope footprint(SELF_OP_SYSINFO);
+        Trace::Span span(traceId, "agent.sysinfo");
+        return SysInfo::getSystemInfo();
+    }, [this, requestId, session](const SystemInfo& sysInfo) {
+        if (session != m_session) return;
+        sendJson(CMD_SYSINFO_RESPONSE, sysInfo.toJson(), requestId);
+        LOG_DEBUG("agent", "已发送系统信息");
+    });
+}
+
+void Agent::handleGetSoftware(quint32 requestId, const QJsonObject& json)
+{
+    QByteArray baseHash = json["baseHash"].toString().toLatin1();
+    quint64 traceId = beginTrace(requestId, json);
+    quint32 session = m_session;
+    
+    // 扫描在线程池中进行,差异计算用到 m_lastSoftware,回到主线程再做
+    runAsync<QList<SoftwareInfo>>(this, QThreadPool::globalInstance(), [traceId]() {
+        Trace::Span span(traceId, "agent.inventory_scan");
+        return SoftwareManager::getInstalledSoftware();
+    }, [this, requestId, session, baseHash](const QList<SoftwareInfo>& softList) {
+        if (session != m_session) return;
+        
+        QByteArray hash = Inventory::hash(softList);
+        sendJson(CMD_SOFTWARE_RESPONSE, softwareReport(softList, hash, baseHash), requestId);
+    });
 }
 
-void Agent::handleGetSoftware()
+void Agent::onInventoryChanged()
 {
-    QList<SoftwareInfo> softList = SoftwareManager::getInstalledSoftware();
+    // 未连接时不推送,重新连接后服务端会用清单摘要校验
+    if (!isConnected()) return;
     
-    QJsonArray arr;
-    for (const SoftwareInfo& info : softList) {
-        arr.append(info.toJson());
+    // 扫描期间又有变化,扫描完成后再来一次
+    if (m_inventoryScanning) {
+        m_inventoryDirty = true;
+        return;
     }
+    m_inventoryScanning = true;
     
-    QJsonObject json;
-    json["software"] = arr;
-    json["count"] = softList.size();
+    quint32 session = m_session;
+    runAsync<QList<SoftwareInfo>>(this, QThreadPool::globalInstance(), &SoftwareManager::getInstalledSoftware,
+                                  [this, session](const QList<SoftwareInfo>& softList) {
+        m_inventoryScanning = false;
+        
+        QByteArray hash = Inventory::hash(softList);
+        if (session == m_session && hash != m_lastSoftwareHash) {
+            LOG_INFO("agent", "检测到软件清单变化");
+            // 以上次上报的版本为基准推送差异,服务端版本不一致时会重新请求完整列表
+            sendJson(CMD_INVENTORY_CHANGED, softwareReport(softList, hash, m_lastSoftwareHash));
+        }
+        
+        if (m_inventoryDirty) {
+            m_inventoryDirty = false;
+            onInventoryChanged();
+        }
+    });
+}
+
+QJsonObject Agent::softwareReport(const QList<SoftwareInfo>& softList, const QByteArray& hash,
+                                  const QByteArray& baseHash)
+{
+    QJsonObject response;
+    response["hash"] = QString::fromLatin1(hash);
+    response["count"] = softList.size();
     
-    sendJson(CMD_SOFTWARE_RESPONSE, json);
-    emit logMessage(QString("已发送软件列表 (%1 个)").arg(softList.size()));
+    if (!baseHash.isEmpty() && baseHash == hash) {
+        // 服务端快照与本机一致
+        response["unchanged"] = true;
+        response["baseHash"] = QString::fromLatin1(baseHash);
+        LOG_INFO("agent", "软件列表未变化 (%1 个)", softList.size());
+    } else if (!baseHash.isEmpty() && baseHash == m_lastSoftwareHash) {
+        // 服务端持有上次上报的版本,只发送差异
+        QList<SoftwareInfo> added;
+        QStringList removed;
+        Inventory::diff(m_lastSoftware, softList, added, removed);
+        response["baseHash"] = QString::fromLatin1(baseHash);
+        response["delta"] = Inventory::diffToJson(added, removed);
+        LOG_INFO("agent", "已发送软件列表变化 (新增/更新 %1 个, 删除 %2 个)", added.size(), removed.size());
+    } else {
+        QJsonArray arr;
+        for (const SoftwareInfo& info : softList) {
+            arr.append(info.toJson());
+        }
+        response["software"] = arr;
+        LOG_INFO("agent", "已发送软件列表 (%1 个)", softList.size());
+    }
+    
+    m_lastSoftware = softList;
+    m_lastSoftwareHash = hash;
+    return response;
 }
 
-void Agent::handleInstallSoftware(const QJsonObject& json)
+void Agent::handleInstallSoftware(quint32 requestId, const QJsonObject& json)
 {
     QString filePath = json["filePath"].toString();
     QString args = json["args"].toString();
+    quint64 traceId = beginTrace(requestId, json);
+    quint32 session = m_session;
     
-    emit logMessage(QString("正在安装: %1").arg(filePath));
-    
-    bool success = SoftwareManager::installSoftware(filePath, args);
+    LOG_INFO("agent", "正在安装: %1", filePath);
     
-    QJsonObject response;
-    response["success"] = success;
-    response["filePath"] = filePath;
-    response["message"] = success ? "安装成功" : "安装失败";
-    
-    sendJson(CMD_INSTALL_RESPONSE, response);
-    emit logMessage(success ? "安装完成" : "安装失败");
+    runAsync<QPair<bool, int>>(this, &m_installPool, [filePath, args, traceId]() {
+        Trace::Scope scope(traceId);
+        Trace::Span span(traceId, "agent.install");
+        int exitCode = NO_EXIT_CODE;
+        bool success = SoftwareManager::installSoftware(filePath, args, &exitCode);
+        return qMakePair(success, exitCode);
+    }, [this, requestId, session, filePath](const QPair<bool, int>& result) {
+        LOG_INFO("agent", "%1", result.first ? "安装完成" : "安装失败");
+        if (session != m_session) return;
+        
+        QJsonObject response;
+        response["success"] = result.first;
+        response["filePath"] = filePath;
+        response["message"] = result.first ? "安装成功" : "安装失败";
+        setExitCode(response, result.second);
+        sendJson(CMD_INSTALL_RESPONSE, response, requestId);
+    });
 }
 
-void Agent::handleUninstallSoftware(const QJsonObject& json)
+void Agent::handleUninstallSoftware(quint32 requestId, const QJsonObject& json)
 {
     QString softwareName = json["name"].toString();
     QString uninstallCmd = json["uninstallCmd"].toString();
+    quint64 traceId = beginTrace(requestId, json);
+    quint32 session = m_session;
     
-    emit logMessage(QString("正在卸载: %1").arg(softwareName));
-    
-    bool success = SoftwareManager::uninstallSoftware(uninstallCmd);
-    
-    QJsonObject response;
-    response["success"] = success;
-    response["name"] = softwareName;
-    response["message"] = success ? "卸载成功" : "卸载失败";
+    LOG_INFO("agent", "正在卸载: %1", softwareName);
     
-    sendJson(CMD_UNINSTALL_RESPONSE, response);
-    emit logMessage(success ? "卸载完成" : "卸载失败");
+    runAsync<QPair<bool, int>>(this, &m_installPool, [uninstallCmd, traceId]() {
+        Trace::Scope scope(traceId);
+        Trace::Span span(traceId, "agent.uninstall");
+        int exitCode = NO_EXIT_CODE;
+        bool success = SoftwareManager::uninstallSoftware(uninstallCmd, &exitCode);
+        return qMakePair(success, exitCode);
+    }, [this, requestId, session, softwareName](const QPair<bool, int>& result) {
+        LOG_INFO("agent", "%1", result.first ? "卸载完成" : "卸载失败");
+        if (session != m_session) return;
+        
+        QJsonObject response;
+        response["success"] = result.first;
+        response["name"] = softwareName;
+        response["message"] = result.first ? "卸载成功" : "卸载失败";
+        setExitCode(response, result.second);
+        sendJson(CMD_UNINSTALL_RESPONSE, response, requestId);
+    });
 }
 
-void Agent::handleFileTransferStart(const QJsonObject& json)
+void Agent::handleFileTransferStart(quint32 requestId, const QJsonObject& json)
 {
-    QString fileName = json["fileName"].toString();
-    m_expectedFileSize = json["fileSize"].toVariant().toLongLong();
-    m_pendingInstallArgs = json["installArgs"].toString();
+    QString fileName = QFileInfo(json["fileName"].toString()).fileName();
     
-    // 创建临时目录
-    QString tempDir = QStandardPaths::writableLocation(QStandardPaths::TempLocation);
-    QDir().mkpath(tempDir);
+    // 同一请求号重复开始时丢弃之前未完成的文件
+    if (m_incoming.contains(requestId)) {
+        IncomingFile old = m_incoming.take(requestId);
+        old.writer->abort();
+        delete old.writer;
+    }
     
-    m_receiveFilePath = tempDir + "/" + fileName;
+    IncomingFile incoming;
+    incoming.expectedSize = json["fileSize"].toVariant().toLongLong();
+    incoming.installArgs = json["installArgs"].toString();
+    incoming.traceId = beginTrace(requestId, json);
+    incoming.startUs = Trace::now();
     
-    // 关闭之前的文件(如果有)
-    if (m_receiveFile) {
-        m_receiveFile->close();
-        delete m_receiveFile;
+    // 创建临时目录;并发传输时每个请求使用单独的子目录,避免同名安装包互相覆盖
+    QString tempDir = QStandardPaths::writableLocation(QStandardPaths::TempLocation);
+    if (requestId != 0) {
+        incoming.tempDir = QString("%1/lanmgr-%2-%3").arg(tempDir).arg(m_session).arg(requestId);
+        tempDir = incoming.tempDir;
     }
+    QDir().mkpath(tempDir);
     
-    m_receiveFile = new QFile(m_receiveFilePath);
-    if (!m_receiveFile->open(QIODevice::WriteOnly)) {
-        emit logMessage("无法创建文件: " + m_receiveFilePath);
+    incoming.filePath = tempDir + "/" + fileName;
+    incoming.writer = new FileWriter(this);
+    incoming.writer->setTraceId(incoming.traceId);
+    connect(incoming.writer, &FileWriter::notFull, this, &Agent::resumeReading);
+    if (!incoming.writer->open(incoming.filePath, incoming.expectedSize)) {
+        LOG_WARN("agent", "无法创建文件: %1", incoming.filePath);
+        delete incoming.writer;
         
         QJsonObject response;
         response["success"] = false;
         response["message"] = "无法创建文件";
-        sendJson(CMD_FILE_TRANSFER_ACK, response);
+        sendJson(CMD_FILE_TRANSFER_ACK, response, requestId);
         return;
     }
     
-    m_receivedSize = 0;
+    m_incoming.insert(requestId, incoming);
     
     QJsonObject response;
     response["success"] = true;
     response["message"] = "准备接收文件";
-    sendJson(CMD_FILE_TRANSFER_ACK, response);
+    sendJson(CMD_FILE_TRANSFER_ACK, response, requestId);
     
-    emit logMessage(QString("开始接收文件: %1 (%2 字节)").arg(fileName).arg(m_expectedFileSize));
+    LOG_INFO("agent", "开始接收文件: %1 (%2 字节)", fileName, incoming.expectedSize);
 }
 
-void Agent::handleFileTransferData(const QByteArray& data)
+void Agent::handleFileTransferData(quint32 requestId, const QByteArray& data)
 {
-    if (!m_receiveFile || !m_receiveFile->isOpen()) {
+    auto it = m_incoming.find(requestId);
+    if (it == m_incoming.end()) {
         return;
     }
     
-    m_receiveFile->write(data);
-    m_receivedSize += data.size();
+    // 交给写入线程,网络线程不等待磁盘;队列满时暂停读取,写入线程腾出空间后恢复
+    if (!it->writer->write(data)) {
+        m_readPaused = true;
+    }
+    it->receivedSize += data.size();
     
     // 计算进度
-    int progress = (m_expectedFileSize > 0) ? 
-        (int)(m_receivedSize * 100 / m_expectedFileSize) : 0;
+    int progress = (it->expectedSize > 0) ? 
+        (int)(it->receivedSize * 100 / it->expectedSize) : 0;
     
-    if (m_receivedSize % (1024 * 1024) < data.size()) { // 每MB报告一次
-        emit logMessage(QString("接收进度: %1%").arg(progress));
+    if (it->receivedSize % (1024 * 1024) < data.size()) { // 每MB报告一次
+        LOG_DEBUG("agent", "接收进度: %1%", progress);
     }
 }
 
-void Agent::handleFileTransferEnd()
+void Agent::handleFileTransferEnd(quint32 requestId)
 {
-    if (!m_receiveFile) {
+    if (!m_incoming.contains(requestId)) {
         return;
     }
     
-    m_receiveFile->close();
-    
-    bool success = (m_receivedSize == m_expectedFileSize);
+    IncomingFile incoming = m_incoming.take(requestId);
+    FileWriter* writer = incoming.writer;
+    incoming.writer = nullptr;
+    Trace::complete(incoming.traceId, "agent.receive_file", incoming.startUs);
+    qint64 endUs = Trace::now();
     
     QJsonObject response;
-    response["success"] = success;
-    response["filePath"] = m_receiveFilePath;
-    response["receivedSize"] = m_receivedSize;
+    response["filePath"] = incoming.filePath;
+    response["receivedSize"] = incoming.receivedSize;
     
-    if (success) {
-        response["message"] = "文件接收完成";
-        emit logMessage("文件接收完成: " + m_receiveFilePath);
+    if (incoming.receivedSize != incoming.expectedSize) {
+        writer->abort();
+        delete writer;
+        removeIncomingFile(incoming);
         
-        // 自动安装
-        emit logMessage("开始安装...");
-        bool installSuccess = SoftwareManager::installSoftware(m_receiveFilePath, m_pendingInstallArgs);
+        response["success"] = false;
+        response["message"] = QString("文件不完整: 期望 %1 字节, 收到 %2 字节")
+            .arg(incoming.expectedSize).arg(incoming.receivedSize);
+        LOG_WARN("agent", "%1", response["message"].toString());
+        sendJson(CMD_FILE_TRANSFER_ACK, response, requestId);
+        return;
+    }
+    
+    // 等写入线程写完剩余数据并刷盘后再确认和安装
+    quint32 session = m_session;
+    connect(writer, &FileWriter::writeFinished, this,
+            [this, requestId, session, incoming, writer, response, endUs](bool ok, const QByteArray& sha256,
+                                                                          const QString& error) mutable {
+        writer->deleteLater();
+        Trace::complete(incoming.traceId, "agent.wait_disk", endUs);
         
-        QJsonObject installResponse;
-        installResponse["success"] = installSuccess;
-        installResponse["filePath"] = m_receiveFilePath;
-        installResponse["message"] = installSuccess ? "安装成功" : "安装失败";
-        sendJson(CMD_INSTALL_RESPONSE, installResponse);
+        if (session != m_session) {
+            // 已断线,服务端已按失败处理
+            removeIncomingFile(incoming);
+            return;
+        }
         
+        response["success"] = ok;
+        response["sha256"] = QString::fromLatin1(sha256);
+        if (!ok) {
+            response["message"] = "写入文件失败: " + error;
+            LOG_WARN("agent", "%1", response["message"].toString());
+            sendJson(CMD_FILE_TRANSFER_ACK, response, requestId);
+            removeIncomingFile(incoming);
+            return;
+        }
+        
+        response["message"] = "文件接收完成";
+        LOG_INFO("agent", "文件接收完成: %1 (SHA-256 %2)", incoming.filePath, QString::fromLatin1(sha256));
+        sendJson(CMD_FILE_TRANSFER_ACK, response, requestId);
+        installReceivedFile(requestId, incoming);
+    });
+    writer->finish();
+}
+
+void Agent::installReceivedFile(quint32 requestId, const IncomingFile& incoming)
+{
+    // 自动安装,安装期间继续处理其他请求
+    LOG_INFO("agent", "开始安装...");
+    quint32 session = m_session;
+    QString filePath = incoming.filePath;
+    QString args = incoming.installArgs;
+    quint64 traceId = incoming.traceId;
+    runAsync<QPair<bool, int>>(this, &m_installPool, [filePath, args, traceId]() {
+        Trace::Scope scope(traceId);
+        Trace::Span span(traceId, "agent.install");
+        int exitCode = NO_EXIT_CODE;
+        bool success = SoftwareManager::installSoftware(filePath, args, &exitCode);
+        return qMakePair(success, exitCode);
+    }, [this, requestId, session, incoming](const QPair<bool, int>& result) {
         // 删除临时文件
-        QFile::remove(m_receiveFilePath);
-    } else {
-        response["message"] = QString("文件不完整: 期望 %1 字节, 收到 %2 字节")
-            .arg(m_expectedFileSize).arg(m_receivedSize);
-        emit logMessage(response["message"].toString());
+        removeIncomingFile(incoming);
+        LOG_INFO("agent", "%1", result.first ? "安装完成" : "安装失败");
+        if (session != m_session) return;
+        
+        QJsonObject installResponse;
+        installResponse["success"] = result.first;
+        installResponse["filePath"] = incoming.filePath;
+        installResponse["message"] = result.first ? "安装成功" : "安装失败";
+        setExitCode(installResponse, result.second);
+        sendJson(CMD_INSTALL_RESPONSE, installResponse, requestId);
+    });
+}
+
+void Agent::removeIncomingFile(const IncomingFile& incoming)
+{
+    QFile::remove(incoming.filePath);
+    if (!incoming.tempDir.isEmpty()) {
+        QDir().rmdir(incoming.tempDir);
+    }
+}
+
+void Agent::clearIncomingFiles()
+{
+    for (IncomingFile& incoming : m_incoming) {
+        incoming.writer->abort();
+        delete incoming.writer;
+        removeIncomingFile(incoming);
+    }
+    m_incoming.clear();
+}
+
+void Agent::handleExecStart(quint32 requestId, const QJsonObject& json)
+{
+    // 同一请求号的作业还在运行: 这个请求号的结果要留给运行中的作业,回复任何结果都会让
+    // 服务端把它当作已结束,只记录后忽略
+    if (requestId != 0 && m_jobs.contains(requestId)) {
+        LOG_WARN("agent", "忽略重复的执行请求 #%1,该作业仍在运行", requestId);
+        return;
     }
     
-    sendJson(CMD_FILE_TRANSFER_ACK, response);
+    ExecRequest request = ExecRequest::fromJson(json);
+    beginTrace(requestId, json);
     
-    delete m_receiveFile;
-    m_receiveFile = nullptr;
-    m_receiveFilePath.clear();
-    m_pendingInstallArgs.clear();
+    // 输出按作业号回传,旧版服务端没有请求号,无法区分
+    ExecResult result;
+    if (requestId == 0) {
+        result.error = "服务端版本过旧,不支持远程执行";
+    } else if (request.command.isEmpty() && request.program.isEmpty()) {
+        result.error = "执行请求中没有命令";
+    }
+    if (!result.error.isEmpty()) {
+        LOG_WARN("agent", "拒绝执行请求 #%1: %2", requestId, result.error);
+        sendJson(CMD_EXEC_RESULT, result.toJson(), requestId);
+        return;
+    }
+    
+    QString display = request.program.isEmpty() ? request.command : request.program;
+    LOG_INFO("agent", "执行命令 #%1: %2", requestId, display);
+    
+    JobRunner* job = new JobRunner(requestId, request, this);
+    connect(job, &JobRunner::output, this, [this](quint32 jobId, int stream, const QByteArray& data) {
+        sendPacket(CMD_EXEC_OUTPUT, ExecOutputFrame::encode(ExecStream(stream), data), jobId);
+    });
+    connect(job, &JobRunner::finished, this, [this](quint32 jobId, const ExecResult& result) {
+        RequestTrace trace = m_traces.value(jobId);
+        Trace::instant(trace.traceId, "process.exit");
+        Trace::complete(trace.traceId, "agent.exec", trace.receivedUs);
+        sendJson(CMD_EXEC_RESULT, result.toJson(), jobId);
+        if (!result.started) {
+            LOG_WARN("agent", "命令 #%1 启动失败: %2", jobId, result.error);
+        } else {
+            LOG_INFO("agent", "命令 #%1 已结束,退出码 %2%3", jobId, result.exitCode,
+                     result.canceled ? " (已取消)" : result.timedOut ? " (超时)" : "");
+        }
+        JobRunner* finishedJob = m_jobs.take(jobId);
+        if (finishedJob) {
+            finishedJob->deleteLater();
+        }
+    });
+    m_jobs.insert(requestId, job);
+    Trace::instant(m_traces.value(requestId).traceId, "process.start");
+    job->start();
+}
+
+void Agent::handleExecCancel(quint32 requestId)
+{
+    JobRunner* job = m_jobs.value(requestId, nullptr);
+    if (job) {
+        LOG_INFO("agent", "取消命令 #%1", requestId);
+        job->cancel();
+    }
+}
+
+void Agent::clearJobs()
+{
+    // 连接已断开,结果无处回复,直接结束进程
+    qDeleteAll(m_jobs);
+    m_jobs.clear();
+}
+
+void Agent::handleTelemetryConfig(const QJsonObject& json)
+{
+    int interval = json["interval"].toInt(TELEMETRY_INTERVAL);
+    int batchSize = json["batchSize"].toInt(TELEMETRY_BATCH_SIZE);
+    bool enabled = json["enabled"].toBool(true);
+    
+    m_telemetryBatch.clear();
+    if (!enabled || interval <= 0) {
+        m_telemetryTimer->stop();
+        LOG_INFO("agent", "性能遥测已停止");
+        return;
+    }
+    
+    m_telemetryBatchSize = qBound(1, batchSize, TELEMETRY_MAX_BATCH);
+    m_telemetryBatch.reserve(m_telemetryBatchSize);
+    // 立即采一次建立基线,之后按间隔采样
+    m_telemetry.sample();
+    m_telemetryTimer->start(qMax(200, interval));
+    LOG_INFO("agent", "性能遥测已启动: 间隔 %1 ms, 每批 %2 个样本",
+             m_telemetryTimer->interval(), m_telemetryBatchSize);
+}
+
+void Agent::collectTelemetry()
+{
+    SelfMonitor::Scope footprint(SELF_OP_TELEMETRY);
+    m_telemetryBatch.append(m_telemetry.sample());
+    if (m_telemetryBatch.size() >= m_telemetryBatchSize) {
+        sendPacket(CMD_TELEMETRY_BATCH, TelemetryCodec::encodeBatch(m_telemetryBatch));
+        m_telemetryBatch.clear();
+        // 旧版服务端忽略该命令
+        sendJson(CMD_AGENT_STATS, SelfMonitor::report(m_footprint));
+    }
+}
+
+void Agent::checkFootprint()
+{
+    m_footprint = SelfMonitor::sample();
 }
@@ -6,7 +6,21 @@
 #include <QUdpSocket>
 #include <QTimer>
 #include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QThreadPool>
 #include "../Common/protocol.h"
+#include "../Common/discovery.h"
+#include "../Common/framescheduler.h"
+#include "../Common/trace.h"
+#include "../Common/capture.h"
+#include "perfmon.h"
+#include "selfmonitor.h"
+
+class FileWriter;
+class InventoryWatcher;
+class JobRunner;
 
 class Agent : public QObject
 {
@@ -21,17 +35,22 @@ public:
     // 启动自动发现模式
     void startAutoDiscovery();
     
+    // 指定服务器列表(不依赖广播),按MAC一致性哈希选择其中一台连接
+    void connectToCluster(const QList<ServerAnnounce>& servers);
+    
     // 断开连接
     void disconnect();
     
     // 是否已连接
     bool isConnected() const;
     
+    // 记录与服务端之间的收发帧(见 capture.h),供 Replay 工具回放
+    bool startCapture(const QString& path, bool full = false);
+    
 signals:
     void connected();
     void disconnected();
     void errorOccurred(const QString& error);
-    void logMessage(const QString& message);
     void serverDiscovered(const QString& host, quint16 port);
     
 private slots:
@@ -40,45 +59,152 @@ private slots:
     void onReadyRead();
     void onError(QAbstractSocket::SocketError error);
     void sendHeartbeat();
+    void onBytesWritten();
     void onBroadcastReceived();
     void tryReconnect();
+    void sendProbe();
+    void chooseServer();
+    void rebalance();
+    void collectTelemetry();
+    void checkFootprint();
+    void onInventoryChanged();
+    void resumeReading();
     
 private:
-    // 发送数据
-    void sendPacket(CommandType cmd, const QByteArray& data);
-    void sendJson(CommandType cmd, const QJsonObject& json);
+    // 正在接收的文件(按请求号区分,旧版服务端的请求号为0)
+    struct IncomingFile {
+        FileWriter* writer = nullptr;   // 写入线程,收到结束帧后转为等待刷盘
+        QString filePath;
+        QString tempDir;         // 请求专用的临时目录,为空表示直接放在系统临时目录
+        QString installArgs;
+        qint64 expectedSize = 0;
+        qint64 receivedSize = 0;
+        quint64 traceId = 0;
+        qint64 startUs = 0;      // 收到开始帧的时间(Trace::now)
+    };
+    
+    // 服务端下发了跟踪号的请求
+    struct RequestTrace {
+        quint64 traceId = 0;
+        qint64 receivedUs = 0;
+    };
+    
+    // 发送数据(请求号非0时作为对应请求的响应发送)
+    void sendPacket(CommandType cmd, const QByteArray& data, quint32 requestId = 0);
+    void sendJson(CommandType cmd, const QJsonObject& json, quint32 requestId = 0);
     
     // 处理接收到的命令
-    void processCommand(CommandType cmd, const QByteArray& data);
+    void processCommand(const ProtocolHeader& header, const QByteArray& data);
+    
+    // 请求带有跟踪号时开始记录,返回跟踪号(没有时为0)
+    quint64 beginTrace(quint32 requestId, const QJsonObject& json);
+    
+    // 请求的最终响应附带本端记录的事件,之后不再记录
+    void attachTrace(CommandType cmd, quint32 requestId, QJsonObject& response);
     
     // 命令处理函数
-    void handleGetSysInfo();
-    void handleGetSoftware();
-    void handleInstallSoftware(const QJsonObject& json);
-    void handleUninstallSoftware(const QJsonObject& json);
-    void handleFileTransferStart(const QJsonObject& json);
-    void handleFileTransferData(const QByteArray& data);
-    void handleFileTransferEnd();
+    // 耗时操作在线程池中执行,完成后按请求号回复,互不阻塞
+    void handleGetSysInfo(quint32 requestId, const QJsonObject& json);
+    void handleGetSoftware(quint32 requestId, const QJsonObject& json);
+    
+    // 生成软件清单报告并记为最近一次上报: 与 baseHash 一致时只带标记,
+    // baseHash 为上次上报的版本时只带差异,否则为完整列表
+    QJsonObject softwareReport(const QList<SoftwareInfo>& softList, const QByteArray& hash,
+                               const QByteArray& baseHash);
+    void handleInstallSoftware(quint32 requestId, const QJsonObject& json);
+    void handleUninstallSoftware(quint32 requestId, const QJsonObject& json);
+    void handleFileTransferStart(quint32 requestId, const QJsonObject& json);
+    void handleFileTransferData(quint32 requestId, const QByteArray& data);
+    void handleFileTransferEnd(quint32 requestId);
+    void installReceivedFile(quint32 requestId, const IncomingFile& incoming);
+    void removeIncomingFile(const IncomingFile& incoming);
+    void clearIncomingFiles();
+    void handleTelemetryConfig(const QJsonObject& json);
+    void handleClusterInfo(const QJsonObject& json);
+    void handleExecStart(quint32 requestId, const QJsonObject& json);
+    void handleExecCancel(quint32 requestId);
+    void clearJobs();
     
     // 发送客户端基本信息
     void sendClientInfo();
     
+    // 开始主动探测服务器(仅在未连接时)
+    void startProbing();
+    
+    // 在候选服务器中按一致性哈希选择一台并连接
+    bool connectToBest(const QList<ServerAnnounce>& servers);
+    
+    // 计算按当前集群负载应当连接的服务器,无需迁移时返回-1
+    int rebalanceTarget() const;
+    
+    QString currentServerId() const;
+    QByteArray agentKey();
+    
 private:
     QTcpSocket* m_socket;
     QUdpSocket* m_discoverySocket;
     QTimer* m_heartbeatTimer;
     QTimer* m_reconnectTimer;
     QByteArray m_buffer;  // 接收缓冲区
+    FrameScheduler m_scheduler;  // 发送队列
+    QElapsedTimer m_heartbeatSent;  // 等待心跳响应的计时
+    qint64 m_lastHeartbeatRtt;      // 上一次心跳往返时间(毫秒),随下一个心跳上报,-1表示没有
     QString m_serverHost;
     quint16 m_serverPort;
     bool m_autoDiscovery;
     
+    // 服务发现相关
+    QTimer* m_probeTimer;
+    QTimer* m_chooseTimer;
+    int m_probeInterval;
+    QHash<QString, ServerAnnounce> m_candidates;  // 收集窗口内发现的服务器(按服务器标识)
+    
+    // 多服务器分片相关
+    QList<ServerAnnounce> m_staticServers;  // 命令行指定的服务器列表
+    QList<ServerAnnounce> m_cluster;        // 当前服务器下发的集群信息
+    QSet<QString> m_failedServers;          // 最近连接失败的服务器
+    QTimer* m_rebalanceTimer;
+    QElapsedTimer m_connectedTime;
+    bool m_pendingMove;
+    QByteArray m_agentKey;                  // 一致性哈希使用的本机标识(MAC)
+    
     // 文件传输相关
-    QFile* m_receiveFile;
-    QString m_receiveFilePath;
-    QString m_pendingInstallArgs;
-    qint64 m_expectedFileSize;
-    qint64 m_receivedSize;
+    QHash<quint32, IncomingFile> m_incoming;
+    bool m_readPaused;   // 写入队列已满,暂停读取套接字直到写入线程腾出空间
+    
+    // 远程执行的作业(按作业号)
+    QHash<quint32, JobRunner*> m_jobs;
+    
+    // 正在跟踪的请求(按请求号)
+    QHash<quint32, RequestTrace> m_traces;
+    
+    // 安装和卸载串行执行(Windows Installer 同一时间只允许一个安装事务)
+    QThreadPool m_installPool;
+    
+    // 连接序号,断线后完成的异步操作不再回复到新连接上
+    quint32 m_session;
+    
+    // 流量记录(连接编号为连接序号)
+    CaptureWriter m_capture;
+    
+    // 性能遥测相关
+    QTimer* m_telemetryTimer;
+    TelemetryCollector m_telemetry;
+    QVector<TelemetrySample> m_telemetryBatch;
+    int m_telemetryBatchSize;
+    
+    // 自身资源占用,定期采样并检查预算,随遥测批次上报
+    QTimer* m_footprintTimer;
+    SelfMonitor::Usage m_footprint;
+    
+    // 最近一次上报的软件清单,用于回复差异
+    QList<SoftwareInfo> m_lastSoftware;
+    QByteArray m_lastSoftwareHash;
+    
+    // 软件清单变化监视
+    InventoryWatcher* m_inventoryWatcher;
+    bool m_inventoryScanning;   // 推送前的扫描正在进行
+    bool m_inventoryDirty;      // 扫描期间又收到了变化通知
 };
 
 #endif // AGENT_H
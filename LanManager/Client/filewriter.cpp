@@ -0,0 +1,170 @@
+#include "filewriter.h"
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include "selfmonitor.h"
+#include "../Common/trace.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+FileWriter::FileWriter(QObject *parent)
+    : QThread(parent)
+    , m_written(0)
+    , m_full(false)
+    , m_finishing(false)
+    , m_aborted(false)
+    , m_traceId(0)
+{
+}
+
+FileWriter::~FileWriter()
+{
+    // 还没调用 finish 的写入视为放弃;已在收尾的等它写完
+    bool finishing;
+    {
+        QMutexLocker locker(&m_mutex);
+        finishing = m_finishing;
+    }
+    if (isRunning() && !finishing) {
+        abort();
+    }
+    wait();
+}
+
+bool FileWriter::open(const QString& filePath, qint64 expectedSize)
+{
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+    
+    // 预分配空间: Linux 用 posix_fallocate 真正分配磁盘块,
+    // Windows 下 resize 通过 SetEndOfFile 一次性扩展文件
+    if (expectedSize > 0) {
+#ifdef Q_OS_LINUX
+        posix_fallocate(m_file.handle(), 0, off_t(expectedSize));
+#else
+        m_file.resize(expectedSize);
+#endif
+    }
+    
+    start();
+    return true;
+}
+
+bool FileWriter::write(const QByteArray& data)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_aborted || m_finishing) return true;
+    
+    m_queue.enqueue(data);
+    m_notEmpty.wakeOne();
+    if (m_queue.size() < FILE_WRITE_QUEUE_SIZE) return true;
+    
+    m_full = true;
+    return false;
+}
+
+void FileWriter::finish()
+{
+    QMutexLocker locker(&m_mutex);
+    m_finishing = true;
+    m_notEmpty.wakeOne();
+}
+
+void FileWriter::abort()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_aborted = true;
+        m_queue.clear();
+        m_notEmpty.wakeOne();
+    }
+    wait();
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_file.remove();
+}
+
+void FileWriter::run()
+{
+    SelfMonitor::Scope footprint(SELF_OP_FILE_RECEIVE);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    
+    // 从第一块数据到队列写完记为一段,不按块记录,大文件也只有两个事件
+    qint64 writeStart = -1;
+    
+    while (true) {
+        QByteArray data;
+        bool resume = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_queue.isEmpty() && !m_finishing && !m_aborted) {
+                m_notEmpty.wait(&m_mutex);
+            }
+            if (m_aborted) return;
+            if (m_queue.isEmpty()) break;  // 已结束且队列写完
+            
+            data = m_queue.dequeue();
+            if (m_full && m_queue.size() <= FILE_WRITE_QUEUE_SIZE / 2) {
+                m_full = false;
+                resume = true;
+            }
+        }
+        if (resume) {
+            emit notFull();
+        }
+        
+        // 出错后继续消费队列,调用方照常恢复读取,结束时统一报告
+        if (!m_error.isEmpty()) continue;
+        
+        if (writeStart < 0) {
+            writeStart = Trace::now();
+        }
+        hash.addData(data);
+        if (m_file.write(data) != data.size()) {
+            m_error = m_file.errorString();
+            continue;
+        }
+        m_written += data.size();
+        footprint.addIo(data.size());
+        
+        // 超出资源预算时限制写盘速率,队列满后由TCP流控让服务端放慢
+        SelfMonitor::pace(data.size());
+    }
+    
+    if (writeStart >= 0) {
+        Trace::complete(m_traceId, "disk.write", writeStart);
+    }
+    
+    // 截掉预分配但未写入的部分,然后刷盘
+    {
+        Trace::Span span(m_traceId, "disk.sync");
+        if (m_error.isEmpty() && m_file.size() != m_written && !m_file.resize(m_written)) {
+            m_error = m_file.errorString();
+        }
+        if (m_error.isEmpty() && !syncToDisk()) {
+            m_error = "刷新文件到磁盘失败";
+        }
+        m_file.close();
+    }
+    
+    emit writeFinished(m_error.isEmpty(), hash.result().toHex(), m_error);
+}
+
+bool FileWriter::syncToDisk()
+{
+    if (!m_file.flush()) return false;
+#ifdef Q_OS_WIN
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(m_file.handle()))) != 0;
+#else
+    return fsync(m_file.handle()) == 0;
+#endif
+}
@@ -0,0 +1,71 @@
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <QThread>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QByteArray>
+
+// 写入队列最多缓存的数据块数(64KB一块,约4MB)
+#define FILE_WRITE_QUEUE_SIZE 64
+
+// 接收文件的写入线程
+//
+// 网络线程收到数据块后只放入队列,由独立线程写盘并同时计算SHA-256,网络线程从不等待磁盘。
+// 队列满时 write 返回 false,调用方暂停读取套接字,交给TCP流控;
+// 队列降到一半后发出 notFull,调用方再恢复读取。
+// 打开时按预期大小预分配空间,减少大文件的碎片;结束时只做一次刷盘。
+// 客户端超出资源预算时写入线程降低优先级并限制写盘速率(见 SelfMonitor)。
+class FileWriter : public QThread
+{
+    Q_OBJECT
+public:
+    explicit FileWriter(QObject *parent = nullptr);
+    ~FileWriter();
+    
+    // 创建文件并预分配空间,成功后启动写入线程
+    bool open(const QString& filePath, qint64 expectedSize);
+    QString errorString() const { return m_error; }
+    
+    // 追加数据块,不阻塞;返回 false 表示队列已满,应暂停提交直到 notFull
+    bool write(const QByteArray& data);
+    
+    // 数据已全部提交: 写完队列、截掉多余的预分配空间并刷盘,完成后发出 writeFinished
+    void finish();
+    
+    // 放弃写入并删除文件
+    void abort();
+    
+    // 写盘和刷盘耗时记录到该跟踪(在 open 之前设置)
+    void setTraceId(quint64 traceId) { m_traceId = traceId; }
+    
+signals:
+    // write 返回 false 之后队列降到一半(在写入线程发出)
+    void notFull();
+    
+    // sha256 为十六进制摘要
+    void writeFinished(bool success, const QByteArray& sha256, const QString& error);
+    
+protected:
+    void run() override;
+    
+private:
+    bool syncToDisk();
+    
+private:
+    QFile m_file;
+    QString m_error;
+    qint64 m_written;
+    
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QQueue<QByteArray> m_queue;
+    bool m_full;             // 队列满过,降到一半时发出 notFull
+    bool m_finishing;
+    bool m_aborted;
+    quint64 m_traceId;
+};
+
+#endif // FILEWRITER_H
@@ -0,0 +1,413 @@
+#include "inventorysource.h"
+#include "selfmonitor.h"
+#include "../Common/inventory.h"
+#include <QSettings>
+#include <QProcess>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QtConcurrent>
+
+// ---------------- InventorySource ----------------
+
+QByteArray InventorySource::fileStamp(const QStringList& paths)
+{
+    QByteArray stamp;
+    for (const QString& path : paths) {
+        QFileInfo info(path);
+        if (!info.exists()) {
+            continue;
+        }
+        stamp += path.toUtf8() + ':' + QByteArray::number(info.size()) + ':' +
+                 QByteArray::number(info.lastModified().toMSecsSinceEpoch()) + ';';
+    }
+    return stamp;
+}
+
+QByteArray InventorySource::runCommand(const QString& program, const QStringList& arguments)
+{
+    QProcess process;
+    process.start(program, arguments);
+    if (!process.waitForFinished(INVENTORY_COMMAND_TIMEOUT)) {
+        process.kill();
+        process.waitForFinished();
+        return QByteArray();
+    }
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        return QByteArray();
+    }
+    return process.readAllStandardOutput();
+}
+
+// ---------------- RegistrySource ----------------
+
+RegistrySource::RegistrySource(const QString& name, const QString& regPath)
+    : m_name(name)
+    , m_regPath(regPath)
+{
+}
+
+bool RegistrySource::isAvailable() const
+{
+#ifdef Q_OS_WIN
+    return true;
+#else
+    return false;
+#endif
+}
+
+QList<SoftwareInfo> RegistrySource::scan() const
+{
+    QList<SoftwareInfo> list;
+    QSettings reg(m_regPath, QSettings::NativeFormat);
+
+    const QStringList subKeys = reg.childGroups();
+    list.reserve(subKeys.size());
+    for (const QString& subKey : subKeys) {
+        reg.beginGroup(subKey);
+
+        QString displayName = reg.value("DisplayName").toString();
+
+        // 过滤掉没有名称的条目和更新补丁
+        if (!displayName.isEmpty() && !displayName.contains("Update") &&
+            !displayName.contains("KB") && !reg.value("SystemComponent", 0).toBool()) {
+
+            SoftwareInfo info;
+            info.name = displayName;
+            info.version = reg.value("DisplayVersion").toString();
+            info.publisher = reg.value("Publisher").toString();
+            info.installDate = reg.value("InstallDate").toString();
+            info.installPath = reg.value("InstallLocation").toString();
+            info.uninstallCmd = reg.value("UninstallString").toString();
+
+            if (!info.uninstallCmd.isEmpty()) {
+                list.append(info);
+            }
+        }
+
+        reg.endGroup();
+
+        // 注册表逐项读取是扫描中最耗CPU的部分,超出资源预算时在这里让出
+        SelfMonitor::pace();
+    }
+    return list;
+}
+
+// ---------------- DpkgSource ----------------
+
+DpkgSource::DpkgSource(const QString& statusPath)
+    : m_statusPath(statusPath)
+{
+}
+
+bool DpkgSource::isAvailable() const
+{
+    return QFileInfo::exists(m_statusPath);
+}
+
+QByteArray DpkgSource::stamp() const
+{
+    return fileStamp(QStringList() << m_statusPath);
+}
+
+QList<SoftwareInfo> DpkgSource::scan() const
+{
+    QFile file(m_statusPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QList<SoftwareInfo>();
+    }
+    return parseStatus(file.readAll());
+}
+
+QList<SoftwareInfo> DpkgSource::parseStatus(const QByteArray& content)
+{
+    QList<SoftwareInfo> list;
+
+    // 每个包一段,段之间以空行分隔;以空白开头的是上一字段的续行,不关心
+    QByteArray package, version, maintainer;
+    bool installed = false;
+
+    auto finishStanza = [&]() {
+        if (installed && !package.isEmpty()) {
+            SoftwareInfo info;
+            info.name = QString::fromUtf8(package);
+            info.version = QString::fromUtf8(version);
+            // "姓名 <邮箱>" 只保留姓名
+            int angle = maintainer.indexOf('<');
+            info.publisher = QString::fromUtf8(angle >= 0 ? maintainer.left(angle) : maintainer).trimmed();
+            info.uninstallCmd = "apt-get -y remove " + info.name;
+            list.append(info);
+        }
+        package.clear();
+        version.clear();
+        maintainer.clear();
+        installed = false;
+    };
+
+    int pos = 0;
+    const int size = content.size();
+    while (pos < size) {
+        int end = content.indexOf('\n', pos);
+        if (end < 0) {
+            end = size;
+        }
+        int len = end - pos;
+        const char* line = content.constData() + pos;
+
+        if (len == 0) {
+            finishStanza();
+        } else if (line[0] != ' ' && line[0] != '\t') {
+            int colon = content.indexOf(':', pos);
+            if (colon > pos && colon < end) {
+                QByteArray field = content.mid(pos, colon - pos);
+                QByteArray value = content.mid(colon + 1, end - colon - 1).trimmed();
+                if (field == "Package") {
+                    package = value;
+                } else if (field == "Version") {
+                    version = value;
+                } else if (field == "Maintainer") {
+                    maintainer = value;
+                } else if (field == "Status") {
+                    // 形如 "install ok installed",最后一项为当前状态
+                    installed = value.endsWith(" installed");
+                }
+            }
+        }
+        pos = end + 1;
+    }
+    finishStanza();
+
+    return list;
+}
+
+// ---------------- RpmSource ----------------
+
+bool RpmSource::isAvailable() const
+{
+    return !QStandardPaths::findExecutable("rpm").isEmpty();
+}
+
+QStringList RpmSource::databaseFiles()
+{
+    return QStringList()
+        << "/var/lib/rpm/rpmdb.sqlite"
+        << "/var/lib/rpm/Packages"
+        << "/var/lib/rpm/Packages.db"
+        << "/usr/lib/sysimage/rpm/rpmdb.sqlite";
+}
+
+QList<SoftwareInfo> RpmSource::scan() const
+{
+    QByteArray output = runCommand("rpm", QStringList()
+        << "-qa" << "--queryformat" << "%{NAME}\\t%{VERSION}-%{RELEASE}\\t%{VENDOR}\\t%{INSTALLTIME}\\n");
+
+    QList<SoftwareInfo> list;
+    for (const QByteArray& line : output.split('\n')) {
+        QList<QByteArray> fields = line.split('\t');
+        if (fields.size() < 4 || fields[0].isEmpty() || fields[0] == "gpg-pubkey") {
+            continue;
+        }
+        SoftwareInfo info;
+        info.name = QString::fromUtf8(fields[0]);
+        info.version = QString::fromUtf8(fields[1]);
+        if (fields[2] != "(none)") {
+            info.publisher = QString::fromUtf8(fields[2]);
+        }
+        // 与注册表的 InstallDate 一致,使用 yyyyMMdd
+        bool ok = false;
+        qint64 installTime = fields[3].toLongLong(&ok);
+        if (ok && installTime > 0) {
+            info.installDate = QDateTime::fromSecsSinceEpoch(installTime).toString("yyyyMMdd");
+        }
+        info.uninstallCmd = "rpm -e " + info.name;
+        list.append(info);
+    }
+    return list;
+}
+
+// ---------------- FlatpakSource ----------------
+
+bool FlatpakSource::isAvailable() const
+{
+    return !QStandardPaths::findExecutable("flatpak").isEmpty();
+}
+
+QStringList FlatpakSource::changedFiles()
+{
+    return QStringList()
+        << "/var/lib/flatpak/.changed"
+        << QDir::homePath() + "/.local/share/flatpak/.changed";
+}
+
+QList<SoftwareInfo> FlatpakSource::scan() const
+{
+    // 输出不是终端时没有表头,各列以制表符分隔
+    QByteArray output = runCommand("flatpak", QStringList()
+        << "list" << "--app" << "--columns=name,application,version,origin,installation");
+
+    QList<SoftwareInfo> list;
+    for (const QByteArray& line : output.split('\n')) {
+        QList<QByteArray> fields = line.split('\t');
+        if (fields.size() < 5 || fields[1].isEmpty()) {
+            continue;
+        }
+        QString appId = QString::fromUtf8(fields[1]);
+        QString installation = QString::fromUtf8(fields[4]).trimmed();
+
+        SoftwareInfo info;
+        info.name = fields[0].isEmpty() ? appId : QString::fromUtf8(fields[0]);
+        info.version = QString::fromUtf8(fields[2]);
+        info.publisher = QString::fromUtf8(fields[3]);
+        info.installPath = installation;
+
+        QString scope;
+        if (installation == "user") {
+            scope = "--user";
+        } else if (installation == "system" || installation.isEmpty()) {
+            scope = "--system";
+        } else {
+            scope = "--installation=" + installation;
+        }
+        info.uninstallCmd = "flatpak uninstall -y --noninteractive " + scope + " " + appId;
+        list.append(info);
+    }
+    return list;
+}
+
+// ---------------- InventoryScanner ----------------
+
+InventoryScanner::InventoryScanner()
+{
+}
+
+InventoryScanner::~InventoryScanner()
+{
+    m_pool.waitForDone();
+    for (SourceState* state : m_sources) {
+        delete state->source;
+        delete state;
+    }
+}
+
+void InventoryScanner::addSource(InventorySource* source)
+{
+    if (!source->isAvailable()) {
+        delete source;
+        return;
+    }
+    SourceState* state = new SourceState;
+    state->source = source;
+    state->stats.name = source->name();
+
+    QMutexLocker locker(&m_mutex);
+    m_sources.append(state);
+}
+
+void InventoryScanner::addDefaultSources()
+{
+    // 顺序即去重时的优先级,与原先逐个读取注册表的顺序一致
+    addSource(new RegistrySource("registry-64",
+        "HKEY_LOCAL_MACHINE\\SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall"));
+    addSource(new RegistrySource("registry-32",
+        "HKEY_LOCAL_MACHINE\\SOFTWARE\\WOW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall"));
+    addSource(new RegistrySource("registry-user",
+        "HKEY_CURRENT_USER\\SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall"));
+    addSource(new DpkgSource());
+    addSource(new RpmSource());
+    addSource(new FlatpakSource());
+}
+
+void InventoryScanner::scanSource(SourceState* state)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray stamp = state->source->stamp();
+    if (state->hasCache && !stamp.isEmpty() && stamp == state->stamp) {
+        state->stats.cached = true;
+        state->stats.elapsedUs = 0;
+        return;
+    }
+
+    state->cache = state->source->scan();
+    state->stamp = stamp;
+    state->hasCache = true;
+    state->stats.cached = false;
+    state->stats.count = state->cache.size();
+    state->stats.elapsedUs = timer.nsecsElapsed() / 1000;
+}
+
+QList<SoftwareInfo> InventoryScanner::scan()
+{
+    QMutexLocker locker(&m_mutex);
+
+    SelfMonitor::Scope footprint(SELF_OP_INVENTORY_SCAN);
+
+    if (SelfMonitor::isThrottled()) {
+        // 超出资源预算时依次扫描,同一时间只占一个核心
+        for (SourceState* state : m_sources) {
+            scanSource(state);
+            SelfMonitor::pace();
+        }
+    } else {
+        // 第一个来源在当前线程扫描,其余的交给线程池
+        QList<QFuture<void>> futures;
+        for (int i = 1; i < m_sources.size(); ++i) {
+            SourceState* state = m_sources[i];
+            futures.append(QtConcurrent::run(&m_pool, [state]() {
+                SelfMonitor::Scope footprint(SELF_OP_INVENTORY_SCAN, false);
+                scanSource(state);
+            }));
+        }
+        if (!m_sources.isEmpty()) {
+            scanSource(m_sources.first());
+        }
+        for (QFuture<void>& future : futures) {
+            future.waitForFinished();
+        }
+    }
+
+    // 按来源顺序合并,名称+版本相同的只保留第一条
+    int total = 0;
+    for (const SourceState* state : m_sources) {
+        total += state->cache.size();
+    }
+    QList<SoftwareInfo> result;
+    result.reserve(total);
+    QSet<QString> seen;
+    seen.reserve(total);
+    for (const SourceState* state : m_sources) {
+        for (const SoftwareInfo& info : state->cache) {
+            int before = seen.size();
+            seen.insert(Inventory::key(info));
+            if (seen.size() != before) {
+                result.append(info);
+            }
+        }
+    }
+    return result;
+}
+
+QList<InventoryScanner::SourceStats> InventoryScanner::lastStats() const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<SourceStats> stats;
+    for (const SourceState* state : m_sources) {
+        stats.append(state->stats);
+    }
+    return stats;
+}
+
+QStringList InventoryScanner::watchPaths() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList paths;
+    for (const SourceState* state : m_sources) {
+        paths += state->source->watchPaths();
+    }
+    return paths;
+}
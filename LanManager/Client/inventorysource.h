@@ -0,0 +1,154 @@
+#ifndef INVENTORYSOURCE_H
+#define INVENTORYSOURCE_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <QThreadPool>
+#include "../Common/protocol.h"
+
+// 外部包管理命令的最长等待时间(毫秒)
+#define INVENTORY_COMMAND_TIMEOUT 30000
+
+// 软件清单来源
+//
+// 每个来源独立扫描一类安装记录(一个注册表分支、一个包数据库),
+// 互不依赖,可以并行执行。scan() 在线程池中调用,实现不能依赖调用线程。
+class InventorySource {
+public:
+    virtual ~InventorySource() {}
+
+    // 来源名称(用于统计和调试)
+    virtual QString name() const = 0;
+
+    // 本机是否存在该来源
+    virtual bool isAvailable() const = 0;
+
+    // 变化标记: 数据未变化时返回相同的值,空值表示无法判断,每次都重新扫描
+    virtual QByteArray stamp() const { return QByteArray(); }
+
+    // 数据变化时会被修改的文件,或注册表键(以 "HKEY_" 开头),供 InventoryWatcher 监视
+    virtual QStringList watchPaths() const { return QStringList(); }
+
+    // 扫描已安装软件,没有卸载命令的条目不返回
+    virtual QList<SoftwareInfo> scan() const = 0;
+
+protected:
+    // 由若干文件(或目录)的大小和修改时间组成的变化标记
+    static QByteArray fileStamp(const QStringList& paths);
+
+    // 运行命令并返回标准输出,失败返回空
+    static QByteArray runCommand(const QString& program, const QStringList& arguments);
+};
+
+// Windows注册表卸载信息
+class RegistrySource : public InventorySource {
+public:
+    RegistrySource(const QString& name, const QString& regPath);
+
+    QString name() const override { return m_name; }
+    bool isAvailable() const override;
+    QStringList watchPaths() const override { return QStringList() << m_regPath; }
+    QList<SoftwareInfo> scan() const override;
+
+private:
+    QString m_name;
+    QString m_regPath;
+};
+
+// Debian/Ubuntu: 直接解析 dpkg 状态文件
+class DpkgSource : public InventorySource {
+public:
+    explicit DpkgSource(const QString& statusPath = "/var/lib/dpkg/status");
+
+    QString name() const override { return "dpkg"; }
+    bool isAvailable() const override;
+    QByteArray stamp() const override;
+    QStringList watchPaths() const override { return QStringList() << m_statusPath; }
+    QList<SoftwareInfo> scan() const override;
+
+    // 解析状态文件内容(只返回已安装的包)
+    static QList<SoftwareInfo> parseStatus(const QByteArray& content);
+
+private:
+    QString m_statusPath;
+};
+
+// RPM系发行版: 查询 rpm 数据库
+class RpmSource : public InventorySource {
+public:
+    QString name() const override { return "rpm"; }
+    bool isAvailable() const override;
+    QByteArray stamp() const override { return fileStamp(databaseFiles()); }
+    QStringList watchPaths() const override { return databaseFiles(); }
+    QList<SoftwareInfo> scan() const override;
+
+private:
+    // 不同版本的rpm数据库文件名不同,取存在的那些
+    static QStringList databaseFiles();
+};
+
+// Flatpak 应用(系统和当前用户安装)
+class FlatpakSource : public InventorySource {
+public:
+    QString name() const override { return "flatpak"; }
+    bool isAvailable() const override;
+    QByteArray stamp() const override { return fileStamp(changedFiles()); }
+    QStringList watchPaths() const override { return changedFiles(); }
+    QList<SoftwareInfo> scan() const override;
+
+private:
+    // flatpak 每次安装、更新或卸载后都会更新安装目录下的 .changed 文件
+    static QStringList changedFiles();
+};
+
+// 软件清单扫描器
+//
+// 所有来源并行扫描(客户端超出资源预算时依次扫描,见 SelfMonitor),按注册顺序合并,
+// 以名称+版本(Inventory::key)哈希去重,先注册的来源优先。变化标记未变的来源直接使用上次的结果。
+class InventoryScanner {
+public:
+    // 来源的最近一次扫描统计
+    struct SourceStats {
+        QString name;
+        int count = 0;          // 返回的条目数(去重前)
+        qint64 elapsedUs = 0;   // 扫描耗时(微秒),使用缓存时为0
+        bool cached = false;
+    };
+
+    InventoryScanner();
+    ~InventoryScanner();
+
+    // 添加来源(接管所有权),不可用的来源直接丢弃
+    void addSource(InventorySource* source);
+
+    // 注册本平台的默认来源
+    void addDefaultSources();
+
+    // 扫描并返回去重后的软件列表,可在多个线程中调用(串行执行)
+    QList<SoftwareInfo> scan();
+
+    QList<SourceStats> lastStats() const;
+
+    // 所有来源需要监视的路径
+    QStringList watchPaths() const;
+
+private:
+    struct SourceState {
+        InventorySource* source = nullptr;
+        bool hasCache = false;
+        QByteArray stamp;
+        QList<SoftwareInfo> cache;
+        SourceStats stats;
+    };
+
+    static void scanSource(SourceState* state);
+
+private:
+    QList<SourceState*> m_sources;
+    mutable QMutex m_mutex;
+    QThreadPool m_pool;
+};
+
+#endif // INVENTORYSOURCE_H
@@ -0,0 +1,153 @@
+#include "inventorywatcher.h"
+#include <QFileSystemWatcher>
+#include <QFileInfo>
+#include <QTimer>
+
+#ifdef Q_OS_WIN
+#include <QWinEventNotifier>
+#include <windows.h>
+#endif
+
+InventoryWatcher::InventoryWatcher(QObject *parent)
+    : QObject(parent)
+    , m_fsWatcher(new QFileSystemWatcher(this))
+    , m_settleTimer(new QTimer(this))
+{
+    m_settleTimer->setSingleShot(true);
+    m_settleTimer->setInterval(INVENTORY_SETTLE_MS);
+    connect(m_settleTimer, &QTimer::timeout, this, &InventoryWatcher::changed);
+    connect(m_fsWatcher, &QFileSystemWatcher::fileChanged, this, &InventoryWatcher::onFileChanged);
+    connect(m_fsWatcher, &QFileSystemWatcher::directoryChanged, this, &InventoryWatcher::onDirectoryChanged);
+}
+
+InventoryWatcher::~InventoryWatcher()
+{
+#ifdef Q_OS_WIN
+    for (const RegistryWatch& watch : m_registry) {
+        delete watch.notifier;
+        RegCloseKey(static_cast<HKEY>(watch.key));
+        CloseHandle(watch.event);
+    }
+#endif
+}
+
+int InventoryWatcher::watch(const QStringList& paths)
+{
+    int count = 0;
+    for (const QString& path : paths) {
+        bool ok = path.startsWith("HKEY_") ? watchRegistry(path) : watchFile(path);
+        if (ok) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool InventoryWatcher::watchFile(const QString& path)
+{
+    QFileInfo info(path);
+    QString dir = info.absolutePath();
+    if (!QFileInfo::exists(dir)) {
+        return false;
+    }
+    
+    if (!m_files.contains(path)) {
+        m_files.append(path);
+    }
+    if (!m_fsWatcher->directories().contains(dir)) {
+        m_fsWatcher->addPath(dir);
+    }
+    if (info.exists()) {
+        m_fsWatcher->addPath(path);
+    }
+    return true;
+}
+
+void InventoryWatcher::onFileChanged(const QString& path)
+{
+    Q_UNUSED(path);
+    m_settleTimer->start();
+}
+
+void InventoryWatcher::onDirectoryChanged(const QString& path)
+{
+    // 被改名替换的文件从监视列表中消失了,重新加入
+    const QStringList watched = m_fsWatcher->files();
+    bool relevant = false;
+    for (const QString& file : m_files) {
+        if (QFileInfo(file).absolutePath() != path) {
+            continue;
+        }
+        relevant = true;
+        if (!watched.contains(file) && QFileInfo::exists(file)) {
+            m_fsWatcher->addPath(file);
+        }
+    }
+    if (relevant) {
+        m_settleTimer->start();
+    }
+}
+
+#ifdef Q_OS_WIN
+bool InventoryWatcher::watchRegistry(const QString& path)
+{
+    int sep = path.indexOf('\\');
+    if (sep < 0) {
+        return false;
+    }
+    QString rootName = path.left(sep);
+    QString subKey = path.mid(sep + 1);
+    HKEY root = nullptr;
+    if (rootName == "HKEY_LOCAL_MACHINE") {
+        root = HKEY_LOCAL_MACHINE;
+    } else if (rootName == "HKEY_CURRENT_USER") {
+        root = HKEY_CURRENT_USER;
+    } else {
+        return false;
+    }
+    
+    // 路径里已经写明 WOW6432Node,打开时不再做32位重定向
+    HKEY key = nullptr;
+    if (RegOpenKeyExW(root, reinterpret_cast<LPCWSTR>(subKey.utf16()), 0,
+                      KEY_NOTIFY | KEY_WOW64_64KEY, &key) != ERROR_SUCCESS) {
+        return false;
+    }
+    
+    RegistryWatch watch;
+    watch.key = key;
+    watch.event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!watch.event || !armRegistry(watch)) {
+        if (watch.event) {
+            CloseHandle(watch.event);
+        }
+        RegCloseKey(key);
+        return false;
+    }
+    
+    // 通知只触发一次,每次收到后重新登记
+    watch.notifier = new QWinEventNotifier(watch.event, this);
+    connect(watch.notifier, &QWinEventNotifier::activated, this, [this, watch]() {
+        armRegistry(watch);
+        m_settleTimer->start();
+    });
+    m_registry.append(watch);
+    return true;
+}
+
+bool InventoryWatcher::armRegistry(const RegistryWatch& watch)
+{
+    return RegNotifyChangeKeyValue(static_cast<HKEY>(watch.key), TRUE,
+                                   REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+                                   watch.event, TRUE) == ERROR_SUCCESS;
+}
+#else
+bool InventoryWatcher::watchRegistry(const QString&)
+{
+    return false;
+}
+
+bool InventoryWatcher::armRegistry(const RegistryWatch&)
+{
+    return false;
+}
+#endif
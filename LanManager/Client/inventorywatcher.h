@@ -0,0 +1,58 @@
+#ifndef INVENTORYWATCHER_H
+#define INVENTORYWATCHER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QList>
+
+class QFileSystemWatcher;
+class QTimer;
+class QWinEventNotifier;
+
+// 变化后等待的时间(毫秒): 一次安装会连续修改多次,安静下来后才通知
+#define INVENTORY_SETTLE_MS 3000
+
+// 软件清单变化监视
+//
+// Windows 下用 RegNotifyChangeKeyValue 监视卸载信息所在的注册表键(含子键),
+// 其他平台用 QFileSystemWatcher(Linux 下为 inotify)监视包数据库文件。
+// 包管理器通常以"写新文件再改名"的方式更新数据库,原文件的监视会随之失效,
+// 因此同时监视所在目录,目录变化后重新加入文件。
+class InventoryWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit InventoryWatcher(QObject *parent = nullptr);
+    ~InventoryWatcher();
+    
+    // 开始监视(见 InventorySource::watchPaths),返回实际监视的路径数
+    int watch(const QStringList& paths);
+    
+signals:
+    // 清单可能已变化(合并了一段时间内的多次修改)
+    void changed();
+    
+private slots:
+    void onFileChanged(const QString& path);
+    void onDirectoryChanged(const QString& path);
+    
+private:
+    // 注册表键的监视句柄(HKEY 和事件 HANDLE)
+    struct RegistryWatch {
+        void* key = nullptr;
+        void* event = nullptr;
+        QWinEventNotifier* notifier = nullptr;
+    };
+    
+    bool watchRegistry(const QString& path);
+    static bool armRegistry(const RegistryWatch& watch);
+    bool watchFile(const QString& path);
+    
+private:
+    QFileSystemWatcher* m_fsWatcher;
+    QTimer* m_settleTimer;
+    QStringList m_files;               // 要监视的文件(被替换后需要重新加入)
+    QList<RegistryWatch> m_registry;
+};
+
+#endif // INVENTORYWATCHER_H
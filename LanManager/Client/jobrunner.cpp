@@ -0,0 +1,241 @@
+#include "jobrunner.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+
+namespace {
+
+// 子进程在 exec 之前自成一个进程组,它启动的后代进程默认也在组内
+class GroupProcess : public QProcess
+{
+public:
+    using QProcess::QProcess;
+    
+protected:
+    void setupChildProcess() override
+    {
+        ::setpgid(0, 0);
+    }
+};
+
+} // namespace
+#endif
+
+JobRunner::JobRunner(quint32 jobId, const ExecRequest& request, QObject *parent)
+    : QObject(parent)
+    , m_jobId(jobId)
+    , m_request(request)
+#ifdef Q_OS_WIN
+    , m_process(new QProcess(this))
+    , m_job(nullptr)
+#else
+    , m_process(new GroupProcess(this))
+    , m_processGroup(0)
+#endif
+    , m_flushTimer(new QTimer(this))
+    , m_timeoutTimer(new QTimer(this))
+    , m_pendingBytes(0)
+    , m_forwardedBytes(0)
+    , m_finished(false)
+{
+    m_flushTimer->setSingleShot(true);
+    m_timeoutTimer->setSingleShot(true);
+    connect(m_flushTimer, &QTimer::timeout, this, &JobRunner::flush);
+    connect(m_timeoutTimer, &QTimer::timeout, this, &JobRunner::onTimeout);
+    connect(m_process, &QProcess::readyReadStandardOutput, this, &JobRunner::onStandardOutput);
+    connect(m_process, &QProcess::readyReadStandardError, this, &JobRunner::onStandardError);
+    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &JobRunner::onProcessFinished);
+    connect(m_process, &QProcess::errorOccurred, this, &JobRunner::onProcessError);
+    
+#ifdef Q_OS_WIN
+    // 作业句柄关闭时(包括客户端异常退出)结束作业中的全部进程
+    m_job = CreateJobObjectW(nullptr, nullptr);
+    if (m_job) {
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+        limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+        SetInformationJobObject(m_job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+    }
+#endif
+}
+
+JobRunner::~JobRunner()
+{
+    // 作业被丢弃(例如连接断开),不再发出任何信号
+    m_process->disconnect(this);
+    if (m_process->state() != QProcess::NotRunning) {
+#ifndef Q_OS_WIN
+        if (m_processGroup > 0) {
+            ::kill(pid_t(-m_processGroup), SIGKILL);
+        }
+#endif
+        m_process->kill();
+        m_process->waitForFinished(1000);
+    }
+#ifdef Q_OS_WIN
+    if (m_job) {
+        CloseHandle(m_job);
+    }
+#endif
+}
+
+void JobRunner::start()
+{
+    m_clock.start();
+    
+    if (!m_request.program.isEmpty()) {
+        m_process->setProgram(m_request.program);
+        m_process->setArguments(m_request.arguments);
+    } else {
+#ifdef Q_OS_WIN
+        // 命令行原样交给 cmd,不经过 QProcess 的参数引号处理
+        m_process->setProgram("cmd.exe");
+        m_process->setNativeArguments("/c " + m_request.command);
+#else
+        m_process->setProgram("/bin/sh");
+        m_process->setArguments(QStringList() << "-c" << m_request.command);
+#endif
+    }
+    
+    m_process->start(QIODevice::ReadOnly);
+    if (m_process->processId() != 0) {
+#ifdef Q_OS_WIN
+        // 创建后立即加入作业,之后它启动的后代进程都继承作业
+        HANDLE process = OpenProcess(PROCESS_SET_QUOTA | PROCESS_TERMINATE, FALSE, DWORD(m_process->processId()));
+        if (m_job && process) {
+            AssignProcessToJobObject(m_job, process);
+        }
+        if (process) {
+            CloseHandle(process);
+        }
+#else
+        m_processGroup = m_process->processId();
+#endif
+    }
+    if (m_request.timeoutMs > 0) {
+        m_timeoutTimer->start(m_request.timeoutMs);
+    }
+}
+
+void JobRunner::cancel()
+{
+    if (m_finished) return;
+    m_result.canceled = true;
+    stopProcess();
+}
+
+void JobRunner::onTimeout()
+{
+    m_result.timedOut = true;
+    stopProcess();
+}
+
+void JobRunner::stopProcess()
+{
+    if (m_process->state() == QProcess::NotRunning) return;
+#ifdef Q_OS_WIN
+    // 控制台程序不处理 WM_CLOSE,直接结束作业中的全部进程
+    if (!m_job || !TerminateJobObject(m_job, 1)) {
+        m_process->kill();
+    }
+#else
+    // 进程组中的后代进程也要结束,否则会继续占用输出管道和资源。
+    // 本对象可能先于计时器销毁,强制结束只依赖进程组号
+    qint64 group = m_processGroup;
+    if (group <= 0) {
+        m_process->kill();
+        return;
+    }
+    ::kill(pid_t(-group), SIGTERM);
+    QTimer::singleShot(EXEC_KILL_GRACE, [group]() {
+        ::kill(pid_t(-group), SIGKILL);
+    });
+#endif
+}
+
+void JobRunner::onStandardOutput()
+{
+    collect(EXEC_STDOUT, m_process->readAllStandardOutput());
+}
+
+void JobRunner::onStandardError()
+{
+    collect(EXEC_STDERR, m_process->readAllStandardError());
+}
+
+void JobRunner::collect(ExecStream stream, const QByteArray& data)
+{
+    if (data.isEmpty()) return;
+    m_result.outputBytes += data.size();
+    
+    qint64 room = m_request.maxOutput - m_forwardedBytes;
+    if (room <= 0) {
+        m_result.truncated = true;
+        return;
+    }
+    QByteArray accepted = data.size() > room ? data.left(int(room)) : data;
+    if (accepted.size() < data.size()) {
+        m_result.truncated = true;
+    }
+    m_forwardedBytes += accepted.size();
+    
+    if (!m_pending.isEmpty() && m_pending.last().first == stream) {
+        m_pending.last().second.append(accepted);
+    } else {
+        m_pending.append(qMakePair(stream, accepted));
+    }
+    m_pendingBytes += accepted.size();
+    
+    if (m_pendingBytes >= EXEC_FLUSH_BYTES) {
+        flush();
+    } else if (!m_flushTimer->isActive()) {
+        m_flushTimer->start(EXEC_FLUSH_INTERVAL);
+    }
+}
+
+void JobRunner::flush()
+{
+    m_flushTimer->stop();
+    for (const auto& run : m_pending) {
+        // 一次读到的数据可能很大,按帧大小切开
+        for (int pos = 0; pos < run.second.size(); pos += EXEC_FLUSH_BYTES) {
+            emit output(m_jobId, run.first, run.second.mid(pos, EXEC_FLUSH_BYTES));
+        }
+    }
+    m_pending.clear();
+    m_pendingBytes = 0;
+}
+
+void JobRunner::onProcessFinished(int exitCode, QProcess::ExitStatus status)
+{
+    collect(EXEC_STDOUT, m_process->readAllStandardOutput());
+    collect(EXEC_STDERR, m_process->readAllStandardError());
+    
+    m_result.started = true;
+    m_result.exitCode = exitCode;
+    m_result.crashed = status == QProcess::CrashExit && !m_result.canceled && !m_result.timedOut;
+    finish();
+}
+
+void JobRunner::onProcessError(QProcess::ProcessError error)
+{
+    // 其他错误随后还会有 finished
+    if (error == QProcess::FailedToStart) {
+        m_result.started = false;
+        m_result.error = m_process->errorString();
+        finish();
+    }
+}
+
+void JobRunner::finish()
+{
+    if (m_finished) return;
+    m_finished = true;
+    m_timeoutTimer->stop();
+    flush();
+    m_result.elapsedMs = m_clock.elapsed();
+    emit finished(m_jobId, m_result);
+}
@@ -0,0 +1,73 @@
+#ifndef JOBRUNNER_H
+#define JOBRUNNER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include "../Common/exec.h"
+
+// 远程执行的一个作业
+//
+// 异步运行 QProcess,标准输出和错误输出边产生边回传: 攒够 EXEC_FLUSH_BYTES
+// 或等待 EXEC_FLUSH_INTERVAL 后发出一批,保持两个流之间的先后顺序。
+// 回传总量超过上限后继续读取(避免子进程因管道写满而阻塞)但丢弃,结果中标记截断。
+// 子进程和它启动的后代进程归为一组(Windows 下为作业对象,其他系统为进程组),取消时一起结束。
+class JobRunner : public QObject
+{
+    Q_OBJECT
+public:
+    JobRunner(quint32 jobId, const ExecRequest& request, QObject *parent = nullptr);
+    ~JobRunner();
+    
+    quint32 jobId() const { return m_jobId; }
+    
+    // 启动进程(结束或启动失败时都会发出 finished)
+    void start();
+    
+    // 取消: Windows 下立即结束作业中的全部进程;
+    // 其他系统先向进程组发 SIGTERM,EXEC_KILL_GRACE 后发 SIGKILL
+    void cancel();
+    
+signals:
+    // stream 为 ExecStream
+    void output(quint32 jobId, int stream, const QByteArray& data);
+    void finished(quint32 jobId, const ExecResult& result);
+    
+private slots:
+    void onStandardOutput();
+    void onStandardError();
+    void onProcessFinished(int exitCode, QProcess::ExitStatus status);
+    void onProcessError(QProcess::ProcessError error);
+    void onTimeout();
+    void flush();
+    
+private:
+    void collect(ExecStream stream, const QByteArray& data);
+    void stopProcess();
+    void finish();
+    
+private:
+    quint32 m_jobId;
+    ExecRequest m_request;
+    QProcess* m_process;
+#ifdef Q_OS_WIN
+    void* m_job;                 // 作业对象句柄,关闭时结束其中剩余的进程
+#else
+    qint64 m_processGroup;       // 子进程自成的进程组号,0表示还没有启动
+#endif
+    QTimer* m_flushTimer;
+    QTimer* m_timeoutTimer;
+    QElapsedTimer m_clock;
+    
+    QList<QPair<ExecStream, QByteArray>> m_pending;  // 待发送的输出,相邻同一流的合并
+    qint64 m_pendingBytes;
+    qint64 m_forwardedBytes;                        // 已接受回传的字节数(用于上限)
+    
+    ExecResult m_result;
+    bool m_finished;
+};
+
+#endif // JOBRUNNER_H
@@ -2,6 +2,7 @@
 #include <QCommandLineParser>
 #include <QDebug>
 #include "agent.h"
+#include "../Common/logger.h"
 
 int main(int argc, char *argv[])
 {
@@ -31,6 +32,68 @@ int main(int argc, char *argv[])
     );
     parser.addOption(portOption);
     
+    QCommandLineOption serversOption(
+        "servers",
+        "服务器列表,逗号分隔 (如 192.168.1.10:8899,192.168.1.11:8899),按本机MAC固定选择其中一台",
+        "list",
+        ""
+    );
+    parser.addOption(serversOption);
+    
+    QCommandLineOption captureOption(
+        "capture",
+        "把与服务端之间的收发帧记录到文件,供 Replay 工具回放",
+        "file",
+        ""
+    );
+    parser.addOption(captureOption);
+    
+    QCommandLineOption captureFullOption(
+        "capture-full",
+        "记录流量时文件数据和命令输出也完整保存(默认只保存摘要)"
+    );
+    parser.addOption(captureFullOption);
+    
+    QCommandLineOption logLevelOption(
+        "log-level",
+        "日志级别: debug, info, warn, error",
+        "level",
+        "info"
+    );
+    parser.addOption(logLevelOption);
+    
+    QCommandLineOption logFileOption(
+        "log-file",
+        "同时把日志写入文件(每行一个JSON对象,超过16MB轮转)",
+        "file",
+        ""
+    );
+    parser.addOption(logFileOption);
+    
+    QCommandLineOption cpuBudgetOption(
+        "cpu-budget",
+        "客户端自身CPU占用预算,占整机的百分比,超出时后台操作降速",
+        "percent",
+        QString::number(SELF_CPU_BUDGET / 10.0)
+    );
+    parser.addOption(cpuBudgetOption);
+    
+    QCommandLineOption memoryBudgetOption(
+        "memory-budget",
+        "客户端自身常驻内存预算(MB),超出时后台操作降速并释放空闲内存",
+        "MB",
+        QString::number(SELF_MEMORY_BUDGET)
+    );
+    parser.addOption(memoryBudgetOption);
+    
+    QCommandLineOption ioLimitOption(
+        "throttled-io",
+        "降速时清单扫描和文件写入的磁盘速率上限(KB/s)",
+        "KB/s",
+        QString::number(SELF_THROTTLED_IO_RATE)
+    );
+    parser.addOption(ioLimitOption);
+    
     parser.process(app);
     
     QString serverAddress = parser.value(serverOption);
@@ -40,14 +103,51 @@ int main(int argc, char *argv[])
     qInfo() << "局域网远程管理客户端 v1.0.0";
     qInfo() << "===================================";
     
+    // 日志由后台线程输出,网络线程只把日志放入队列
+    Logger::setLevel(Logger::levelFromName(parser.value(logLevelOption), LOG_LEVEL_INFO));
+    Logger::addSink(new ConsoleLogSink);
+    if (parser.isSet(logFileOption)) {
+        JsonLogFile* logFile = new JsonLogFile(parser.value(logFileOption));
+        if (!logFile->open()) {
+            qCritical() << "无法打开日志文件:" << logFile->errorString();
+            delete logFile;
+            return 1;
+        }
+        Logger::addSink(logFile);
+    }
+    Logger::start();
+    
+    SelfBudget budget;
+    budget.cpuPermille = qMax(1, qRound(parser.value(cpuBudgetOption).toDouble() * 10));
+    budget.memoryMB = qMax(1, parser.value(memoryBudgetOption).toInt());
+    budget.throttledIoRate = qMax(0, parser.value(ioLimitOption).toInt());
+    SelfMonitor::setBudget(budget);
+    
     Agent agent;
     
-    // 日志输出
-    QObject::connect(&agent, &Agent::logMessage, [](const QString& msg) {
-        qInfo() << "[Agent]" << msg;
-    });
+    if (parser.isSet(captureOption) && !agent.startCapture(parser.value(captureOption),
+                                                           parser.isSet(captureFullOption))) {
+        Logger::stop();
+        return 1;
+    }
+    
+    // 解析服务器列表
+    QList<ServerAnnounce> servers;
+    for (const QString& item : parser.value(serversOption).split(',', Qt::SkipEmptyParts)) {
+        int colon = item.lastIndexOf(':');
+        ServerAnnounce info;
+        info.host = colon > 0 ? item.left(colon).trimmed() : item.trimmed();
+        info.port = colon > 0 ? item.mid(colon + 1).toUShort() : DEFAULT_PORT;
+        if (!info.host.isEmpty() && info.port) {
+            servers.append(info);
+        }
+    }
     
-    if (serverAddress.isEmpty()) {
+    if (!servers.isEmpty()) {
+        // 多服务器模式
+        qInfo() << "服务器列表:" << parser.value(serversOption);
+        agent.connectToCluster(servers);
+    } else if (serverAddress.isEmpty()) {
         // 自动发现模式
         qInfo() << "启动自动发现模式,等待服务器广播...";
         agent.startAutoDiscovery();
@@ -57,5 +157,7 @@ int main(int argc, char *argv[])
         agent.connectToServer(serverAddress, serverPort);
     }
     
-    return app.exec();
+    int result = app.exec();
+    Logger::stop();
+    return result;
 }
@@ -0,0 +1,295 @@
+#include "perfmon.h"
+#include "sysinfo.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <windows.h>
+#include <winioctl.h>
+#include <winternl.h>
+#endif
+
+TelemetryCollector::TelemetryCollector()
+    : m_hasBaseline(false)
+    , m_prevDiskRead(0)
+    , m_prevDiskWrite(0)
+    , m_prevNetRx(0)
+    , m_prevNetTx(0)
+{
+}
+
+TelemetrySample TelemetryCollector::sample()
+{
+    TelemetrySample s;
+    s.timestamp = QDateTime::currentMSecsSinceEpoch();
+    SysInfo::getMemoryInfo(s.totalMemory, s.freeMemory);
+    s.freeDisk = readFreeDiskMB();
+
+    CpuTimes cpu;
+    QVector<CpuTimes> cores;
+    quint64 diskRead = 0, diskWrite = 0, netRx = 0, netTx = 0;
+    bool hasCpu = readCpuTimes(cpu, cores);
+    bool hasDisk = readDiskBytes(diskRead, diskWrite);
+    bool hasNet = readNetBytes(netRx, netTx);
+
+    qint64 elapsed = m_clock.isValid() ? m_clock.restart() : 0;
+    if (!m_clock.isValid()) {
+        m_clock.start();
+    }
+
+    if (m_hasBaseline && elapsed > 0) {
+        if (hasCpu) {
+            s.cpuUsage = usagePermille(m_prevCpu, cpu);
+            s.coreUsage.resize(cores.size());
+            for (int i = 0; i < cores.size(); ++i) {
+                s.coreUsage[i] = i < m_prevCores.size()
+                    ? usagePermille(m_prevCores[i], cores[i]) : 0;
+            }
+        }
+        if (hasDisk) {
+            s.diskReadRate = ratePerSecond(m_prevDiskRead, diskRead, elapsed) / 1024;
+            s.diskWriteRate = ratePerSecond(m_prevDiskWrite, diskWrite, elapsed) / 1024;
+        }
+        if (hasNet) {
+            s.netRxRate = ratePerSecond(m_prevNetRx, netRx, elapsed) / 1024;
+            s.netTxRate = ratePerSecond(m_prevNetTx, netTx, elapsed) / 1024;
+        }
+    } else {
+        s.coreUsage.fill(0, cores.size());
+    }
+
+    m_prevCpu = cpu;
+    m_prevCores = cores;
+    m_prevDiskRead = diskRead;
+    m_prevDiskWrite = diskWrite;
+    m_prevNetRx = netRx;
+    m_prevNetTx = netTx;
+    m_hasBaseline = true;
+    return s;
+}
+
+quint64 TelemetryCollector::readFreeDiskMB()
+{
+    quint64 freeBytes = 0;
+    for (const QStorageInfo& storage : QStorageInfo::mountedVolumes()) {
+        if (!storage.isValid() || !storage.isReady() || storage.isReadOnly()) continue;
+#ifdef Q_OS_WIN
+        // 与 SysInfo::getDiskInfo 一致,只统计带盘符的本地磁盘
+        QString root = storage.rootPath();
+        if (root.length() < 2 || root[1] != ':') continue;
+#else
+        // 过滤 tmpfs/overlay 等虚拟文件系统
+        QByteArray device = storage.device();
+        if (!device.startsWith("/dev/")) continue;
+#endif
+        freeBytes += quint64(storage.bytesAvailable());
+    }
+    return freeBytes / (1024 * 1024);
+}
+
+quint32 TelemetryCollector::usagePermille(const CpuTimes& prev, const CpuTimes& cur)
+{
+    if (cur.total <= prev.total || cur.busy < prev.busy) {
+        return 0;
+    }
+    quint64 total = cur.total - prev.total;
+    quint64 busy = cur.busy - prev.busy;
+    return quint32(qMin<quint64>(1000, busy * 1000 / total));
+}
+
+quint64 TelemetryCollector::ratePerSecond(quint64 prev, quint64 cur, qint64 elapsedMs)
+{
+    // 计数器回绕或网卡重置时不报告负速率
+    if (cur < prev || elapsedMs <= 0) {
+        return 0;
+    }
+    return (cur - prev) * 1000 / quint64(elapsedMs);
+}
+
+#ifdef Q_OS_WIN
+
+static quint64 fileTimeToUInt(const FILETIME& ft)
+{
+    return (quint64(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+bool TelemetryCollector::readCpuTimes(CpuTimes& total, QVector<CpuTimes>& cores)
+{
+    FILETIME idleTime, kernelTime, userTime;
+    if (!GetSystemTimes(&idleTime, &kernelTime, &userTime)) {
+        return false;
+    }
+    // 内核时间包含空闲时间
+    quint64 idle = fileTimeToUInt(idleTime);
+    total.total = fileTimeToUInt(kernelTime) + fileTimeToUInt(userTime);
+    total.busy = total.total - idle;
+
+    // 每核心时间通过 NtQuerySystemInformation 获取
+    typedef NTSTATUS (WINAPI *NtQuerySystemInformationFn)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+    static NtQuerySystemInformationFn query = reinterpret_cast<NtQuerySystemInformationFn>(
+        GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtQuerySystemInformation"));
+    if (query) {
+        SYSTEM_INFO sysInfo;
+        GetSystemInfo(&sysInfo);
+        QVector<SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION> perf(int(sysInfo.dwNumberOfProcessors));
+        ULONG size = ULONG(perf.size() * sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION));
+        if (query(SystemProcessorPerformanceInformation, perf.data(), size, &size) == 0) {
+            cores.resize(perf.size());
+            for (int i = 0; i < perf.size(); ++i) {
+                quint64 coreTotal = quint64(perf[i].KernelTime.QuadPart + perf[i].UserTime.QuadPart);
+                cores[i].total = coreTotal;
+                cores[i].busy = coreTotal - quint64(perf[i].IdleTime.QuadPart);
+            }
+        }
+    }
+    return true;
+}
+
+bool TelemetryCollector::readDiskBytes(quint64& readBytes, quint64& writeBytes)
+{
+    readBytes = 0;
+    writeBytes = 0;
+    bool found = false;
+    for (int i = 0; i < 16; ++i) {
+        QString path = QString("\\\\.\\PhysicalDrive%1").arg(i);
+        HANDLE disk = CreateFileW(reinterpret_cast<LPCWSTR>(path.utf16()), 0,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                  OPEN_EXISTING, 0, nullptr);
+        if (disk == INVALID_HANDLE_VALUE) {
+            break;
+        }
+        DISK_PERFORMANCE perf;
+        DWORD returned = 0;
+        if (DeviceIoControl(disk, IOCTL_DISK_PERFORMANCE, nullptr, 0,
+                            &perf, sizeof(perf), &returned, nullptr)) {
+            readBytes += quint64(perf.BytesRead.QuadPart);
+            writeBytes += quint64(perf.BytesWritten.QuadPart);
+            found = true;
+        }
+        CloseHandle(disk);
+    }
+    return found;
+}
+
+bool TelemetryCollector::readNetBytes(quint64& rxBytes, quint64& txBytes)
+{
+    rxBytes = 0;
+    txBytes = 0;
+    MIB_IF_TABLE2* table = nullptr;
+    if (GetIfTable2(&table) != NO_ERROR) {
+        return false;
+    }
+    for (ULONG i = 0; i < table->NumEntries; ++i) {
+        const MIB_IF_ROW2& row = table->Table[i];
+        // 只统计物理网卡,过滤器/虚拟接口会重复计数
+        if (row.Type == IF_TYPE_SOFTWARE_LOOPBACK ||
+            !row.InterfaceAndOperStatusFlags.HardwareInterface) {
+            continue;
+        }
+        rxBytes += row.InOctets;
+        txBytes += row.OutOctets;
+    }
+    FreeMibTable(table);
+    return true;
+}
+
+#else
+
+// /proc 下的文件大小为0,atEnd()不可靠,必须一次性读取
+static QList<QByteArray> readProcLines(const char* path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QList<QByteArray>();
+    }
+    return file.readAll().split('\n');
+}
+
+// 解析 /proc/stat 中的一行 cpu 计数
+static bool parseCpuLine(const QByteArray& line, quint64& busy, quint64& total)
+{
+    QList<QByteArray> fields = line.simplified().split(' ');
+    if (fields.size() < 5) return false;
+    quint64 values[8] = {0};
+    int n = qMin(8, fields.size() - 1);
+    for (int i = 0; i < n; ++i) {
+        values[i] = fields[i + 1].toULongLong();
+    }
+    // user nice system idle iowait irq softirq steal
+    quint64 idle = values[3] + values[4];
+    total = 0;
+    for (int i = 0; i < n; ++i) total += values[i];
+    busy = total - idle;
+    return true;
+}
+
+bool TelemetryCollector::readCpuTimes(CpuTimes& total, QVector<CpuTimes>& cores)
+{
+    bool found = false;
+    for (const QByteArray& line : readProcLines("/proc/stat")) {
+        if (!line.startsWith("cpu")) {
+            break;  // cpu行总在文件开头
+        }
+        CpuTimes t;
+        if (!parseCpuLine(line, t.busy, t.total)) continue;
+        if (line.startsWith("cpu ")) {
+            total = t;
+            found = true;
+        } else {
+            cores.append(t);
+        }
+    }
+    return found;
+}
+
+bool TelemetryCollector::readDiskBytes(quint64& readBytes, quint64& writeBytes)
+{
+    QList<QByteArray> lines = readProcLines("/proc/diskstats");
+    if (lines.isEmpty()) {
+        return false;
+    }
+    readBytes = 0;
+    writeBytes = 0;
+    for (const QByteArray& line : lines) {
+        QList<QByteArray> fields = line.simplified().split(' ');
+        if (fields.size() < 10) continue;
+        const QByteArray& name = fields[2];
+        // 只统计整盘,分区和 loop/ram 设备会重复计数
+        if (name.startsWith("loop") || name.startsWith("ram") ||
+            !QFileInfo::exists("/sys/block/" + QString::fromLatin1(name))) {
+            continue;
+        }
+        // 扇区固定为512字节
+        readBytes += fields[5].toULongLong() * 512;
+        writeBytes += fields[9].toULongLong() * 512;
+    }
+    return true;
+}
+
+bool TelemetryCollector::readNetBytes(quint64& rxBytes, quint64& txBytes)
+{
+    QList<QByteArray> lines = readProcLines("/proc/net/dev");
+    if (lines.isEmpty()) {
+        return false;
+    }
+    rxBytes = 0;
+    txBytes = 0;
+    for (const QByteArray& line : lines) {
+        int colon = line.indexOf(':');
+        if (colon < 0) continue;  // 表头
+        QByteArray iface = line.left(colon).trimmed();
+        if (iface == "lo") continue;
+        QList<QByteArray> fields = line.mid(colon + 1).simplified().split(' ');
+        if (fields.size() < 9) continue;
+        rxBytes += fields[0].toULongLong();
+        txBytes += fields[8].toULongLong();
+    }
+    return true;
+}
+
+#endif
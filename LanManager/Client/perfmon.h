@@ -0,0 +1,50 @@
+#ifndef PERFMON_H
+#define PERFMON_H
+
+#include <QVector>
+#include <QElapsedTimer>
+#include "../Common/telemetry.h"
+
+// 性能遥测采集器
+// 保存上一次的累计计数器,两次采样之间计算CPU占用和各类速率
+class TelemetryCollector {
+public:
+    TelemetryCollector();
+
+    // 采集一个样本(第一次调用只建立基线,速率为0)
+    TelemetrySample sample();
+
+private:
+    // CPU累计时间(忙碌/总计)
+    struct CpuTimes {
+        quint64 busy = 0;
+        quint64 total = 0;
+    };
+
+    // 读取总CPU和每核心累计时间
+    bool readCpuTimes(CpuTimes& total, QVector<CpuTimes>& cores);
+
+    // 读取磁盘累计读写字节数
+    bool readDiskBytes(quint64& readBytes, quint64& writeBytes);
+
+    // 读取网络累计收发字节数
+    bool readNetBytes(quint64& rxBytes, quint64& txBytes);
+
+    // 读取本地磁盘可用空间合计(MB)
+    static quint64 readFreeDiskMB();
+
+    static quint32 usagePermille(const CpuTimes& prev, const CpuTimes& cur);
+    static quint64 ratePerSecond(quint64 prev, quint64 cur, qint64 elapsedMs);
+
+private:
+    bool m_hasBaseline;
+    QElapsedTimer m_clock;
+    CpuTimes m_prevCpu;
+    QVector<CpuTimes> m_prevCores;
+    quint64 m_prevDiskRead;
+    quint64 m_prevDiskWrite;
+    quint64 m_prevNetRx;
+    quint64 m_prevNetTx;
+};
+
+#endif // PERFMON_H
@@ -0,0 +1,454 @@
+#include "selfmonitor.h"
+#include "../Common/logger.h"
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <atomic>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// ioprio_set/ioprio_get 没有 glibc 封装,常量取自内核头文件
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#endif
+
+// 预算、降速状态和各类操作的累计值,所有线程共用
+namespace {
+struct MonitorState {
+    QMutex mutex;
+    SelfBudget budget;
+    SelfMonitor::OpStats ops[SELF_OP_COUNT];
+
+    // 以下只在主线程的 sample() 中访问
+    bool hasBaseline = false;
+    QElapsedTimer clock;
+    qint64 prevCpuUs = 0;
+    quint64 prevIoRead = 0;
+    quint64 prevIoWrite = 0;
+};
+
+MonitorState& monitorState()
+{
+    static MonitorState state;
+    return state;
+}
+
+std::atomic<bool> g_throttled{false};
+std::atomic<quint64> g_throttleCount{0};
+
+// pace() 在每个线程上记录的上一次调用,-1 表示还没有基线
+struct PaceState {
+    qint64 cpuUs = -1;
+    QElapsedTimer clock;
+};
+thread_local PaceState t_pace;
+}
+
+// 进程累计CPU时间(微秒)
+static qint64 processCpuUs();
+
+// 常驻内存和峰值(KB)
+static void readProcessMemory(quint64& rssKB, quint64& peakKB);
+
+// 进程累计磁盘读写字节数
+static bool readProcessIo(quint64& readBytes, quint64& writeBytes);
+
+void SelfMonitor::setBudget(const SelfBudget& budget)
+{
+    QMutexLocker locker(&monitorState().mutex);
+    monitorState().budget = budget;
+}
+
+SelfBudget SelfMonitor::budget()
+{
+    QMutexLocker locker(&monitorState().mutex);
+    return monitorState().budget;
+}
+
+bool SelfMonitor::isThrottled()
+{
+    return g_throttled.load(std::memory_order_relaxed);
+}
+
+quint64 SelfMonitor::throttleCount()
+{
+    return g_throttleCount.load(std::memory_order_relaxed);
+}
+
+SelfMonitor::Usage SelfMonitor::sample()
+{
+    Scope scope(SELF_OP_TELEMETRY);
+    MonitorState& state = monitorState();
+
+    Usage usage;
+    qint64 cpuUs = processCpuUs();
+    quint64 ioRead = 0, ioWrite = 0;
+    bool hasIo = readProcessIo(ioRead, ioWrite);
+    readProcessMemory(usage.rssKB, usage.peakRssKB);
+
+    qint64 elapsedUs = state.clock.isValid() ? state.clock.nsecsElapsed() / 1000 : 0;
+    state.clock.start();
+    bool hasBaseline = state.hasBaseline && elapsedUs > 0;
+    if (hasBaseline) {
+        // 与系统遥测的CPU占用一致,按整机(所有核心)计算
+        qint64 capacityUs = elapsedUs * qMax(1, QThread::idealThreadCount());
+        usage.cpuPermille = quint32(qBound<qint64>(0, (cpuUs - state.prevCpuUs) * 1000 / capacityUs, 1000));
+        if (hasIo && ioRead >= state.prevIoRead && ioWrite >= state.prevIoWrite) {
+            usage.ioReadRate = (ioRead - state.prevIoRead) * 1000000 / quint64(elapsedUs) / 1024;
+            usage.ioWriteRate = (ioWrite - state.prevIoWrite) * 1000000 / quint64(elapsedUs) / 1024;
+        }
+    }
+    state.prevCpuUs = cpuUs;
+    state.prevIoRead = ioRead;
+    state.prevIoWrite = ioWrite;
+    state.hasBaseline = true;
+    if (!hasBaseline) {
+        return usage;
+    }
+
+    SelfBudget limits = budget();
+    quint64 memoryLimitKB = quint64(qMax(1, limits.memoryMB)) * 1024;
+    bool cpuOver = int(usage.cpuPermille) > limits.cpuPermille;
+    bool memoryOver = usage.rssKB > memoryLimitKB;
+    if (!isThrottled() && (cpuOver || memoryOver)) {
+        g_throttled.store(true, std::memory_order_relaxed);
+        g_throttleCount.fetch_add(1, std::memory_order_relaxed);
+        LOG_INFO("agent", "自身占用超出预算(CPU %1‰/%2‰, 内存 %3/%4 MB),后台操作降速",
+                 usage.cpuPermille, limits.cpuPermille, usage.rssKB / 1024, limits.memoryMB);
+        if (memoryOver) {
+            trimMemory();
+        }
+    } else if (isThrottled()
+               && int(usage.cpuPermille) * 100 <= limits.cpuPermille * SELF_RELEASE_PERCENT
+               && usage.rssKB * 100 <= memoryLimitKB * SELF_RELEASE_PERCENT) {
+        g_throttled.store(false, std::memory_order_relaxed);
+        LOG_INFO("agent", "自身占用回到预算内(CPU %1‰, 内存 %2 MB),解除降速",
+                 usage.cpuPermille, usage.rssKB / 1024);
+    }
+    return usage;
+}
+
+SelfMonitor::OpStats SelfMonitor::stats(SelfOperation op)
+{
+    QMutexLocker locker(&monitorState().mutex);
+    return monitorState().ops[op];
+}
+
+const char* SelfMonitor::operationName(SelfOperation op)
+{
+    switch (op) {
+    case SELF_OP_NETWORK: return "network";
+    case SELF_OP_INVENTORY_SCAN: return "inventory_scan";
+    case SELF_OP_SYSINFO: return "sysinfo";
+    case SELF_OP_FILE_RECEIVE: return "file_receive";
+    case SELF_OP_TELEMETRY: return "telemetry";
+    default: return "other";
+    }
+}
+
+QJsonObject SelfMonitor::report(const Usage& usage)
+{
+    SelfBudget limits = budget();
+    QJsonObject json;
+    json["cpu"] = int(usage.cpuPermille);
+    json["rss"] = qint64(usage.rssKB);
+    json["peakRss"] = qint64(usage.peakRssKB);
+    json["ioRead"] = qint64(usage.ioReadRate);
+    json["ioWrite"] = qint64(usage.ioWriteRate);
+    json["throttled"] = isThrottled();
+    json["throttles"] = qint64(throttleCount());
+
+    QJsonObject budgetJson;
+    budgetJson["cpu"] = limits.cpuPermille;
+    budgetJson["memory"] = limits.memoryMB;
+    json["budget"] = budgetJson;
+
+    // 只列出发生过的操作
+    QJsonObject ops;
+    for (int i = 0; i < SELF_OP_COUNT; ++i) {
+        SelfOperation op = static_cast<SelfOperation>(i);
+        OpStats s = stats(op);
+        if (s.count == 0 && s.cpuUs == 0) continue;
+        QJsonObject item;
+        item["count"] = qint64(s.count);
+        item["cpuMs"] = qint64(s.cpuUs / 1000);
+        item["wallMs"] = qint64(s.wallUs / 1000);
+        item["ioKB"] = qint64(s.ioBytes / 1024);
+        ops[operationName(op)] = item;
+    }
+    json["ops"] = ops;
+    return json;
+}
+
+void SelfMonitor::pace(qint64 bytes)
+{
+    PaceState& state = t_pace;
+    if (!isThrottled()) {
+        state.cpuUs = -1;
+        return;
+    }
+    if (state.cpuUs < 0) {
+        // 刚进入降速,从这里开始计算
+        state.cpuUs = threadCpuUs();
+        state.clock.start();
+        return;
+    }
+
+    // 用掉的CPU乘以让出倍数;磁盘读写按速率上限应耗的时间减去实际已过的时间,取两者中较长的
+    qint64 sleepUs = (threadCpuUs() - state.cpuUs) * SELF_THROTTLE_YIELD;
+    int rate = budget().throttledIoRate;
+    if (bytes > 0 && rate > 0) {
+        qint64 ioUs = bytes * 1000000 / (qint64(rate) * 1024) - state.clock.nsecsElapsed() / 1000;
+        sleepUs = qMax(sleepUs, ioUs);
+    }
+    // 单次最多休眠1秒,解除降速后很快恢复全速
+    if (sleepUs > 0) {
+        QThread::usleep(quint64(qMin<qint64>(sleepUs, 1000000)));
+    }
+    state.cpuUs = threadCpuUs();
+    state.clock.start();
+}
+
+SelfMonitor::Scope::Scope(SelfOperation op, bool counted)
+    : m_op(op)
+    , m_counted(counted)
+    , m_startCpu(threadCpuUs())
+    , m_startIo(threadIoBytes())
+{
+    m_wall.start();
+    t_pace.cpuUs = -1;
+
+    // 主线程上的操作(网络、采样)保持原有优先级
+    bool background = op == SELF_OP_INVENTORY_SCAN || op == SELF_OP_SYSINFO || op == SELF_OP_FILE_RECEIVE;
+    if (background && isThrottled()) {
+        m_lowered = lowerThreadPriority(m_savedNice, m_savedIoPriority);
+    }
+}
+
+SelfMonitor::Scope::~Scope()
+{
+    if (m_lowered) {
+        restoreThreadPriority(m_savedNice, m_savedIoPriority);
+    }
+    qint64 io = m_startIo >= 0 ? threadIoBytes() - m_startIo : m_explicitIo;
+    addStats(m_op, m_counted, threadCpuUs() - m_startCpu, m_wall.nsecsElapsed() / 1000, io);
+}
+
+void SelfMonitor::addStats(SelfOperation op, bool counted, qint64 cpuUs, qint64 wallUs, qint64 ioBytes)
+{
+    QMutexLocker locker(&monitorState().mutex);
+    OpStats& s = monitorState().ops[op];
+    if (counted) {
+        s.count++;
+        s.wallUs += quint64(qMax<qint64>(0, wallUs));
+    }
+    s.cpuUs += quint64(qMax<qint64>(0, cpuUs));
+    s.ioBytes += quint64(qMax<qint64>(0, ioBytes));
+}
+
+#ifdef Q_OS_WIN
+
+static quint64 fileTimeToUs(const FILETIME& ft)
+{
+    return ((quint64(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10;
+}
+
+static qint64 processCpuUs()
+{
+    FILETIME creation, exitTime, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user)) {
+        return 0;
+    }
+    return qint64(fileTimeToUs(kernel) + fileTimeToUs(user));
+}
+
+static void readProcessMemory(quint64& rssKB, quint64& peakKB)
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        rssKB = quint64(counters.WorkingSetSize) / 1024;
+        peakKB = quint64(counters.PeakWorkingSetSize) / 1024;
+    }
+}
+
+// Windows 的进程IO计数包括文件和设备读写,也包括部分网络IO
+static bool readProcessIo(quint64& readBytes, quint64& writeBytes)
+{
+    IO_COUNTERS counters;
+    if (!GetProcessIoCounters(GetCurrentProcess(), &counters)) {
+        return false;
+    }
+    readBytes = counters.ReadTransferCount;
+    writeBytes = counters.WriteTransferCount;
+    return true;
+}
+
+qint64 SelfMonitor::threadCpuUs()
+{
+    FILETIME creation, exitTime, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exitTime, &kernel, &user)) {
+        return 0;
+    }
+    return qint64(fileTimeToUs(kernel) + fileTimeToUs(user));
+}
+
+qint64 SelfMonitor::threadIoBytes()
+{
+    return -1;
+}
+
+// 后台模式同时降低线程的CPU、IO和内存页优先级
+bool SelfMonitor::lowerThreadPriority(int& nice, int& ioPriority)
+{
+    Q_UNUSED(nice)
+    Q_UNUSED(ioPriority)
+    return SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) != 0;
+}
+
+void SelfMonitor::restoreThreadPriority(int nice, int ioPriority)
+{
+    Q_UNUSED(nice)
+    Q_UNUSED(ioPriority)
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+}
+
+void SelfMonitor::trimMemory()
+{
+    SetProcessWorkingSetSize(GetCurrentProcess(), SIZE_T(-1), SIZE_T(-1));
+}
+
+#else
+
+static qint64 timevalToUs(const timeval& tv)
+{
+    return qint64(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static qint64 processCpuUs()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return timevalToUs(usage.ru_utime) + timevalToUs(usage.ru_stime);
+}
+
+static void readProcessMemory(quint64& rssKB, quint64& peakKB)
+{
+    // statm 的第二列是常驻页数
+    QFile file("/proc/self/statm");
+    if (file.open(QIODevice::ReadOnly)) {
+        QList<QByteArray> fields = file.readAll().split(' ');
+        if (fields.size() > 1) {
+            rssKB = fields[1].toULongLong() * quint64(sysconf(_SC_PAGESIZE)) / 1024;
+        }
+    }
+    // Linux 上 ru_maxrss 的单位是KB
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peakKB = quint64(usage.ru_maxrss);
+    }
+}
+
+// 只统计真正落到块设备上的读写(read_bytes/write_bytes),读缓存命中不计
+static bool readProcessIo(quint64& readBytes, quint64& writeBytes)
+{
+    QFile file("/proc/self/io");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    bool found = false;
+    for (const QByteArray& line : file.readAll().split('\n')) {
+        if (line.startsWith("read_bytes:")) {
+            readBytes = line.mid(11).trimmed().toULongLong();
+            found = true;
+        } else if (line.startsWith("write_bytes:")) {
+            writeBytes = line.mid(12).trimmed().toULongLong();
+        }
+    }
+    return found;
+}
+
+qint64 SelfMonitor::threadCpuUs()
+{
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+qint64 SelfMonitor::threadIoBytes()
+{
+#ifdef RUSAGE_THREAD
+    // 块数以512字节为单位
+    rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+        return (qint64(usage.ru_inblock) + usage.ru_oublock) * 512;
+    }
+#endif
+    return -1;
+}
+
+// Linux 的 nice 值和IO优先级都是线程属性,只影响当前线程。
+// 没有 CAP_SYS_NICE 时不能调回原来的 nice 值,线程池中的这个线程之后保持低优先级
+bool SelfMonitor::lowerThreadPriority(int& nice, int& ioPriority)
+{
+#ifdef Q_OS_LINUX
+    pid_t tid = pid_t(syscall(SYS_gettid));
+    errno = 0;
+    nice = getpriority(PRIO_PROCESS, id_t(tid));
+    if (errno != 0) {
+        nice = 0;
+    }
+    ioPriority = int(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid));
+    bool lowered = setpriority(PRIO_PROCESS, id_t(tid), 19) == 0;
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == 0) {
+        lowered = true;
+    }
+    return lowered;
+#else
+    Q_UNUSED(nice)
+    Q_UNUSED(ioPriority)
+    return false;
+#endif
+}
+
+void SelfMonitor::restoreThreadPriority(int nice, int ioPriority)
+{
+#ifdef Q_OS_LINUX
+    pid_t tid = pid_t(syscall(SYS_gettid));
+    setpriority(PRIO_PROCESS, id_t(tid), nice);
+    if (ioPriority >= 0) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, ioPriority);
+    }
+#else
+    Q_UNUSED(nice)
+    Q_UNUSED(ioPriority)
+#endif
+}
+
+void SelfMonitor::trimMemory()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef SELFMONITOR_H
+#define SELFMONITOR_H
+
+#include <QJsonObject>
+#include <QElapsedTimer>
+
+// 默认资源预算: 占整机CPU的千分比(10即1%)和常驻内存(MB)
+#define SELF_CPU_BUDGET 10
+#define SELF_MEMORY_BUDGET 30
+
+// 超出预算时清单扫描和文件写入的磁盘速率上限(KB/s)
+#define SELF_THROTTLED_IO_RATE 4096
+
+// 检查预算的间隔(毫秒),CPU占用按这段时间平均
+#define SELF_CHECK_INTERVAL 5000
+
+// 降速时后台操作每用掉1毫秒CPU就让出的毫秒数,单个线程最多占一个核心的 1/(1+N)
+#define SELF_THROTTLE_YIELD 4
+
+// 占用降到预算的该百分比以下才解除降速,避免在边界上反复切换
+#define SELF_RELEASE_PERCENT 80
+
+// 客户端自身的操作类型
+enum SelfOperation {
+    SELF_OP_NETWORK,        // 收发帧和命令分发(主线程)
+    SELF_OP_INVENTORY_SCAN, // 软件清单扫描
+    SELF_OP_SYSINFO,        // 系统信息采集
+    SELF_OP_FILE_RECEIVE,   // 接收文件的写盘和校验
+    SELF_OP_TELEMETRY,      // 性能遥测和自身占用采样
+    SELF_OP_COUNT
+};
+
+// 资源预算
+struct SelfBudget {
+    int cpuPermille = SELF_CPU_BUDGET;
+    int memoryMB = SELF_MEMORY_BUDGET;
+    int throttledIoRate = SELF_THROTTLED_IO_RATE;   // 降速时的磁盘速率上限(KB/s)
+};
+
+// 客户端进程自身的资源占用和预算
+//
+// 进程的CPU时间、常驻内存和磁盘读写由主线程定期调用 sample() 采样;各类操作在执行线程中
+// 用 Scope 记录本线程用掉的CPU时间和磁盘读写(Linux 按线程统计,其他平台只有 addIo 计入的字节)。
+// 采样时CPU或常驻内存超出预算即进入降速状态:
+//   - 后台操作(清单扫描、系统信息、文件写入)的线程降为后台CPU和IO优先级
+//   - 后台操作在 pace() 处按用掉的CPU让出时间,并把磁盘速率限制在 throttledIoRate
+//   - 清单的各个来源改为依次扫描(见 InventoryScanner)
+//   - 常驻内存超出时把空闲的堆内存交还系统
+// 占用降到预算的80%以下后恢复。主线程上的操作不降速,心跳和命令响应不受影响。
+class SelfMonitor {
+public:
+    // 一类操作的累计值
+    struct OpStats {
+        quint64 count = 0;
+        quint64 cpuUs = 0;
+        quint64 wallUs = 0;
+        quint64 ioBytes = 0;
+    };
+
+    // 进程占用
+    struct Usage {
+        quint32 cpuPermille = 0;    // 上次采样以来占整机CPU的千分比
+        quint64 rssKB = 0;          // 常驻内存
+        quint64 peakRssKB = 0;      // 常驻内存峰值
+        quint64 ioReadRate = 0;     // 磁盘读取速率(KB/s)
+        quint64 ioWriteRate = 0;    // 磁盘写入速率(KB/s)
+    };
+
+    static void setBudget(const SelfBudget& budget);
+    static SelfBudget budget();
+
+    // 采样进程占用并按预算进入或解除降速,由主线程定期调用(第一次只建立基线)
+    static Usage sample();
+
+    // 当前是否处于降速状态,以及累计进入降速的次数
+    static bool isThrottled();
+    static quint64 throttleCount();
+
+    static OpStats stats(SelfOperation op);
+    static const char* operationName(SelfOperation op);
+
+    // 上报给服务端的JSON: 进程占用、预算、降速状态和各类操作的累计值
+    static QJsonObject report(const Usage& usage);
+
+    // 后台操作的循环中调用,bytes 为自上次调用以来读写的字节数。
+    // 降速时按本线程用掉的CPU和磁盘速率上限休眠,未降速时立即返回。不能在主线程调用
+    static void pace(qint64 bytes = 0);
+
+    // 作用域内的CPU时间和磁盘读写计入一类操作;降速时后台操作的线程在作用域内降低优先级
+    class Scope {
+    public:
+        // counted 为 false 时只计入CPU和读写,不计次数和耗时(同一次操作在其他线程中的部分)
+        explicit Scope(SelfOperation op, bool counted = true);
+        ~Scope();
+
+        // 显式计入的读写字节数,在不能按线程统计磁盘读写的平台上使用
+        void addIo(qint64 bytes) { m_explicitIo += bytes; }
+
+    private:
+        SelfOperation m_op;
+        bool m_counted;
+        qint64 m_startCpu;
+        qint64 m_startIo;
+        qint64 m_explicitIo = 0;
+        QElapsedTimer m_wall;
+        bool m_lowered = false;
+        int m_savedNice = 0;
+        int m_savedIoPriority = 0;
+        Q_DISABLE_COPY(Scope)
+    };
+
+private:
+    static void addStats(SelfOperation op, bool counted, qint64 cpuUs, qint64 wallUs, qint64 ioBytes);
+
+    // 本线程的CPU时间(微秒)和磁盘读写字节数(不支持时为-1)
+    static qint64 threadCpuUs();
+    static qint64 threadIoBytes();
+
+    // 降低/恢复本线程的CPU和IO优先级,nice/ioPriority 保存原来的设置(只在Linux上使用)
+    static bool lowerThreadPriority(int& nice, int& ioPriority);
+    static void restoreThreadPriority(int nice, int ioPriority);
+
+    // 把空闲的堆内存交还系统
+    static void trimMemory();
+};
+
+#endif // SELFMONITOR_H
@@ -1,73 +1,37 @@
 #include "softmgr.h"
+#include "inventorysource.h"
+#include "../Common/trace.h"
 #include <QSettings>
 #include <QProcess>
 #include <QFileInfo>
 #include <QDir>
 #include <QDebug>
 
+// 扫描器保存各来源上次的结果,整个进程只创建一次
+// 有意不释放: 静态析构时 QCoreApplication 已退出,不再等待线程池
+static InventoryScanner* scanner()
+{
+    static InventoryScanner* instance = [] {
+        InventoryScanner* s = new InventoryScanner;
+        s->addDefaultSources();
+        return s;
+    }();
+    return instance;
+}
+
 QList<SoftwareInfo> SoftwareManager::getInstalledSoftware()
 {
-    QList<SoftwareInfo> softwareList;
-    
-    // 读取64位程序注册表
-    readSoftwareFromRegistry(
-        "HKEY_LOCAL_MACHINE\\SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
-        softwareList);
-    
-    // 读取32位程序注册表(在64位系统上)
-    readSoftwareFromRegistry(
-        "HKEY_LOCAL_MACHINE\\SOFTWARE\\WOW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
-        softwareList);
-    
-    // 读取当前用户安装的程序
-    readSoftwareFromRegistry(
-        "HKEY_CURRENT_USER\\SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
-        softwareList);
-    
-    return softwareList;
+    return scanner()->scan();
 }
 
-void SoftwareManager::readSoftwareFromRegistry(const QString& regPath, QList<SoftwareInfo>& list)
+QStringList SoftwareManager::inventoryWatchPaths()
 {
-    QSettings reg(regPath, QSettings::NativeFormat);
-    
-    foreach (const QString& subKey, reg.childGroups()) {
-        reg.beginGroup(subKey);
-        
-        QString displayName = reg.value("DisplayName").toString();
-        
-        // 过滤掉没有名称的条目和更新补丁
-        if (!displayName.isEmpty() && !displayName.contains("Update") &&
-            !displayName.contains("KB") && !reg.value("SystemComponent", 0).toBool()) {
-            
-            SoftwareInfo info;
-            info.name = displayName;
-            info.version = reg.value("DisplayVersion").toString();
-            info.publisher = reg.value("Publisher").toString();
-            info.installDate = reg.value("InstallDate").toString();
-            info.installPath = reg.value("InstallLocation").toString();
-            info.uninstallCmd = reg.value("UninstallString").toString();
-            
-            // 避免重复
-            bool exists = false;
-            for (const SoftwareInfo& existing : list) {
-                if (existing.name == info.name && existing.version == info.version) {
-                    exists = true;
-                    break;
-                }
-            }
-            
-            if (!exists && !info.uninstallCmd.isEmpty()) {
-                list.append(info);
-            }
-        }
-        
-        reg.endGroup();
-    }
+    return scanner()->watchPaths();
 }
 
-bool SoftwareManager::installSoftware(const QString& filePath, const QString& args)
+bool SoftwareManager::installSoftware(const QString& filePath, const QString& args, int* exitCode)
 {
+    if (exitCode) *exitCode = NO_EXIT_CODE;
     QFileInfo fileInfo(filePath);
     if (!fileInfo.exists()) {
         qWarning() << "Installation file not found:" << filePath;
@@ -110,16 +74,24 @@ bool SoftwareManager::installSoftware(const QString& filePath, const QString& ar
     
     QProcess process;
     process.start(command, arguments);
+    Trace::instant(Trace::current(), "process.start");
     
     // 等待安装完成,最长等待10分钟
-    if (!process.waitForFinished(600000)) {
+    bool finished = process.waitForFinished(600000);
+    Trace::instant(Trace::current(), "process.exit");
+    if (!finished) {
         qWarning() << "Installation timeout";
         return false;
     }
+    if (process.exitStatus() != QProcess::NormalExit) {
+        qWarning() << "Installer crashed";
+        return false;
+    }
     
-    int exitCode = process.exitCode();
-    if (exitCode != 0) {
-        qWarning() << "Installation failed with exit code:" << exitCode;
+    int code = process.exitCode();
+    if (exitCode) *exitCode = code;
+    if (code != 0) {
+        qWarning() << "Installation failed with exit code:" << code;
         qWarning() << "Error output:" << process.readAllStandardError();
         return false;
     }
@@ -127,8 +99,9 @@ bool SoftwareManager::installSoftware(const QString& filePath, const QString& ar
     return true;
 }
 
-bool SoftwareManager::uninstallSoftware(const QString& uninstallCmd)
+bool SoftwareManager::uninstallSoftware(const QString& uninstallCmd, int* exitCode)
 {
+    if (exitCode) *exitCode = NO_EXIT_CODE;
     if (uninstallCmd.isEmpty()) {
         qWarning() << "Uninstall command is empty";
         return false;
@@ -166,6 +139,7 @@ bool SoftwareManager::uninstallSoftware(const QString& uninstallCmd)
             arguments << "/quiet" << "/norestart";
         }
     } else {
+#ifdef Q_OS_WIN
         // EXE卸载程序 - 尝试添加静默参数
         bool hasSilent = false;
         for (const QString& arg : arguments) {
@@ -180,20 +154,30 @@ bool SoftwareManager::uninstallSoftware(const QString& uninstallCmd)
             // 尝试常见的静默参数
             arguments << "/S";
         }
+#endif
+        // 其他平台的卸载命令来自包管理器(dpkg/rpm/flatpak),本身已是非交互的
     }
     
     QProcess process;
     process.start(cmd, arguments);
+    Trace::instant(Trace::current(), "process.start");
     
     // 等待卸载完成,最长等待5分钟
-    if (!process.waitForFinished(300000)) {
+    bool finished = process.waitForFinished(300000);
+    Trace::instant(Trace::current(), "process.exit");
+    if (!finished) {
         qWarning() << "Uninstall timeout";
         return false;
     }
+    if (process.exitStatus() != QProcess::NormalExit) {
+        qWarning() << "Uninstaller crashed";
+        return false;
+    }
     
-    int exitCode = process.exitCode();
-    if (exitCode != 0 && exitCode != 1605) { // 1605 = 产品未安装
-        qWarning() << "Uninstall failed with exit code:" << exitCode;
+    int code = process.exitCode();
+    if (exitCode) *exitCode = code;
+    if (code != 0 && code != 1605) { // 1605 = 产品未安装
+        qWarning() << "Uninstall failed with exit code:" << code;
         return false;
     }
     
@@ -3,28 +3,31 @@
 
 #include <QList>
 #include <QString>
+#include <QStringList>
 #include "../Common/protocol.h"
 
 class SoftwareManager {
 public:
-    // 获取已安装软件列表
+    // 获取已安装软件列表(各来源并行扫描,见 InventoryScanner)
     static QList<SoftwareInfo> getInstalledSoftware();
     
+    // 软件清单来源需要监视的路径(见 InventoryWatcher)
+    static QStringList inventoryWatchPaths();
+    
     // 安装软件(静默安装)
     // filePath: 安装包路径
     // args: 额外的安装参数(可选)
+    // exitCode: 安装程序正常退出时的退出码,否则为 NO_EXIT_CODE(可选)
     // 返回: 是否安装成功
-    static bool installSoftware(const QString& filePath, const QString& args = "");
+    static bool installSoftware(const QString& filePath, const QString& args = "", int* exitCode = nullptr);
     
     // 卸载软件
     // uninstallCmd: 卸载命令(从软件列表获取)
+    // exitCode: 卸载程序正常退出时的退出码,否则为 NO_EXIT_CODE(可选)
     // 返回: 是否卸载成功
-    static bool uninstallSoftware(const QString& uninstallCmd);
+    static bool uninstallSoftware(const QString& uninstallCmd, int* exitCode = nullptr);
     
 private:
-    // 从注册表路径读取软件列表
-    static void readSoftwareFromRegistry(const QString& regPath, QList<SoftwareInfo>& list);
-    
     // 获取静默安装参数
     static QString getSilentArgs(const QString& filePath);
 };
@@ -4,6 +4,7 @@
 #include <QNetworkInterface>
 #include <QSysInfo>
 #include <QHostAddress>
+#include <QFile>
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -96,6 +97,22 @@ void SysInfo::getMemoryInfo(quint64& totalMB, quint64& freeMB)
         freeMB = memStatus.ullAvailPhys / (1024 * 1024);
         return;
     }
+#elif defined(Q_OS_LINUX)
+    QFile meminfo("/proc/meminfo");
+    if (meminfo.open(QIODevice::ReadOnly)) {
+        // /proc 文件大小为0,需一次性读取
+        quint64 totalKB = 0, availKB = 0;
+        for (const QByteArray& line : meminfo.readAll().split('\n')) {
+            if (line.startsWith("MemTotal:")) {
+                totalKB = line.mid(9).trimmed().split(' ').first().toULongLong();
+            } else if (line.startsWith("MemAvailable:")) {
+                availKB = line.mid(13).trimmed().split(' ').first().toULongLong();
+            }
+        }
+        totalMB = totalKB / 1024;
+        freeMB = availKB / 1024;
+        return;
+    }
 #endif
     totalMB = 0;
     freeMB = 0;
@@ -0,0 +1,82 @@
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+#include <QtGlobal>
+
+// 堆分配计数,用于确认热点路径不分配内存
+//
+// 以 LANMGR_COUNT_ALLOCS 编译(qmake CONFIG+=count_allocs)时替换 malloc 系列函数,
+// 按线程统计分配次数,Qt 容器和 operator new 的分配都会计入。替换函数只能定义一次:
+// 程序中恰好一个源文件先定义 ALLOC_COUNTER_DEFINE 再包含本文件。
+// 只支持 glibc,其他平台和未开启时 enabled() 为 false,count() 恒为0,没有额外开销。
+
+#if defined(LANMGR_COUNT_ALLOCS) && defined(__GLIBC__)
+
+namespace AllocCounter {
+inline thread_local quint64 t_count = 0;
+
+inline bool enabled() { return true; }
+
+// 当前线程累计的分配次数(malloc/calloc/realloc/memalign)
+inline quint64 count() { return t_count; }
+}
+
+#ifdef ALLOC_COUNTER_DEFINE
+#include <cerrno>
+#include <cstddef>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) noexcept
+{
+    AllocCounter::t_count++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+    AllocCounter::t_count++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept
+{
+    AllocCounter::t_count++;
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept
+{
+    AllocCounter::t_count++;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    AllocCounter::t_count++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) noexcept
+{
+    AllocCounter::t_count++;
+    *out = __libc_memalign(alignment, size);
+    return *out ? 0 : ENOMEM;
+}
+}
+#endif // ALLOC_COUNTER_DEFINE
+
+#else
+
+namespace AllocCounter {
+inline bool enabled() { return false; }
+inline quint64 count() { return 0; }
+}
+
+#endif
+
+#endif // ALLOCCOUNTER_H
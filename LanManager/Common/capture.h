@@ -0,0 +1,304 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QFile>
+#include <QString>
+#include "protocol.h"
+#include "telemetry.h"
+
+// 流量记录文件标识
+#define CAPTURE_MAGIC "LMCAP001"
+#define CAPTURE_MAGIC_SIZE 8
+
+// 只记录摘要的帧保留的数据开头字节数(回放时用它加0填充到原长度)
+#define CAPTURE_HASH_PREFIX 64
+
+// 写缓冲攒够后写入文件
+#define CAPTURE_FLUSH_BYTES (256 * 1024)
+
+// 记录文件默认上限,写满后停止记录
+#define CAPTURE_DEFAULT_LIMIT (1024LL * 1024 * 1024)
+
+// 记录方
+enum CaptureRole {
+    CAPTURE_SERVER = 1,
+    CAPTURE_AGENT = 2
+};
+
+// 帧方向(相对记录方)
+enum CaptureDirection {
+    CAPTURE_IN = 0,
+    CAPTURE_OUT = 1
+};
+
+// 帧数据的保存方式
+enum CapturePayload {
+    CAPTURE_PAYLOAD_FULL = 0,   // 完整数据
+    CAPTURE_PAYLOAD_HASH = 1,   // SHA-1摘要和开头部分
+    CAPTURE_PAYLOAD_NONE = 2    // 只有长度(文件区间帧,发送时才从文件读取)
+};
+
+// 一条记录
+struct CaptureRecord {
+    qint64 timeUs = 0;              // 相对记录开始的时间(微秒)
+    quint32 connection = 0;         // 连接编号(服务端为客户端编号,客户端为连接序号)
+    CaptureDirection direction = CAPTURE_IN;
+    quint32 cmd = 0;
+    quint8 flags = 0;
+    quint32 requestId = 0;
+    quint32 length = 0;             // 原始数据长度
+    CapturePayload payloadMode = CAPTURE_PAYLOAD_FULL;
+    QByteArray payload;             // 完整数据,或摘要方式下的开头部分
+    QByteArray hash;                // 摘要方式下的SHA-1
+
+    // 回放用的数据,只有摘要时用开头部分加0填充到原长度
+    QByteArray replayPayload() const {
+        if (payloadMode == CAPTURE_PAYLOAD_FULL) {
+            return payload;
+        }
+        QByteArray data(int(length), '\0');
+        memcpy(data.data(), payload.constData(), size_t(qMin(payload.size(), data.size())));
+        return data;
+    }
+};
+
+// 流量记录
+//
+// 文件格式: [标识8B][记录方1B][开始时间varint(UTC毫秒)][数据方式1B],之后是连续的记录:
+// [方向|数据方式<<1 1B][与上一条的时间差varint(微秒)][连接varint][命令varint][标志1B]
+// [请求号varint][数据长度varint] 后跟数据: 完整方式为原始数据,摘要方式为
+// [SHA-1 20B][开头长度varint][开头部分],只有长度时没有数据。
+//
+// 默认只对文件数据和命令输出记摘要,其余帧(心跳、JSON请求和响应、遥测)保存完整数据,
+// 回放时走的处理路径与实际相同;full 为 true 时所有帧都保存完整数据。
+// 不加锁,只能在一个线程中使用(服务端和客户端的收发都在主线程)。
+class CaptureWriter {
+public:
+    ~CaptureWriter() { close(); }
+
+    bool open(const QString& path, CaptureRole role, bool full = false,
+              qint64 limit = CAPTURE_DEFAULT_LIMIT) {
+        close();
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            m_error = m_file.errorString();
+            return false;
+        }
+        m_full = full;
+        m_limit = limit;
+        m_records = 0;
+        m_dropped = 0;
+        m_written = 0;
+        m_lastUs = 0;
+        m_buffer.clear();
+        m_buffer.append(CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+        m_buffer.append(char(role));
+        VarInt::writeUInt(m_buffer, quint64(QDateTime::currentMSecsSinceEpoch()));
+        m_buffer.append(char(full ? CAPTURE_PAYLOAD_FULL : CAPTURE_PAYLOAD_HASH));
+        m_clock.start();
+        return true;
+    }
+
+    void close() {
+        if (m_file.isOpen()) {
+            flush();
+            m_file.close();
+        }
+    }
+
+    bool isOpen() const { return m_file.isOpen(); }
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_error; }
+    qint64 records() const { return m_records; }
+    qint64 dropped() const { return m_dropped; }
+    qint64 bytes() const { return m_written + m_buffer.size(); }
+
+    // 记录一帧
+    void write(quint32 connection, CaptureDirection direction, quint32 cmd, quint8 flags,
+               quint32 requestId, const QByteArray& data) {
+        if (!m_file.isOpen()) return;
+        CapturePayload mode = m_full || !isBulk(cmd) ? CAPTURE_PAYLOAD_FULL : CAPTURE_PAYLOAD_HASH;
+        if (!beginRecord(connection, direction, cmd, flags, requestId, mode, data.size())) return;
+        if (mode == CAPTURE_PAYLOAD_FULL) {
+            m_buffer.append(data);
+        } else {
+            QByteArray prefix = data.left(CAPTURE_HASH_PREFIX);
+            m_buffer.append(QCryptographicHash::hash(data, QCryptographicHash::Sha1));
+            VarInt::writeUInt(m_buffer, quint64(prefix.size()));
+            m_buffer.append(prefix);
+        }
+        endRecord();
+    }
+
+    // 记录数据不在内存中的帧(只有长度)
+    void writeLength(quint32 connection, CaptureDirection direction, quint32 cmd, quint8 flags,
+                     quint32 requestId, qint64 length) {
+        if (!m_file.isOpen()) return;
+        if (!beginRecord(connection, direction, cmd, flags, requestId, CAPTURE_PAYLOAD_NONE, length)) return;
+        endRecord();
+    }
+
+    void flush() {
+        if (!m_buffer.isEmpty() && m_file.isOpen()) {
+            m_written += m_file.write(m_buffer);
+            m_buffer.clear();
+            m_file.flush();
+        }
+    }
+
+    // 默认只记摘要的大块数据帧
+    static bool isBulk(quint32 cmd) {
+        return cmd == CMD_FILE_TRANSFER_DATA || cmd == CMD_EXEC_OUTPUT;
+    }
+
+private:
+    bool beginRecord(quint32 connection, CaptureDirection direction, quint32 cmd, quint8 flags,
+                     quint32 requestId, CapturePayload mode, qint64 length) {
+        // 写满后不再记录,保证文件中的记录都是完整的
+        qint64 stored = mode == CAPTURE_PAYLOAD_FULL ? length : 0;
+        if (m_written + m_buffer.size() + stored > m_limit) {
+            m_dropped++;
+            return false;
+        }
+        qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+        m_buffer.append(char(direction | (mode << 1)));
+        VarInt::writeUInt(m_buffer, quint64(qMax<qint64>(0, nowUs - m_lastUs)));
+        VarInt::writeUInt(m_buffer, connection);
+        VarInt::writeUInt(m_buffer, cmd);
+        m_buffer.append(char(flags));
+        VarInt::writeUInt(m_buffer, requestId);
+        VarInt::writeUInt(m_buffer, quint64(length));
+        m_lastUs = qMax(m_lastUs, nowUs);
+        return true;
+    }
+
+    void endRecord() {
+        m_records++;
+        if (m_buffer.size() >= CAPTURE_FLUSH_BYTES) {
+            flush();
+        }
+    }
+
+    QFile m_file;
+    QByteArray m_buffer;
+    QElapsedTimer m_clock;
+    QString m_error;
+    bool m_full = false;
+    qint64 m_limit = CAPTURE_DEFAULT_LIMIT;
+    qint64 m_lastUs = 0;
+    qint64 m_written = 0;
+    qint64 m_records = 0;
+    qint64 m_dropped = 0;
+};
+
+// 读取流量记录文件(内存映射,按顺序解码)
+class CaptureReader {
+public:
+    bool open(const QString& path) {
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            m_error = m_file.errorString();
+            return false;
+        }
+        const char* data = nullptr;
+        if (m_file.size() > 0) {
+            data = reinterpret_cast<const char*>(m_file.map(0, m_file.size()));
+        }
+        if (!data) {
+            m_copy = m_file.readAll();
+            data = m_copy.constData();
+        }
+        m_pos = data;
+        m_end = data + m_file.size();
+
+        quint64 start;
+        if (m_end - m_pos < CAPTURE_MAGIC_SIZE + 1 || memcmp(m_pos, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0) {
+            m_error = "不是流量记录文件";
+            return false;
+        }
+        m_pos += CAPTURE_MAGIC_SIZE;
+        m_role = CaptureRole(quint8(*m_pos++));
+        if (!VarInt::readUInt(m_pos, m_end, start) || m_pos >= m_end) {
+            m_error = "文件头不完整";
+            return false;
+        }
+        m_startTime = qint64(start);
+        m_full = quint8(*m_pos++) == CAPTURE_PAYLOAD_FULL;
+        m_timeUs = 0;
+        return true;
+    }
+
+    CaptureRole role() const { return m_role; }
+    qint64 startTime() const { return m_startTime; }
+    bool isFullPayload() const { return m_full; }
+    QString errorString() const { return m_error; }
+
+    // 读取下一条记录,到文件末尾或记录损坏时返回false(损坏时 errorString 非空)
+    bool next(CaptureRecord& record) {
+        if (m_pos >= m_end) return false;
+        const char* p = m_pos;
+        quint8 kind = quint8(*p++);
+        quint64 delta, connection, cmd, requestId, length;
+        if (!VarInt::readUInt(p, m_end, delta) || !VarInt::readUInt(p, m_end, connection)
+            || !VarInt::readUInt(p, m_end, cmd) || p >= m_end) {
+            return corrupt();
+        }
+        quint8 flags = quint8(*p++);
+        if (!VarInt::readUInt(p, m_end, requestId) || !VarInt::readUInt(p, m_end, length)) {
+            return corrupt();
+        }
+
+        record.direction = CaptureDirection(kind & 1);
+        record.payloadMode = CapturePayload((kind >> 1) & 3);
+        record.connection = quint32(connection);
+        record.cmd = quint32(cmd);
+        record.flags = flags;
+        record.requestId = quint32(requestId);
+        record.length = quint32(length);
+        record.hash.clear();
+        record.payload.clear();
+
+        if (record.payloadMode == CAPTURE_PAYLOAD_FULL) {
+            if (quint64(m_end - p) < length) return corrupt();
+            record.payload = QByteArray(p, int(length));
+            p += length;
+        } else if (record.payloadMode == CAPTURE_PAYLOAD_HASH) {
+            quint64 prefix;
+            if (m_end - p < 20) return corrupt();
+            record.hash = QByteArray(p, 20);
+            p += 20;
+            if (!VarInt::readUInt(p, m_end, prefix) || quint64(m_end - p) < prefix) return corrupt();
+            record.payload = QByteArray(p, int(prefix));
+            p += prefix;
+        }
+
+        m_timeUs += qint64(delta);
+        record.timeUs = m_timeUs;
+        m_pos = p;
+        return true;
+    }
+
+private:
+    // 记录方异常退出时最后一条记录可能不完整
+    bool corrupt() {
+        m_error = "记录不完整或已损坏";
+        m_pos = m_end;
+        return false;
+    }
+
+    QFile m_file;
+    QByteArray m_copy;
+    const char* m_pos = nullptr;
+    const char* m_end = nullptr;
+    CaptureRole m_role = CAPTURE_SERVER;
+    qint64 m_startTime = 0;
+    qint64 m_timeUs = 0;
+    bool m_full = false;
+    QString m_error;
+};
+
+#endif // CAPTURE_H
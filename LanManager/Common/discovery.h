@@ -0,0 +1,154 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSet>
+#include <QHostAddress>
+#include <QNetworkInterface>
+#include "protocol.h"
+
+// 服务端通告信息
+struct ServerAnnounce {
+    QString host;           // 服务器地址(由接收方根据来源地址填写)
+    quint16 port = 0;       // TCP端口
+    int load = 0;           // 当前连接数
+    int capacity = 0;       // 建议最大连接数(0表示未知)
+    quint16 peerPort = 0;   // 服务器间互查端口(0表示不支持)
+
+    // 服务器标识,客户端分片和服务器互查都使用它
+    QString id() const { return host + ':' + QString::number(port); }
+};
+
+// 服务发现报文
+//   服务端广播/单播回复: LANMGR_SERVER:端口[:连接数:容量[:互查端口]]
+//   客户端探测:         LANMGR_PROBE
+// 旧版客户端只解析前两段,新增字段放在末尾保持兼容
+class Discovery {
+public:
+    static QByteArray announce(const ServerAnnounce& info) {
+        QByteArray data(BROADCAST_MAGIC);
+        data += ':' + QByteArray::number(info.port);
+        data += ':' + QByteArray::number(info.load);
+        data += ':' + QByteArray::number(info.capacity);
+        if (info.peerPort) {
+            data += ':' + QByteArray::number(info.peerPort);
+        }
+        return data;
+    }
+
+    // 直接在原始字节上解析,不构造QString
+    static bool parseAnnounce(const QByteArray& data, ServerAnnounce& info) {
+        static const int magicLen = int(sizeof(BROADCAST_MAGIC)) - 1;
+        if (data.size() <= magicLen + 1 || !data.startsWith(BROADCAST_MAGIC) || data[magicLen] != ':') {
+            return false;
+        }
+
+        int pos = magicLen + 1;
+        qint64 fields[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4 && pos < data.size(); ++i) {
+            int end = data.indexOf(':', pos);
+            if (end < 0) end = data.size();
+            bool ok = false;
+            fields[i] = data.mid(pos, end - pos).toLongLong(&ok);
+            if (!ok) {
+                if (i == 0) return false;
+                break;
+            }
+            pos = end + 1;
+        }
+        if (fields[0] <= 0 || fields[0] > 65535) return false;
+
+        info.port = quint16(fields[0]);
+        info.load = int(qMax<qint64>(0, fields[1]));
+        info.capacity = int(qMax<qint64>(0, fields[2]));
+        info.peerPort = (fields[3] > 0 && fields[3] <= 65535) ? quint16(fields[3]) : 0;
+        return true;
+    }
+
+    static QByteArray probe() {
+        return QByteArray(PROBE_MAGIC);
+    }
+
+    static bool isProbe(const QByteArray& data) {
+        return data.startsWith(PROBE_MAGIC);
+    }
+
+    // 所有可广播的IPv4接口的子网广播地址(多网卡时每个子网各一个)
+    static QList<QHostAddress> broadcastAddresses() {
+        QList<QHostAddress> result;
+        const QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
+        for (const QNetworkInterface& iface : interfaces) {
+            QNetworkInterface::InterfaceFlags flags = iface.flags();
+            if (!(flags & QNetworkInterface::IsUp) || !(flags & QNetworkInterface::IsRunning) ||
+                !(flags & QNetworkInterface::CanBroadcast) || (flags & QNetworkInterface::IsLoopBack)) {
+                continue;
+            }
+            for (const QNetworkAddressEntry& entry : iface.addressEntries()) {
+                if (entry.ip().protocol() == QAbstractSocket::IPv4Protocol &&
+                    !entry.broadcast().isNull() && !result.contains(entry.broadcast())) {
+                    result.append(entry.broadcast());
+                }
+            }
+        }
+        if (result.isEmpty()) {
+            result.append(QHostAddress(QHostAddress::Broadcast));
+        }
+        return result;
+    }
+
+    // 负载比例(越小越空闲),旧版服务端不带容量,按半负载对待
+    static double loadRatio(const ServerAnnounce& info) {
+        return info.capacity > 0 ? double(info.load) / info.capacity : 0.5;
+    }
+
+    // 最高随机权重(rendezvous)哈希得分
+    // 每个客户端对每台服务器算一个得分,取得分最高者。增减一台服务器只影响
+    // 原本落在该服务器上的客户端。不能用qHash,它的种子每个进程不同。
+    static quint64 rendezvousScore(const QByteArray& agentKey, const QString& serverId) {
+        quint64 h = 14695981039346656037ULL;                 // FNV-1a 64
+        auto feed = [&h](const QByteArray& bytes) {
+            for (char c : bytes) {
+                h ^= quint8(c);
+                h *= 1099511628211ULL;
+            }
+        };
+        feed(agentKey);
+        h ^= 0xFF;
+        h *= 1099511628211ULL;
+        feed(serverId.toUtf8());
+        // 末尾混合,让相近的输入得分分布均匀
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // 为客户端选择服务器: 在负载低于 highWatermark 的服务器中取得分最高者,
+    // 全部超载时在所有服务器中选择。exclude 中的服务器(如刚连接失败)不参与选择,
+    // 除非没有其他服务器。返回下标,列表为空时返回-1。
+    static int pickServer(const QByteArray& agentKey, const QList<ServerAnnounce>& servers,
+                          double highWatermark, const QSet<QString>& exclude = QSet<QString>()) {
+        int best = -1;
+        int bestRank = -1;
+        quint64 bestScore = 0;
+        for (int i = 0; i < servers.size(); ++i) {
+            const ServerAnnounce& info = servers[i];
+            QString id = info.id();
+            bool available = info.capacity <= 0 || info.load < info.capacity * highWatermark;
+            // 选择顺序: 未排除且未超载 > 未排除 > 其他
+            int rank = (exclude.contains(id) ? 0 : 2) + (available ? 1 : 0);
+            quint64 score = rendezvousScore(agentKey, id);
+            if (rank > bestRank || (rank == bestRank && score > bestScore)) {
+                best = i;
+                bestRank = rank;
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+};
+
+#endif // DISCOVERY_H
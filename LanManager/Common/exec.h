@@ -0,0 +1,131 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStringList>
+
+// 命令执行默认超时(毫秒)
+#define EXEC_DEFAULT_TIMEOUT (10 * 60 * 1000)
+
+// 每个作业最多回传的输出字节数,超过后丢弃并标记截断
+#define EXEC_DEFAULT_MAX_OUTPUT (4 * 1024 * 1024)
+
+// 客户端输出攒批: 最长等待时间(毫秒)和单帧最大字节数
+#define EXEC_FLUSH_INTERVAL 100
+#define EXEC_FLUSH_BYTES (32 * 1024)
+
+// 取消时先请求进程退出,超过该时间(毫秒)仍未退出则强制结束
+#define EXEC_KILL_GRACE 3000
+
+// 输出流
+enum ExecStream {
+    EXEC_STDOUT = 1,
+    EXEC_STDERR = 2
+};
+
+// 执行请求(CMD_EXEC_START,请求号即作业号)
+// 给出 program 时直接启动该程序,否则由系统shell解释 command
+struct ExecRequest {
+    QString command;          // shell命令行(Windows为cmd /c,其他平台为 /bin/sh -c)
+    QString program;          // 直接启动的程序
+    QStringList arguments;    // program 的参数
+    int timeoutMs = EXEC_DEFAULT_TIMEOUT;
+    qint64 maxOutput = EXEC_DEFAULT_MAX_OUTPUT;
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        if (!command.isEmpty()) obj["command"] = command;
+        if (!program.isEmpty()) {
+            obj["program"] = program;
+            obj["arguments"] = QJsonArray::fromStringList(arguments);
+        }
+        obj["timeoutMs"] = timeoutMs;
+        obj["maxOutput"] = maxOutput;
+        return obj;
+    }
+
+    static ExecRequest fromJson(const QJsonObject& obj) {
+        ExecRequest req;
+        req.command = obj["command"].toString();
+        req.program = obj["program"].toString();
+        for (const QJsonValue& val : obj["arguments"].toArray()) {
+            req.arguments.append(val.toString());
+        }
+        req.timeoutMs = obj["timeoutMs"].toInt(EXEC_DEFAULT_TIMEOUT);
+        req.maxOutput = obj["maxOutput"].toVariant().toLongLong();
+        if (req.maxOutput <= 0) {
+            req.maxOutput = EXEC_DEFAULT_MAX_OUTPUT;
+        }
+        return req;
+    }
+};
+
+// 执行结果(CMD_EXEC_RESULT)
+struct ExecResult {
+    bool started = false;     // 进程是否启动成功
+    int exitCode = -1;
+    bool crashed = false;     // 进程异常退出
+    bool canceled = false;    // 被服务端取消
+    bool timedOut = false;    // 超时被结束
+    bool truncated = false;   // 输出超过上限,后面的部分未回传
+    qint64 outputBytes = 0;   // 进程产生的输出总字节数(含未回传部分)
+    qint64 elapsedMs = 0;
+    QString error;
+
+    bool isSuccess() const {
+        return started && !crashed && !canceled && !timedOut && exitCode == 0;
+    }
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        obj["started"] = started;
+        obj["exitCode"] = exitCode;
+        obj["crashed"] = crashed;
+        obj["canceled"] = canceled;
+        obj["timedOut"] = timedOut;
+        obj["truncated"] = truncated;
+        obj["outputBytes"] = outputBytes;
+        obj["elapsedMs"] = elapsedMs;
+        if (!error.isEmpty()) obj["error"] = error;
+        return obj;
+    }
+
+    static ExecResult fromJson(const QJsonObject& obj) {
+        ExecResult result;
+        result.started = obj["started"].toBool();
+        result.exitCode = obj["exitCode"].toInt(-1);
+        result.crashed = obj["crashed"].toBool();
+        result.canceled = obj["canceled"].toBool();
+        result.timedOut = obj["timedOut"].toBool();
+        result.truncated = obj["truncated"].toBool();
+        result.outputBytes = obj["outputBytes"].toVariant().toLongLong();
+        result.elapsedMs = obj["elapsedMs"].toVariant().toLongLong();
+        result.error = obj["error"].toString();
+        return result;
+    }
+};
+
+// 输出帧(CMD_EXEC_OUTPUT): [1字节流][原始输出],请求号为作业号
+class ExecOutputFrame {
+public:
+    static QByteArray encode(ExecStream stream, const QByteArray& data) {
+        QByteArray frame;
+        frame.reserve(1 + data.size());
+        frame.append(char(stream));
+        frame.append(data);
+        return frame;
+    }
+
+    static bool decode(const QByteArray& frame, ExecStream& stream, QByteArray& data) {
+        if (frame.isEmpty()) return false;
+        quint8 s = quint8(frame.at(0));
+        if (s != EXEC_STDOUT && s != EXEC_STDERR) return false;
+        stream = ExecStream(s);
+        data = frame.mid(1);
+        return true;
+    }
+};
+
+#endif // EXEC_H
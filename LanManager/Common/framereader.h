@@ -0,0 +1,158 @@
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include "protocol.h"
+#include "objectpool.h"
+
+// 一批帧处理完后,容量超过该值的接收缓冲(已无剩余数据时)和帧数据缓冲交还缓冲池
+#define FRAME_READER_KEEP (64 * 1024)
+
+// 从字节流中拆出完整的帧
+//
+// 接收缓冲和帧数据缓冲都从缓冲池取得并反复使用: 拆出的帧只移动读位置,一批帧处理完
+// (compact)才把剩余数据移到缓冲开头;帧数据复制到固定的缓冲交给处理函数。心跳这类
+// 小帧在稳定状态下不分配内存。处理函数保留了帧数据(隐式共享)时,下一帧换用新的缓冲,
+// 保留的数据不会被改写。接收缓冲只随数据到达增长,不按帧头声明的长度预先分配,
+// 只发帧头不发数据的连接不会占用大量内存;占用的容量见 capacity(),服务端按它记账。
+class FrameReader {
+public:
+    enum Status {
+        FRAME_READY,        // 取出了一帧,数据见 payload()
+        FRAME_INCOMPLETE,   // 数据不足一帧
+        FRAME_TOO_LARGE     // 帧头声明的长度超过上限
+    };
+
+    explicit FrameReader(BufferPool* pool = nullptr) : m_pool(pool) {}
+    ~FrameReader() { reset(); }
+
+    // 缓冲池须比本对象存活更久,应在读入数据前设置
+    void setPool(BufferPool* pool) { m_pool = pool; }
+
+    // 从设备读取至多 maxBytes 字节追加到缓冲,返回读到的字节数,出错返回-1
+    qint64 readFrom(QIODevice* device, qint64 maxBytes) {
+        reserve(int(available() + maxBytes));
+        int old = m_buffer.size();
+        m_buffer.resize(old + int(maxBytes));
+        qint64 n = device->read(m_buffer.data() + old, maxBytes);
+        m_buffer.resize(old + int(qMax<qint64>(0, n)));
+        return n;
+    }
+
+    void append(const char* data, int size) {
+        reserve(available() + size);
+        m_buffer.append(data, size);
+    }
+
+    // 取出下一帧,maxFrameSize 为数据长度上限
+    Status next(ProtocolHeader& header, qint64 maxFrameSize) {
+        const char* data = m_buffer.constData() + m_pos;
+        int size = available();
+        if (!Protocol::parseHeader(data, size, header)) {
+            return FRAME_INCOMPLETE;
+        }
+        if (header.dataLength > maxFrameSize) {
+            return FRAME_TOO_LARGE;
+        }
+        int frameSize = int(header.size + header.dataLength);
+        if (size < frameSize) {
+            return FRAME_INCOMPLETE;
+        }
+
+        // 上一帧的数据仍被处理函数保留着,换一块缓冲
+        if (!m_payload.isDetached() || m_payload.capacity() < int(header.dataLength)) {
+            release(m_payload);
+            m_payload = acquire(int(header.dataLength));
+        }
+        m_payload.truncate(0);
+        m_payload.append(data + header.size, int(header.dataLength));
+        m_pos += frameSize;
+        return FRAME_READY;
+    }
+
+    // 最近取出的一帧的数据,下次调用 next 前有效;需要保留时复制(隐式共享,不复制数据)
+    const QByteArray& payload() const { return m_payload; }
+
+    // 一批帧处理完,丢弃已取出的数据
+    void compact() {
+        if (m_pos == 0) return;
+        m_buffer.remove(0, m_pos);
+        m_pos = 0;
+        if (m_buffer.isEmpty() && m_buffer.capacity() > FRAME_READER_KEEP) {
+            release(m_buffer);
+            m_buffer = acquire(BUFFER_POOL_MIN_CLASS);
+        }
+        if (m_payload.capacity() > FRAME_READER_KEEP) {
+            release(m_payload);
+        }
+    }
+
+    // 尚未取出的字节数
+    int available() const { return m_buffer.size() - m_pos; }
+
+    // 接收缓冲和帧数据缓冲占用的容量
+    qint64 capacity() const { return qint64(m_buffer.capacity()) + m_payload.capacity(); }
+
+    // 再读入 incoming 字节需要新申请的容量,放得下时为0
+    qint64 growthFor(qint64 incoming) const {
+        qint64 needed = available() + incoming;
+        if (m_buffer.isDetached() && m_buffer.capacity() - m_pos >= needed) {
+            return 0;
+        }
+        int size = grownSize(int(needed));
+        return m_pool ? BufferPool::capacityFor(size) : size;
+    }
+
+    // 丢弃所有数据,缓冲交还缓冲池
+    void reset() {
+        release(m_buffer);
+        release(m_payload);
+        m_pos = 0;
+    }
+
+private:
+    // 保证未取出的数据加上新数据能放进缓冲,不够时换用更大级别的缓冲并搬移数据
+    void reserve(int needed) {
+        if (m_buffer.isDetached() && m_buffer.capacity() - m_pos >= needed) {
+            return;
+        }
+        QByteArray larger = acquire(grownSize(needed));
+        larger.append(m_buffer.constData() + m_pos, available());
+        release(m_buffer);
+        m_buffer = std::move(larger);
+        m_pos = 0;
+    }
+
+    // 超过缓冲池最大级别的缓冲至少增长一半,大帧逐块到达时搬移的总量与帧长成正比
+    int grownSize(int needed) const {
+        if (needed <= BufferPool::classSize(BUFFER_POOL_CLASSES - 1)) {
+            return needed;
+        }
+        return qMax(needed, available() + available() / 2);
+    }
+
+    QByteArray acquire(int capacity) {
+        if (m_pool) {
+            return m_pool->acquire(capacity);
+        }
+        QByteArray buffer;
+        buffer.reserve(capacity);
+        return buffer;
+    }
+
+    void release(QByteArray& buffer) {
+        if (m_pool) {
+            m_pool->release(buffer);
+        } else {
+            buffer = QByteArray();
+        }
+    }
+
+    BufferPool* m_pool;
+    QByteArray m_buffer;
+    QByteArray m_payload;
+    int m_pos = 0;
+};
+
+#endif // FRAMEREADER_H
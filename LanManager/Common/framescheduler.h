@@ -0,0 +1,344 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QAbstractSocket>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QSocketNotifier>
+#include <deque>
+#include <functional>
+#include "protocol.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+
+// 发送队列中允许积压的最大字节数
+// 超过后新帧留在调度队列里,控制消息最多只需等待这么多数据发完
+#define WRITE_HIGH_WATERMARK (128 * 1024)
+
+// 帧优先级,数值越小越优先
+enum FramePriority {
+    PRIORITY_CONTROL = 0,    // 心跳、安装/卸载命令和结果等控制消息
+    PRIORITY_INVENTORY,      // 系统信息、软件清单和遥测
+    PRIORITY_BULK,           // 文件数据
+    PRIORITY_COUNT
+};
+
+// 待发送的帧: 协议头放在帧内的定长数组里,数据与调用方共享(隐式共享,不复制)
+// 写入时头部和数据分两段交给套接字,省去 Protocol::pack 拼接整帧的那次复制
+// 设置了 file 时数据是文件中的一段,发送时才读取(Linux下由内核直接发送)
+struct OutgoingFrame {
+    char header[Protocol::MAX_HEADER_SIZE];
+    int headerSize = 0;
+    CommandType cmd = CMD_ERROR;
+    quint32 requestId = 0;
+    QByteArray payload;
+
+    QSharedPointer<QFile> file;
+    qint64 fileOffset = 0;
+    qint64 fileLength = 0;
+
+    OutgoingFrame() = default;
+    OutgoingFrame(CommandType cmd, const QByteArray& data, quint32 requestId, quint8 flags)
+        : headerSize(Protocol::writeHeader(header, cmd, quint32(data.size()), requestId, flags))
+        , cmd(cmd), requestId(requestId), payload(data) {}
+    OutgoingFrame(CommandType cmd, const QSharedPointer<QFile>& f, qint64 offset, qint64 length,
+                  quint32 requestId, quint8 flags)
+        : headerSize(Protocol::writeHeader(header, cmd, quint32(length), requestId, flags))
+        , cmd(cmd), requestId(requestId), file(f), fileOffset(offset), fileLength(length) {}
+
+    qint64 payloadSize() const { return file ? fileLength : payload.size(); }
+    qint64 size() const { return headerSize + payloadSize(); }
+};
+
+// 按优先级和逻辑流调度待发送的帧
+//
+// 同一条TCP连接上的帧按优先级分为几类,高优先级的帧总是先发;
+// 同一优先级内按流(请求号)轮流各发一帧,多个文件同时传输时互不饿死。
+// 同一个流内的帧保持发送顺序。
+//
+// Linux下文件帧绕过 QTcpSocket 的缓冲: 等套接字缓冲清空后,头部用 send 写入,
+// 数据用 sendfile 由内核从页缓存直接发送。内核缓冲写满时记下发送进度,
+// 等套接字可写后再继续,期间不发送其他帧,保证帧的完整性。这段时间 QTcpSocket
+// 自己的缓冲为空,它的写通知是关闭的,不会和这里的可写通知冲突。
+class FrameScheduler {
+public:
+    FrameScheduler() = default;
+    ~FrameScheduler() { delete m_notifier.data(); }
+
+    // 命令对应的优先级
+    static FramePriority priorityOf(CommandType cmd) {
+        switch (cmd) {
+        case CMD_FILE_TRANSFER_DATA:
+        case CMD_FILE_TRANSFER_END:    // 必须排在同一个流的数据之后
+            return PRIORITY_BULK;
+        case CMD_GET_SYSINFO:
+        case CMD_SYSINFO_RESPONSE:
+        case CMD_GET_SOFTWARE:
+        case CMD_SOFTWARE_RESPONSE:
+        case CMD_INVENTORY_CHANGED:
+        case CMD_TELEMETRY_BATCH:
+        case CMD_AGENT_STATS:
+        case CMD_EXEC_OUTPUT:
+        case CMD_EXEC_RESULT:          // 必须排在同一个作业的输出之后
+            return PRIORITY_INVENTORY;
+        default:
+            return PRIORITY_CONTROL;
+        }
+    }
+
+    // 内核发送的帧因缓冲已满而暂停后,套接字重新可写时的回调,用于继续发送和补充数据
+    void setWritableHandler(const std::function<void()>& handler) { m_onWritable = handler; }
+
+    // 一帧完整写入套接字(或内核)后的回调,用于跟踪记录;回调中不能再操作本队列
+    void setSentHandler(const std::function<void(const OutgoingFrame&)>& handler) { m_onSent = handler; }
+
+    // 加入一帧,优先级由命令决定,流为请求号
+    void enqueue(CommandType cmd, const QByteArray& data, quint32 requestId = 0, quint8 flags = 0) {
+        push(priorityOf(cmd), requestId, OutgoingFrame(cmd, data, requestId, flags));
+    }
+
+    // 加入以文件区间为数据的帧
+    void enqueueFile(CommandType cmd, const QSharedPointer<QFile>& file, qint64 offset, qint64 length,
+                     quint32 requestId = 0, quint8 flags = 0) {
+        push(priorityOf(cmd), requestId, OutgoingFrame(cmd, file, offset, length, requestId, flags));
+    }
+
+    // 加入一帧并写出,与 enqueue 后 flush 的结果相同
+    // 队列为空且套接字缓冲未到水位线时直接写入,不经过队列,心跳响应这类控制消息不为排队分配内存
+    void send(QAbstractSocket* socket, CommandType cmd, const QByteArray& data,
+              quint32 requestId = 0, quint8 flags = 0) {
+        if (m_broken || !isEmpty() || socket->bytesToWrite() >= WRITE_HIGH_WATERMARK) {
+            enqueue(cmd, data, requestId, flags);
+            flush(socket);
+            return;
+        }
+        OutgoingFrame frame(cmd, data, requestId, flags);
+        socket->write(frame.header, frame.headerSize);
+        if (!frame.payload.isEmpty()) {
+            socket->write(frame.payload.constData(), frame.payload.size());
+        }
+        if (m_onSent) {
+            m_onSent(frame);
+        }
+    }
+
+    // 取出下一个应当发送的帧
+    bool dequeue(OutgoingFrame& frame) {
+        Class* c = nextClass();
+        if (!c) return false;
+
+        quint32 stream = c->order.takeFirst();
+        auto it = c->streams.find(stream);
+        frame = std::move(it->front());
+        it->pop_front();
+        if (it->empty()) {
+            c->streams.erase(it);
+        } else {
+            c->order.append(stream);  // 轮到队尾
+        }
+        m_pendingBytes -= frame.size();
+        return true;
+    }
+
+    // 把帧写入套接字,直到套接字的发送缓冲达到水位线,返回写入的帧数
+    // 头部和数据分别写入,数据只在进入套接字缓冲时复制一次
+    int flush(QAbstractSocket* socket, qint64 highWatermark = WRITE_HIGH_WATERMARK) {
+        int written = 0;
+        OutgoingFrame frame;
+        while (!m_broken) {
+            // 上一个内核发送的帧还没写完
+            if (m_inflight.file && !continueKernelSend(socket)) {
+                break;
+            }
+            if (socket->bytesToWrite() >= highWatermark) {
+                break;
+            }
+            const OutgoingFrame* next = peek();
+            if (!next) {
+                break;
+            }
+            if (next->file && canKernelSend(socket)) {
+                // 等 QTcpSocket 缓冲里的数据先写完,避免乱序
+                if (socket->bytesToWrite() > 0) {
+                    break;
+                }
+                dequeue(m_inflight);
+                m_inflightSent = 0;
+                written++;
+                continue;
+            }
+
+            dequeue(frame);
+            socket->write(frame.header, frame.headerSize);
+            if (frame.file) {
+                if (!writeFileRegion(socket, frame)) {
+                    fail(socket);
+                    break;
+                }
+            } else if (!frame.payload.isEmpty()) {
+                socket->write(frame.payload.constData(), frame.payload.size());
+            }
+            if (m_onSent) {
+                m_onSent(frame);
+            }
+            written++;
+        }
+        return written;
+    }
+
+    // 指定流中尚未写入套接字的帧数
+    int pendingFrames(FramePriority priority, quint32 stream) const {
+        auto it = m_classes[priority].streams.constFind(stream);
+        return it == m_classes[priority].streams.constEnd() ? 0 : int(it->size());
+    }
+
+    qint64 pendingBytes() const { return m_pendingBytes; }
+    bool isEmpty() const { return !m_inflight.file && !nextClass(); }
+
+    void clear() {
+        for (Class& c : m_classes) {
+            c.streams.clear();
+            c.order.clear();
+        }
+        m_pendingBytes = 0;
+        m_inflight = OutgoingFrame();
+        m_broken = false;
+        if (m_notifier) {
+            m_notifier->setEnabled(false);
+        }
+    }
+
+    // 换用新连接前调用: 清空队列,丢弃旧套接字的可写通知和回调
+    void reset() {
+        clear();
+        delete m_notifier.data();
+        m_inflightSent = 0;
+        m_onWritable = nullptr;
+        m_onSent = nullptr;
+    }
+
+private:
+    struct Class {
+        QHash<quint32, std::deque<OutgoingFrame>> streams;  // 按流排队的帧
+        QList<quint32> order;                        // 有待发帧的流,按轮转顺序
+    };
+
+    void push(FramePriority priority, quint32 stream, OutgoingFrame&& frame) {
+        Class& c = m_classes[priority];
+        std::deque<OutgoingFrame>& queue = c.streams[stream];
+        if (queue.empty()) {
+            c.order.append(stream);
+        }
+        m_pendingBytes += frame.size();
+        queue.push_back(std::move(frame));
+    }
+
+    Class* nextClass() const {
+        for (const Class& c : m_classes) {
+            if (!c.order.isEmpty()) return const_cast<Class*>(&c);
+        }
+        return nullptr;
+    }
+
+    const OutgoingFrame* peek() const {
+        Class* c = nextClass();
+        return c ? &c->streams.find(c->order.first())->front() : nullptr;
+    }
+
+    // 缓冲方式发送文件区间
+    static bool writeFileRegion(QAbstractSocket* socket, const OutgoingFrame& frame) {
+        if (!frame.file->seek(frame.fileOffset)) return false;
+        QByteArray data = frame.file->read(frame.fileLength);
+        if (data.size() != frame.fileLength) return false;
+        socket->write(data);
+        return true;
+    }
+
+    // 帧只写了一部分,连接上的数据已无法解析,只能断开
+    // 断开放到事件循环里做,调用方可能正持有本对象
+    void fail(QAbstractSocket* socket) {
+        m_broken = true;
+        m_inflight = OutgoingFrame();
+        QMetaObject::invokeMethod(socket, "abort", Qt::QueuedConnection);
+    }
+
+#ifdef Q_OS_LINUX
+    bool canKernelSend(QAbstractSocket* socket) const {
+        return socket->socketDescriptor() != -1 && socket->state() == QAbstractSocket::ConnectedState;
+    }
+
+    // 继续发送 m_inflight,全部写完返回true;内核缓冲已满返回false并等待可写通知
+    bool continueKernelSend(QAbstractSocket* socket) {
+        int fd = int(socket->socketDescriptor());
+        qint64 total = m_inflight.size();
+        while (m_inflightSent < total) {
+            ssize_t n;
+            if (m_inflightSent < m_inflight.headerSize) {
+                n = ::send(fd, m_inflight.header + m_inflightSent,
+                           size_t(m_inflight.headerSize - m_inflightSent), MSG_NOSIGNAL | MSG_MORE);
+            } else {
+                off_t offset = off_t(m_inflight.fileOffset + m_inflightSent - m_inflight.headerSize);
+                n = ::sendfile(fd, m_inflight.file->handle(), &offset, size_t(total - m_inflightSent));
+            }
+            if (n > 0) {
+                m_inflightSent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                waitWritable(socket, fd);
+                return false;
+            }
+            // 发送出错或文件被截断
+            fail(socket);
+            return false;
+        }
+        if (m_onSent) {
+            m_onSent(m_inflight);
+        }
+        m_inflight = OutgoingFrame();
+        return true;
+    }
+
+    void waitWritable(QAbstractSocket* socket, int fd) {
+        if (!m_notifier) {
+            m_notifier = new QSocketNotifier(fd, QSocketNotifier::Write, socket);
+            QObject::connect(m_notifier.data(), &QSocketNotifier::activated, socket, [this]() {
+                m_notifier->setEnabled(false);
+                if (m_onWritable) {
+                    m_onWritable();
+                }
+            });
+        }
+        m_notifier->setEnabled(true);
+    }
+#else
+    bool canKernelSend(QAbstractSocket*) const { return false; }
+    bool continueKernelSend(QAbstractSocket*) { return true; }
+#endif
+
+    Class m_classes[PRIORITY_COUNT];
+    qint64 m_pendingBytes = 0;
+
+    // 正在由内核发送的文件帧
+    OutgoingFrame m_inflight;
+    qint64 m_inflightSent = 0;
+    bool m_broken = false;
+    QPointer<QSocketNotifier> m_notifier;
+    std::function<void()> m_onWritable;
+    std::function<void(const OutgoingFrame&)> m_onSent;
+
+    Q_DISABLE_COPY(FrameScheduler)
+};
+
+#endif // FRAMESCHEDULER_H
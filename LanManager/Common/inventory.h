@@ -0,0 +1,106 @@
+#ifndef INVENTORY_H
+#define INVENTORY_H
+
+#include <QCryptographicHash>
+#include <QSet>
+#include <QStringList>
+#include <algorithm>
+#include "protocol.h"
+
+// 软件清单工具: 唯一键、摘要和差异计算
+class Inventory {
+public:
+    // 软件唯一键(名称+版本)
+    static QString key(const SoftwareInfo& info) {
+        return info.name + QChar(0x1F) + info.version;
+    }
+
+    // 清单摘要,与顺序无关
+    static QByteArray hash(const QList<SoftwareInfo>& list) {
+        QStringList entries;
+        entries.reserve(list.size());
+        for (const SoftwareInfo& info : list) {
+            entries.append(key(info) + QChar(0x1F) + info.publisher + QChar(0x1F) +
+                           info.installDate + QChar(0x1F) + info.installPath + QChar(0x1F) +
+                           info.uninstallCmd);
+        }
+        std::sort(entries.begin(), entries.end());
+
+        QCryptographicHash h(QCryptographicHash::Sha1);
+        for (const QString& entry : entries) {
+            h.addData(entry.toUtf8());
+            h.addData("\n", 1);
+        }
+        return h.result().toHex();
+    }
+
+    // 计算从 base 到 current 的差异
+    // added 包含新增和内容变化的条目, removed 为被删除条目的唯一键
+    static void diff(const QList<SoftwareInfo>& base, const QList<SoftwareInfo>& current,
+                     QList<SoftwareInfo>& added, QStringList& removed) {
+        QHash<QString, const SoftwareInfo*> baseMap;
+        baseMap.reserve(base.size());
+        for (const SoftwareInfo& info : base) {
+            baseMap.insert(key(info), &info);
+        }
+
+        QSet<QString> seen;
+        seen.reserve(current.size());
+        for (const SoftwareInfo& info : current) {
+            QString k = key(info);
+            seen.insert(k);
+            const SoftwareInfo* old = baseMap.value(k, nullptr);
+            if (!old || old->publisher != info.publisher || old->installDate != info.installDate ||
+                old->installPath != info.installPath || old->uninstallCmd != info.uninstallCmd) {
+                added.append(info);
+            }
+        }
+        for (auto it = baseMap.constBegin(); it != baseMap.constEnd(); ++it) {
+            if (!seen.contains(it.key())) {
+                removed.append(it.key());
+            }
+        }
+    }
+
+    // 把差异应用到 base 上
+    static QList<SoftwareInfo> apply(const QList<SoftwareInfo>& base,
+                                     const QList<SoftwareInfo>& added, const QStringList& removed) {
+        QSet<QString> drop(removed.begin(), removed.end());
+        for (const SoftwareInfo& info : added) {
+            drop.insert(key(info));
+        }
+
+        QList<SoftwareInfo> result;
+        result.reserve(base.size() + added.size());
+        for (const SoftwareInfo& info : base) {
+            if (!drop.contains(key(info))) {
+                result.append(info);
+            }
+        }
+        result.append(added);
+        return result;
+    }
+
+    // 差异的JSON表示
+    static QJsonObject diffToJson(const QList<SoftwareInfo>& added, const QStringList& removed) {
+        QJsonArray addedArr;
+        for (const SoftwareInfo& info : added) {
+            addedArr.append(info.toJson());
+        }
+        QJsonObject json;
+        json["added"] = addedArr;
+        json["removed"] = QJsonArray::fromStringList(removed);
+        return json;
+    }
+
+    static void diffFromJson(const QJsonObject& json, QList<SoftwareInfo>& added, QStringList& removed) {
+        for (const QJsonValue& val : json["added"].toArray()) {
+            added.append(SoftwareInfo::fromJson(val.toObject()));
+        }
+        for (const QJsonValue& val : json["removed"].toArray()) {
+            removed.append(val.toString());
+        }
+    }
+};
+
+#endif // INVENTORY_H
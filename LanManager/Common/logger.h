@@ -0,0 +1,456 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// 日志级别
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+// 编译期最低级别: 低于它的日志语句连同参数求值一起被编译器去掉
+// Release 默认不编译调试日志,需要时在 .pro 中加 DEFINES += LANMGR_LOG_MIN_LEVEL=0
+#ifndef LANMGR_LOG_MIN_LEVEL
+#ifdef QT_NO_DEBUG
+#define LANMGR_LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LANMGR_LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+// 日志队列槽位数(必须是2的幂),写满时丢弃新日志并计数
+#define LOG_QUEUE_SIZE 4096
+
+// 每条日志最多携带的参数个数
+#define LOG_MAX_ARGS 6
+
+// 写入线程在队列为空时的休眠间隔(毫秒)
+#define LOG_IDLE_MS 20
+
+// 日志文件达到该大小后轮转,保留的历史文件数
+#define LOG_ROTATE_SIZE (16 * 1024 * 1024)
+#define LOG_ROTATE_KEEP 5
+
+// 级别名称,用于日志文件和命令行参数
+inline QString logLevelName(int level)
+{
+    switch (level) {
+    case LOG_LEVEL_DEBUG: return "debug";
+    case LOG_LEVEL_INFO: return "info";
+    case LOG_LEVEL_WARN: return "warn";
+    default: return "error";
+    }
+}
+
+// 日志参数: 整数、浮点数和字符串按值保存,格式化推迟到写入线程
+// QString 是隐式共享的,保存时只增加引用计数
+class LogArg {
+public:
+    LogArg() = default;
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, int>::type = 0>
+    LogArg(T value) : m_type(Int) { m_int = qint64(value); }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, int>::type = 0>
+    LogArg(T value) : m_type(UInt) { m_uint = quint64(value); }
+
+    LogArg(double value) : m_type(Double) { m_double = value; }
+    LogArg(const QString& value) : m_type(String), m_string(value) {}
+    LogArg(QString&& value) : m_type(String), m_string(std::move(value)) {}
+    LogArg(const char* value) : m_type(String), m_string(QString::fromUtf8(value)) {}
+    LogArg(const QByteArray& value) : m_type(String), m_string(QString::fromUtf8(value)) {}
+
+    // 替换 text 中编号最小的 %n,与 QString::arg 相同
+    QString apply(const QString& text) const {
+        switch (m_type) {
+        case Int: return text.arg(m_int);
+        case UInt: return text.arg(m_uint);
+        case Double: return text.arg(m_double);
+        default: return text.arg(m_string);
+        }
+    }
+
+    QJsonValue toJson() const {
+        switch (m_type) {
+        case Int: return QJsonValue(m_int);
+        case UInt: return QJsonValue(qint64(m_uint));
+        case Double: return QJsonValue(m_double);
+        default: return QJsonValue(m_string);
+        }
+    }
+
+private:
+    enum Type { Int, UInt, Double, String };
+    Type m_type = String;
+    union {
+        qint64 m_int;
+        quint64 m_uint;
+        double m_double;
+    };
+    QString m_string;
+};
+
+// 一条日志,类别和格式必须是字符串常量(只保存指针)
+struct LogRecord {
+    qint64 time = 0;                // UTC毫秒
+    int level = LOG_LEVEL_INFO;
+    const char* category = "";
+    const char* format = "";        // %1..%n 依次对应参数
+    int argc = 0;
+    LogArg args[LOG_MAX_ARGS];
+
+    QString message() const {
+        QString text = QString::fromUtf8(format);
+        for (int i = 0; i < argc; ++i) {
+            text = args[i].apply(text);
+        }
+        return text;
+    }
+};
+
+// 有界多生产者队列(每个槽位带序号,生产者用CAS占位,不加锁)
+// 只有写入线程消费
+class LogQueue {
+public:
+    LogQueue() {
+        for (size_t i = 0; i < LOG_QUEUE_SIZE; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // 队列满时返回false
+    bool push(LogRecord& record) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = m_cells[pos & (LOG_QUEUE_SIZE - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            qintptr diff = qintptr(sequence) - qintptr(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.record = std::move(record);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(LogRecord& record) {
+        Cell& cell = m_cells[m_head & (LOG_QUEUE_SIZE - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != m_head + 1) return false;
+        record = std::move(cell.record);
+        cell.sequence.store(m_head + LOG_QUEUE_SIZE, std::memory_order_release);
+        m_head++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    Cell m_cells[LOG_QUEUE_SIZE];
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) size_t m_head = 0;
+};
+
+// 日志输出,只在写入线程(未启动写入线程时在调用线程,由 Logger 加锁)调用
+class LogSink {
+public:
+    explicit LogSink(int level) : m_level(level) {}
+    virtual ~LogSink() {}
+
+    int level() const { return m_level; }
+    virtual void write(const LogRecord& record, const QString& message) = 0;
+    virtual void flush() {}
+
+private:
+    int m_level;
+};
+
+// 控制台输出 "[类别] 消息",经过Qt的消息处理
+class ConsoleLogSink : public LogSink {
+public:
+    explicit ConsoleLogSink(int level = LOG_LEVEL_DEBUG) : LogSink(level) {}
+
+    void write(const LogRecord& record, const QString& message) override {
+        QString line = QString("[%1] %2").arg(QLatin1String(record.category), message);
+        switch (record.level) {
+        case LOG_LEVEL_DEBUG: qDebug().noquote() << line; break;
+        case LOG_LEVEL_INFO: qInfo().noquote() << line; break;
+        case LOG_LEVEL_WARN: qWarning().noquote() << line; break;
+        default: qCritical().noquote() << line; break;
+        }
+    }
+};
+
+// 每行一个JSON对象的日志文件,除消息外保留格式和参数,便于按消息模板统计
+// 超过大小后轮转: path -> path.1 -> ... -> path.N,最早的删除
+class JsonLogFile : public LogSink {
+public:
+    explicit JsonLogFile(const QString& path, int level = LOG_LEVEL_DEBUG,
+                         qint64 rotateSize = LOG_ROTATE_SIZE, int keep = LOG_ROTATE_KEEP)
+        : LogSink(level), m_rotateSize(rotateSize), m_keep(keep) {
+        m_file.setFileName(path);
+    }
+
+    bool open() {
+        QDir().mkpath(QFileInfo(m_file.fileName()).absolutePath());
+        return m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    QString errorString() const { return m_file.errorString(); }
+
+    void write(const LogRecord& record, const QString& message) override {
+        if (!m_file.isOpen()) return;
+
+        QJsonObject json;
+        json["time"] = QDateTime::fromMSecsSinceEpoch(record.time).toString(Qt::ISODateWithMs);
+        json["level"] = logLevelName(record.level);
+        json["cat"] = QLatin1String(record.category);
+        json["msg"] = message;
+        if (record.argc > 0) {
+            QJsonArray args;
+            for (int i = 0; i < record.argc; ++i) {
+                args.append(record.args[i].toJson());
+            }
+            json["fmt"] = QString::fromUtf8(record.format);
+            json["args"] = args;
+        }
+        m_file.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+        m_file.write("\n", 1);
+
+        if (m_file.size() >= m_rotateSize) {
+            rotate();
+        }
+    }
+
+    void flush() override { m_file.flush(); }
+
+private:
+    void rotate() {
+        QString path = m_file.fileName();
+        m_file.close();
+        QFile::remove(QString("%1.%2").arg(path).arg(m_keep));
+        for (int i = m_keep - 1; i >= 1; --i) {
+            QFile::rename(QString("%1.%2").arg(path).arg(i), QString("%1.%2").arg(path).arg(i + 1));
+        }
+        QFile::rename(path, path + ".1");
+        m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    QFile m_file;
+    qint64 m_rotateSize;
+    int m_keep;
+};
+
+// 把格式化后的日志交给回调(例如转发到界面线程)
+class CallbackLogSink : public LogSink {
+public:
+    typedef std::function<void(const LogRecord&, const QString&)> Callback;
+
+    CallbackLogSink(int level, Callback callback) : LogSink(level), m_callback(std::move(callback)) {}
+
+    void write(const LogRecord& record, const QString& message) override { m_callback(record, message); }
+
+private:
+    Callback m_callback;
+};
+
+// 结构化异步日志
+//
+// 日志语句只把时间、级别、格式指针和参数放进无锁队列,由写入线程格式化并写到各个输出,
+// 网络线程不做字符串拼接和文件/控制台IO。低于运行时级别的语句只比较一次整数,
+// 低于编译期级别(LANMGR_LOG_MIN_LEVEL)的语句不会被编译。
+// 写入线程启动前(以及工具程序不启动时)日志在调用线程同步输出。
+class Logger {
+public:
+    static bool isEnabled(int level) { return level >= levelFlag().load(std::memory_order_relaxed); }
+    static void setLevel(int level) { levelFlag().store(level, std::memory_order_relaxed); }
+    static int level() { return levelFlag().load(std::memory_order_relaxed); }
+
+    // "debug"/"info"/"warn"/"error",无法识别时返回 fallback
+    static int levelFromName(const QString& name, int fallback) {
+        for (int level = LOG_LEVEL_DEBUG; level <= LOG_LEVEL_ERROR; ++level) {
+            if (name.compare(logLevelName(level), Qt::CaseInsensitive) == 0) return level;
+        }
+        return fallback;
+    }
+
+    // 添加输出,Logger 接管所有权
+    static void addSink(LogSink* sink) {
+        Logger& logger = instance();
+        QMutexLocker locker(&logger.m_sinkMutex);
+        logger.m_sinks.append(sink);
+    }
+
+    // 启动写入线程
+    static void start() {
+        Logger& logger = instance();
+        if (logger.m_thread) return;
+        if (!logger.m_queue) {
+            logger.m_queue = new LogQueue;
+        }
+        logger.m_running.store(true, std::memory_order_release);
+        logger.m_thread = QThread::create([&logger]() { logger.run(); });
+        logger.m_thread->start(QThread::LowPriority);
+    }
+
+    // 写完队列中的日志后停止写入线程,之后的日志同步输出
+    // 队列保留到进程退出,停止前已读到"运行中"的其他线程仍可以安全写入
+    static void stop() {
+        Logger& logger = instance();
+        if (!logger.m_thread) return;
+        logger.m_running.store(false, std::memory_order_release);
+        logger.m_thread->wait();
+        delete logger.m_thread;
+        logger.m_thread = nullptr;
+        logger.drain();
+        logger.flushSinks();
+    }
+
+    // 队列满被丢弃的日志数
+    static qint64 dropped() { return instance().m_dropped.load(std::memory_order_relaxed); }
+
+    template <typename... Args>
+    static void write(int level, const char* category, const char* format, Args&&... args) {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "日志参数过多");
+        LogRecord record;
+        record.time = QDateTime::currentMSecsSinceEpoch();
+        record.level = level;
+        record.category = category;
+        record.format = format;
+        record.argc = int(sizeof...(Args));
+        LogArg* out = record.args;
+        using expand = int[];
+        (void)expand{0, ((*out++ = LogArg(std::forward<Args>(args))), 0)...};
+        (void)out;
+
+        Logger& logger = instance();
+        if (logger.m_running.load(std::memory_order_acquire)) {
+            if (!logger.m_queue->push(record)) {
+                logger.m_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+        logger.dispatch(record);
+        logger.flushSinks();
+    }
+
+private:
+    Logger() {}
+    ~Logger() {
+        stop();
+        qDeleteAll(m_sinks);
+        delete m_queue;
+    }
+
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    static std::atomic<int>& levelFlag() {
+        static std::atomic<int> level{LOG_LEVEL_INFO};
+        return level;
+    }
+
+    void run() {
+        while (true) {
+            bool stopping = !m_running.load(std::memory_order_acquire);
+            if (drain() > 0) continue;
+            flushSinks();
+            if (stopping) break;
+            QThread::msleep(LOG_IDLE_MS);
+        }
+    }
+
+    // 处理队列中已有的日志,返回条数
+    int drain() {
+        int count = 0;
+        LogRecord record;
+        while (m_queue && m_queue->pop(record)) {
+            dispatch(record);
+            count++;
+        }
+
+        qint64 dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != m_reportedDropped) {
+            LogRecord warning;
+            warning.time = QDateTime::currentMSecsSinceEpoch();
+            warning.level = LOG_LEVEL_WARN;
+            warning.category = "log";
+            warning.format = "日志队列已满,丢弃 %1 条";
+            warning.argc = 1;
+            warning.args[0] = LogArg(dropped - m_reportedDropped);
+            m_reportedDropped = dropped;
+            dispatch(warning);
+        }
+        return count;
+    }
+
+    void dispatch(const LogRecord& record) {
+        QMutexLocker locker(&m_sinkMutex);
+        QString message;
+        for (LogSink* sink : m_sinks) {
+            if (record.level < sink->level()) continue;
+            if (message.isNull()) {
+                message = record.message();
+            }
+            sink->write(record, message);
+        }
+    }
+
+    void flushSinks() {
+        QMutexLocker locker(&m_sinkMutex);
+        for (LogSink* sink : m_sinks) {
+            sink->flush();
+        }
+    }
+
+    QMutex m_sinkMutex;
+    QList<LogSink*> m_sinks;
+    LogQueue* m_queue = nullptr;
+    QThread* m_thread = nullptr;
+    std::atomic<bool> m_running{false};
+    std::atomic<qint64> m_dropped{0};
+    qint64 m_reportedDropped = 0;
+};
+
+// 日志语句,参数只在该级别开启时求值
+#define LOG_AT(level, category, ...) \
+    do { \
+        if ((level) >= LANMGR_LOG_MIN_LEVEL && Logger::isEnabled(level)) { \
+            Logger::write((level), (category), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(category, ...) LOG_AT(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_WARN(category, ...) LOG_AT(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG_AT(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+
+#endif // LOGGER_H
@@ -0,0 +1,153 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <QByteArray>
+#include <QVector>
+#include <new>
+
+// 对象池每次向系统申请的对象个数
+#define OBJECT_POOL_SLAB 64
+
+// 缓冲池的尺寸级别: 从4KB起每级乘4,最大16MB;更大的缓冲不回收
+#define BUFFER_POOL_MIN_CLASS (4 * 1024)
+#define BUFFER_POOL_CLASSES 7
+
+// 缓冲池中空闲缓冲的总字节数上限,超过后交还的缓冲直接释放
+#define BUFFER_POOL_MAX_BYTES (32 * 1024 * 1024)
+
+// 定长对象池
+//
+// 对象的存储按 OBJECT_POOL_SLAB 个一块向系统申请。交还的对象不析构,调用 T::reset() 清空
+// 后留在池中,下次 acquire() 直接取出,对象内部容器已分配的容量随之复用;reset() 须把对象
+// 恢复到与新构造的对象等价的状态。池本身只增不减,所有对象在池析构时才析构。
+// acquire/release 只能在同一线程调用。池析构前所有对象必须已经 release。
+template <typename T>
+class ObjectPool {
+public:
+    ObjectPool() = default;
+    ~ObjectPool() {
+        for (T* object : m_free) {
+            object->~T();
+        }
+        for (Slot* slab : m_slabs) {
+            delete[] slab;
+        }
+    }
+
+    // 取得一个对象: 优先取回收的对象,没有时在新槽位上默认构造
+    T* acquire() {
+        m_live++;
+        if (!m_free.isEmpty()) {
+            return m_free.takeLast();
+        }
+        if (m_constructed == capacity()) {
+            m_slabs.append(new Slot[OBJECT_POOL_SLAB]);
+        }
+        Slot* slot = &m_slabs.last()[m_constructed % OBJECT_POOL_SLAB];
+        m_constructed++;
+        return new (slot->storage) T();
+    }
+
+    // 交还对象,清空后留在池中
+    void release(T* object) {
+        if (!object) return;
+        object->reset();
+        m_free.append(object);
+        m_live--;
+    }
+
+    int live() const { return m_live; }
+    int capacity() const { return m_slabs.size() * OBJECT_POOL_SLAB; }
+
+private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    QVector<Slot*> m_slabs;
+    QVector<T*> m_free;       // 已构造、等待复用的对象
+    int m_constructed = 0;    // 已构造过对象的槽位数
+    int m_live = 0;
+
+    Q_DISABLE_COPY(ObjectPool)
+};
+
+// 按尺寸级别回收的 QByteArray 缓冲池
+//
+// 取出的缓冲为空且已 reserve 到所在级别的容量,之后 resize/truncate/remove 都不会释放或
+// 重新申请内存,只有写入超过容量时才会增长。交还时仍被其他地方共享的缓冲不回收(共享者
+// 持有的数据不能被改写),按容量向下归入级别。只能在同一线程使用。
+class BufferPool {
+public:
+    // 取得容量至少为 minCapacity 的空缓冲
+    QByteArray acquire(int minCapacity) {
+        int cls = classFor(minCapacity);
+        if (cls < BUFFER_POOL_CLASSES && !m_free[cls].isEmpty()) {
+            QByteArray buffer = m_free[cls].takeLast();
+            m_freeBytes -= buffer.capacity();
+            m_hits++;
+            return buffer;
+        }
+        m_misses++;
+        QByteArray buffer;
+        buffer.reserve(cls < BUFFER_POOL_CLASSES ? classSize(cls) : minCapacity);
+        return buffer;
+    }
+
+    // 交还缓冲,之后 buffer 为空
+    void release(QByteArray& buffer) {
+        int capacity = buffer.capacity();
+        if (buffer.isDetached() && capacity >= BUFFER_POOL_MIN_CLASS
+            && m_freeBytes + capacity <= BUFFER_POOL_MAX_BYTES) {
+            int cls = BUFFER_POOL_CLASSES - 1;
+            while (cls > 0 && classSize(cls) > capacity) {
+                cls--;
+            }
+            // 追加增长过的缓冲没有保留容量的标记,先补上,清空时才不会释放
+            buffer.reserve(capacity);
+            buffer.truncate(0);
+            m_freeBytes += capacity;
+            m_free[cls].append(std::move(buffer));
+        }
+        buffer = QByteArray();
+    }
+
+    // 从大到小释放空闲缓冲,直到空闲总字节数不超过 keepBytes
+    void trim(qint64 keepBytes) {
+        for (int cls = BUFFER_POOL_CLASSES - 1; cls >= 0 && m_freeBytes > keepBytes; --cls) {
+            while (!m_free[cls].isEmpty() && m_freeBytes > keepBytes) {
+                m_freeBytes -= m_free[cls].last().capacity();
+                m_free[cls].removeLast();
+            }
+        }
+    }
+
+    qint64 freeBytes() const { return m_freeBytes; }
+    quint64 hits() const { return m_hits; }
+    quint64 misses() const { return m_misses; }
+
+    static int classSize(int cls) { return BUFFER_POOL_MIN_CLASS << (2 * cls); }
+
+    // acquire(minCapacity) 取得的缓冲的容量
+    static int capacityFor(int minCapacity) {
+        int cls = classFor(minCapacity);
+        return cls < BUFFER_POOL_CLASSES ? classSize(cls) : minCapacity;
+    }
+
+private:
+    // 能放下 size 字节的最小级别,超过最大级别时返回 BUFFER_POOL_CLASSES
+    static int classFor(int size) {
+        int cls = 0;
+        while (cls < BUFFER_POOL_CLASSES && classSize(cls) < size) {
+            cls++;
+        }
+        return cls;
+    }
+
+    QVector<QByteArray> m_free[BUFFER_POOL_CLASSES];
+    qint64 m_freeBytes = 0;
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+};
+
+#endif // OBJECTPOOL_H
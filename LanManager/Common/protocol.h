@@ -7,6 +7,8 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QtEndian>
+#include <cstring>
 
 // 默认端口
 #define DEFAULT_PORT 8899
@@ -20,12 +22,34 @@
 // UDP广播标识
 #define BROADCAST_MAGIC "LANMGR_SERVER"
 
+// 服务端广播最大间隔(已知客户端全部在线时逐步退避到此值,毫秒)
+#define BROADCAST_MAX_INTERVAL 60000
+
+// UDP探测端口(服务端接收客户端探测并单播回复)
+#define DISCOVERY_PORT 8897
+
+// UDP探测标识
+#define PROBE_MAGIC "LANMGR_PROBE"
+
+// 客户端探测间隔(未连接时从最小值开始指数退避,毫秒)
+#define PROBE_MIN_INTERVAL 1000
+#define PROBE_MAX_INTERVAL 30000
+
 // 心跳间隔(毫秒)
 #define HEARTBEAT_INTERVAL 5000
 
 // 心跳超时(毫秒)
 #define HEARTBEAT_TIMEOUT 15000
 
+// 遥测默认采样间隔(毫秒)
+#define TELEMETRY_INTERVAL 2000
+
+// 遥测默认批量大小(每帧包含的样本数)
+#define TELEMETRY_BATCH_SIZE 5
+
+// 安装/卸载结果中没有退出码时的取值(安装程序没有运行、超时或崩溃,或旧版客户端不上报)
+#define NO_EXIT_CODE (-2147483647 - 1)
+
 // 命令类型枚举
 enum CommandType {
     CMD_HEARTBEAT = 0x0001,          // 心跳包
@@ -34,6 +58,7 @@ enum CommandType {
     CMD_SYSINFO_RESPONSE = 0x0011,   // 系统信息响应
     CMD_GET_SOFTWARE = 0x0020,       // 获取已安装软件列表
     CMD_SOFTWARE_RESPONSE = 0x0021,  // 软件列表响应
+    CMD_INVENTORY_CHANGED = 0x0022,  // 软件清单变化(客户端主动推送)
     CMD_INSTALL_SOFTWARE = 0x0030,   // 安装软件
     CMD_INSTALL_RESPONSE = 0x0031,   // 安装结果响应
     CMD_UNINSTALL_SOFTWARE = 0x0040, // 卸载软件
@@ -43,14 +68,40 @@ enum CommandType {
     CMD_FILE_TRANSFER_END = 0x0052,  // 文件传输结束
     CMD_FILE_TRANSFER_ACK = 0x0053,  // 文件传输确认
     CMD_CLIENT_INFO = 0x0060,        // 客户端基本信息(连接时发送)
+    CMD_CLIENT_MOVING = 0x0061,      // 客户端迁移到其他服务器(断开前发送)
+    CMD_TELEMETRY_CONFIG = 0x0070,   // 遥测配置(采样间隔/批量大小)
+    CMD_TELEMETRY_BATCH = 0x0071,    // 遥测样本批量上报
+    CMD_AGENT_STATS = 0x0072,        // 客户端自身资源占用(随遥测批次上报)
+    CMD_CLUSTER_INFO = 0x0080,       // 服务器集群信息(各服务器地址和负载)
+    CMD_PEER_QUERY = 0x0090,         // 服务器间查询机器清单
+    CMD_PEER_RESPONSE = 0x0091,      // 服务器间查询响应
+    CMD_EXEC_START = 0x00A0,         // 执行命令(请求号即作业号)
+    CMD_EXEC_OUTPUT = 0x00A1,        // 命令输出(分批回传)
+    CMD_EXEC_CANCEL = 0x00A2,        // 取消命令
+    CMD_EXEC_RESULT = 0x00A3,        // 命令执行结果
     CMD_ERROR = 0x00FF               // 错误响应
 };
 
+// 协议版本
+// 版本1: [4字节数据长度][4字节命令类型][数据]
+// 版本2: [4字节数据长度][1字节版本][1字节标志][2字节命令类型][4字节请求号][数据]
+// 版本1的命令字段高16位恒为0,据此区分两种格式。请求号为0的帧仍按版本1发送,
+// 只有双方都支持版本2(客户端在 CMD_CLIENT_INFO 中声明)时才使用请求号。
+#define PROTOCOL_VERSION 2
+
+// 帧标志(版本2)
+enum FrameFlag {
+    FLAG_RESPONSE = 0x01             // 响应帧,请求号与对应请求相同
+};
+
 // 协议头结构
-// [4字节数据长度][4字节命令类型][数据]
 struct ProtocolHeader {
-    quint32 dataLength;  // 数据长度(不包含头部)
-    quint32 cmdType;     // 命令类型
+    quint32 dataLength = 0;  // 数据长度(不包含头部)
+    quint32 cmdType = 0;     // 命令类型
+    quint8 version = 1;      // 协议版本
+    quint8 flags = 0;        // 帧标志
+    quint32 requestId = 0;   // 请求号(0表示不需要关联)
+    int size = 8;            // 头部长度
 };
 
 // 系统信息结构
@@ -126,14 +177,37 @@ struct SoftwareInfo {
 // 协议工具类
 class Protocol {
 public:
+    // 最大协议头长度(版本2)
+    static const int MAX_HEADER_SIZE = 12;
+    
+    // 把协议头写入调用方提供的缓冲区(至少 MAX_HEADER_SIZE 字节),返回头部长度
+    // 请求号为0且无标志时写版本1格式
+    static int writeHeader(char* out, CommandType cmd, quint32 dataLength,
+                           quint32 requestId = 0, quint8 flags = 0) {
+        qToBigEndian<quint32>(dataLength, out);
+        if (requestId == 0 && flags == 0) {
+            qToBigEndian<quint32>(quint32(cmd), out + 4);
+            return 8;
+        }
+        qToBigEndian<quint32>((quint32(PROTOCOL_VERSION) << 24) | (quint32(flags) << 16) | (quint32(cmd) & 0xFFFF),
+                              out + 4);
+        qToBigEndian<quint32>(requestId, out + 8);
+        return 12;
+    }
+    
     // 打包数据
     static QByteArray pack(CommandType cmd, const QByteArray& data) {
-        QByteArray packet;
-        QDataStream stream(&packet, QIODevice::WriteOnly);
-        stream.setByteOrder(QDataStream::BigEndian);
-        stream << (quint32)data.size();
-        stream << (quint32)cmd;
-        packet.append(data);
+        return pack(cmd, data, 0);
+    }
+    
+    // 打包带请求号的数据(版本2),请求号为0且无标志时退化为版本1
+    // 发送路径请使用 FrameScheduler,头部和数据分开写入,不再拼接整帧
+    static QByteArray pack(CommandType cmd, const QByteArray& data, quint32 requestId, quint8 flags = 0) {
+        char header[MAX_HEADER_SIZE];
+        int headerLen = writeHeader(header, cmd, quint32(data.size()), requestId, flags);
+        QByteArray packet(headerLen + data.size(), Qt::Uninitialized);
+        memcpy(packet.data(), header, size_t(headerLen));
+        memcpy(packet.data() + headerLen, data.constData(), size_t(data.size()));
         return packet;
     }
     
@@ -143,13 +217,38 @@ public:
         return pack(cmd, doc.toJson(QJsonDocument::Compact));
     }
     
-    // 解析协议头
+    static QByteArray packJson(CommandType cmd, const QJsonObject& json, quint32 requestId, quint8 flags = 0) {
+        QJsonDocument doc(json);
+        return pack(cmd, doc.toJson(QJsonDocument::Compact), requestId, flags);
+    }
+    
+    // 解析协议头,数据不足一个完整头部时返回false
     static bool parseHeader(const QByteArray& data, ProtocolHeader& header) {
-        if (data.size() < 8) return false;
-        QDataStream stream(data);
-        stream.setByteOrder(QDataStream::BigEndian);
-        stream >> header.dataLength;
-        stream >> header.cmdType;
+        return parseHeader(data.constData(), data.size(), header);
+    }
+    
+    // 从缓冲区中解析协议头,不复制数据
+    static bool parseHeader(const char* data, int size, ProtocolHeader& header) {
+        if (size < 8) return false;
+        header.dataLength = qFromBigEndian<quint32>(data);
+        quint32 cmdField = qFromBigEndian<quint32>(data + 4);
+        
+        quint8 version = quint8(cmdField >> 24);
+        if (version < 2) {
+            header.cmdType = cmdField;
+            header.version = 1;
+            header.flags = 0;
+            header.requestId = 0;
+            header.size = 8;
+            return true;
+        }
+        
+        if (size < 12) return false;
+        header.requestId = qFromBigEndian<quint32>(data + 8);
+        header.cmdType = cmdField & 0xFFFF;
+        header.version = version;
+        header.flags = quint8(cmdField >> 16);
+        header.size = 12;
         return true;
     }
     
@@ -159,7 +258,42 @@ public:
         return doc.object();
     }
     
-    // 协议头大小
+    // 命令名称(用于日志和指标标签),未知命令返回空
+    static const char* commandName(quint32 cmd) {
+        switch (cmd) {
+        case CMD_HEARTBEAT: return "heartbeat";
+        case CMD_HEARTBEAT_ACK: return "heartbeat_ack";
+        case CMD_GET_SYSINFO: return "get_sysinfo";
+        case CMD_SYSINFO_RESPONSE: return "sysinfo_response";
+        case CMD_GET_SOFTWARE: return "get_software";
+        case CMD_SOFTWARE_RESPONSE: return "software_response";
+        case CMD_INVENTORY_CHANGED: return "inventory_changed";
+        case CMD_INSTALL_SOFTWARE: return "install_software";
+        case CMD_INSTALL_RESPONSE: return "install_response";
+        case CMD_UNINSTALL_SOFTWARE: return "uninstall_software";
+        case CMD_UNINSTALL_RESPONSE: return "uninstall_response";
+        case CMD_FILE_TRANSFER_START: return "file_transfer_start";
+        case CMD_FILE_TRANSFER_DATA: return "file_transfer_data";
+        case CMD_FILE_TRANSFER_END: return "file_transfer_end";
+        case CMD_FILE_TRANSFER_ACK: return "file_transfer_ack";
+        case CMD_CLIENT_INFO: return "client_info";
+        case CMD_CLIENT_MOVING: return "client_moving";
+        case CMD_TELEMETRY_CONFIG: return "telemetry_config";
+        case CMD_TELEMETRY_BATCH: return "telemetry_batch";
+        case CMD_AGENT_STATS: return "agent_stats";
+        case CMD_CLUSTER_INFO: return "cluster_info";
+        case CMD_PEER_QUERY: return "peer_query";
+        case CMD_PEER_RESPONSE: return "peer_response";
+        case CMD_EXEC_START: return "exec_start";
+        case CMD_EXEC_OUTPUT: return "exec_output";
+        case CMD_EXEC_CANCEL: return "exec_cancel";
+        case CMD_EXEC_RESULT: return "exec_result";
+        case CMD_ERROR: return "error";
+        default: return "";
+        }
+    }
+    
+    // 协议头最小长度(版本1)
     static int headerSize() {
         return 8; // 4字节长度 + 4字节命令
     }
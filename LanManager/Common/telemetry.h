@@ -0,0 +1,164 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <QByteArray>
+#include <QVector>
+
+// 每批最多的样本数,服务端下发的批量大小不超过它
+#define TELEMETRY_MAX_BATCH 100
+
+// 每个样本最多的核心数
+#define TELEMETRY_MAX_CORES 1024
+
+// 遥测样本结构
+// 所有字段均为整数,便于差分编码
+struct TelemetrySample {
+    qint64 timestamp = 0;        // 采样时间(UTC毫秒)
+    quint32 cpuUsage = 0;        // CPU总占用(千分比)
+    QVector<quint32> coreUsage;  // 每个核心占用(千分比)
+    quint64 totalMemory = 0;     // 总内存(MB)
+    quint64 freeMemory = 0;      // 可用内存(MB)
+    quint64 freeDisk = 0;        // 本地磁盘可用空间合计(MB)
+    quint64 diskReadRate = 0;    // 磁盘读取速率(KB/s)
+    quint64 diskWriteRate = 0;   // 磁盘写入速率(KB/s)
+    quint64 netRxRate = 0;       // 网络接收速率(KB/s)
+    quint64 netTxRate = 0;       // 网络发送速率(KB/s)
+};
+
+// 变长整数工具(LEB128 + ZigZag)
+class VarInt {
+public:
+    static void writeUInt(QByteArray& out, quint64 value) {
+        while (value >= 0x80) {
+            out.append(char((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.append(char(value));
+    }
+
+    static void writeInt(QByteArray& out, qint64 value) {
+        writeUInt(out, zigzag(value));
+    }
+
+    static bool readUInt(const char*& p, const char* end, quint64& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7) {
+            quint8 byte = quint8(*p++);
+            value |= quint64(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool readInt(const char*& p, const char* end, qint64& value) {
+        quint64 raw;
+        if (!readUInt(p, end, raw)) return false;
+        value = unzigzag(raw);
+        return true;
+    }
+
+    static quint64 zigzag(qint64 v) {
+        return (quint64(v) << 1) ^ quint64(v >> 63);
+    }
+
+    static qint64 unzigzag(quint64 v) {
+        return qint64(v >> 1) ^ -qint64(v & 1);
+    }
+};
+
+// 遥测批量编解码
+// 格式: [版本1B][样本数varint][核心数varint] 后跟每个样本的各字段,
+// 每个字段都是相对上一个样本同字段的ZigZag差值(第一个样本相对0)
+class TelemetryCodec {
+public:
+    static const quint8 VERSION = 1;
+
+    static QByteArray encodeBatch(const QVector<TelemetrySample>& samples) {
+        QByteArray out;
+        out.reserve(16 + samples.size() * 24);
+        out.append(char(VERSION));
+
+        int coreCount = samples.isEmpty() ? 0 : qMin(samples.first().coreUsage.size(), TELEMETRY_MAX_CORES);
+        VarInt::writeUInt(out, quint64(samples.size()));
+        VarInt::writeUInt(out, quint64(coreCount));
+
+        TelemetrySample prev;
+        prev.coreUsage.fill(0, coreCount);
+        for (const TelemetrySample& s : samples) {
+            VarInt::writeInt(out, s.timestamp - prev.timestamp);
+            VarInt::writeInt(out, qint64(s.cpuUsage) - qint64(prev.cpuUsage));
+            for (int i = 0; i < coreCount; ++i) {
+                quint32 core = i < s.coreUsage.size() ? s.coreUsage[i] : 0;
+                VarInt::writeInt(out, qint64(core) - qint64(prev.coreUsage[i]));
+                prev.coreUsage[i] = core;
+            }
+            VarInt::writeInt(out, qint64(s.totalMemory - prev.totalMemory));
+            VarInt::writeInt(out, qint64(s.freeMemory - prev.freeMemory));
+            VarInt::writeInt(out, qint64(s.freeDisk - prev.freeDisk));
+            VarInt::writeInt(out, qint64(s.diskReadRate - prev.diskReadRate));
+            VarInt::writeInt(out, qint64(s.diskWriteRate - prev.diskWriteRate));
+            VarInt::writeInt(out, qint64(s.netRxRate - prev.netRxRate));
+            VarInt::writeInt(out, qint64(s.netTxRate - prev.netTxRate));
+
+            prev.timestamp = s.timestamp;
+            prev.cpuUsage = s.cpuUsage;
+            prev.totalMemory = s.totalMemory;
+            prev.freeMemory = s.freeMemory;
+            prev.freeDisk = s.freeDisk;
+            prev.diskReadRate = s.diskReadRate;
+            prev.diskWriteRate = s.diskWriteRate;
+            prev.netRxRate = s.netRxRate;
+            prev.netTxRate = s.netTxRate;
+        }
+        return out;
+    }
+
+    // maxCount: 允许的最大样本数,超过时视为格式错误
+    static bool decodeBatch(const QByteArray& data, QVector<TelemetrySample>& samples,
+                            int maxCount = TELEMETRY_MAX_BATCH) {
+        const char* p = data.constData();
+        const char* end = p + data.size();
+        if (p >= end || quint8(*p++) != VERSION) return false;
+
+        quint64 count, coreCount;
+        if (!VarInt::readUInt(p, end, count) || !VarInt::readUInt(p, end, coreCount)) {
+            return false;
+        }
+        // 样本数和核心数由对端给出: 先限制在批量上限内,再按每个样本的最小编码长度
+        // (时间、CPU、7个内存/磁盘/网络字段和每个核心各至少1字节)核对剩余字节数,
+        // 不按对端给出的样本数预留空间
+        if (count > quint64(qMax(0, maxCount)) || coreCount > TELEMETRY_MAX_CORES ||
+            count * (9 + coreCount) > quint64(end - p)) {
+            return false;
+        }
+
+        samples.clear();
+
+        TelemetrySample cur;
+        cur.coreUsage.fill(0, int(coreCount));
+        for (quint64 n = 0; n < count; ++n) {
+            qint64 d;
+            if (!VarInt::readInt(p, end, d)) return false;
+            cur.timestamp += d;
+            if (!VarInt::readInt(p, end, d)) return false;
+            cur.cpuUsage = quint32(qint64(cur.cpuUsage) + d);
+            for (int i = 0; i < int(coreCount); ++i) {
+                if (!VarInt::readInt(p, end, d)) return false;
+                cur.coreUsage[i] = quint32(qint64(cur.coreUsage[i]) + d);
+            }
+            quint64* fields[] = { &cur.totalMemory, &cur.freeMemory, &cur.freeDisk,
+                                  &cur.diskReadRate, &cur.diskWriteRate,
+                                  &cur.netRxRate, &cur.netTxRate };
+            for (quint64* field : fields) {
+                if (!VarInt::readInt(p, end, d)) return false;
+                *field = quint64(qint64(*field) + d);
+            }
+            samples.append(cur);
+        }
+        return true;
+    }
+};
+
+#endif // TELEMETRY_H
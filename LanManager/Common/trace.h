@@ -0,0 +1,256 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QRandomGenerator>
+#include <QString>
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+
+// 每个线程的跟踪缓冲能保存的事件数,写满后覆盖最早的
+#define TRACE_BUFFER_EVENTS 4096
+
+// 跟踪事件,名称必须是字符串常量(缓冲中只保存指针)
+struct TraceEvent {
+    quint64 traceId = 0;
+    const char* name = "";
+    qint64 startUs = 0;      // Trace::now()
+    qint64 durationUs = -1;  // -1 表示瞬时事件
+    int thread = 0;          // 缓冲序号,同一线程不变
+};
+
+// 单个线程的事件环形缓冲
+//
+// 只有所属线程写入: 先写槽位再发布写入计数,不加锁。读取方按计数复制,复制完后重新读取计数,
+// 丢弃复制期间可能被覆盖的槽位(与顺序锁的做法相同),写入方永远不等待读取方。
+class TraceBuffer {
+public:
+    explicit TraceBuffer(int index) : m_index(index) {}
+
+    int index() const { return m_index; }
+
+    void push(quint64 traceId, const char* name, qint64 startUs, qint64 durationUs) {
+        quint64 head = m_head.load(std::memory_order_relaxed);
+        TraceEvent& event = m_events[head % TRACE_BUFFER_EVENTS];
+        event.traceId = traceId;
+        event.name = name;
+        event.startUs = startUs;
+        event.durationUs = durationUs;
+        event.thread = m_index;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // 复制属于 traceId 的事件(0 表示全部)
+    void collect(quint64 traceId, QVector<TraceEvent>& out) const {
+        quint64 head = m_head.load(std::memory_order_acquire);
+        quint64 begin = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+        int first = out.size();
+        QVector<quint64> positions;
+        for (quint64 i = begin; i < head; ++i) {
+            const TraceEvent& event = m_events[i % TRACE_BUFFER_EVENTS];
+            if (traceId == 0 || event.traceId == traceId) {
+                out.append(event);
+                positions.append(i);
+            }
+        }
+        // 写入方正在写的是 newHead 号事件,它和之前的覆盖了 newHead - N 及更早的位置
+        std::atomic_thread_fence(std::memory_order_acquire);
+        quint64 newHead = m_head.load(std::memory_order_relaxed);
+        if (newHead >= TRACE_BUFFER_EVENTS) {
+            quint64 valid = newHead - TRACE_BUFFER_EVENTS + 1;
+            int keep = first;
+            for (int i = 0; i < positions.size(); ++i) {
+                if (positions[i] >= valid) {
+                    out[keep++] = out[first + i];
+                }
+            }
+            out.resize(keep);
+        }
+    }
+
+    // 线程结束后缓冲交给新线程复用,已记录的事件保留
+    std::atomic<bool> owned{true};
+
+private:
+    int m_index;
+    std::atomic<quint64> m_head{0};
+    TraceEvent m_events[TRACE_BUFFER_EVENTS];
+};
+
+// 操作跟踪
+//
+// 每个操作(一次请求)有一个64位跟踪号,服务端生成后随请求下发,两端各自把带时间戳的事件
+// 记录到本线程的缓冲里。记录只写线程自己的缓冲,没有锁和内存分配,可以一直开启。
+// 时间为本进程内的单调微秒数,不同机器之间的对齐由服务端按请求往返时间估算。
+class Trace {
+public:
+    static bool isEnabled() { return enabledFlag().load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { enabledFlag().store(enabled, std::memory_order_relaxed); }
+
+    // 本进程内的单调时间(微秒)
+    static qint64 now() {
+        static QElapsedTimer clock = []() { QElapsedTimer t; t.start(); return t; }();
+        return clock.nsecsElapsed() / 1000;
+    }
+
+    static quint64 newId() {
+        quint64 id = 0;
+        while (id == 0) {
+            id = QRandomGenerator::global()->generate64();
+        }
+        return id;
+    }
+
+    // 跟踪号在JSON中以16位十六进制字符串传输(JSON数字放不下64位整数)
+    static QString idToString(quint64 traceId) { return QString("%1").arg(traceId, 16, 16, QChar('0')); }
+    static quint64 idFromString(const QString& text) { return text.toULongLong(nullptr, 16); }
+
+    static void instant(quint64 traceId, const char* name) {
+        if (traceId && isEnabled()) {
+            localBuffer()->push(traceId, name, now(), -1);
+        }
+    }
+
+    static void complete(quint64 traceId, const char* name, qint64 startUs, qint64 endUs = now()) {
+        if (traceId && isEnabled()) {
+            localBuffer()->push(traceId, name, startUs, qMax<qint64>(0, endUs - startUs));
+        }
+    }
+
+    // 当前线程正在处理的跟踪号,供不知道请求上下文的底层代码(如启动进程)记录事件
+    static quint64 current() { return currentId(); }
+
+    // 在作用域内设置当前线程的跟踪号
+    class Scope {
+    public:
+        explicit Scope(quint64 traceId) : m_previous(currentId()) { currentId() = traceId; }
+        ~Scope() { currentId() = m_previous; }
+    private:
+        quint64 m_previous;
+        Q_DISABLE_COPY(Scope)
+    };
+
+    // 作用域结束时记录一个时间段
+    class Span {
+    public:
+        Span(quint64 traceId, const char* name) : m_traceId(traceId), m_name(name), m_start(traceId ? now() : 0) {}
+        ~Span() { complete(m_traceId, m_name, m_start); }
+    private:
+        quint64 m_traceId;
+        const char* m_name;
+        qint64 m_start;
+        Q_DISABLE_COPY(Span)
+    };
+
+    // 从所有线程的缓冲中取出一个跟踪的事件,按开始时间排序
+    static QVector<TraceEvent> collect(quint64 traceId) {
+        QVector<TraceEvent> events;
+        QMutexLocker locker(&registryMutex());
+        for (const TraceBuffer* buffer : registry()) {
+            buffer->collect(traceId, events);
+        }
+        std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+            return a.startUs < b.startUs;
+        });
+        return events;
+    }
+
+    // 事件的紧凑JSON形式 [名称, 开始, 时长, 线程],开始时间减去 baseUs
+    static QJsonArray toJson(const QVector<TraceEvent>& events, qint64 baseUs) {
+        QJsonArray array;
+        for (const TraceEvent& event : events) {
+            array.append(QJsonArray{QString::fromLatin1(event.name), event.startUs - baseUs,
+                                    event.durationUs, event.thread});
+        }
+        return array;
+    }
+
+    // Chrome trace-event 格式的一个事件(chrome://tracing、Perfetto 可直接打开)
+    static QJsonObject chromeEvent(const QString& name, qint64 startUs, qint64 durationUs,
+                                   int pid, int tid, const QJsonObject& args = QJsonObject()) {
+        QJsonObject event;
+        event["name"] = name;
+        event["cat"] = "lanmgr";
+        event["ts"] = startUs;
+        event["pid"] = pid;
+        event["tid"] = tid;
+        if (durationUs < 0) {
+            event["ph"] = "i";
+            event["s"] = "t";
+        } else {
+            event["ph"] = "X";
+            event["dur"] = durationUs;
+        }
+        if (!args.isEmpty()) {
+            event["args"] = args;
+        }
+        return event;
+    }
+
+    // 进程名称元数据事件
+    static QJsonObject chromeProcessName(int pid, const QString& name) {
+        QJsonObject event;
+        event["name"] = "process_name";
+        event["ph"] = "M";
+        event["pid"] = pid;
+        event["args"] = QJsonObject{{"name", name}};
+        return event;
+    }
+
+private:
+    static std::atomic<bool>& enabledFlag() {
+        static std::atomic<bool> enabled{true};
+        return enabled;
+    }
+
+    static quint64& currentId() {
+        thread_local quint64 id = 0;
+        return id;
+    }
+
+    static QMutex& registryMutex() {
+        static QMutex mutex;
+        return mutex;
+    }
+
+    // 缓冲只增加不释放,线程结束时标记为空闲
+    static QList<TraceBuffer*>& registry() {
+        static QList<TraceBuffer*> buffers;
+        return buffers;
+    }
+
+    // 当前线程的缓冲,首次使用时领取空闲的或新建一个(只有这一步加锁)
+    static TraceBuffer* localBuffer() {
+        struct Holder {
+            TraceBuffer* buffer = nullptr;
+            ~Holder() {
+                if (buffer) {
+                    buffer->owned.store(false, std::memory_order_release);
+                }
+            }
+        };
+        thread_local Holder holder;
+        if (!holder.buffer) {
+            QMutexLocker locker(&registryMutex());
+            for (TraceBuffer* buffer : registry()) {
+                bool expected = false;
+                if (buffer->owned.compare_exchange_strong(expected, true)) {
+                    holder.buffer = buffer;
+                    break;
+                }
+            }
+            if (!holder.buffer) {
+                holder.buffer = new TraceBuffer(registry().size());
+                registry().append(holder.buffer);
+            }
+        }
+        return holder.buffer;
+    }
+};
+
+#endif // TRACE_H
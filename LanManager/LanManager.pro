@@ -0,0 +1,22 @@
+# 一次编译全部程序: 客户端、服务端(界面版和无界面版)、时序存储库、回放/网络模拟/基准测试/负载测试工具
+# 可以在源码目录外编译(影子构建),可执行文件输出到构建目录下的 bin/
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    Client \
+    Server \
+    ServerDaemon \
+    TsStore \
+    TsBench \
+    Replay \
+    NetEmu \
+    ProtoBench \
+    LoadTest
+
+ServerDaemon.subdir = Server/daemon
+TsBench.subdir = TsStore/bench
+Replay.subdir = Tools/Replay
+NetEmu.subdir = Tools/NetEmu
+ProtoBench.subdir = Tools/ProtoBench
+LoadTest.subdir = Tools/LoadTest
@@ -1,4 +1,4 @@
-QT += core gui widgets network
+QT += core gui widgets network concurrent
 
 CONFIG += c++17
 
@@ -8,15 +8,50 @@ TEMPLATE = app
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
-    tcpserver.cpp
+    tcpserver.cpp \
+    inventorysnapshot.cpp \
+    peerlink.cpp \
+    resultaggregator.cpp \
+    metricsserver.cpp
 
 HEADERS += \
     mainwindow.h \
+    datadir.h \
     tcpserver.h \
-    ../Common/protocol.h
+    telemetryring.h \
+    inventorysnapshot.h \
+    peerlink.h \
+    bandwidthshaper.h \
+    execoutput.h \
+    resultaggregator.h \
+    metrics.h \
+    metricsserver.h \
+    tracelog.h \
+    memorybudget.h \
+    ../Common/protocol.h \
+    ../Common/telemetry.h \
+    ../Common/inventory.h \
+    ../Common/discovery.h \
+    ../Common/framescheduler.h \
+    ../Common/exec.h \
+    ../Common/trace.h \
+    ../Common/capture.h \
+    ../Common/logger.h \
+    ../Common/objectpool.h \
+    ../Common/framereader.h \
+    ../Common/alloccounter.h
 
 INCLUDEPATH += ../Common
 
+# qmake CONFIG+=count_allocs: 统计堆分配次数(见 Common/alloccounter.h),只用于测量
+count_allocs: DEFINES += LANMGR_COUNT_ALLOCS
+
+# 时序存储库
+include(../TsStore/tsstore.pri)
+
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../pgo.pri)
+
 # 输出目录
 DESTDIR = ../bin
 
@@ -0,0 +1,149 @@
+#ifndef BANDWIDTHSHAPER_H
+#define BANDWIDTHSHAPER_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QString>
+
+// 令牌桶突发时长(毫秒): 桶容量为速率乘以该时长,但至少能放下一个数据块
+#define SHAPER_BURST_MS 50
+
+// 带宽限制配置,速率单位为字节/秒,0表示不限制
+struct BandwidthLimits {
+    qint64 globalRate = 0;     // 服务端总出口
+    qint64 subnetRate = 0;     // 每个子网
+    qint64 clientRate = 0;     // 每个客户端连接
+    int subnetPrefix = 24;     // 划分子网的IPv4前缀长度
+
+    bool isEnabled() const { return globalRate > 0 || subnetRate > 0 || clientRate > 0; }
+};
+
+// 令牌桶,时间由调用方传入(微秒,单调递增)
+class TokenBucket {
+public:
+    void configure(qint64 rate, qint64 minBurst, qint64 nowUs) {
+        refill(nowUs);
+        m_rate = rate;
+        m_burst = qMax(double(minBurst), double(rate) * SHAPER_BURST_MS / 1000.0);
+        if (m_lastUs < 0) {
+            m_tokens = m_burst;  // 新建的桶是满的
+            m_lastUs = nowUs;
+        }
+        m_tokens = qMin(m_tokens, m_burst);
+    }
+
+    bool isLimited() const { return m_rate > 0; }
+
+    void refill(qint64 nowUs) {
+        if (m_rate > 0 && m_lastUs >= 0 && nowUs > m_lastUs) {
+            m_tokens = qMin(m_burst, m_tokens + double(nowUs - m_lastUs) * m_rate / 1000000.0);
+        }
+        if (m_lastUs >= 0) {
+            m_lastUs = nowUs;
+        }
+    }
+
+    bool canConsume(qint64 bytes) const { return m_rate <= 0 || m_tokens >= bytes; }
+    void consume(qint64 bytes) { if (m_rate > 0) m_tokens -= bytes; }
+
+private:
+    qint64 m_rate = 0;
+    double m_burst = 0;
+    double m_tokens = 0;
+    qint64 m_lastUs = -1;
+};
+
+// 三级带宽整形: 客户端连接、子网、全局出口
+// 一次发送必须同时从三个桶取得令牌,任何一级不足都不发送
+class BandwidthShaper {
+public:
+    void setLimits(const BandwidthLimits& limits, qint64 minBurst, qint64 nowUs) {
+        bool prefixChanged = limits.subnetPrefix != m_limits.subnetPrefix;
+        m_limits = limits;
+        m_minBurst = minBurst;
+        m_global.configure(limits.globalRate, minBurst, nowUs);
+        for (Client& client : m_clients) {
+            client.bucket.configure(limits.clientRate, minBurst, nowUs);
+            if (prefixChanged) {
+                client.subnet = subnetOf(client.address, limits.subnetPrefix);
+            }
+        }
+        if (prefixChanged) {
+            m_subnets.clear();
+        }
+        for (TokenBucket& bucket : m_subnets) {
+            bucket.configure(limits.subnetRate, minBurst, nowUs);
+        }
+    }
+
+    const BandwidthLimits& limits() const { return m_limits; }
+    bool isEnabled() const { return m_limits.isEnabled(); }
+
+    // 连接建立时登记,子网按套接字的对端地址划分,标识只在这里和前缀变化时计算
+    void addClient(qintptr clientId, const QHostAddress& peerAddress, qint64 nowUs) {
+        Client& client = m_clients[clientId];
+        client.address = peerAddress;
+        client.subnet = subnetOf(peerAddress, m_limits.subnetPrefix);
+        client.bucket = TokenBucket();
+        client.bucket.configure(m_limits.clientRate, m_minBurst, nowUs);
+    }
+
+    bool tryConsume(qintptr clientId, qint64 bytes, qint64 nowUs) {
+        auto it = m_clients.find(clientId);
+        if (it == m_clients.end()) {
+            addClient(clientId, QHostAddress(), nowUs);
+            it = m_clients.find(clientId);
+        }
+        TokenBucket& client = it->bucket;
+        client.refill(nowUs);
+        TokenBucket& subnet = bucket(m_subnets, it->subnet, m_limits.subnetRate, nowUs);
+        m_global.refill(nowUs);
+        if (!client.canConsume(bytes) || !subnet.canConsume(bytes) || !m_global.canConsume(bytes)) {
+            return false;
+        }
+        client.consume(bytes);
+        subnet.consume(bytes);
+        m_global.consume(bytes);
+        return true;
+    }
+
+    void removeClient(qintptr clientId) { m_clients.remove(clientId); }
+
+    // 子网标识: IPv4(含IPv4映射的IPv6地址)取前缀,其他地址整体作为一个子网
+    static QString subnetOf(const QHostAddress& address, int prefix) {
+        bool isV4 = false;
+        quint32 v4 = address.toIPv4Address(&isV4);
+        if (!isV4) {
+            return address.toString();
+        }
+        prefix = qBound(0, prefix, 32);
+        quint32 mask = prefix == 0 ? 0 : ~quint32(0) << (32 - prefix);
+        return QString("%1/%2").arg(QHostAddress(v4 & mask).toString()).arg(prefix);
+    }
+
+private:
+    struct Client {
+        TokenBucket bucket;
+        QHostAddress address;  // 套接字的对端地址
+        QString subnet;        // subnetOf(address) 的缓存
+    };
+
+    template <typename Key>
+    TokenBucket& bucket(QHash<Key, TokenBucket>& buckets, const Key& key, qint64 rate, qint64 nowUs) {
+        auto it = buckets.find(key);
+        if (it == buckets.end()) {
+            it = buckets.insert(key, TokenBucket());
+            it->configure(rate, m_minBurst, nowUs);
+        }
+        it->refill(nowUs);
+        return it.value();
+    }
+
+    BandwidthLimits m_limits;
+    qint64 m_minBurst = 0;
+    TokenBucket m_global;
+    QHash<qintptr, Client> m_clients;
+    QHash<QString, TokenBucket> m_subnets;
+};
+
+#endif // BANDWIDTHSHAPER_H
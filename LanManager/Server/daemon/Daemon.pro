@@ -0,0 +1,45 @@
+QT += core network concurrent
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = LanServerd
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    ../tcpserver.cpp \
+    ../inventorysnapshot.cpp \
+    ../peerlink.cpp \
+    ../metricsserver.cpp
+
+HEADERS += \
+    ../datadir.h \
+    ../tcpserver.h \
+    ../telemetryring.h \
+    ../inventorysnapshot.h \
+    ../peerlink.h \
+    ../bandwidthshaper.h \
+    ../execoutput.h \
+    ../metrics.h \
+    ../metricsserver.h \
+    ../tracelog.h \
+    ../memorybudget.h \
+    ../../Common/protocol.h \
+    ../../Common/logger.h \
+    ../../Common/alloccounter.h
+
+INCLUDEPATH += ../../Common ..
+
+# qmake CONFIG+=count_allocs: 统计堆分配次数(见 Common/alloccounter.h),只用于测量
+count_allocs: DEFINES += LANMGR_COUNT_ALLOCS
+
+# 时序存储库
+include(../../TsStore/tsstore.pri)
+
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../../pgo.pri)
+
+# 输出目录
+DESTDIR = ../../bin
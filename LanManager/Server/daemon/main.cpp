@@ -0,0 +1,160 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <csignal>
+#include "tcpserver.h"
+#include "metricsserver.h"
+#include "inventorysnapshot.h"
+#include "tsstore.h"
+#include "datadir.h"
+#include "logger.h"
+
+// 以 LANMGR_COUNT_ALLOCS 编译时在这里定义分配计数的替换函数
+#define ALLOC_COUNTER_DEFINE
+#include "alloccounter.h"
+
+// 无界面的服务端
+// 与界面版使用同一个服务端核心和同样的数据目录,启动后直接监听,适合放在服务器上长期运行,
+// 收集遥测、机器清单和运行指标,并作为集群中的一台服务器接收客户端。
+// 收到 SIGINT/SIGTERM 时停止监听、保存清单快照后退出。
+
+static void onSignal(int)
+{
+    QCoreApplication::quit();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // 应用名和组织名与界面版相同,默认数据目录也相同
+    app.setApplicationName("LanManager Server");
+    app.setApplicationVersion("1.0.0");
+    app.setOrganizationName("LanManager");
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("局域网远程管理服务端(无界面)");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    
+    QCommandLineOption dataDirOption = DataDir::option();
+    parser.addOption(dataDirOption);
+    
+    QCommandLineOption portOption(
+        QStringList() << "p" << "port",
+        "监听端口",
+        "port",
+        QString::number(DEFAULT_PORT)
+    );
+    parser.addOption(portOption);
+    
+    QCommandLineOption metricsPortOption(
+        "metrics-port",
+        "运行指标端口(只监听本机),0表示关闭",
+        "port",
+        QString::number(METRICS_PORT)
+    );
+    parser.addOption(metricsPortOption);
+    
+    QCommandLineOption logLevelOption(
+        "log-level",
+        "日志级别: debug, info, warn, error",
+        "level",
+        "info"
+    );
+    parser.addOption(logLevelOption);
+    
+    parser.process(app);
+    
+    const quint16 port = parser.value(portOption).toUShort();
+    bool metricsOk = false;
+    const uint metricsPort = parser.value(metricsPortOption).toUInt(&metricsOk);
+    if (port == 0 || !metricsOk || metricsPort > 65535) {
+        qCritical("参数无效");
+        return 1;
+    }
+    
+    DataDir dataDir(parser.value(dataDirOption));
+    QString error;
+    if (!dataDir.lock(&error)) {
+        qCritical("%s", qPrintable(error));
+        return 1;
+    }
+    
+    Logger::setLevel(Logger::levelFromName(parser.value(logLevelOption), LOG_LEVEL_INFO));
+    Logger::addSink(new ConsoleLogSink);
+    if (!dataDir.addLogFile(&error)) {
+        qWarning("无法打开日志文件: %s", qPrintable(error));
+    }
+    Logger::start();
+    
+    TcpServer server;
+    server.setExecOutputDir(dataDir.path() + "/exec");
+    server.setMetricsPort(quint16(metricsPort));
+    
+    TsStore history(dataDir.path() + "/history");
+    if (history.open()) {
+        server.setHistoryStore(&history);
+    } else {
+        LOG_WARN("server", "历史数据存储打开失败: %1", history.errorString());
+    }
+    
+    // 快照损坏时从空清单开始,下次保存会覆盖
+    InventorySnapshot inventory(dataDir.path() + "/inventory.snap");
+    if (inventory.load()) {
+        LOG_INFO("server", "已加载机器清单快照: %1 台电脑", inventory.count());
+    } else {
+        LOG_WARN("server", "机器清单快照加载失败: %1", inventory.errorString());
+    }
+    server.setInventorySnapshot(&inventory);
+    
+    // 与界面版相同的定期维护: 清单快照在后台线程保存,历史数据刷盘并清理过期的段
+    QElapsedTimer inventorySaved;
+    inventorySaved.start();
+    QTimer maintenance;
+    QObject::connect(&maintenance, &QTimer::timeout, [&]() {
+        if (!inventory.isSaving() && (inventory.hasChanges() ||
+            (inventory.isDirty() && inventorySaved.hasExpired(INVENTORY_SEEN_SAVE_INTERVAL)))) {
+            inventorySaved.restart();
+            inventory.saveAsync([&inventory](bool ok) {
+                if (!ok) {
+                    LOG_WARN("server", "机器清单快照保存失败: %1", inventory.errorString());
+                }
+            });
+        }
+        if (history.isOpen()) {
+            history.flush();
+            qint64 cutoff = QDateTime::currentMSecsSinceEpoch() - qint64(HISTORY_RETENTION_DAYS) * 24 * 3600 * 1000;
+            int removed = history.removeSegmentsBefore(cutoff);
+            if (removed > 0) {
+                LOG_INFO("server", "已清理 %1 个过期历史数据段", removed);
+            }
+        }
+    });
+    maintenance.start(HISTORY_FLUSH_INTERVAL);
+    
+    if (!server.start(port)) {
+        LOG_ERROR("server", "无法监听端口 %1", port);
+        server.setHistoryStore(nullptr);
+        server.setInventorySnapshot(nullptr);
+        Logger::stop();
+        return 1;
+    }
+    LOG_INFO("server", "服务器已启动,监听端口 %1,数据目录 %2", port, dataDir.path());
+    
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    int result = app.exec();
+    
+    maintenance.stop();
+    server.stop();
+    server.setHistoryStore(nullptr);
+    server.setInventorySnapshot(nullptr);
+    if (inventory.isDirty() && !inventory.save()) {
+        LOG_WARN("server", "机器清单快照保存失败: %1", inventory.errorString());
+    }
+    LOG_INFO("server", "服务器已停止");
+    Logger::stop();
+    return result;
+}
@@ -0,0 +1,81 @@
+#ifndef DATADIR_H
+#define DATADIR_H
+
+#include <QString>
+#include <QDir>
+#include <QLockFile>
+#include <QStandardPaths>
+#include <QCommandLineOption>
+#include "../Common/logger.h"
+
+// 历史数据保留天数
+#define HISTORY_RETENTION_DAYS 90
+
+// 历史数据刷盘间隔(毫秒)
+#define HISTORY_FLUSH_INTERVAL 10000
+
+// 只有上线时间变化时清单快照的保存间隔(毫秒)
+#define INVENTORY_SEEN_SAVE_INTERVAL 600000
+
+// 服务端数据目录(历史数据、机器清单快照、命令输出、日志)
+//
+// 界面版和无界面的服务端共用同一套命令行参数和目录布局。一个目录只能由一个实例使用:
+// 历史存储和快照都假定独占写入,lock() 用目录下的 server.lock 保证这一点。
+class DataDir {
+public:
+    explicit DataDir(const QString& path)
+        : m_path(QDir(path).absolutePath())
+        , m_lock(m_path + "/server.lock")
+    {
+        m_lock.setStaleLockTime(0);
+    }
+
+    // --data-dir 参数,默认为系统的应用数据目录(取决于应用名和组织名,须先设置)
+    static QCommandLineOption option()
+    {
+        return QCommandLineOption(
+            "data-dir",
+            "数据目录(历史数据、机器清单快照、日志),同一台机器运行多个服务端时各用一个",
+            "path",
+            QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    }
+
+    QString path() const { return m_path; }
+
+    // 创建目录并加锁,目录已被其他实例使用时返回 false,error 中给出提示
+    bool lock(QString* error)
+    {
+        QDir().mkpath(m_path);
+        if (m_lock.tryLock(0)) {
+            return true;
+        }
+        qint64 pid = 0;
+        QString host, appName;
+        m_lock.getLockInfo(&pid, &host, &appName);
+        if (error) {
+            *error = QString("数据目录 %1 正在被另一个服务端实例(进程 %2)使用。\n"
+                             "在同一台机器上运行多个服务端时,请用 --data-dir 为每个实例指定不同的目录。")
+                         .arg(QDir::toNativeSeparators(m_path)).arg(pid);
+        }
+        return false;
+    }
+
+    // 日志同时写入 logs/server.jsonl(按大小轮转),在 Logger::start() 之前调用
+    bool addLogFile(QString* error)
+    {
+        JsonLogFile* logFile = new JsonLogFile(m_path + "/logs/server.jsonl");
+        if (!logFile->open()) {
+            if (error) *error = logFile->errorString();
+            delete logFile;
+            return false;
+        }
+        Logger::addSink(logFile);
+        return true;
+    }
+
+private:
+    QString m_path;
+    QLockFile m_lock;
+};
+
+#endif // DATADIR_H
@@ -0,0 +1,81 @@
+#ifndef EXECOUTPUT_H
+#define EXECOUTPUT_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QScopedPointer>
+#include <QString>
+#include "../Common/exec.h"
+
+// 每个作业在内存中保留的输出字节数,超过后转存到文件
+#define EXEC_MEMORY_LIMIT (64 * 1024)
+
+// 一个作业(一台客户端上的一次命令执行)的输出
+//
+// 输出按到达顺序保存,两个流合在一起。开头 EXEC_MEMORY_LIMIT 字节留在内存里供界面预览;
+// 超过后把已有内容写入 spillPath 并关闭内存追加,之后的数据直接写文件。
+// 同时在数百台客户端上执行时,每个作业的内存占用都不超过这个上限。
+class ExecOutput {
+public:
+    explicit ExecOutput(const QString& spillPath)
+        : m_path(spillPath) {}
+
+    void append(ExecStream stream, const QByteArray& data) {
+        m_size += data.size();
+        if (stream == EXEC_STDERR) {
+            m_stderrBytes += data.size();
+        }
+        if (m_file) {
+            m_file->write(data);
+            return;
+        }
+        if (m_head.size() + data.size() <= EXEC_MEMORY_LIMIT || !spill()) {
+            // 转存失败时只保留开头部分
+            m_head.append(data.left(qMax(0, EXEC_MEMORY_LIMIT - m_head.size())));
+            return;
+        }
+        m_file->write(data);
+    }
+
+    // 作业结束,关闭转存文件
+    void close() {
+        if (m_file) {
+            m_file->close();
+        }
+    }
+
+    qint64 size() const { return m_size; }
+    qint64 stderrBytes() const { return m_stderrBytes; }
+
+    // 内存中保留的开头部分(未转存时就是全部输出)
+    const QByteArray& head() const { return m_head; }
+
+    bool isSpilled() const { return m_spilled; }
+    QString spillPath() const { return m_spilled ? m_path : QString(); }
+    QString errorString() const { return m_error; }
+
+private:
+    bool spill() {
+        if (m_path.isEmpty()) return false;
+        QScopedPointer<QFile> file(new QFile(m_path));
+        if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            m_error = file->errorString();
+            m_path.clear();
+            return false;
+        }
+        file->write(m_head);
+        m_file.swap(file);
+        m_spilled = true;
+        return true;
+    }
+
+    QString m_path;
+    QString m_error;
+    QByteArray m_head;
+    QScopedPointer<QFile> m_file;
+    qint64 m_size = 0;
+    qint64 m_stderrBytes = 0;
+    bool m_spilled = false;
+};
+
+#endif // EXECOUTPUT_H
@@ -0,0 +1,609 @@
+#include "inventorysnapshot.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const quint32 SNAPSHOT_MAGIC = 0x53494D4C;  // "LMIS"
+const quint32 SNAPSHOT_VERSION = 1;
+const int FILE_HEADER_SIZE = 16;
+const int INDEX_ENTRY_SIZE = 12;
+
+// 只变化了上线时间的记录在内存中的估算字节数(不含标识)
+const qint64 SEEN_FOOTPRINT = 64;
+
+void writeString(QDataStream& stream, const QString& s)
+{
+    stream << s.toUtf8();
+}
+
+QString readString(QDataStream& stream)
+{
+    QByteArray utf8;
+    stream >> utf8;
+    return QString::fromUtf8(utf8);
+}
+
+} // namespace
+
+InventorySnapshot::InventorySnapshot(const QString& filePath)
+    : m_path(filePath)
+    , m_file(nullptr)
+    , m_map(nullptr)
+    , m_mapSize(0)
+    , m_dirtyBytes(0)
+    , m_saving(false)
+{
+    QObject::connect(&m_saveWatcher, &QFutureWatcherBase::finished, &m_saveWatcher, [this]() {
+        finishSave();
+    });
+}
+
+InventorySnapshot::~InventorySnapshot()
+{
+    // 调用方可能已经销毁,析构时完成的保存不再通知
+    if (m_job) {
+        m_job->done = nullptr;
+    }
+    waitForSave();
+    unmap();
+}
+
+void InventorySnapshot::unmap()
+{
+    if (m_file) {
+        if (m_map) {
+            m_file->unmap(const_cast<uchar*>(m_map));
+        }
+        m_file->close();
+        delete m_file;
+    }
+    m_file = nullptr;
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_index.clear();
+}
+
+bool InventorySnapshot::load()
+{
+    unmap();
+    if (!QFile::exists(m_path)) {
+        return true;
+    }
+
+    m_file = new QFile(m_path);
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        m_error = "无法打开快照文件: " + m_file->errorString();
+        unmap();
+        return false;
+    }
+    m_mapSize = m_file->size();
+    if (m_mapSize < FILE_HEADER_SIZE) {
+        m_error = "快照文件已损坏";
+        unmap();
+        return false;
+    }
+    m_map = m_file->map(0, m_mapSize);
+    if (!m_map) {
+        m_error = "无法映射快照文件: " + m_file->errorString();
+        unmap();
+        return false;
+    }
+
+    if (qFromLittleEndian<quint32>(m_map) != SNAPSHOT_MAGIC ||
+        qFromLittleEndian<quint32>(m_map + 4) != SNAPSHOT_VERSION) {
+        m_error = "快照文件格式不兼容";
+        unmap();
+        return false;
+    }
+    quint32 count = qFromLittleEndian<quint32>(m_map + 8);
+    if (FILE_HEADER_SIZE + qint64(count) * INDEX_ENTRY_SIZE > m_mapSize) {
+        m_error = "快照文件已损坏";
+        unmap();
+        return false;
+    }
+
+    // 只读取每条记录开头的机器标识,其余字段按需解码
+    m_index.reserve(int(count));
+    const uchar* idx = m_map + FILE_HEADER_SIZE;
+    for (quint32 i = 0; i < count; ++i, idx += INDEX_ENTRY_SIZE) {
+        IndexEntry entry;
+        entry.offset = qFromLittleEndian<quint64>(idx);
+        entry.size = qFromLittleEndian<quint32>(idx + 8);
+        if (entry.offset + entry.size > quint64(m_mapSize) || entry.size < 12) {
+            continue;
+        }
+        const uchar* rec = m_map + entry.offset;
+        quint32 keyLen = qFromLittleEndian<quint32>(rec + 4);
+        if (keyLen == 0xFFFFFFFF || 8 + quint64(keyLen) > entry.size) {
+            continue;
+        }
+        QString key = QString::fromUtf8(reinterpret_cast<const char*>(rec + 8), int(keyLen));
+        m_index.insert(key, entry);
+    }
+    return true;
+}
+
+bool InventorySnapshot::save()
+{
+    waitForSave();
+    if (!isDirty()) {
+        return true;
+    }
+
+    bool ok = false;
+    saveAsync([&ok](bool result) { ok = result; });
+    waitForSave();
+    return ok;
+}
+
+void InventorySnapshot::saveAsync(std::function<void(bool)> done)
+{
+    if (m_saving) {
+        m_error = "上一次保存尚未完成";
+        if (done) done(false);
+        return;
+    }
+    if (!isDirty()) {
+        if (done) done(true);
+        return;
+    }
+
+    // 修改记录是隐式共享的,这里只复制引用;保存期间再修改时才各自分离
+    QSharedPointer<SaveJob> job(new SaveJob);
+    job->path = m_path;
+    job->keys = keys();
+    job->index = m_index;
+    job->dirty = m_dirty;
+    job->seen = m_seen;
+    job->map = m_map;
+    job->thread = QThread::currentThread();
+    job->done = std::move(done);
+
+    m_job = job;
+    m_saving = true;
+    m_touched.clear();
+    m_saveWatcher.setFuture(QtConcurrent::run([job]() { writeSnapshot(*job); }));
+}
+
+void InventorySnapshot::writeSnapshot(SaveJob& job)
+{
+    // 汇总最终的记录集合: 未修改的记录直接复制映射中的原始字节
+    std::sort(job.keys.begin(), job.keys.end());
+
+    QVector<QByteArray> records;
+    records.reserve(job.keys.size());
+    for (const QString& key : job.keys) {
+        auto dirtyIt = job.dirty.constFind(key);
+        if (dirtyIt != job.dirty.constEnd()) {
+            records.append(encode(dirtyIt.value()));
+            continue;
+        }
+        const IndexEntry entry = job.index.value(key);
+        const uchar* rec = job.map + entry.offset;
+        auto seenIt = job.seen.constFind(key);
+        if (seenIt == job.seen.constEnd()) {
+            records.append(QByteArray::fromRawData(reinterpret_cast<const char*>(rec), int(entry.size)));
+            continue;
+        }
+
+        // 上线时间紧跟在头部的机器标识之后,复制原始记录后原地改写
+        QByteArray record(reinterpret_cast<const char*>(rec), int(entry.size));
+        quint32 keyLen = qFromLittleEndian<quint32>(rec + 4);
+        if (16 + quint64(keyLen) <= entry.size) {
+            qToLittleEndian<qint64>(seenIt.value(), reinterpret_cast<uchar*>(record.data()) + 8 + keyLen);
+        }
+        records.append(record);
+    }
+
+    QDir().mkpath(QFileInfo(job.path).absolutePath());
+    QScopedPointer<QSaveFile> out(new QSaveFile(job.path));
+    if (!out->open(QIODevice::WriteOnly)) {
+        job.error = "无法写入快照文件: " + out->errorString();
+        return;
+    }
+
+    QByteArray header(FILE_HEADER_SIZE + records.size() * INDEX_ENTRY_SIZE, 0);
+    uchar* h = reinterpret_cast<uchar*>(header.data());
+    qToLittleEndian<quint32>(SNAPSHOT_MAGIC, h);
+    qToLittleEndian<quint32>(SNAPSHOT_VERSION, h + 4);
+    qToLittleEndian<quint32>(quint32(records.size()), h + 8);
+    quint64 offset = quint64(header.size());
+    for (int i = 0; i < records.size(); ++i) {
+        uchar* idx = h + FILE_HEADER_SIZE + i * INDEX_ENTRY_SIZE;
+        qToLittleEndian<quint64>(offset, idx);
+        qToLittleEndian<quint32>(quint32(records[i].size()), idx + 8);
+        offset += quint64(records[i].size());
+    }
+
+    out->write(header);
+    for (const QByteArray& record : records) {
+        out->write(record);
+    }
+    if (!out->flush()) {
+        job.error = "无法写入快照文件: " + out->errorString();
+        return;
+    }
+
+    // 提交要替换仍被映射的文件,只能回到调用线程先释放映射再做
+    out->moveToThread(job.thread);
+    job.out = out.take();
+}
+
+void InventorySnapshot::waitForSave()
+{
+    if (m_saving) {
+        m_saveWatcher.waitForFinished();
+        finishSave();
+    }
+}
+
+void InventorySnapshot::finishSave()
+{
+    // save() 已经等待并处理过时,随后到达的完成通知直接忽略
+    if (!m_saving) return;
+    m_saving = false;
+    QSharedPointer<SaveJob> job;
+    job.swap(m_job);
+
+    bool ok = false;
+    if (job->out) {
+        // Windows 上无法替换仍被映射的文件,提交前先释放旧映射
+        QScopedPointer<QSaveFile> out(job->out);
+        unmap();
+        ok = out->commit();
+        if (!ok) {
+            m_error = "提交快照文件失败: " + out->errorString();
+            load();
+        } else {
+            ok = load();
+        }
+    } else {
+        m_error = job->error;
+    }
+
+    if (ok) {
+        // 已写入新文件、保存期间又没有再修改的记录不必再保留
+        for (auto it = job->dirty.constBegin(); it != job->dirty.constEnd(); ++it) {
+            if (!m_touched.contains(it.key())) {
+                m_dirty.remove(it.key());
+            }
+        }
+        for (auto it = job->seen.constBegin(); it != job->seen.constEnd(); ++it) {
+            if (!m_touched.contains(it.key())) {
+                m_seen.remove(it.key());
+            }
+        }
+    }
+
+    // 已删除的记录只在仍出现在快照文件中时需要记住
+    for (auto it = m_removed.begin(); it != m_removed.end();) {
+        if (m_index.contains(*it)) {
+            ++it;
+        } else {
+            it = m_removed.erase(it);
+        }
+    }
+    m_touched.clear();
+    recountDirtyBytes();
+
+    if (job->done) {
+        job->done(ok);
+    }
+}
+
+void InventorySnapshot::touch(const QString& key)
+{
+    if (m_saving) {
+        m_touched.insert(key);
+    }
+}
+
+void InventorySnapshot::recountDirtyBytes()
+{
+    m_dirtyBytes = 0;
+    for (const MachineInventory& inv : m_dirty) {
+        m_dirtyBytes += footprint(inv);
+    }
+    for (auto it = m_seen.constBegin(); it != m_seen.constEnd(); ++it) {
+        m_dirtyBytes += SEEN_FOOTPRINT + qint64(it.key().size()) * 2;
+    }
+}
+
+int InventorySnapshot::count() const
+{
+    return keys().size();
+}
+
+QStringList InventorySnapshot::keys() const
+{
+    QSet<QString> all;
+    all.reserve(m_index.size() + m_dirty.size());
+    for (auto it = m_index.constBegin(); it != m_index.constEnd(); ++it) {
+        all.insert(it.key());
+    }
+    for (auto it = m_dirty.constBegin(); it != m_dirty.constEnd(); ++it) {
+        all.insert(it.key());
+    }
+    for (const QString& key : m_removed) {
+        all.remove(key);
+    }
+    return all.values();
+}
+
+bool InventorySnapshot::contains(const QString& key) const
+{
+    return !m_removed.contains(key) && (m_dirty.contains(key) || m_index.contains(key));
+}
+
+bool InventorySnapshot::summary(const QString& key, MachineInventory& out) const
+{
+    if (m_removed.contains(key)) return false;
+
+    auto dirtyIt = m_dirty.constFind(key);
+    if (dirtyIt != m_dirty.constEnd()) {
+        out = dirtyIt.value();
+        out.software.clear();
+        return true;
+    }
+    auto idxIt = m_index.constFind(key);
+    if (idxIt == m_index.constEnd() || !decode(idxIt.value(), out, false)) {
+        return false;
+    }
+    out.lastSeen = m_seen.value(key, out.lastSeen);
+    return true;
+}
+
+bool InventorySnapshot::sysInfo(const QString& key, SystemInfo& out) const
+{
+    MachineInventory inv;
+    if (!summary(key, inv) || !inv.hasSysInfo) {
+        return false;
+    }
+    out = inv.sysInfo;
+    return true;
+}
+
+bool InventorySnapshot::software(const QString& key, QList<SoftwareInfo>& out) const
+{
+    if (m_removed.contains(key)) return false;
+
+    auto dirtyIt = m_dirty.constFind(key);
+    if (dirtyIt != m_dirty.constEnd()) {
+        out = dirtyIt.value().software;
+        return dirtyIt.value().hasSoftware;
+    }
+    auto idxIt = m_index.constFind(key);
+    MachineInventory inv;
+    if (idxIt == m_index.constEnd() || !decode(idxIt.value(), inv, true) || !inv.hasSoftware) {
+        return false;
+    }
+    out = inv.software;
+    return true;
+}
+
+QByteArray InventorySnapshot::softwareHash(const QString& key) const
+{
+    MachineInventory inv;
+    if (!summary(key, inv) || !inv.hasSoftware) {
+        return QByteArray();
+    }
+    return inv.softwareHash;
+}
+
+MachineInventory& InventorySnapshot::edit(const QString& key)
+{
+    auto dirtyIt = m_dirty.find(key);
+    if (dirtyIt != m_dirty.end()) {
+        return dirtyIt.value();
+    }
+
+    MachineInventory inv;
+    auto idxIt = m_index.constFind(key);
+    if (m_removed.contains(key) || idxIt == m_index.constEnd() || !decode(idxIt.value(), inv, true)) {
+        inv = MachineInventory();
+    }
+    inv.key = key;
+    auto seenIt = m_seen.find(key);
+    if (seenIt != m_seen.end()) {
+        inv.lastSeen = seenIt.value();
+        m_dirtyBytes -= SEEN_FOOTPRINT + qint64(key.size()) * 2;
+        m_seen.erase(seenIt);
+    }
+    m_removed.remove(key);
+    m_dirtyBytes += footprint(inv);
+    return m_dirty.insert(key, inv).value();
+}
+
+void InventorySnapshot::updateClient(const QString& key, const QString& computerName,
+                                     const QString& ipAddress, const QString& osVersion)
+{
+    if (key.isEmpty()) return;
+    touch(key);
+
+    // 机器重新上线通常只有上线时间变化,不必解码整条记录
+    MachineInventory current;
+    if (!m_dirty.contains(key) && summary(key, current) && current.computerName == computerName &&
+        current.ipAddress == ipAddress && current.osVersion == osVersion) {
+        if (!m_seen.contains(key)) {
+            m_dirtyBytes += SEEN_FOOTPRINT + qint64(key.size()) * 2;
+        }
+        m_seen.insert(key, QDateTime::currentMSecsSinceEpoch());
+        return;
+    }
+
+    MachineInventory& inv = edit(key);
+    m_dirtyBytes -= footprint(inv);
+    inv.lastSeen = QDateTime::currentMSecsSinceEpoch();
+    inv.computerName = computerName;
+    inv.ipAddress = ipAddress;
+    inv.osVersion = osVersion;
+    m_dirtyBytes += footprint(inv);
+}
+
+void InventorySnapshot::updateSysInfo(const QString& key, const SystemInfo& info)
+{
+    if (key.isEmpty()) return;
+    touch(key);
+    MachineInventory& inv = edit(key);
+    m_dirtyBytes -= footprint(inv);
+    inv.hasSysInfo = true;
+    inv.sysInfo = info;
+    m_dirtyBytes += footprint(inv);
+}
+
+void InventorySnapshot::updateSoftware(const QString& key, const QList<SoftwareInfo>& list,
+                                       const QByteArray& hash)
+{
+    if (key.isEmpty()) return;
+    touch(key);
+    MachineInventory& inv = edit(key);
+    m_dirtyBytes -= footprint(inv);
+    inv.hasSoftware = true;
+    inv.software = list;
+    inv.softwareHash = hash;
+    m_dirtyBytes += footprint(inv);
+}
+
+void InventorySnapshot::remove(const QString& key)
+{
+    touch(key);
+    auto dirtyIt = m_dirty.find(key);
+    if (dirtyIt != m_dirty.end()) {
+        m_dirtyBytes -= footprint(dirtyIt.value());
+        m_dirty.erase(dirtyIt);
+    }
+    if (m_seen.remove(key) > 0) {
+        m_dirtyBytes -= SEEN_FOOTPRINT + qint64(key.size()) * 2;
+    }
+    // 保存进行中时这条记录可能正被写入新文件,也要记下
+    if (m_index.contains(key) || m_saving) {
+        m_removed.insert(key);
+    }
+}
+
+qint64 InventorySnapshot::footprint(const MachineInventory& inv)
+{
+    // 只计字符串内容(UTF-16),结构本身按固定开销估算
+    auto text = [](const QString& s) { return qint64(s.size()) * 2; };
+    qint64 bytes = 256 + text(inv.key) + text(inv.computerName) + text(inv.ipAddress) + text(inv.osVersion)
+                 + inv.softwareHash.size();
+    if (inv.hasSysInfo) {
+        const SystemInfo& info = inv.sysInfo;
+        bytes += text(info.computerName) + text(info.osVersion) + text(info.cpuInfo) + text(info.diskInfo)
+               + text(info.macAddress) + text(info.ipAddress);
+    }
+    for (const SoftwareInfo& sw : inv.software) {
+        bytes += 64 + text(sw.name) + text(sw.version) + text(sw.publisher) + text(sw.installDate)
+               + text(sw.installPath) + text(sw.uninstallCmd);
+    }
+    return bytes;
+}
+
+QByteArray InventorySnapshot::encode(const MachineInventory& inv)
+{
+    QByteArray header;
+    {
+        QDataStream stream(&header, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::LittleEndian);
+        writeString(stream, inv.key);
+        stream << inv.lastSeen;
+        writeString(stream, inv.computerName);
+        writeString(stream, inv.ipAddress);
+        writeString(stream, inv.osVersion);
+        stream << inv.hasSysInfo;
+        writeString(stream, inv.sysInfo.computerName);
+        writeString(stream, inv.sysInfo.osVersion);
+        writeString(stream, inv.sysInfo.cpuInfo);
+        stream << inv.sysInfo.totalMemory << inv.sysInfo.freeMemory;
+        writeString(stream, inv.sysInfo.diskInfo);
+        writeString(stream, inv.sysInfo.macAddress);
+        writeString(stream, inv.sysInfo.ipAddress);
+        stream << inv.hasSoftware << inv.softwareHash;
+    }
+
+    QByteArray software;
+    {
+        QDataStream stream(&software, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::LittleEndian);
+        stream << quint32(inv.software.size());
+        for (const SoftwareInfo& info : inv.software) {
+            writeString(stream, info.name);
+            writeString(stream, info.version);
+            writeString(stream, info.publisher);
+            writeString(stream, info.installDate);
+            writeString(stream, info.installPath);
+            writeString(stream, info.uninstallCmd);
+        }
+    }
+
+    QByteArray record(8 + header.size() + software.size(), Qt::Uninitialized);
+    uchar* p = reinterpret_cast<uchar*>(record.data());
+    qToLittleEndian<quint32>(quint32(header.size()), p);
+    memcpy(p + 4, header.constData(), size_t(header.size()));
+    qToLittleEndian<quint32>(quint32(software.size()), p + 4 + header.size());
+    memcpy(p + 8 + header.size(), software.constData(), size_t(software.size()));
+    return record;
+}
+
+bool InventorySnapshot::decode(const IndexEntry& entry, MachineInventory& out, bool withSoftware) const
+{
+    const uchar* rec = m_map + entry.offset;
+    quint32 headerLen = qFromLittleEndian<quint32>(rec);
+    if (8 + quint64(headerLen) > entry.size) return false;
+
+    // 直接在映射内存上解码,不复制记录
+    QByteArray header = QByteArray::fromRawData(reinterpret_cast<const char*>(rec + 4), int(headerLen));
+    QDataStream hs(header);
+    hs.setByteOrder(QDataStream::LittleEndian);
+    out.key = readString(hs);
+    hs >> out.lastSeen;
+    out.computerName = readString(hs);
+    out.ipAddress = readString(hs);
+    out.osVersion = readString(hs);
+    hs >> out.hasSysInfo;
+    out.sysInfo.computerName = readString(hs);
+    out.sysInfo.osVersion = readString(hs);
+    out.sysInfo.cpuInfo = readString(hs);
+    hs >> out.sysInfo.totalMemory >> out.sysInfo.freeMemory;
+    out.sysInfo.diskInfo = readString(hs);
+    out.sysInfo.macAddress = readString(hs);
+    out.sysInfo.ipAddress = readString(hs);
+    hs >> out.hasSoftware >> out.softwareHash;
+    if (hs.status() != QDataStream::Ok) return false;
+
+    out.software.clear();
+    if (!withSoftware) return true;
+
+    const uchar* sw = rec + 4 + headerLen;
+    quint32 softwareLen = qFromLittleEndian<quint32>(sw);
+    if (8 + quint64(headerLen) + softwareLen > entry.size) return false;
+
+    QByteArray software = QByteArray::fromRawData(reinterpret_cast<const char*>(sw + 4), int(softwareLen));
+    QDataStream ss(software);
+    ss.setByteOrder(QDataStream::LittleEndian);
+    quint32 count = 0;
+    ss >> count;
+    out.software.reserve(int(qMin<quint32>(count, softwareLen / 24 + 1)));
+    for (quint32 i = 0; i < count && ss.status() == QDataStream::Ok; ++i) {
+        SoftwareInfo info;
+        info.name = readString(ss);
+        info.version = readString(ss);
+        info.publisher = readString(ss);
+        info.installDate = readString(ss);
+        info.installPath = readString(ss);
+        info.uninstallCmd = readString(ss);
+        out.software.append(info);
+    }
+    return ss.status() == QDataStream::Ok;
+}
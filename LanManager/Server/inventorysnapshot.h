@@ -0,0 +1,146 @@
+#ifndef INVENTORYSNAPSHOT_H
+#define INVENTORYSNAPSHOT_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QSharedPointer>
+#include <QFutureWatcher>
+#include <functional>
+#include "../Common/protocol.h"
+
+class QFile;
+class QSaveFile;
+class QThread;
+
+// 单台机器的已知清单
+struct MachineInventory {
+    QString key;                  // 稳定标识(MAC地址)
+    qint64 lastSeen = 0;          // 最后上线时间(UTC毫秒)
+    QString computerName;
+    QString ipAddress;
+    QString osVersion;
+
+    bool hasSysInfo = false;
+    SystemInfo sysInfo;
+
+    bool hasSoftware = false;
+    QByteArray softwareHash;      // 软件清单摘要(见 Inventory::hash)
+    QList<SoftwareInfo> software;
+};
+
+// 机器清单快照
+//
+// 按机器稳定标识保存最近一次的系统信息和软件清单,服务端重启后直接内存映射
+// 快照文件,只解析索引,具体记录在首次访问时才解码。
+//
+// 文件格式(小端):
+//   [magic 4B][版本 4B][记录数 4B][保留 4B]
+//   [索引: 记录数 x (偏移 8B, 长度 4B)]
+//   [记录: [头部长度 4B][头部][软件长度 4B][软件列表]]
+// 头部以机器标识开头,加载索引时只需读取这一个字段。
+//
+// 保存在后台线程进行: 取修改记录的写时复制副本,编码和写盘都不占用调用线程,
+// 旧映射在写盘期间保持可读,完成后回到调用线程提交并重新映射。
+// 只变化了上线时间的机器不解码整条记录,保存时直接改写原始记录中的这个字段。
+class InventorySnapshot {
+public:
+    explicit InventorySnapshot(const QString& filePath);
+    ~InventorySnapshot();
+
+    // 映射快照文件并建立索引(文件不存在视为空快照)
+    bool load();
+
+    // 把所有修改写入新快照文件并重新映射(先等待进行中的后台保存)
+    bool save();
+
+    // 在后台线程写新快照,完成后在调用线程替换映射并调用 done(需要调用线程有事件循环)。
+    // 保存期间的新修改留到下一次保存
+    void saveAsync(std::function<void(bool)> done = nullptr);
+    bool isSaving() const { return m_saving; }
+
+    // 有尚未保存的内容(包括只变化了上线时间的机器)
+    bool isDirty() const { return hasChanges() || !m_seen.isEmpty(); }
+
+    // 有尚未保存的记录修改或删除(不计上线时间)
+    bool hasChanges() const { return !m_dirty.isEmpty() || !m_removed.isEmpty(); }
+
+    // 尚未保存的记录在内存中的估算字节数(按字符串长度计)
+    qint64 dirtyBytes() const { return m_dirtyBytes; }
+    QString errorString() const { return m_error; }
+
+    int count() const;
+    QStringList keys() const;
+    bool contains(const QString& key) const;
+
+    // 读取机器概要(不解码软件列表)
+    bool summary(const QString& key, MachineInventory& out) const;
+
+    bool sysInfo(const QString& key, SystemInfo& out) const;
+    bool software(const QString& key, QList<SoftwareInfo>& out) const;
+    QByteArray softwareHash(const QString& key) const;
+
+    // 更新
+    void updateClient(const QString& key, const QString& computerName,
+                      const QString& ipAddress, const QString& osVersion);
+    void updateSysInfo(const QString& key, const SystemInfo& info);
+    void updateSoftware(const QString& key, const QList<SoftwareInfo>& list, const QByteArray& hash);
+    void remove(const QString& key);
+
+private:
+    struct IndexEntry {
+        quint64 offset;
+        quint32 size;
+    };
+
+    // 一次后台保存的输入(保存开始时的写时复制副本)和结果
+    struct SaveJob {
+        QString path;
+        QStringList keys;
+        QHash<QString, IndexEntry> index;
+        QHash<QString, MachineInventory> dirty;
+        QHash<QString, qint64> seen;
+        const uchar* map = nullptr;
+        QThread* thread = nullptr;      // 调用线程,写好的文件交回这里提交
+        QSaveFile* out = nullptr;       // 写好但尚未提交的新快照,失败时为空
+        QString error;
+        std::function<void(bool)> done;
+    };
+
+    static void writeSnapshot(SaveJob& job);
+    void finishSave();
+    void waitForSave();
+
+    // 保存进行中修改过的记录不能在保存完成后清除
+    void touch(const QString& key);
+    void recountDirtyBytes();
+
+    // 取得可修改的完整记录(必要时从映射中解码)
+    MachineInventory& edit(const QString& key);
+
+    bool decode(const IndexEntry& entry, MachineInventory& out, bool withSoftware) const;
+    static QByteArray encode(const MachineInventory& inv);
+    static qint64 footprint(const MachineInventory& inv);
+    void unmap();
+
+private:
+    QString m_path;
+    QString m_error;
+    QFile* m_file;
+    const uchar* m_map;
+    qint64 m_mapSize;
+
+    QHash<QString, IndexEntry> m_index;         // 快照文件中的记录
+    QHash<QString, MachineInventory> m_dirty;   // 新增或修改过的记录
+    QSet<QString> m_removed;
+    QHash<QString, qint64> m_seen;              // 只变化了上线时间的记录
+    qint64 m_dirtyBytes;
+
+    bool m_saving;
+    QSharedPointer<SaveJob> m_job;
+    QFutureWatcher<void> m_saveWatcher;
+    QSet<QString> m_touched;
+};
+
+#endif // INVENTORYSNAPSHOT_H
@@ -1,5 +1,12 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QMessageBox>
+#include "datadir.h"
+
+// 以 LANMGR_COUNT_ALLOCS 编译时在这里定义分配计数的替换函数
+#define ALLOC_COUNTER_DEFINE
+#include "../Common/alloccounter.h"
 
 int main(int argc, char *argv[])
 {
@@ -12,8 +19,34 @@ int main(int argc, char *argv[])
     QFont font("Microsoft YaHei", 9);
     app.setFont(font);
     
-    MainWindow window;
-    window.show();
+    QCommandLineParser parser;
+    parser.setApplicationDescription("局域网远程管理服务端");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    
+    QCommandLineOption dataDirOption = DataDir::option();
+    parser.addOption(dataDirOption);
+    parser.process(app);
+    
+    DataDir dataDir(parser.value(dataDirOption));
+    QString error;
+    if (!dataDir.lock(&error)) {
+        QMessageBox::critical(nullptr, "无法启动", error);
+        return 1;
+    }
+    
+    if (!dataDir.addLogFile(&error)) {
+        qWarning("无法打开日志文件: %s", qPrintable(error));
+    }
+    Logger::start();
+    
+    int result;
+    {
+        MainWindow window(dataDir.path());
+        window.show();
+        result = app.exec();
+    }
     
-    return app.exec();
+    Logger::stop();
+    return result;
 }
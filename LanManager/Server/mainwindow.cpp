@@ -12,14 +12,52 @@
 #include <QMenuBar>
 #include <QStatusBar>
 #include <QTabWidget>
+#include <QTimer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QSpinBox>
+#include <QTextDocument>
+#include <QPointer>
+#include <QCoreApplication>
+#include "tsstore.h"
+#include "inventorysnapshot.h"
+#include "datadir.h"
+#include "../Common/logger.h"
 
-MainWindow::MainWindow(QWidget *parent)
+// 日志和结果汇总的界面刷新间隔(毫秒)
+#define UI_REFRESH_INTERVAL 200
+
+// 日志窗口保留的最大行数
+#define LOG_MAX_LINES 5000
+
+MainWindow::MainWindow(const QString& dataDir, QWidget *parent)
     : QMainWindow(parent)
     , m_server(new TcpServer(this))
+    , m_shownRevision(0)
+    , m_uiTimer(new QTimer(this))
     , m_currentClient(-1)
+    , m_dataDir(dataDir)
+    , m_inventory(nullptr)
+    , m_history(nullptr)
+    , m_historyTimer(new QTimer(this))
 {
     setupUI();
     createMenuBar();
+    openHistoryStore();
+    openInventorySnapshot();
+    updateClientList();
+    m_server->setExecOutputDir(m_dataDir + "/exec");
+    
+    connect(m_historyTimer, &QTimer::timeout, this, &MainWindow::onHistoryMaintenance);
+    m_historyTimer->start(HISTORY_FLUSH_INTERVAL);
+    onHistoryMaintenance();
+    
+    connect(m_uiTimer, &QTimer::timeout, this, &MainWindow::onRefreshUi);
+    m_uiTimer->start(UI_REFRESH_INTERVAL);
     
     // 连接服务器信号
     connect(m_server, &TcpServer::clientConnected, this, &MainWindow::onClientConnected);
@@ -30,7 +68,23 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_server, &TcpServer::installResult, this, &MainWindow::onInstallResult);
     connect(m_server, &TcpServer::uninstallResult, this, &MainWindow::onUninstallResult);
     connect(m_server, &TcpServer::fileTransferProgress, this, &MainWindow::onFileTransferProgress);
-    connect(m_server, &TcpServer::logMessage, this, &MainWindow::onLogMessage);
+    connect(m_server, &TcpServer::telemetryReceived, this, &MainWindow::onTelemetryReceived);
+    connect(m_server, &TcpServer::agentStatsUpdated, this, &MainWindow::onAgentStatsUpdated);
+    connect(m_server, &TcpServer::execOutputReceived, this, &MainWindow::onExecOutputReceived);
+    connect(m_server, &TcpServer::execFinished, this, &MainWindow::onExecFinished);
+    connect(m_server->peers(), &PeerLink::queryFinished, this, &MainWindow::onPeerQueryFinished);
+    
+    // 服务端日志在日志线程格式化,再转到界面线程显示
+    QPointer<MainWindow> window(this);
+    Logger::addSink(new CallbackLogSink(LOG_LEVEL_INFO, [window](const LogRecord&, const QString& message) {
+        QCoreApplication* app = QCoreApplication::instance();
+        if (!app) return;
+        QMetaObject::invokeMethod(app, [window, message]() {
+            if (window) {
+                window->onLogMessage(message);
+            }
+        }, Qt::QueuedConnection);
+    }));
     
     setWindowTitle("局域网远程管理系统 - 服务端");
     resize(1200, 800);
@@ -41,6 +95,76 @@ MainWindow::MainWindow(QWidget *parent)
 MainWindow::~MainWindow()
 {
     m_server->stop();
+    m_server->setHistoryStore(nullptr);
+    m_server->setInventorySnapshot(nullptr);
+    delete m_history;
+    
+    if (m_inventory->isDirty() && !m_inventory->save()) {
+        qWarning("清单快照保存失败: %s", qPrintable(m_inventory->errorString()));
+    }
+    delete m_inventory;
+}
+
+void MainWindow::openHistoryStore()
+{
+    m_history = new TsStore(m_dataDir + "/history");
+    if (!m_history->open()) {
+        addLog("历史数据存储打开失败: " + m_history->errorString());
+        delete m_history;
+        m_history = nullptr;
+        return;
+    }
+    
+    m_server->setHistoryStore(m_history);
+}
+
+void MainWindow::openInventorySnapshot()
+{
+    QDir().mkpath(m_dataDir);
+    m_inventory = new InventorySnapshot(m_dataDir + "/inventory.snap");
+    
+    QElapsedTimer timer;
+    timer.start();
+    if (m_inventory->load()) {
+        addLog(QString("已加载机器清单快照: %1 台电脑, 耗时 %2 ms")
+            .arg(m_inventory->count()).arg(timer.elapsed()));
+        
+        // 快照中的电脑在上线前以离线状态显示
+        for (const QString& key : m_inventory->keys()) {
+            MachineInventory inv;
+            if (m_inventory->summary(key, inv)) {
+                m_knownMachines.insert(key, inv);
+            }
+        }
+    } else {
+        // 快照损坏时从空清单开始,下次保存会覆盖
+        addLog("机器清单快照加载失败: " + m_inventory->errorString());
+    }
+    m_server->setInventorySnapshot(m_inventory);
+    m_inventorySaved.start();
+}
+
+void MainWindow::onHistoryMaintenance()
+{
+    // 清单快照在后台线程保存;只有上线时间变化时不必每次都重写整个文件
+    if (m_inventory && !m_inventory->isSaving() && (m_inventory->hasChanges() ||
+        (m_inventory->isDirty() && m_inventorySaved.hasExpired(INVENTORY_SEEN_SAVE_INTERVAL)))) {
+        m_inventorySaved.restart();
+        m_inventory->saveAsync([this](bool ok) {
+            if (!ok) {
+                addLog("机器清单快照保存失败: " + m_inventory->errorString());
+            }
+        });
+    }
+    
+    if (!m_history) return;
+    
+    m_history->flush();
+    qint64 cutoff = QDateTime::currentMSecsSinceEpoch() - qint64(HISTORY_RETENTION_DAYS) * 24 * 3600 * 1000;
+    int removed = m_history->removeSegmentsBefore(cutoff);
+    if (removed > 0) {
+        addLog(QString("已清理 %1 个过期历史数据段").arg(removed));
+    }
 }
 
 void MainWindow::setupUI()
@@ -85,8 +209,8 @@ void MainWindow::setupUI()
     QVBoxLayout* clientLayout = new QVBoxLayout(clientGroup);
     
     m_clientTable = new QTableWidget();
-    m_clientTable->setColumnCount(5);
-    m_clientTable->setHorizontalHeaderLabels({"选择", "计算机名", "IP地址", "MAC地址", "操作系统"});
+    m_clientTable->setColumnCount(8);
+    m_clientTable->setHorizontalHeaderLabels({"选择", "计算机名", "IP地址", "MAC地址", "操作系统", "CPU", "可用内存", "客户端占用"});
     m_clientTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     m_clientTable->setSelectionMode(QAbstractItemView::SingleSelection);
     m_clientTable->horizontalHeader()->setStretchLastSection(true);
@@ -113,11 +237,18 @@ void MainWindow::setupUI()
     m_btnRefreshSysInfo = new QPushButton("刷新系统信息");
     connect(m_btnRefreshSysInfo, &QPushButton::clicked, this, &MainWindow::onRefreshSysInfo);
     
+    m_btnHistory = new QPushButton("历史趋势(30天)");
+    connect(m_btnHistory, &QPushButton::clicked, this, &MainWindow::onShowHistory);
+    
+    QHBoxLayout* sysInfoBtnLayout = new QHBoxLayout();
+    sysInfoBtnLayout->addWidget(m_btnRefreshSysInfo);
+    sysInfoBtnLayout->addWidget(m_btnHistory);
+    
     m_sysInfoText = new QTextEdit();
     m_sysInfoText->setReadOnly(true);
     m_sysInfoText->setFont(QFont("Consolas", 10));
     
-    sysInfoLayout->addWidget(m_btnRefreshSysInfo);
+    sysInfoLayout->addLayout(sysInfoBtnLayout);
     sysInfoLayout->addWidget(m_sysInfoText);
     
     // 软件管理页
@@ -148,8 +279,61 @@ void MainWindow::setupUI()
     softwareLayout->addLayout(softwareBtnLayout);
     softwareLayout->addWidget(m_softwareTree);
     
+    // 远程执行页
+    QWidget* execPage = new QWidget();
+    QVBoxLayout* execLayout = new QVBoxLayout(execPage);
+    
+    QHBoxLayout* execBtnLayout = new QHBoxLayout();
+    m_execCommand = new QLineEdit();
+    m_execCommand->setPlaceholderText("在勾选的电脑上执行的命令(Windows 由 cmd /c 执行, Linux 由 /bin/sh -c 执行)");
+    m_btnExec = new QPushButton("执行");
+    m_btnCancelExec = new QPushButton("取消执行");
+    m_btnCancelExec->setEnabled(false);
+    
+    connect(m_execCommand, &QLineEdit::returnPressed, this, &MainWindow::onExecuteCommand);
+    connect(m_btnExec, &QPushButton::clicked, this, &MainWindow::onExecuteCommand);
+    connect(m_btnCancelExec, &QPushButton::clicked, this, &MainWindow::onCancelCommands);
+    
+    execBtnLayout->addWidget(m_execCommand);
+    execBtnLayout->addWidget(m_btnExec);
+    execBtnLayout->addWidget(m_btnCancelExec);
+    
+    m_execOutputText = new QPlainTextEdit();
+    m_execOutputText->setReadOnly(true);
+    m_execOutputText->setFont(QFont("Consolas", 9));
+    m_execOutputText->setMaximumBlockCount(5000);
+    
+    execLayout->addLayout(execBtnLayout);
+    execLayout->addWidget(m_execOutputText);
+    
+    // 结果汇总页: 批量操作的结果按消息分组计数,展开可查看电脑列表
+    QWidget* resultPage = new QWidget();
+    QVBoxLayout* resultLayout = new QVBoxLayout(resultPage);
+    
+    QHBoxLayout* resultBtnLayout = new QHBoxLayout();
+    m_resultSummary = new QLabel("暂无结果");
+    QPushButton* btnClearResults = new QPushButton("清空");
+    connect(btnClearResults, &QPushButton::clicked, this, &MainWindow::onClearResults);
+    resultBtnLayout->addWidget(m_resultSummary);
+    resultBtnLayout->addStretch();
+    resultBtnLayout->addWidget(btnClearResults);
+    
+    m_resultTree = new QTreeWidget();
+    m_resultTree->setHeaderLabels({"操作", "结果", "消息", "电脑数"});
+    m_resultTree->setColumnWidth(0, 80);
+    m_resultTree->setColumnWidth(1, 60);
+    m_resultTree->setColumnWidth(2, 400);
+    m_resultTree->setSortingEnabled(true);
+    m_resultTree->sortByColumn(3, Qt::DescendingOrder);
+    connect(m_resultTree, &QTreeWidget::itemExpanded, this, &MainWindow::onResultGroupExpanded);
+    
+    resultLayout->addLayout(resultBtnLayout);
+    resultLayout->addWidget(m_resultTree);
+    
     infoTabs->addTab(sysInfoPage, "系统信息");
     infoTabs->addTab(softwarePage, "软件管理");
+    infoTabs->addTab(execPage, "远程执行");
+    infoTabs->addTab(resultPage, "结果汇总");
     
     // 日志区域
     QGroupBox* logGroup = new QGroupBox("操作日志");
@@ -159,6 +343,7 @@ void MainWindow::setupUI()
     m_logText->setReadOnly(true);
     m_logText->setFont(QFont("Consolas", 9));
     m_logText->setMaximumHeight(200);
+    m_logText->document()->setMaximumBlockCount(LOG_MAX_LINES);
     
     logLayout->addWidget(m_logText);
     
@@ -182,8 +367,69 @@ void MainWindow::setupUI()
 void MainWindow::createMenuBar()
 {
     QMenu* fileMenu = menuBar()->addMenu("文件(&F)");
+    fileMenu->addAction("导出操作跟踪(&T)...", [this]() {
+        QString path = QFileDialog::getSaveFileName(this, "导出操作跟踪",
+            QString("lanmgr-trace-%1.json").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")),
+            "Chrome 跟踪文件 (*.json)");
+        if (path.isEmpty()) return;
+        int count = m_server->exportTraces(path);
+        if (count >= 0) {
+            addLog(QString("已导出 %1 个操作的跟踪到 %2(可用 chrome://tracing 或 Perfetto 打开)").arg(count).arg(path));
+        }
+    });
+    QAction* captureAction = fileMenu->addAction("记录流量(&R)...");
+    captureAction->setCheckable(true);
+    connect(captureAction, &QAction::triggered, this, [this, captureAction](bool checked) {
+        if (!checked) {
+            m_server->stopCapture();
+            return;
+        }
+        QString path = QFileDialog::getSaveFileName(this, "记录流量",
+            QString("lanmgr-%1.lmcap").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")),
+            "流量记录 (*.lmcap)");
+        captureAction->setChecked(!path.isEmpty() && m_server->startCapture(path));
+    });
+    fileMenu->addSeparator();
     fileMenu->addAction("退出(&X)", this, &QWidget::close);
     
+    QMenu* settingsMenu = menuBar()->addMenu("设置(&S)");
+    settingsMenu->addAction("遥测采样间隔(&T)...", [this]() {
+        bool ok;
+        int interval = QInputDialog::getInt(this, "遥测设置", "采样间隔(毫秒, 0表示关闭):",
+                                            m_server->telemetryInterval(), 0, 600000, 500, &ok);
+        if (ok) {
+            m_server->setTelemetryConfig(interval);
+        }
+    });
+    settingsMenu->addAction("带宽限制(&B)...", this, &MainWindow::onBandwidthSettings);
+    settingsMenu->addAction("内存限制(&R)...", this, &MainWindow::onMemorySettings);
+    settingsMenu->addAction("指标端口(&M)...", [this]() {
+        bool ok;
+        int port = QInputDialog::getInt(this, "运行指标", "本机指标端口(0表示关闭):",
+                                        m_server->metricsPort(), 0, 65535, 1, &ok);
+        if (ok) {
+            m_server->setMetricsPort(quint16(port));
+        }
+    });
+    
+    QMenu* clusterMenu = menuBar()->addMenu("集群(&C)");
+    clusterMenu->addAction("服务器列表(&L)", [this]() {
+        QString text = QString("本机: 连接数 %1/%2\n").arg(m_server->getClientIds().size()).arg(m_server->capacity());
+        for (const ServerAnnounce& info : m_server->peers()->peers()) {
+            text += QString("%1: 连接数 %2/%3\n").arg(info.id()).arg(info.load).arg(info.capacity);
+        }
+        QMessageBox::information(this, "服务器列表", text);
+    });
+    clusterMenu->addAction("跨服务器查询电脑(&Q)...", [this]() {
+        bool ok;
+        QString machine = QInputDialog::getText(this, "跨服务器查询", "MAC地址、计算机名或IP:",
+                                                QLineEdit::Normal, QString(), &ok).trimmed();
+        if (ok && !machine.isEmpty()) {
+            m_server->peers()->queryInventory(machine);
+            addLog(QString("正在向其他服务器查询 %1...").arg(machine));
+        }
+    });
+    
     QMenu* helpMenu = menuBar()->addMenu("帮助(&H)");
     helpMenu->addAction("关于(&A)", [this]() {
         QMessageBox::about(this, "关于", 
@@ -199,10 +445,23 @@ void MainWindow::updateClientList()
 {
     m_clientTable->setRowCount(0);
     
+    QSet<QString> online;
     for (qintptr clientId : m_server->getClientIds()) {
         ClientConnection* client = m_server->getClient(clientId);
         if (!client) continue;
         
+        // 记下在线电脑的最新信息,断开后按离线显示
+        QString key = TcpServer::historyKey(client);
+        if (!key.isEmpty()) {
+            MachineInventory& known = m_knownMachines[key];
+            known.key = key;
+            known.lastSeen = QDateTime::currentMSecsSinceEpoch();
+            known.computerName = client->computerName;
+            known.ipAddress = client->ipAddress;
+            known.osVersion = client->osVersion;
+            online.insert(key);
+        }
+        
         int row = m_clientTable->rowCount();
         m_clientTable->insertRow(row);
         
@@ -210,13 +469,105 @@ void MainWindow::updateClientList()
         QTableWidgetItem* checkItem = new QTableWidgetItem();
         checkItem->setCheckState(Qt::Unchecked);
         checkItem->setData(Qt::UserRole, (qlonglong)clientId);
+        checkItem->setData(Qt::UserRole + 1, key);
         m_clientTable->setItem(row, 0, checkItem);
         
         m_clientTable->setItem(row, 1, new QTableWidgetItem(client->computerName));
         m_clientTable->setItem(row, 2, new QTableWidgetItem(client->ipAddress));
         m_clientTable->setItem(row, 3, new QTableWidgetItem(client->macAddress));
         m_clientTable->setItem(row, 4, new QTableWidgetItem(client->osVersion));
+        m_clientTable->setItem(row, 5, new QTableWidgetItem());
+        m_clientTable->setItem(row, 6, new QTableWidgetItem());
+        m_clientTable->setItem(row, 7, new QTableWidgetItem());
+        if (!client->telemetry.isEmpty()) {
+            updateTelemetryCells(row, client->telemetry.latest());
+        }
+        if (!client->agentStats.isEmpty()) {
+            updateAgentStatsCell(row, client->agentStats);
+        }
     }
+    
+    // 离线的电脑排在后面,不能勾选,选中后显示快照中的清单
+    for (auto it = m_knownMachines.constBegin(); it != m_knownMachines.constEnd(); ++it) {
+        if (online.contains(it.key())) continue;
+        const MachineInventory& inv = it.value();
+        
+        int row = m_clientTable->rowCount();
+        m_clientTable->insertRow(row);
+        
+        QTableWidgetItem* idItem = new QTableWidgetItem();
+        idItem->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+        idItem->setData(Qt::UserRole, (qlonglong)0);
+        idItem->setData(Qt::UserRole + 1, inv.key);
+        m_clientTable->setItem(row, 0, idItem);
+        
+        QStringList cells = {inv.computerName, inv.ipAddress, inv.key, inv.osVersion, "离线", QString(),
+            "最后上线 " + QDateTime::fromMSecsSinceEpoch(inv.lastSeen).toString("yyyy-MM-dd hh:mm")};
+        for (int col = 1; col <= cells.size(); ++col) {
+            QTableWidgetItem* item = new QTableWidgetItem(cells[col - 1]);
+            item->setForeground(Qt::gray);
+            m_clientTable->setItem(row, col, item);
+        }
+    }
+}
+
+void MainWindow::updateTelemetryCells(int row, const TelemetrySample& sample)
+{
+    QTableWidgetItem* cpuItem = m_clientTable->item(row, 5);
+    QTableWidgetItem* memItem = m_clientTable->item(row, 6);
+    if (!cpuItem || !memItem) return;
+    
+    cpuItem->setText(QString("%1%").arg(sample.cpuUsage / 10.0, 0, 'f', 1));
+    memItem->setText(QString("%1 MB").arg(sample.freeMemory));
+    
+    // 高负载客户端标红,便于在大量机器中快速定位
+    bool cpuBusy = sample.cpuUsage >= 900;
+    bool memLow = sample.totalMemory > 0 && sample.freeMemory * 10 < sample.totalMemory;
+    cpuItem->setForeground(cpuBusy ? Qt::red : palette().text().color());
+    memItem->setForeground(memLow ? Qt::red : palette().text().color());
+}
+
+void MainWindow::updateAgentStatsCell(int row, const QJsonObject& stats)
+{
+    QTableWidgetItem* item = m_clientTable->item(row, 7);
+    if (!item) return;
+    
+    item->setText(QString("%1% / %2 MB")
+        .arg(stats.value("cpu").toInt() / 10.0, 0, 'f', 1)
+        .arg(stats.value("rss").toDouble() / 1024, 0, 'f', 1));
+    
+    // 降速中的客户端标红,提示各类操作的明细
+    bool throttled = stats.value("throttled").toBool();
+    item->setForeground(throttled ? Qt::red : palette().text().color());
+    
+    QJsonObject budget = stats.value("budget").toObject();
+    QString tip = QString("预算: CPU %1%, 内存 %2 MB\n降速 %3 次%4")
+        .arg(budget.value("cpu").toInt() / 10.0, 0, 'f', 1)
+        .arg(budget.value("memory").toInt())
+        .arg(stats.value("throttles").toInt())
+        .arg(throttled ? " (降速中)" : "");
+    QJsonObject ops = stats.value("ops").toObject();
+    for (auto it = ops.constBegin(); it != ops.constEnd(); ++it) {
+        QJsonObject op = it.value().toObject();
+        tip += QString("\n%1: %2 次, CPU %3 ms, 耗时 %4 ms, 读写 %5 KB")
+            .arg(it.key())
+            .arg(op.value("count").toDouble(), 0, 'f', 0)
+            .arg(op.value("cpuMs").toDouble(), 0, 'f', 0)
+            .arg(op.value("wallMs").toDouble(), 0, 'f', 0)
+            .arg(op.value("ioKB").toDouble(), 0, 'f', 0);
+    }
+    item->setToolTip(tip);
+}
+
+int MainWindow::findClientRow(qintptr clientId) const
+{
+    for (int row = 0; row < m_clientTable->rowCount(); ++row) {
+        QTableWidgetItem* item = m_clientTable->item(row, 0);
+        if (item && item->data(Qt::UserRole).toLongLong() == clientId) {
+            return row;
+        }
+    }
+    return -1;
 }
 
 void MainWindow::updateSysInfoDisplay(const SystemInfo& info)
@@ -266,8 +617,105 @@ QList<qintptr> MainWindow::getSelectedClients()
 
 void MainWindow::addLog(const QString& message)
 {
+    // 只记下来,由 onRefreshUi 批量写入;积压超过窗口能显示的行数时丢弃最早的
     QString timestamp = QDateTime::currentDateTime().toString("hh:mm:ss");
-    m_logText->append(QString("[%1] %2").arg(timestamp).arg(message));
+    m_pendingLog.append(QString("[%1] %2").arg(timestamp).arg(message));
+    if (m_pendingLog.size() > LOG_MAX_LINES) {
+        m_pendingLog.erase(m_pendingLog.begin(), m_pendingLog.begin() + (m_pendingLog.size() - LOG_MAX_LINES));
+    }
+}
+
+void MainWindow::flushLog()
+{
+    if (m_pendingLog.isEmpty()) return;
+    m_logText->append(m_pendingLog.join('\n'));
+    m_pendingLog.clear();
+}
+
+void MainWindow::onRefreshUi()
+{
+    flushLog();
+    refreshResults();
+}
+
+QString MainWindow::clientName(qintptr clientId)
+{
+    ClientConnection* client = m_server->getClient(clientId);
+    return client && !client->computerName.isEmpty() ? client->computerName : QString::number(clientId);
+}
+
+void MainWindow::refreshResults()
+{
+    if (m_results.revision() == m_shownRevision) return;
+    m_shownRevision = m_results.revision();
+    
+    if (m_results.total() == 0) {
+        m_resultSummary->setText("暂无结果");
+    } else {
+        m_resultSummary->setText(QString("共 %1 条结果: 成功 %2, 失败 %3, 分为 %4 组")
+            .arg(m_results.total()).arg(m_results.successCount())
+            .arg(m_results.failureCount()).arg(m_results.groupCount()));
+    }
+    
+    // 组只会增加,已有的行就地更新计数,展开状态不受影响
+    m_resultTree->setSortingEnabled(false);
+    for (int i = m_resultItems.size(); i < m_results.groupCount(); ++i) {
+        const ResultGroup& group = m_results.group(i);
+        QTreeWidgetItem* item = new QTreeWidgetItem();
+        item->setText(0, group.operation);
+        item->setText(1, group.success ? "成功" : "失败");
+        if (group.exitCode != NO_EXIT_CODE) {
+            item->setText(2, QString("%1 (退出码 %2)").arg(group.message).arg(group.exitCode));
+        } else {
+            item->setText(2, group.message);
+        }
+        item->setData(0, Qt::UserRole, i);
+        item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+        if (!group.success) {
+            item->setForeground(1, Qt::red);
+        }
+        m_resultTree->addTopLevelItem(item);
+        m_resultItems.append(item);
+    }
+    for (int i = 0; i < m_resultItems.size(); ++i) {
+        QTreeWidgetItem* item = m_resultItems[i];
+        int count = m_results.group(i).machines.size();
+        if (item->data(3, Qt::DisplayRole).toInt() != count) {
+            item->setData(3, Qt::DisplayRole, count);
+            if (item->isExpanded()) {
+                fillResultMachines(item);
+            }
+        }
+    }
+    m_resultTree->setSortingEnabled(true);
+}
+
+void MainWindow::onResultGroupExpanded(QTreeWidgetItem* item)
+{
+    if (!item->parent()) {
+        fillResultMachines(item);
+    }
+}
+
+void MainWindow::fillResultMachines(QTreeWidgetItem* item)
+{
+    // 电脑列表在展开时才创建,之后只追加新到的
+    const ResultGroup& group = m_results.group(item->data(0, Qt::UserRole).toInt());
+    QList<QTreeWidgetItem*> children;
+    for (int i = item->childCount(); i < group.machines.size(); ++i) {
+        QTreeWidgetItem* child = new QTreeWidgetItem();
+        child->setText(2, group.machines[i]);
+        children.append(child);
+    }
+    item->addChildren(children);
+}
+
+void MainWindow::onClearResults()
+{
+    m_results.clear();
+    m_resultItems.clear();
+    m_resultTree->clear();
+    refreshResults();
 }
 
 void MainWindow::onStartServer()
@@ -293,7 +741,7 @@ void MainWindow::onStopServer()
     m_btnStart->setEnabled(true);
     m_btnStop->setEnabled(false);
     m_statusLabel->setText("服务器已停止");
-    m_clientTable->setRowCount(0);
+    updateClientList();
     m_sysInfoText->clear();
     m_softwareTree->clear();
     addLog("服务器已停止");
@@ -317,6 +765,50 @@ void MainWindow::onRefreshSysInfo()
     }
 }
 
+void MainWindow::onShowHistory()
+{
+    ClientConnection* client = m_server->getClient(m_currentClient);
+    if (!client) {
+        QMessageBox::information(this, "提示", "请先选择一个客户端");
+        return;
+    }
+    if (!m_history) {
+        QMessageBox::warning(this, "错误", "历史数据存储不可用");
+        return;
+    }
+    
+    const qint64 day = 24LL * 3600 * 1000;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 from = (now / day - 29) * day;
+    QString key = TcpServer::historyKey(client);
+    
+    QVector<TsStore::Bucket> cpu = m_history->downsample(key + "/cpu", from, now, day);
+    QVector<TsStore::Bucket> mem = m_history->downsample(key + "/freeMemory", from, now, day);
+    QVector<TsStore::Bucket> disk = m_history->downsample(key + "/freeDisk", from, now, day);
+    
+    // 三个序列按桶起始时间合并显示
+    QMap<qint64, QString> rows;
+    for (const TsStore::Bucket& b : cpu) {
+        rows[b.start] += QString("  CPU平均 %1% 峰值 %2%")
+            .arg(b.avg() / 10.0, 0, 'f', 1).arg(b.max / 10.0, 0, 'f', 1);
+    }
+    for (const TsStore::Bucket& b : mem) {
+        rows[b.start] += QString("  最低可用内存 %1 MB").arg(b.min);
+    }
+    for (const TsStore::Bucket& b : disk) {
+        rows[b.start] += QString("  最低可用磁盘 %1 MB").arg(b.min);
+    }
+    
+    QString text = QString("%1 (%2) 最近30天趋势\n\n").arg(client->computerName).arg(key);
+    if (rows.isEmpty()) {
+        text += "暂无历史数据";
+    }
+    for (auto it = rows.constBegin(); it != rows.constEnd(); ++it) {
+        text += QDateTime::fromMSecsSinceEpoch(it.key()).toString("yyyy-MM-dd") + it.value() + "\n";
+    }
+    m_sysInfoText->setText(text);
+}
+
 void MainWindow::onRefreshSoftware()
 {
     QList<qintptr> clients = getSelectedClients();
@@ -399,11 +891,47 @@ void MainWindow::onUninstallSoftware()
     }
 }
 
+void MainWindow::onExecuteCommand()
+{
+    QList<qintptr> clients = getSelectedClients();
+    if (clients.isEmpty()) {
+        QMessageBox::information(this, "提示", "请先勾选要操作的客户端");
+        return;
+    }
+    
+    QString command = m_execCommand->text().trimmed();
+    if (command.isEmpty()) {
+        return;
+    }
+    
+    int ret = QMessageBox::question(this, "确认",
+        QString("确定要在 %1 台电脑上执行:\n%2?").arg(clients.size()).arg(command));
+    if (ret != QMessageBox::Yes) return;
+    
+    ExecRequest request;
+    request.command = command;
+    m_execOutputText->clear();
+    for (qintptr clientId : clients) {
+        quint32 jobId = m_server->executeCommand(clientId, request);
+        if (jobId != 0) {
+            m_runningJobs.insert(clientId, jobId);
+        }
+    }
+    m_btnCancelExec->setEnabled(!m_runningJobs.isEmpty());
+}
+
+void MainWindow::onCancelCommands()
+{
+    for (auto it = m_runningJobs.constBegin(); it != m_runningJobs.constEnd(); ++it) {
+        m_server->cancelCommand(it.key(), it.value());
+    }
+}
+
 void MainWindow::onSelectAll()
 {
     for (int row = 0; row < m_clientTable->rowCount(); ++row) {
         QTableWidgetItem* item = m_clientTable->item(row, 0);
-        if (item) {
+        if (item && (item->flags() & Qt::ItemIsUserCheckable)) {
             item->setCheckState(Qt::Checked);
         }
     }
@@ -413,7 +941,7 @@ void MainWindow::onDeselectAll()
 {
     for (int row = 0; row < m_clientTable->rowCount(); ++row) {
         QTableWidgetItem* item = m_clientTable->item(row, 0);
-        if (item) {
+        if (item && (item->flags() & Qt::ItemIsUserCheckable)) {
             item->setCheckState(Qt::Unchecked);
         }
     }
@@ -428,7 +956,6 @@ void MainWindow::onClientConnected(qintptr clientId)
 void MainWindow::onClientDisconnected(qintptr clientId)
 {
     updateClientList();
-    m_softwareLists.remove(clientId);
     if (m_currentClient == clientId) {
         m_currentClient = -1;
         m_sysInfoText->clear();
@@ -439,6 +966,7 @@ void MainWindow::onClientDisconnected(qintptr clientId)
 
 void MainWindow::onClientInfoUpdated(qintptr clientId)
 {
+    Q_UNUSED(clientId)
     updateClientList();
 }
 
@@ -452,37 +980,30 @@ void MainWindow::onSysInfoReceived(qintptr clientId, const SystemInfo& info)
 
 void MainWindow::onSoftwareListReceived(qintptr clientId, const QList<SoftwareInfo>& list)
 {
-    m_softwareLists[clientId] = list;
-    
     if (clientId == m_currentClient || getSelectedClients().contains(clientId)) {
         updateSoftwareList(list);
     }
     addLog(QString("收到客户端 %1 软件列表 (%2 个软件)").arg(clientId).arg(list.size()));
 }
 
-void MainWindow::onInstallResult(qintptr clientId, bool success, const QString& message)
+void MainWindow::onInstallResult(qintptr clientId, bool success, int exitCode, const QString& message)
 {
     m_progressBar->setVisible(false);
     
-    ClientConnection* client = m_server->getClient(clientId);
-    QString name = client ? client->computerName : QString::number(clientId);
-    
+    QString name = clientName(clientId);
     addLog(QString("客户端 %1 安装%2: %3").arg(name)
         .arg(success ? "成功" : "失败").arg(message));
     
-    if (!success) {
-        QMessageBox::warning(this, "安装失败", 
-            QString("客户端 %1 安装失败:\n%2").arg(name).arg(message));
-    }
+    // 失败不再逐台弹窗,在结果汇总页按消息分组查看
+    m_results.add("安装", success, name, message, exitCode);
 }
 
-void MainWindow::onUninstallResult(qintptr clientId, bool success, const QString& message)
+void MainWindow::onUninstallResult(qintptr clientId, bool success, int exitCode, const QString& message)
 {
-    ClientConnection* client = m_server->getClient(clientId);
-    QString name = client ? client->computerName : QString::number(clientId);
-    
+    QString name = clientName(clientId);
     addLog(QString("客户端 %1 卸载%2: %3").arg(name)
         .arg(success ? "成功" : "失败").arg(message));
+    m_results.add("卸载", success, name, message, exitCode);
     
     if (success) {
         // 刷新软件列表
@@ -492,9 +1013,64 @@ void MainWindow::onUninstallResult(qintptr clientId, bool success, const QString
 
 void MainWindow::onFileTransferProgress(qintptr clientId, int percent)
 {
+    Q_UNUSED(clientId)
     m_progressBar->setValue(percent);
 }
 
+void MainWindow::onTelemetryReceived(qintptr clientId, const TelemetrySample& latest)
+{
+    // 只更新对应行的单元格,不重建整个表格
+    int row = findClientRow(clientId);
+    if (row >= 0) {
+        updateTelemetryCells(row, latest);
+    }
+}
+
+void MainWindow::onAgentStatsUpdated(qintptr clientId)
+{
+    ClientConnection* client = m_server->getClient(clientId);
+    int row = findClientRow(clientId);
+    if (client && row >= 0) {
+        updateAgentStatsCell(row, client->agentStats);
+    }
+}
+
+void MainWindow::onPeerQueryFinished(int requestId, const QString& machine,
+                                     const QList<PeerQueryResult>& results)
+{
+    Q_UNUSED(requestId)
+    
+    QString text = QString("跨服务器查询 %1: %2 台服务器回复\n\n").arg(machine).arg(results.size());
+    const PeerQueryResult* shown = nullptr;
+    for (const PeerQueryResult& result : results) {
+        if (!result.found) {
+            text += QString("%1: 未找到\n").arg(result.serverId);
+            continue;
+        }
+        const MachineInventory& inv = result.inventory;
+        text += QString("%1: %2 (%3) %4, 最后上线 %5, 软件 %6 个\n")
+            .arg(result.serverId).arg(inv.computerName).arg(inv.key)
+            .arg(result.online ? "在线" : "离线")
+            .arg(QDateTime::fromMSecsSinceEpoch(inv.lastSeen).toString("yyyy-MM-dd hh:mm"))
+            .arg(inv.software.size());
+        // 优先显示在线的那份清单
+        if (!shown || (result.online && !shown->online)) {
+            shown = &result;
+        }
+    }
+    
+    if (shown && shown->inventory.hasSysInfo) {
+        const SystemInfo& info = shown->inventory.sysInfo;
+        text += QString("\n操作系统: %1\nCPU: %2\n总内存: %3 MB\n磁盘: %4\n")
+            .arg(info.osVersion).arg(info.cpuInfo).arg(info.totalMemory).arg(info.diskInfo);
+    }
+    m_sysInfoText->setText(text);
+    if (shown) {
+        updateSoftwareList(shown->inventory.software);
+    }
+    addLog(QString("跨服务器查询 %1 完成").arg(machine));
+}
+
 void MainWindow::onLogMessage(const QString& message)
 {
     addLog(message);
@@ -511,13 +1087,138 @@ void MainWindow::onClientSelectionChanged()
     int row = selected.first()->row();
     QTableWidgetItem* idItem = m_clientTable->item(row, 0);
     if (idItem) {
+        qintptr previous = m_currentClient;
         m_currentClient = idItem->data(Qt::UserRole).toLongLong();
+        if (m_currentClient != previous) {
+            m_execOutputText->clear();
+        }
         
-        // 如果有缓存的软件列表,显示它
-        if (m_softwareLists.contains(m_currentClient)) {
-            updateSoftwareList(m_softwareLists[m_currentClient]);
+        // 如果快照中有这台电脑的清单,直接显示(离线的电脑也可以查看)
+        QString key = idItem->data(Qt::UserRole + 1).toString();
+        SystemInfo info;
+        QList<SoftwareInfo> list;
+        if (!key.isEmpty() && m_inventory->sysInfo(key, info)) {
+            updateSysInfoDisplay(info);
+        }
+        if (!key.isEmpty() && m_inventory->software(key, list)) {
+            updateSoftwareList(list);
         } else {
             m_softwareTree->clear();
         }
     }
 }
+
+void MainWindow::onExecOutputReceived(qintptr clientId, quint32 jobId, int stream, const QByteArray& data)
+{
+    Q_UNUSED(stream);
+    // 只显示当前选中电脑的输出,完整输出由服务端按作业保存
+    if (clientId != m_currentClient || m_runningJobs.value(clientId) != jobId) {
+        return;
+    }
+    m_execOutputText->moveCursor(QTextCursor::End);
+    m_execOutputText->insertPlainText(QString::fromLocal8Bit(data));
+}
+
+void MainWindow::onExecFinished(qintptr clientId, quint32 jobId, const ExecResult& result, const ExecOutput* output)
+{
+    if (m_runningJobs.value(clientId) == jobId) {
+        m_runningJobs.remove(clientId);
+    }
+    m_btnCancelExec->setEnabled(!m_runningJobs.isEmpty());
+    
+    if (output && output->isSpilled()) {
+        addLog(QString("客户端 %1 命令 #%2 输出已保存到 %3").arg(clientId).arg(jobId).arg(output->spillPath()));
+    }
+    QString status = !result.started ? QString("启动失败: %1").arg(result.error)
+                   : result.canceled ? QString("已取消")
+                   : result.timedOut ? QString("超时")
+                   : QString("退出码 %1").arg(result.exitCode);
+    m_results.add("执行", result.isSuccess(), clientName(clientId), status);
+    
+    if (clientId == m_currentClient) {
+        m_execOutputText->appendPlainText(QString("\n[命令 #%1 %2, 耗时 %3 ms%4]")
+            .arg(jobId).arg(status).arg(result.elapsedMs).arg(result.truncated ? ", 输出已截断" : ""));
+    }
+}
+
+void MainWindow::onBandwidthSettings()
+{
+    const BandwidthLimits& current = m_server->bandwidthLimits();
+    
+    QDialog dialog(this);
+    dialog.setWindowTitle("带宽限制");
+    QFormLayout* form = new QFormLayout(&dialog);
+    
+    auto rateBox = [&dialog](qint64 rate) {
+        QSpinBox* box = new QSpinBox(&dialog);
+        box->setRange(0, 10 * 1024 * 1024);
+        box->setSingleStep(1024);
+        box->setSuffix(" KB/s");
+        box->setSpecialValueText("不限");
+        box->setValue(int(rate / 1024));
+        return box;
+    };
+    QSpinBox* globalBox = rateBox(current.globalRate);
+    QSpinBox* subnetBox = rateBox(current.subnetRate);
+    QSpinBox* clientBox = rateBox(current.clientRate);
+    QSpinBox* prefixBox = new QSpinBox(&dialog);
+    prefixBox->setRange(8, 32);
+    prefixBox->setPrefix("/");
+    prefixBox->setValue(current.subnetPrefix);
+    
+    form->addRow("全局出口:", globalBox);
+    form->addRow("每个子网:", subnetBox);
+    form->addRow("子网前缀:", prefixBox);
+    form->addRow("每个客户端:", clientBox);
+    
+    QDialogButtonBox* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    form->addRow(buttons);
+    
+    if (dialog.exec() == QDialog::Accepted) {
+        BandwidthLimits limits;
+        limits.globalRate = qint64(globalBox->value()) * 1024;
+        limits.subnetRate = qint64(subnetBox->value()) * 1024;
+        limits.clientRate = qint64(clientBox->value()) * 1024;
+        limits.subnetPrefix = prefixBox->value();
+        m_server->setBandwidthLimits(limits);
+    }
+}
+
+void MainWindow::onMemorySettings()
+{
+    const MemoryLimits& current = m_server->memoryLimits();
+    
+    QDialog dialog(this);
+    dialog.setWindowTitle("内存限制");
+    QFormLayout* form = new QFormLayout(&dialog);
+    
+    auto sizeBox = [&dialog](qint64 bytes, int minimum, int maximum) {
+        QSpinBox* box = new QSpinBox(&dialog);
+        box->setRange(minimum, maximum);
+        box->setSuffix(" MB");
+        box->setValue(int(bytes / (1024 * 1024)));
+        return box;
+    };
+    QSpinBox* frameBox = sizeBox(current.maxFrameSize, 1, 1024);
+    QSpinBox* clientBox = sizeBox(current.clientLimit, 1, 64 * 1024);
+    QSpinBox* globalBox = sizeBox(current.globalBudget, 16, 64 * 1024);
+    
+    form->addRow("最大帧长度:", frameBox);
+    form->addRow("每个连接:", clientBox);
+    form->addRow("全局预算:", globalBox);
+    
+    QDialogButtonBox* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    form->addRow(buttons);
+    
+    if (dialog.exec() == QDialog::Accepted) {
+        MemoryLimits limits;
+        limits.maxFrameSize = qint64(frameBox->value()) * 1024 * 1024;
+        limits.clientLimit = qint64(clientBox->value()) * 1024 * 1024;
+        limits.globalBudget = qint64(globalBox->value()) * 1024 * 1024;
+        m_server->setMemoryLimits(limits);
+    }
+}
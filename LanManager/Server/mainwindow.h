@@ -9,14 +9,24 @@
 #include <QLabel>
 #include <QProgressBar>
 #include <QSplitter>
+#include <QLineEdit>
+#include <QPlainTextEdit>
+#include <QElapsedTimer>
+#include <QMap>
 #include "tcpserver.h"
+#include "peerlink.h"
+#include "resultaggregator.h"
+
+class TsStore;
+class InventorySnapshot;
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
     
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // dataDir: 历史数据、机器清单快照和命令输出所在的目录,调用方保证只有本实例使用
+    explicit MainWindow(const QString& dataDir, QWidget *parent = nullptr);
     ~MainWindow();
     
 private slots:
@@ -24,11 +34,20 @@ private slots:
     void onStartServer();
     void onStopServer();
     void onRefreshSysInfo();
+    void onShowHistory();
     void onRefreshSoftware();
     void onInstallSoftware();
     void onUninstallSoftware();
     void onSelectAll();
     void onDeselectAll();
+    void onExecuteCommand();
+    void onCancelCommands();
+    void onClearResults();
+    void onResultGroupExpanded(QTreeWidgetItem* item);
+    
+    // 菜单
+    void onBandwidthSettings();
+    void onMemorySettings();
     
     // 服务器事件
     void onClientConnected(qintptr clientId);
@@ -36,22 +55,44 @@ private slots:
     void onClientInfoUpdated(qintptr clientId);
     void onSysInfoReceived(qintptr clientId, const SystemInfo& info);
     void onSoftwareListReceived(qintptr clientId, const QList<SoftwareInfo>& list);
-    void onInstallResult(qintptr clientId, bool success, const QString& message);
-    void onUninstallResult(qintptr clientId, bool success, const QString& message);
+    void onInstallResult(qintptr clientId, bool success, int exitCode, const QString& message);
+    void onUninstallResult(qintptr clientId, bool success, int exitCode, const QString& message);
     void onFileTransferProgress(qintptr clientId, int percent);
+    void onTelemetryReceived(qintptr clientId, const TelemetrySample& latest);
+    void onAgentStatsUpdated(qintptr clientId);
+    void onExecOutputReceived(qintptr clientId, quint32 jobId, int stream, const QByteArray& data);
+    void onExecFinished(qintptr clientId, quint32 jobId, const ExecResult& result, const ExecOutput* output);
     void onLogMessage(const QString& message);
     
+    // 跨服务器查询结果
+    void onPeerQueryFinished(int requestId, const QString& machine, const QList<PeerQueryResult>& results);
+    
     // 表格选择变化
     void onClientSelectionChanged();
     
+    // 定期刷新历史数据、清理过期段并保存清单快照
+    void onHistoryMaintenance();
+    
+    // 定时把积攒的日志和结果汇总刷新到界面
+    void onRefreshUi();
+    
 private:
     void setupUI();
+    void openHistoryStore();
+    void openInventorySnapshot();
     void createMenuBar();
     void updateClientList();
+    void updateTelemetryCells(int row, const TelemetrySample& sample);
+    void updateAgentStatsCell(int row, const QJsonObject& stats);
+    int findClientRow(qintptr clientId) const;
     void updateSysInfoDisplay(const SystemInfo& info);
     void updateSoftwareList(const QList<SoftwareInfo>& list);
     QList<qintptr> getSelectedClients();
+    QString clientName(qintptr clientId);
     void addLog(const QString& message);
+    void flushLog();
+    void refreshResults();
+    void fillResultMachines(QTreeWidgetItem* item);
     
 private:
     TcpServer* m_server;
@@ -68,17 +109,47 @@ private:
     QPushButton* m_btnStart;
     QPushButton* m_btnStop;
     QPushButton* m_btnRefreshSysInfo;
+    QPushButton* m_btnHistory;
     QPushButton* m_btnRefreshSoftware;
     QPushButton* m_btnInstall;
     QPushButton* m_btnUninstall;
     QPushButton* m_btnSelectAll;
     QPushButton* m_btnDeselectAll;
     
+    // 远程执行页
+    QLineEdit* m_execCommand;
+    QPushButton* m_btnExec;
+    QPushButton* m_btnCancelExec;
+    QPlainTextEdit* m_execOutputText;   // 当前客户端的命令输出
+    QHash<qintptr, quint32> m_runningJobs;  // 执行中的作业(每台客户端最近一次)
+    
+    // 结果汇总页
+    QLabel* m_resultSummary;
+    QTreeWidget* m_resultTree;
+    QVector<QTreeWidgetItem*> m_resultItems;  // 按组下标(表格排序后顺序会变)
+    ResultAggregator m_results;
+    quint64 m_shownRevision;
+    
+    // 界面刷新: 日志和结果先积攒,由定时器批量写入
+    QTimer* m_uiTimer;
+    QStringList m_pendingLog;
+    
     // 当前选中的客户端
     qintptr m_currentClient;
     
-    // 缓存的软件列表
-    QMap<qintptr, QList<SoftwareInfo>> m_softwareLists;
+    // 本实例的数据目录
+    QString m_dataDir;
+    
+    // 机器清单快照(系统信息和软件列表,服务端重启后保留)
+    InventorySnapshot* m_inventory;
+    QElapsedTimer m_inventorySaved;
+    
+    // 见过的电脑(快照中的和本次运行中上线过的),不在线时按离线显示
+    QMap<QString, MachineInventory> m_knownMachines;
+    
+    // 历史数据存储
+    TsStore* m_history;
+    QTimer* m_historyTimer;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,96 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QtGlobal>
+
+// 单个帧的最大数据长度,帧头声明的长度超过它时直接断开该连接
+#define MAX_FRAME_SIZE (16 * 1024 * 1024)
+
+// 单个连接的接收缓冲和发送积压合计上限
+#define CLIENT_MEMORY_LIMIT (24 * 1024 * 1024)
+
+// 服务端全局内存预算(接收缓冲、发送积压、命令输出、清单缓存、缓冲池、遥测缓冲合计)
+#define SERVER_MEMORY_BUDGET (256 * 1024 * 1024)
+
+// 每次从套接字读取的最大字节数,也是套接字自身读缓冲的大小
+#define CLIENT_READ_CHUNK (64 * 1024)
+
+// 全局预算中留给普通读取(心跳和命令)的百分比,把接收缓冲扩大到 4*CLIENT_READ_CHUNK 以上
+// 拼接大帧的读取不能占用
+#define MEMORY_SMALL_READ_RESERVE 10
+
+// 内存限制配置,字节数
+struct MemoryLimits {
+    qint64 maxFrameSize = MAX_FRAME_SIZE;
+    qint64 clientLimit = CLIENT_MEMORY_LIMIT;
+    qint64 globalBudget = SERVER_MEMORY_BUDGET;
+};
+
+// 内存占用的分类
+enum MemoryCategory {
+    MEMORY_RECEIVE,     // 客户端接收缓冲占用的容量
+    MEMORY_SEND,        // 调度队列和套接字发送缓冲
+    MEMORY_EXEC,        // 远程执行输出留在内存中的部分
+    MEMORY_INVENTORY,   // 尚未写入快照文件的机器清单
+    MEMORY_POOL,        // 缓冲池中等待复用的空闲缓冲
+    MEMORY_TELEMETRY,   // 各连接的遥测环形缓冲区
+    MEMORY_CATEGORIES
+};
+
+// 服务端内存记账
+//
+// 接收缓冲按缓冲容量随读取和拆帧增减,遥测缓冲随样本写入增减;其余分类由服务端定期汇总后整体设置。
+// 除接收缓冲外数值是按数据长度估算的,不含容器本身的开销,用于决定何时暂停读取和断开连接,
+// 不追求与进程的实际内存一致。
+class MemoryBudget {
+public:
+    void setLimits(const MemoryLimits& limits) { m_limits = limits; }
+    const MemoryLimits& limits() const { return m_limits; }
+
+    void add(MemoryCategory category, qint64 bytes) {
+        m_used[category] += bytes;
+        updatePeak();
+    }
+    void set(MemoryCategory category, qint64 bytes) {
+        m_used[category] = bytes;
+        updatePeak();
+    }
+
+    qint64 used(MemoryCategory category) const { return m_used[category]; }
+    qint64 total() const {
+        qint64 sum = 0;
+        for (qint64 bytes : m_used) {
+            sum += bytes;
+        }
+        return sum;
+    }
+    qint64 peak() const { return m_peak; }
+
+    // 预算内还能放下 bytes 字节
+    bool canReserve(qint64 bytes) const { return total() + bytes <= m_limits.globalBudget; }
+    bool isExhausted() const { return total() >= m_limits.globalBudget; }
+
+    // 留给普通读取的预算
+    qint64 smallReadReserve() const { return m_limits.globalBudget * MEMORY_SMALL_READ_RESERVE / 100; }
+
+    static const char* categoryName(MemoryCategory category) {
+        switch (category) {
+        case MEMORY_RECEIVE: return "receive";
+        case MEMORY_SEND: return "send";
+        case MEMORY_EXEC: return "exec";
+        case MEMORY_INVENTORY: return "inventory";
+        case MEMORY_POOL: return "pool";
+        case MEMORY_TELEMETRY: return "telemetry";
+        default: return "other";
+        }
+    }
+
+private:
+    void updatePeak() { m_peak = qMax(m_peak, total()); }
+
+    MemoryLimits m_limits;
+    qint64 m_used[MEMORY_CATEGORIES] = {};
+    qint64 m_peak = 0;
+};
+
+#endif // MEMORYBUDGET_H
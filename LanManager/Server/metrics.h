@@ -0,0 +1,267 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QtAlgorithms>
+#include <atomic>
+#include <cmath>
+#include <functional>
+
+// 直方图每个2的幂区间再细分的份数(2^METRIC_SUB_BITS),相对误差不超过 1/2^METRIC_SUB_BITS
+#define METRIC_SUB_BITS 2
+#define METRIC_SUB_BUCKETS (1 << METRIC_SUB_BITS)
+#define METRIC_HISTOGRAM_BUCKETS ((64 - METRIC_SUB_BITS + 1) * METRIC_SUB_BUCKETS)
+
+// 计数器,只增不减
+class MetricCounter {
+public:
+    void inc(quint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> m_value{0};
+};
+
+// 瞬时值
+class MetricGauge {
+public:
+    void set(qint64 value) { m_value.store(value, std::memory_order_relaxed); }
+    void add(qint64 delta) { m_value.fetch_add(delta, std::memory_order_relaxed); }
+    qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> m_value{0};
+};
+
+// 对数-线性分桶的直方图(HDR风格)
+//
+// 值为非负整数(单位由调用方决定,如纳秒、毫秒)。小于 METRIC_SUB_BUCKETS 的值各占一个桶,
+// 之后每个2的幂区间等分为 METRIC_SUB_BUCKETS 个桶,覆盖整个64位范围,无需预先设定上下限。
+// 记录一次只有一次前导零计数和三次原子加,不加锁。
+class MetricHistogram {
+public:
+    // scale: 输出时把记录值换算为基本单位(如纳秒记录、以秒输出时为1e-9)
+    explicit MetricHistogram(double scale = 1.0) : m_scale(scale) {
+        for (std::atomic<quint64>& bucket : m_buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void observe(quint64 value) {
+        m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+    quint64 sum() const { return m_sum.load(std::memory_order_relaxed); }
+    quint64 bucketCount(int index) const { return m_buckets[index].load(std::memory_order_relaxed); }
+    double scale() const { return m_scale; }
+
+    static int bucketOf(quint64 value) {
+        if (value < METRIC_SUB_BUCKETS) {
+            return int(value);
+        }
+        int exponent = 63 - qCountLeadingZeroBits(value);
+        int sub = int(value >> (exponent - METRIC_SUB_BITS)) & (METRIC_SUB_BUCKETS - 1);
+        return (exponent - METRIC_SUB_BITS + 1) * METRIC_SUB_BUCKETS + sub;
+    }
+
+    // 分位数(q 在0到1之间),返回所在桶的上界,没有记录时返回0
+    quint64 percentile(double q) const {
+        quint64 total = 0;
+        for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+            total += bucketCount(i);
+        }
+        quint64 rank = qMax<quint64>(1, quint64(std::ceil(q * double(total))));
+        quint64 seen = 0;
+        for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+            seen += bucketCount(i);
+            if (seen >= rank) {
+                return bucketUpperBound(i);
+            }
+        }
+        return 0;
+    }
+
+    // 桶内最大值(含)
+    static quint64 bucketUpperBound(int index) {
+        if (index < METRIC_SUB_BUCKETS) {
+            return quint64(index);
+        }
+        int exponent = index / METRIC_SUB_BUCKETS + METRIC_SUB_BITS - 1;
+        int sub = index % METRIC_SUB_BUCKETS;
+        int shift = exponent - METRIC_SUB_BITS;
+        quint64 lower = quint64(METRIC_SUB_BUCKETS + sub) << shift;
+        return lower + ((quint64(1) << shift) - 1);
+    }
+
+private:
+    double m_scale;
+    std::atomic<quint64> m_buckets[METRIC_HISTOGRAM_BUCKETS];
+    std::atomic<quint64> m_count{0};
+    std::atomic<quint64> m_sum{0};
+};
+
+// 指标注册表,按 Prometheus 文本格式(0.0.4)输出
+//
+// 注册时加锁并返回指标指针,之后的更新只做原子操作;指标的生命周期与注册表相同。
+// 只能在抓取时计算的值(连接数、队列深度等)通过 addCollector 注册回调,在 render() 中生成。
+class MetricsRegistry {
+public:
+    typedef std::function<void(QByteArray& out)> Collector;
+
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    ~MetricsRegistry() {
+        for (Family& family : m_families) {
+            for (Series& series : family.series) {
+                delete series.counter;
+                delete series.gauge;
+                delete series.histogram;
+            }
+        }
+    }
+
+    // labels 为已转义的标签列表,如 cmd="heartbeat",direction="in"
+    // 同名同标签重复注册时返回已有的指标
+    MetricCounter* counter(const QString& name, const QString& help, const QString& labels = QString()) {
+        return series(name, help, "counter", labels).counter;
+    }
+
+    MetricGauge* gauge(const QString& name, const QString& help, const QString& labels = QString()) {
+        return series(name, help, "gauge", labels).gauge;
+    }
+
+    MetricHistogram* histogram(const QString& name, const QString& help, double scale,
+                               const QString& labels = QString()) {
+        return series(name, help, "histogram", labels, scale).histogram;
+    }
+
+    void addCollector(const Collector& collector) {
+        QMutexLocker locker(&m_mutex);
+        m_collectors.append(collector);
+    }
+
+    QByteArray render() const {
+        QMutexLocker locker(&m_mutex);
+        QByteArray out;
+        out.reserve(16 * 1024);
+        for (auto it = m_families.constBegin(); it != m_families.constEnd(); ++it) {
+            const Family& family = it.value();
+            writeFamily(out, it.key(), family.help, family.type);
+            for (const Series& series : family.series) {
+                if (series.counter) {
+                    writeSample(out, it.key(), series.labels, double(series.counter->value()));
+                } else if (series.gauge) {
+                    writeSample(out, it.key(), series.labels, double(series.gauge->value()));
+                } else {
+                    writeHistogram(out, it.key(), series.labels, *series.histogram);
+                }
+            }
+        }
+        for (const Collector& collector : m_collectors) {
+            collector(out);
+        }
+        return out;
+    }
+
+    // 以下供 Collector 使用
+    static void writeFamily(QByteArray& out, const QString& name, const QString& help, const char* type) {
+        out += "# HELP " + name.toUtf8() + ' ' + help.toUtf8() + '\n';
+        out += "# TYPE " + name.toUtf8() + ' ' + type + '\n';
+    }
+
+    static void writeSample(QByteArray& out, const QString& name, const QString& labels, double value) {
+        out += name.toUtf8();
+        if (!labels.isEmpty()) {
+            out += '{' + labels.toUtf8() + '}';
+        }
+        out += ' ' + QByteArray::number(value, 'g', 15) + '\n';
+    }
+
+    // 标签值转义(反斜杠、双引号、换行)
+    static QString escapeLabel(const QString& value) {
+        QString escaped = value;
+        escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+        return escaped;
+    }
+
+private:
+    struct Series {
+        QString labels;
+        MetricCounter* counter = nullptr;
+        MetricGauge* gauge = nullptr;
+        MetricHistogram* histogram = nullptr;
+    };
+
+    struct Family {
+        QString help;
+        const char* type = "";
+        QList<Series> series;
+    };
+
+    Series series(const QString& name, const QString& help, const char* type, const QString& labels,
+                  double scale = 1.0) {
+        QMutexLocker locker(&m_mutex);
+        Family& family = m_families[name];
+        if (family.series.isEmpty()) {
+            family.help = help;
+            family.type = type;
+        }
+        for (const Series& s : family.series) {
+            if (s.labels == labels) {
+                return s;
+            }
+        }
+        Series s;
+        s.labels = labels;
+        if (qstrcmp(type, "counter") == 0) {
+            s.counter = new MetricCounter;
+        } else if (qstrcmp(type, "gauge") == 0) {
+            s.gauge = new MetricGauge;
+        } else {
+            s.histogram = new MetricHistogram(scale);
+        }
+        family.series.append(s);
+        return s;
+    }
+
+    // 只输出到最大的非空桶为止,桶边界只增不减,对 Prometheus 是兼容的
+    static void writeHistogram(QByteArray& out, const QString& name, const QString& labels,
+                               const MetricHistogram& histogram) {
+        QString prefix = labels.isEmpty() ? QString() : labels + ',';
+        int last = -1;
+        quint64 counts[METRIC_HISTOGRAM_BUCKETS];
+        for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+            counts[i] = histogram.bucketCount(i);
+            if (counts[i]) {
+                last = i;
+            }
+        }
+        quint64 cumulative = 0;
+        for (int i = 0; i <= last; ++i) {
+            cumulative += counts[i];
+            double le = double(MetricHistogram::bucketUpperBound(i)) * histogram.scale();
+            writeSample(out, name + "_bucket",
+                        prefix + QString("le=\"%1\"").arg(le, 0, 'g', 10), double(cumulative));
+        }
+        // 各桶和总数分别读取,抓取期间有新记录时 +Inf 取两者中较大的,保证累计值单调
+        quint64 count = qMax(cumulative, histogram.count());
+        writeSample(out, name + "_bucket", prefix + "le=\"+Inf\"", double(count));
+        writeSample(out, name + "_sum", labels, double(histogram.sum()) * histogram.scale());
+        writeSample(out, name + "_count", labels, double(count));
+    }
+
+    QMap<QString, Family> m_families;
+    QList<Collector> m_collectors;
+    mutable QMutex m_mutex;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,109 @@
+#include "metricsserver.h"
+#include <QElapsedTimer>
+#include <QTimer>
+
+#define METRICS_MAX_REQUEST (8 * 1024)   // 请求头最大长度
+#define METRICS_REQUEST_TIMEOUT 5000     // 请求头最长等待时间(毫秒)
+
+MetricsServer::MetricsServer(MetricsRegistry* registry, QObject* parent)
+    : QObject(parent)
+    , m_registry(registry)
+    , m_listener(new QTcpServer(this))
+    , m_scrapeTime(registry->histogram("lanmgr_metrics_scrape_seconds", "生成一次指标输出的耗时", 1e-9))
+{
+    connect(m_listener, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+bool MetricsServer::start(const QHostAddress& address, quint16 port)
+{
+    stop();
+    return m_listener->listen(address, port);
+}
+
+void MetricsServer::stop()
+{
+    m_listener->close();
+    for (auto it = m_requests.begin(); it != m_requests.end(); ++it) {
+        it.key()->disconnect(this);
+        it.key()->abort();
+        it.key()->deleteLater();
+    }
+    m_requests.clear();
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (m_listener->hasPendingConnections()) {
+        QTcpSocket* socket = m_listener->nextPendingConnection();
+        m_requests.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, &MetricsServer::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &MetricsServer::onDisconnected);
+        
+        // 迟迟不发完请求头的连接直接关闭
+        QTimer::singleShot(METRICS_REQUEST_TIMEOUT, socket, [socket]() { socket->abort(); });
+    }
+}
+
+void MetricsServer::onReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !m_requests.contains(socket)) return;
+    
+    QByteArray& request = m_requests[socket];
+    request.append(socket->readAll());
+    if (!request.contains("\r\n\r\n")) {
+        if (request.size() > METRICS_MAX_REQUEST) {
+            respond(socket, "431 Request Header Fields Too Large", "text/plain", QByteArray());
+        }
+        return;
+    }
+    
+    // 请求行: 方法 路径 版本,路径忽略查询参数
+    QList<QByteArray> parts = request.left(request.indexOf("\r\n")).split(' ');
+    QByteArray method = parts.value(0);
+    QByteArray path = parts.value(1);
+    int query = path.indexOf('?');
+    if (query >= 0) {
+        path.truncate(query);
+    }
+    
+    if (method != "GET") {
+        respond(socket, "405 Method Not Allowed", "text/plain", QByteArray());
+    } else if (path != "/metrics") {
+        respond(socket, "404 Not Found", "text/plain", "see /metrics\n");
+    } else {
+        QElapsedTimer timer;
+        timer.start();
+        QByteArray body = m_registry->render();
+        m_scrapeTime->observe(quint64(timer.nsecsElapsed()));
+        respond(socket, "200 OK", "text/plain; version=0.0.4; charset=utf-8", body);
+    }
+}
+
+void MetricsServer::respond(QTcpSocket* socket, const QByteArray& status, const QByteArray& contentType,
+                            const QByteArray& body)
+{
+    m_requests.remove(socket);
+    disconnect(socket, &QTcpSocket::readyRead, this, &MetricsServer::onReadyRead);
+    
+    QByteArray header = "HTTP/1.1 " + status + "\r\n"
+                        "Content-Type: " + contentType + "\r\n"
+                        "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                        "Connection: close\r\n\r\n";
+    socket->write(header);
+    socket->write(body);
+    socket->disconnectFromHost();
+}
+
+void MetricsServer::onDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) return;
+    m_requests.remove(socket);
+    socket->deleteLater();
+}
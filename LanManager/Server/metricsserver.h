@@ -0,0 +1,46 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHash>
+#include "metrics.h"
+
+// 指标端口默认值,只监听本机地址
+#define METRICS_PORT 8896
+
+// 指标HTTP端点
+//
+// 只实现抓取需要的最小HTTP: 读到请求头结束后,GET /metrics 返回注册表的文本格式输出,
+// 其他路径返回404,每次响应后关闭连接。抓取在主线程执行,Collector 可以直接读取服务端状态。
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    MetricsServer(MetricsRegistry* registry, QObject* parent = nullptr);
+    ~MetricsServer();
+
+    bool start(const QHostAddress& address, quint16 port);
+    void stop();
+
+    bool isListening() const { return m_listener->isListening(); }
+    QString errorString() const { return m_listener->errorString(); }
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    void respond(QTcpSocket* socket, const QByteArray& status, const QByteArray& contentType,
+                 const QByteArray& body);
+
+private:
+    MetricsRegistry* m_registry;
+    QTcpServer* m_listener;
+    QHash<QTcpSocket*, QByteArray> m_requests;  // 未读完的请求头
+    MetricHistogram* m_scrapeTime;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,423 @@
+#include "peerlink.h"
+#include "tcpserver.h"
+#include "../Common/logger.h"
+#include <QDateTime>
+#include <QNetworkInterface>
+#include <QJsonArray>
+
+#define PEER_TIMEOUT (3 * BROADCAST_MAX_INTERVAL)  // 超过该时间未收到通告视为下线
+#define PEER_QUERY_TIMEOUT 5000                     // 单次查询等待时间(毫秒)
+#define PEER_MAX_QUERY_SIZE (64 * 1024)             // 查询请求最大长度
+#define PEER_MAX_RESPONSE_SIZE (64 * 1024 * 1024)   // 查询响应最大长度
+
+PeerLink::PeerLink(TcpServer* server)
+    : QObject(server)
+    , m_server(server)
+    , m_tcpPort(0)
+    , m_announceSocket(new QUdpSocket(this))
+    , m_listener(new QTcpServer(this))
+    , m_expireTimer(new QTimer(this))
+    , m_nextRequestId(1)
+{
+    connect(m_announceSocket, &QUdpSocket::readyRead, this, &PeerLink::onAnnounceReceived);
+    connect(m_listener, &QTcpServer::newConnection, this, &PeerLink::onPeerConnection);
+    connect(m_expireTimer, &QTimer::timeout, this, &PeerLink::expirePeers);
+}
+
+PeerLink::~PeerLink()
+{
+    stop();
+}
+
+bool PeerLink::start(quint16 tcpPort)
+{
+    m_tcpPort = tcpPort;
+
+    // 与本机客户端共享广播端口,接收其他服务器的通告
+    if (!m_announceSocket->bind(QHostAddress::AnyIPv4, BROADCAST_PORT,
+                                QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
+        LOG_WARN("peer", "无法监听服务器通告: %1", m_announceSocket->errorString());
+        return false;
+    }
+    if (!m_listener->listen(QHostAddress::Any, 0)) {
+        LOG_WARN("peer", "无法启动服务器互查端口: %1", m_listener->errorString());
+        m_announceSocket->close();
+        return false;
+    }
+    m_expireTimer->start(BROADCAST_MAX_INTERVAL);
+
+    // 主动探测一次,其他服务器会单播回复,不必等待它们的下一次广播
+    QByteArray probe = Discovery::probe();
+    for (const QHostAddress& address : Discovery::broadcastAddresses()) {
+        m_announceSocket->writeDatagram(probe, address, DISCOVERY_PORT);
+    }
+    return true;
+}
+
+void PeerLink::stop()
+{
+    m_expireTimer->stop();
+    m_announceSocket->close();
+    m_listener->close();
+
+    for (QTcpSocket* socket : m_incoming.keys()) {
+        socket->abort();
+        socket->deleteLater();
+    }
+    m_incoming.clear();
+    for (QTcpSocket* socket : m_outgoing.keys()) {
+        socket->abort();
+        socket->deleteLater();
+    }
+    m_outgoing.clear();
+    for (int requestId : m_queries.keys()) {
+        completeQuery(requestId);
+    }
+
+    if (!m_peers.isEmpty()) {
+        m_peers.clear();
+        emit peersChanged();
+    }
+}
+
+quint16 PeerLink::peerPort() const
+{
+    return m_listener->isListening() ? m_listener->serverPort() : 0;
+}
+
+QList<ServerAnnounce> PeerLink::peers() const
+{
+    QList<ServerAnnounce> result;
+    result.reserve(m_peers.size());
+    for (const PeerEntry& entry : m_peers) {
+        result.append(entry.info);
+    }
+    return result;
+}
+
+void PeerLink::onAnnounceReceived()
+{
+    bool changed = false;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    while (m_announceSocket->hasPendingDatagrams()) {
+        QByteArray data;
+        QHostAddress sender;
+        quint16 senderPort;
+
+        data.resize(int(m_announceSocket->pendingDatagramSize()));
+        m_announceSocket->readDatagram(data.data(), data.size(), &sender, &senderPort);
+
+        ServerAnnounce info;
+        if (!Discovery::parseAnnounce(data, info)) {
+            continue;
+        }
+
+        // 忽略本机自己的通告
+        if (info.port == m_tcpPort && (sender.isLoopback() ||
+                                       QNetworkInterface::allAddresses().contains(sender))) {
+            continue;
+        }
+
+        bool ok = false;
+        QHostAddress ipv4(sender.toIPv4Address(&ok));
+        info.host = ok ? ipv4.toString() : sender.toString();
+
+        auto it = m_peers.find(info.id());
+        if (it == m_peers.end()) {
+            LOG_INFO("peer", "发现其他服务器: %1 (连接数 %2/%3)", info.id(), info.load, info.capacity);
+            m_peers.insert(info.id(), PeerEntry{ info, now });
+            changed = true;
+        } else {
+            // 负载变化随定期的集群信息下发,这里只通知服务器加入/离开
+            it->info = info;
+            it->lastSeen = now;
+        }
+    }
+
+    if (changed) {
+        emit peersChanged();
+    }
+}
+
+void PeerLink::expirePeers()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    bool changed = false;
+    for (auto it = m_peers.begin(); it != m_peers.end();) {
+        if (now - it->lastSeen > PEER_TIMEOUT) {
+            LOG_INFO("peer", "服务器 %1 已下线", it.key());
+            it = m_peers.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+    if (changed) {
+        emit peersChanged();
+    }
+}
+
+void PeerLink::onPeerConnection()
+{
+    while (m_listener->hasPendingConnections()) {
+        QTcpSocket* socket = m_listener->nextPendingConnection();
+        m_incoming.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, &PeerLink::onIncomingReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_incoming.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void PeerLink::onIncomingReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !m_incoming.contains(socket)) return;
+
+    QByteArray& buffer = m_incoming[socket];
+    buffer.append(socket->readAll());
+
+    while (buffer.size() >= Protocol::headerSize()) {
+        ProtocolHeader header;
+        if (!Protocol::parseHeader(buffer, header)) {
+            break;
+        }
+        if (header.cmdType != CMD_PEER_QUERY || header.dataLength > PEER_MAX_QUERY_SIZE) {
+            socket->abort();
+            return;
+        }
+        int packetSize = header.size + int(header.dataLength);
+        if (buffer.size() < packetSize) {
+            break;
+        }
+
+        QJsonObject query = Protocol::parseJson(buffer.mid(header.size, int(header.dataLength)));
+        buffer.remove(0, packetSize);
+        socket->write(Protocol::packJson(CMD_PEER_RESPONSE, answerQuery(query)));
+    }
+}
+
+QJsonObject PeerLink::answerQuery(const QJsonObject& query) const
+{
+    QString machine = query["machine"].toString().trimmed();
+    QJsonObject response;
+    response["requestId"] = query["requestId"];
+    response["found"] = false;
+    response["online"] = false;
+    if (machine.isEmpty()) {
+        return response;
+    }
+
+    // 先在线客户端,再快照
+    QString key;
+    for (qintptr clientId : m_server->getClientIds()) {
+        ClientConnection* client = m_server->getClient(clientId);
+        if (client && (client->macAddress.compare(machine, Qt::CaseInsensitive) == 0 ||
+                       client->computerName.compare(machine, Qt::CaseInsensitive) == 0 ||
+                       client->ipAddress == machine)) {
+            key = TcpServer::historyKey(client);
+            response["online"] = true;
+            break;
+        }
+    }
+
+    InventorySnapshot* snapshot = m_server->inventorySnapshot();
+    if (!snapshot) {
+        return response;
+    }
+    if (key.isEmpty()) {
+        if (snapshot->contains(machine.toUpper())) {
+            key = machine.toUpper();
+        } else {
+            for (const QString& candidate : snapshot->keys()) {
+                MachineInventory inv;
+                if (snapshot->summary(candidate, inv) &&
+                    (inv.computerName.compare(machine, Qt::CaseInsensitive) == 0 ||
+                     inv.ipAddress == machine)) {
+                    key = candidate;
+                    break;
+                }
+            }
+        }
+    }
+
+    MachineInventory inv;
+    if (!key.isEmpty() && snapshot->summary(key, inv)) {
+        snapshot->software(key, inv.software);
+        response["found"] = true;
+        response["inventory"] = inventoryToJson(inv);
+    }
+    return response;
+}
+
+int PeerLink::queryInventory(const QString& machine)
+{
+    int requestId = m_nextRequestId++;
+
+    PendingQuery& pending = m_queries[requestId];
+    pending.machine = machine;
+    pending.remaining = 0;
+    pending.timer = new QTimer(this);
+    pending.timer->setSingleShot(true);
+    connect(pending.timer, &QTimer::timeout, this, [this, requestId]() {
+        completeQuery(requestId);
+    });
+
+    for (const PeerEntry& entry : m_peers) {
+        if (!entry.info.peerPort) continue;
+
+        QTcpSocket* socket = new QTcpSocket(this);
+        m_outgoing.insert(socket, Outgoing{ requestId, entry.info.id(), QByteArray() });
+        connect(socket, &QTcpSocket::connected, this, &PeerLink::onOutgoingConnected);
+        connect(socket, &QTcpSocket::readyRead, this, &PeerLink::onOutgoingReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &PeerLink::onOutgoingClosed);
+        connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+                this, &PeerLink::onOutgoingClosed);
+        socket->connectToHost(entry.info.host, entry.info.peerPort);
+        pending.remaining++;
+    }
+
+    if (pending.remaining == 0) {
+        // 没有可查询的服务器,异步返回空结果
+        pending.timer->start(0);
+    } else {
+        pending.timer->start(PEER_QUERY_TIMEOUT);
+    }
+    return requestId;
+}
+
+void PeerLink::onOutgoingConnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !m_outgoing.contains(socket)) return;
+
+    const Outgoing& out = m_outgoing[socket];
+    QJsonObject query;
+    query["requestId"] = out.requestId;
+    query["machine"] = m_queries.value(out.requestId).machine;
+    socket->write(Protocol::packJson(CMD_PEER_QUERY, query));
+}
+
+void PeerLink::onOutgoingReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !m_outgoing.contains(socket)) return;
+
+    QByteArray& buffer = m_outgoing[socket].buffer;
+    buffer.append(socket->readAll());
+    if (buffer.size() < Protocol::headerSize()) return;
+
+    ProtocolHeader header;
+    if (!Protocol::parseHeader(buffer, header)) return;
+    if (header.cmdType != CMD_PEER_RESPONSE || header.dataLength > PEER_MAX_RESPONSE_SIZE) {
+        finishOutgoing(socket, nullptr);
+        return;
+    }
+    if (buffer.size() < header.size + int(header.dataLength)) return;
+
+    QJsonObject response = Protocol::parseJson(buffer.mid(header.size, int(header.dataLength)));
+    finishOutgoing(socket, &response);
+}
+
+void PeerLink::onOutgoingClosed()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (socket && m_outgoing.contains(socket)) {
+        finishOutgoing(socket, nullptr);
+    }
+}
+
+void PeerLink::finishOutgoing(QTcpSocket* socket, const QJsonObject* response)
+{
+    Outgoing out = m_outgoing.take(socket);
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    auto it = m_queries.find(out.requestId);
+    if (it == m_queries.end()) return;
+
+    if (response) {
+        PeerQueryResult result;
+        result.serverId = out.serverId;
+        result.found = (*response)["found"].toBool();
+        result.online = (*response)["online"].toBool();
+        if (result.found) {
+            result.inventory = inventoryFromJson((*response)["inventory"].toObject());
+        }
+        it->results.append(result);
+    }
+
+    if (--it->remaining <= 0) {
+        completeQuery(out.requestId);
+    }
+}
+
+void PeerLink::completeQuery(int requestId)
+{
+    auto it = m_queries.find(requestId);
+    if (it == m_queries.end()) return;
+
+    PendingQuery pending = it.value();
+    m_queries.erase(it);
+    pending.timer->deleteLater();
+
+    // 超时时仍未回复的连接一并放弃
+    for (auto out = m_outgoing.begin(); out != m_outgoing.end();) {
+        if (out->requestId == requestId) {
+            QTcpSocket* socket = out.key();
+            socket->disconnect(this);
+            socket->abort();
+            socket->deleteLater();
+            out = m_outgoing.erase(out);
+        } else {
+            ++out;
+        }
+    }
+
+    emit queryFinished(requestId, pending.machine, pending.results);
+}
+
+QJsonObject PeerLink::inventoryToJson(const MachineInventory& inv)
+{
+    QJsonObject json;
+    json["key"] = inv.key;
+    json["lastSeen"] = inv.lastSeen;
+    json["computerName"] = inv.computerName;
+    json["ipAddress"] = inv.ipAddress;
+    json["osVersion"] = inv.osVersion;
+    if (inv.hasSysInfo) {
+        json["sysInfo"] = inv.sysInfo.toJson();
+    }
+    if (inv.hasSoftware) {
+        QJsonArray arr;
+        for (const SoftwareInfo& info : inv.software) {
+            arr.append(info.toJson());
+        }
+        json["software"] = arr;
+        json["softwareHash"] = QString::fromLatin1(inv.softwareHash);
+    }
+    return json;
+}
+
+MachineInventory PeerLink::inventoryFromJson(const QJsonObject& json)
+{
+    MachineInventory inv;
+    inv.key = json["key"].toString();
+    inv.lastSeen = qint64(json["lastSeen"].toDouble());
+    inv.computerName = json["computerName"].toString();
+    inv.ipAddress = json["ipAddress"].toString();
+    inv.osVersion = json["osVersion"].toString();
+    inv.hasSysInfo = json.contains("sysInfo");
+    if (inv.hasSysInfo) {
+        inv.sysInfo = SystemInfo::fromJson(json["sysInfo"].toObject());
+    }
+    inv.hasSoftware = json.contains("software");
+    for (const QJsonValue& val : json["software"].toArray()) {
+        inv.software.append(SoftwareInfo::fromJson(val.toObject()));
+    }
+    inv.softwareHash = json["softwareHash"].toString().toLatin1();
+    return inv;
+}
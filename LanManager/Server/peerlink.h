@@ -0,0 +1,103 @@
+#ifndef PEERLINK_H
+#define PEERLINK_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QHash>
+#include <QTimer>
+#include "../Common/discovery.h"
+#include "inventorysnapshot.h"
+
+class TcpServer;
+
+// 一台服务器对机器清单查询的回复
+struct PeerQueryResult {
+    QString serverId;             // 回复的服务器
+    bool found = false;           // 是否有这台电脑的清单
+    bool online = false;          // 这台电脑当前是否连在该服务器上
+    MachineInventory inventory;
+};
+
+// 服务器互联
+//
+// 通过监听其他服务器的UDP通告维护同一网段的服务器列表(地址、负载、互查端口),
+// 并提供服务器之间的机器清单查询: 每次查询向所有已知服务器的互查端口建立短连接,
+// 发送 CMD_PEER_QUERY,收集 CMD_PEER_RESPONSE 或等待超时后汇总结果。
+class PeerLink : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PeerLink(TcpServer* server);
+    ~PeerLink();
+
+    // 开始监听服务器通告和互查端口(互查端口自动分配)
+    bool start(quint16 tcpPort);
+    void stop();
+
+    quint16 peerPort() const;
+
+    // 当前在线的其他服务器
+    QList<ServerAnnounce> peers() const;
+
+    // 向所有服务器查询一台电脑(MAC地址、计算机名或IP),返回请求号
+    int queryInventory(const QString& machine);
+
+signals:
+    // 有服务器加入或离开
+    void peersChanged();
+    void queryFinished(int requestId, const QString& machine, const QList<PeerQueryResult>& results);
+
+private slots:
+    void onAnnounceReceived();
+    void onPeerConnection();
+    void onIncomingReadyRead();
+    void onOutgoingConnected();
+    void onOutgoingReadyRead();
+    void onOutgoingClosed();
+    void expirePeers();
+
+private:
+    // 在本机清单快照和在线客户端中查找
+    QJsonObject answerQuery(const QJsonObject& query) const;
+
+    // 一台服务器回复或失败后,检查查询是否全部完成
+    void finishOutgoing(QTcpSocket* socket, const QJsonObject* response);
+    void completeQuery(int requestId);
+
+    static QJsonObject inventoryToJson(const MachineInventory& inv);
+    static MachineInventory inventoryFromJson(const QJsonObject& json);
+
+private:
+    struct PeerEntry {
+        ServerAnnounce info;
+        qint64 lastSeen;
+    };
+
+    struct PendingQuery {
+        QString machine;
+        int remaining;
+        QList<PeerQueryResult> results;
+        QTimer* timer;
+    };
+
+    struct Outgoing {
+        int requestId;
+        QString serverId;
+        QByteArray buffer;
+    };
+
+    TcpServer* m_server;
+    quint16 m_tcpPort;
+    QUdpSocket* m_announceSocket;
+    QTcpServer* m_listener;
+    QTimer* m_expireTimer;
+    QHash<QString, PeerEntry> m_peers;          // 按服务器标识
+    QHash<QTcpSocket*, QByteArray> m_incoming;  // 其他服务器发来的查询
+    QHash<QTcpSocket*, Outgoing> m_outgoing;    // 本机发出的查询
+    QHash<int, PendingQuery> m_queries;
+    int m_nextRequestId;
+};
+
+#endif // PEERLINK_H
@@ -0,0 +1,74 @@
+#include "resultaggregator.h"
+#include <QRegularExpression>
+
+int ResultAggregator::add(const QString& operation, bool success, const QString& machine,
+                          const QString& message, int exitCode)
+{
+    // 同样的"安装失败"可能是不同的退出码(需要重启、缺少依赖、权限不足),分开计数
+    QString normalized = normalizeCached(message);
+    QString key = operation + QChar(0x1F) + (success ? '1' : '0') + QChar(0x1F) +
+                  QString::number(exitCode) + QChar(0x1F) + normalized;
+    
+    int index = m_index.value(key, -1);
+    if (index < 0) {
+        index = m_groups.size();
+        ResultGroup group;
+        group.operation = operation;
+        group.success = success;
+        group.exitCode = exitCode;
+        group.message = normalized;
+        m_groups.append(group);
+        m_index.insert(key, index);
+    }
+    m_groups[index].machines.append(machine);
+    
+    m_total++;
+    if (success) {
+        m_successCount++;
+    }
+    m_revision++;
+    return index;
+}
+
+void ResultAggregator::clear()
+{
+    m_groups.clear();
+    m_index.clear();
+    m_total = 0;
+    m_successCount = 0;
+    m_revision++;
+}
+
+QString ResultAggregator::normalizeCached(const QString& message)
+{
+    // 同一批操作的消息大多完全相同,正则只在第一次遇到时执行
+    auto it = m_normalized.constFind(message);
+    if (it != m_normalized.constEnd()) {
+        return it.value();
+    }
+    if (m_normalized.size() >= RESULT_NORMALIZE_CACHE) {
+        m_normalized.clear();
+    }
+    QString normalized = normalize(message);
+    m_normalized.insert(message, normalized);
+    return normalized;
+}
+
+QString ResultAggregator::normalize(const QString& message)
+{
+    static const QRegularExpression path(
+        "(?:[A-Za-z]:)?[\\\\/](?:[^\\s\\\\/:\"]+[\\\\/])+[^\\s\\\\/:\"]*");
+    static const QRegularExpression guid(
+        "\\{?[0-9A-Fa-f]{8}-[0-9A-Fa-f]{4}-[0-9A-Fa-f]{4}-[0-9A-Fa-f]{4}-[0-9A-Fa-f]{12}\\}?");
+    static const QRegularExpression ipv4("\\b\\d{1,3}(?:\\.\\d{1,3}){3}\\b");
+    static const QRegularExpression longNumber("\\b\\d{6,}\\b");
+    static const QRegularExpression spaces("\\s+");
+    
+    QString text = message;
+    text.replace(path, "<路径>");
+    text.replace(guid, "<GUID>");
+    text.replace(ipv4, "<IP>");
+    text.replace(longNumber, "<N>");
+    text.replace(spaces, " ");
+    return text.trimmed();
+}
@@ -0,0 +1,60 @@
+#ifndef RESULTAGGREGATOR_H
+#define RESULTAGGREGATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include "../Common/protocol.h"
+
+// 归一化缓存的最大条目数(超过后清空重建)
+#define RESULT_NORMALIZE_CACHE 4096
+
+// 一组相同的结果: 同一操作、同一结论、同一退出码、归一化后相同的消息
+struct ResultGroup {
+    QString operation;       // 操作(安装/卸载/执行)
+    bool success = false;
+    int exitCode = NO_EXIT_CODE;  // 安装/卸载程序的退出码,没有时为 NO_EXIT_CODE
+    QString message;         // 归一化后的消息
+    QStringList machines;    // 按到达顺序
+};
+
+// 批量操作的结果汇总
+//
+// 对上千台电脑下发的操作,结果按"操作+成败+退出码+归一化消息"分组计数,逐条到达时增量更新,
+// 界面按固定间隔读取 revision() 判断是否需要刷新,而不是每条结果刷新一次。
+// 组一旦创建,下标就不再变化,界面可以按下标就地更新已有的行。
+class ResultAggregator {
+public:
+    // 加入一条结果,返回所属组的下标
+    int add(const QString& operation, bool success, const QString& machine, const QString& message,
+            int exitCode = NO_EXIT_CODE);
+
+    void clear();
+
+    int groupCount() const { return m_groups.size(); }
+    const ResultGroup& group(int index) const { return m_groups.at(index); }
+
+    int total() const { return m_total; }
+    int successCount() const { return m_successCount; }
+    int failureCount() const { return m_total - m_successCount; }
+
+    // 每加入一条结果加一,界面据此判断是否有变化
+    quint64 revision() const { return m_revision; }
+
+    // 去掉消息中因机器而异的部分(路径、IP、GUID、长数字),保留错误码之类的短数字
+    static QString normalize(const QString& message);
+
+private:
+    QString normalizeCached(const QString& message);
+
+private:
+    QVector<ResultGroup> m_groups;
+    QHash<QString, int> m_index;           // 分组键 -> 下标
+    QHash<QString, QString> m_normalized;  // 原始消息 -> 归一化消息
+    int m_total = 0;
+    int m_successCount = 0;
+    quint64 m_revision = 0;
+};
+
+#endif // RESULTAGGREGATOR_H
@@ -1,23 +1,65 @@
 #include "tcpserver.h"
 #include <QFile>
 #include <QFileInfo>
+#include <QDir>
+#include <QRegularExpression>
 #include <QDateTime>
 #include <QJsonArray>
 #include <QDebug>
+#include <limits>
+#include <algorithm>
+#include "../Common/telemetry.h"
+#include "../Common/inventory.h"
+#include "../Common/discovery.h"
+#include "../Common/logger.h"
+#include "../Common/alloccounter.h"
+#include "tsstore.h"
+#include "inventorysnapshot.h"
+#include "peerlink.h"
+#include "metricsserver.h"
 
 #define FILE_CHUNK_SIZE (64 * 1024)  // 64KB每块
+#define FILE_PIPELINE_CHUNKS 4       // 每个传输在调度队列中最多预读的块数
+#define SERVER_CAPACITY 1000         // 默认建议最大连接数
+#define CLUSTER_INFO_INTERVAL 30000  // 集群信息下发间隔(毫秒)
+#define REQUEST_TIMEOUT (30 * 60 * 1000)  // 请求最长等待时间(含文件传输和安装)
+#define SHAPING_TICK 10              // 限速时发送数据块的调度间隔(毫秒)
+#define KNOWN_CLIENT_TTL (3LL * 24 * 3600 * 1000)  // 已知客户端超过该时间未上线就不再等它(毫秒)
 
 TcpServer::TcpServer(QObject *parent)
     : QObject(parent)
     , m_server(new QTcpServer(this))
     , m_broadcastSocket(new QUdpSocket(this))
+    , m_discoverySocket(new QUdpSocket(this))
     , m_broadcastTimer(new QTimer(this))
+    , m_broadcastInterval(BROADCAST_INTERVAL)
+    , m_capacity(SERVER_CAPACITY)
+    , m_peers(new PeerLink(this))
+    , m_clusterTimer(new QTimer(this))
     , m_heartbeatChecker(new QTimer(this))
     , m_tcpPort(DEFAULT_PORT)
+    , m_discoveryEnabled(true)
+    , m_telemetryInterval(TELEMETRY_INTERVAL)
+    , m_telemetryBatchSize(TELEMETRY_BATCH_SIZE)
+    , m_history(nullptr)
+    , m_inventory(nullptr)
+    , m_shapingTimer(new QTimer(this))
+    , m_resumingReads(false)
+    , m_execOutputDir(QDir::tempPath() + "/lanmgr-exec")
+    , m_metricsServer(nullptr)
+    , m_metricsPort(METRICS_PORT)
 {
     connect(m_server, &QTcpServer::newConnection, this, &TcpServer::onNewConnection);
     connect(m_heartbeatChecker, &QTimer::timeout, this, &TcpServer::checkHeartbeats);
     connect(m_broadcastTimer, &QTimer::timeout, this, &TcpServer::sendBroadcast);
+    connect(m_discoverySocket, &QUdpSocket::readyRead, this, &TcpServer::onProbeReceived);
+    connect(m_clusterTimer, &QTimer::timeout, this, &TcpServer::broadcastClusterInfo);
+    connect(m_peers, &PeerLink::peersChanged, this, &TcpServer::broadcastClusterInfo);
+    connect(m_shapingTimer, &QTimer::timeout, this, &TcpServer::onShapingTick);
+    m_broadcastTimer->setSingleShot(true);
+    m_shapingTimer->setTimerType(Qt::PreciseTimer);
+    m_shaperClock.start();
+    setupMetrics();
 }
 
 TcpServer::~TcpServer()
@@ -32,18 +74,33 @@ bool TcpServer::start(quint16 port)
     }
     
     if (!m_server->listen(QHostAddress::Any, port)) {
-        emit logMessage("服务器启动失败: " + m_server->errorString());
+        LOG_WARN("server", "服务器启动失败: %1", m_server->errorString());
         return false;
     }
     
     m_tcpPort = port;
-    emit logMessage(QString("服务器已启动,监听端口: %1").arg(port));
+    LOG_INFO("server", "服务器已启动,监听端口: %1", port);
     m_heartbeatChecker->start(HEARTBEAT_INTERVAL);
+    startMetricsServer();
+    
+    if (!m_discoveryEnabled) {
+        return true;
+    }
+    
+    // 接收客户端探测,单播回复
+    if (!m_discoverySocket->bind(QHostAddress::AnyIPv4, DISCOVERY_PORT,
+                                 QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
+        LOG_WARN("server", "无法绑定探测端口: %1", m_discoverySocket->errorString());
+    }
+    
+    // 发现同网段的其他服务器
+    m_peers->start(port);
+    m_clusterTimer->start(CLUSTER_INFO_INTERVAL);
     
     // 启动UDP广播，让客户端自动发现
-    m_broadcastTimer->start(BROADCAST_INTERVAL);
+    m_broadcastInterval = BROADCAST_INTERVAL;
     sendBroadcast();
-    emit logMessage("UDP广播已启动,客户端将自动上线");
+    LOG_INFO("server", "UDP广播已启动,客户端将自动上线");
     
     return true;
 }
@@ -52,19 +109,31 @@ void TcpServer::stop()
 {
     m_heartbeatChecker->stop();
     m_broadcastTimer->stop();
+    m_discoverySocket->close();
+    m_clusterTimer->stop();
+    m_peers->stop();
+    m_shapingTimer->stop();
+    m_throttled.clear();
+    m_throttledSet.clear();
+    m_metricsServer->stop();
+    stopCapture();
     
     // 断开所有客户端
     for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
         if (it.value()->socket) {
             it.value()->socket->disconnectFromHost();
         }
-        delete it.value();
+        m_connectionPool.release(it.value());
     }
     m_clients.clear();
+    m_pausedReads.clear();
+    m_memory.set(MEMORY_RECEIVE, 0);
+    m_memory.set(MEMORY_SEND, 0);
+    m_memory.set(MEMORY_TELEMETRY, 0);
     
     if (m_server->isListening()) {
         m_server->close();
-        emit logMessage("服务器已停止");
+        LOG_INFO("server", "服务器已停止");
     }
 }
 
@@ -83,19 +152,129 @@ ClientConnection* TcpServer::getClient(qintptr clientId)
     return m_clients.value(clientId, nullptr);
 }
 
-void TcpServer::sendToClient(qintptr clientId, CommandType cmd, const QByteArray& data)
+void TcpServer::sendToClient(qintptr clientId, CommandType cmd, const QByteArray& data, quint32 requestId)
 {
     ClientConnection* client = m_clients.value(clientId, nullptr);
     if (client && client->socket && client->socket->state() == QAbstractSocket::ConnectedState) {
-        QByteArray packet = Protocol::pack(cmd, data);
-        client->socket->write(packet);
+        if (client->protocolVersion < 2) {
+            requestId = 0;
+        }
+        frameCounter(m_framesOut, "out", cmd)->inc();
+        m_bytesOut->inc(quint64(data.size() + (requestId ? Protocol::MAX_HEADER_SIZE : Protocol::headerSize())));
+        m_capture.write(quint32(clientId), CAPTURE_OUT, cmd, 0, requestId, data);
+        client->scheduler.send(client->socket, cmd, data, requestId);
     }
 }
 
-void TcpServer::sendJsonToClient(qintptr clientId, CommandType cmd, const QJsonObject& json)
+void TcpServer::sendJsonToClient(qintptr clientId, CommandType cmd, const QJsonObject& json, quint32 requestId)
 {
     QJsonDocument doc(json);
-    sendToClient(clientId, cmd, doc.toJson(QJsonDocument::Compact));
+    sendToClient(clientId, cmd, doc.toJson(QJsonDocument::Compact), requestId);
+}
+
+quint32 TcpServer::sendRequest(qintptr clientId, CommandType cmd, const QJsonObject& json, const QString& target)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return 0;
+    
+    quint32 requestId = client->nextRequestId++;
+    if (client->nextRequestId == 0) {
+        client->nextRequestId = 1;
+    }
+    
+    PendingRequest& request = client->requests[requestId];
+    request.cmd = cmd;
+    request.sentAt = QDateTime::currentMSecsSinceEpoch();
+    request.target = target;
+    
+    // 跟踪号随请求下发,客户端在最终响应中带回它记录的事件;旧版客户端没有请求号,无法对应
+    if (client->protocolVersion >= 2 && Trace::isEnabled()) {
+        request.traceId = Trace::newId();
+        request.queuedUs = Trace::now();
+        Trace::instant(request.traceId, "server.queued");
+        QJsonObject traced = json;
+        traced["traceId"] = Trace::idToString(request.traceId);
+        sendJsonToClient(clientId, cmd, traced, requestId);
+        return requestId;
+    }
+    
+    sendJsonToClient(clientId, cmd, json, requestId);
+    return requestId;
+}
+
+int TcpServer::pendingRequestCount(qintptr clientId) const
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    return client ? client->requests.size() : 0;
+}
+
+bool TcpServer::takeRequest(ClientConnection* client, quint32 requestId, CommandType requestCmd,
+                            PendingRequest* out, const QJsonObject* response)
+{
+    auto it = client->requests.end();
+    if (requestId != 0) {
+        it = client->requests.find(requestId);
+    } else {
+        // 请求号有序,第一个同类请求就是最早发送的
+        for (auto i = client->requests.begin(); i != client->requests.end(); ++i) {
+            if (i->cmd == requestCmd) {
+                it = i;
+                break;
+            }
+        }
+    }
+    if (it == client->requests.end() || it->cmd != requestCmd) {
+        return false;
+    }
+    if (out) {
+        *out = it.value();
+    }
+    if (it->traceId) {
+        finishTrace(client, it.value(), response);
+    }
+    client->requests.erase(it);
+    return true;
+}
+
+void TcpServer::failPendingRequests(qintptr clientId, qint64 before, const QString& reason)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return;
+    
+    QList<quint32> expired;
+    for (auto it = client->requests.constBegin(); it != client->requests.constEnd(); ++it) {
+        if (it->sentAt < before) {
+            expired.append(it.key());
+        }
+    }
+    
+    for (quint32 requestId : expired) {
+        PendingRequest request = client->requests.take(requestId);
+        if (request.traceId) {
+            finishTrace(client, request, nullptr);
+        }
+        quint32 transferId = client->protocolVersion >= 2 ? requestId : 0;
+        QString message = QString("%1: %2").arg(request.target).arg(reason);
+        
+        if (request.cmd == CMD_FILE_TRANSFER_START) {
+            m_pendingTransfers.remove(TransferKey(clientId, transferId));
+            LOG_INFO("server", "客户端 %1 安装请求 #%2 %3", clientId, requestId, message);
+            emit installResult(clientId, false, NO_EXIT_CODE, message);
+        } else if (request.cmd == CMD_UNINSTALL_SOFTWARE) {
+            LOG_INFO("server", "客户端 %1 卸载请求 #%2 %3", clientId, requestId, message);
+            emit uninstallResult(clientId, false, NO_EXIT_CODE, message);
+        } else if (request.cmd == CMD_EXEC_START) {
+            QSharedPointer<ExecOutput> output = m_execJobs.take(JobKey(clientId, requestId));
+            ExecResult result;
+            result.error = reason;
+            if (output) {
+                output->close();
+            }
+            LOG_INFO("server", "客户端 %1 命令 #%2 %3", clientId, requestId, message);
+            emit execFinished(clientId, requestId, result, output.data());
+        }
+    }
+    flushTraces();
 }
 
 void TcpServer::sendToAll(CommandType cmd, const QByteArray& data)
@@ -107,43 +286,63 @@ void TcpServer::sendToAll(CommandType cmd, const QByteArray& data)
 
 void TcpServer::requestSysInfo(qintptr clientId)
 {
-    sendToClient(clientId, CMD_GET_SYSINFO, QByteArray());
-    emit logMessage(QString("向客户端 %1 请求系统信息").arg(clientId));
+    sendRequest(clientId, CMD_GET_SYSINFO, QJsonObject());
+    LOG_INFO("server", "向客户端 %1 请求系统信息", clientId);
 }
 
 void TcpServer::requestSoftwareList(qintptr clientId)
 {
-    sendToClient(clientId, CMD_GET_SOFTWARE, QByteArray());
-    emit logMessage(QString("向客户端 %1 请求软件列表").arg(clientId));
+    // 附带快照中的清单摘要,客户端据此只回传差异
+    QJsonObject json;
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (m_inventory && client) {
+        QByteArray hash = m_inventory->softwareHash(historyKey(client));
+        if (!hash.isEmpty()) {
+            json["baseHash"] = QString::fromLatin1(hash);
+        }
+    }
+    sendRequest(clientId, CMD_GET_SOFTWARE, json);
+    LOG_INFO("server", "向客户端 %1 请求软件列表", clientId);
 }
 
 void TcpServer::installSoftware(qintptr clientId, const QString& filePath, const QString& args)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        emit installResult(clientId, false, "无法打开文件: " + filePath);
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return;
+    
+    QSharedPointer<QFile> file(new QFile(filePath));
+    if (!file->open(QIODevice::ReadOnly)) {
+        emit installResult(clientId, false, NO_EXIT_CODE, "无法打开文件: " + filePath);
+        return;
+    }
+    
+    // 旧版客户端同一时间只能接收一个文件
+    if (client->protocolVersion < 2 && m_pendingTransfers.contains(TransferKey(clientId, 0))) {
+        emit installResult(clientId, false, NO_EXIT_CODE, "客户端正在接收其他文件,请稍后再试");
         return;
     }
     
     QFileInfo fileInfo(filePath);
     
+    // 发送文件传输开始命令,后续数据帧和结果都使用这个请求号
+    QJsonObject json;
+    json["fileName"] = fileInfo.fileName();
+    json["fileSize"] = file->size();
+    json["installArgs"] = args;
+    quint32 requestId = sendRequest(clientId, CMD_FILE_TRANSFER_START, json, fileInfo.fileName());
+    
     // 存储文件传输信息
-    FileTransferInfo& transfer = m_pendingTransfers[clientId];
+    quint32 transferId = client->protocolVersion >= 2 ? requestId : 0;
+    FileTransferInfo& transfer = m_pendingTransfers[TransferKey(clientId, transferId)];
+    transfer.file = file;
     transfer.filePath = filePath;
     transfer.installArgs = args;
-    transfer.fileData = file.readAll();
+    transfer.fileSize = file->size();
     transfer.sentSize = 0;
-    file.close();
+    transfer.finished = false;
     
-    // 发送文件传输开始命令
-    QJsonObject json;
-    json["fileName"] = fileInfo.fileName();
-    json["fileSize"] = transfer.fileData.size();
-    json["installArgs"] = args;
-    
-    sendJsonToClient(clientId, CMD_FILE_TRANSFER_START, json);
-    emit logMessage(QString("开始向客户端 %1 传输文件: %2 (%3 字节)")
-        .arg(clientId).arg(fileInfo.fileName()).arg(transfer.fileData.size()));
+    LOG_INFO("server", "开始向客户端 %1 传输文件: %2 (%3 字节, 请求 #%4)",
+             clientId, fileInfo.fileName(), transfer.fileSize, requestId);
 }
 
 void TcpServer::uninstallSoftware(qintptr clientId, const QString& softwareName, const QString& uninstallCmd)
@@ -152,8 +351,47 @@ void TcpServer::uninstallSoftware(qintptr clientId, const QString& softwareName,
     json["name"] = softwareName;
     json["uninstallCmd"] = uninstallCmd;
     
-    sendJsonToClient(clientId, CMD_UNINSTALL_SOFTWARE, json);
-    emit logMessage(QString("向客户端 %1 发送卸载命令: %2").arg(clientId).arg(softwareName));
+    sendRequest(clientId, CMD_UNINSTALL_SOFTWARE, json, softwareName);
+    LOG_INFO("server", "向客户端 %1 发送卸载命令: %2", clientId, softwareName);
+}
+
+quint32 TcpServer::executeCommand(qintptr clientId, const ExecRequest& request)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return 0;
+    
+    // 输出按作业号区分,旧版客户端的帧没有请求号
+    if (client->protocolVersion < 2) {
+        LOG_WARN("server", "客户端 %1 版本过低,不支持远程执行", clientId);
+        return 0;
+    }
+    
+    // 客户端的超时必须早于服务端放弃请求的时间,结果才能送回
+    ExecRequest req = request;
+    if (req.timeoutMs <= 0 || req.timeoutMs > REQUEST_TIMEOUT - 60000) {
+        req.timeoutMs = REQUEST_TIMEOUT - 60000;
+    }
+    
+    QString display = req.program.isEmpty() ? req.command : req.program;
+    quint32 jobId = sendRequest(clientId, CMD_EXEC_START, req.toJson(), display);
+    
+    // 转存文件名: 机器标识-时间-作业号.log
+    QString machine = historyKey(client);
+    machine.replace(QRegularExpression("[^A-Za-z0-9_.-]"), "-");
+    QDir().mkpath(m_execOutputDir);
+    QString spillPath = QString("%1/%2-%3-%4.log").arg(m_execOutputDir).arg(machine)
+        .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss")).arg(jobId);
+    m_execJobs.insert(JobKey(clientId, jobId), QSharedPointer<ExecOutput>(new ExecOutput(spillPath)));
+    
+    LOG_INFO("server", "向客户端 %1 发送命令 #%2: %3", clientId, jobId, display);
+    return jobId;
+}
+
+void TcpServer::cancelCommand(qintptr clientId, quint32 jobId)
+{
+    if (!m_execJobs.contains(JobKey(clientId, jobId))) return;
+    sendToClient(clientId, CMD_EXEC_CANCEL, QByteArray(), jobId);
+    LOG_INFO("server", "取消客户端 %1 命令 #%2", clientId, jobId);
 }
 
 void TcpServer::onNewConnection()
@@ -162,23 +400,46 @@ void TcpServer::onNewConnection()
         QTcpSocket* socket = m_server->nextPendingConnection();
         qintptr clientId = socket->socketDescriptor();
         
-        ClientConnection* client = new ClientConnection();
+        // 预算用尽时不再接受新连接,客户端稍后重试或迁移到集群中的其他服务器
+        if (!reserveMemory(CLIENT_READ_CHUNK)) {
+            m_rejectedConnections->inc();
+            LOG_WARN("server", "内存预算已用尽,拒绝连接: %1", socket->peerAddress().toString());
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        m_acceptedConnections->inc();
+        
+        // 套接字读缓冲满后Qt停止从内核读取,暂停读取时TCP窗口随之关闭
+        socket->setReadBufferSize(CLIENT_READ_CHUNK);
+        
+        ClientConnection* client = m_connectionPool.acquire();
         client->socket = socket;
-        client->ipAddress = socket->peerAddress().toString();
-        client->lastHeartbeat = QDateTime::currentDateTime();
+        client->peerAddress = socket->peerAddress().toString();
+        client->ipAddress = client->peerAddress;
+        client->lastHeartbeat = QDateTime::currentMSecsSinceEpoch();
+        client->reader.setPool(&m_buffers);
         client->online = true;
         client->isTransferring = false;
         client->fileSize = 0;
         client->sentSize = 0;
         
         m_clients[clientId] = client;
+        m_shaper.addClient(clientId, socket->peerAddress(), m_shaperClock.nsecsElapsed() / 1000);
         
         connect(socket, &QTcpSocket::disconnected, this, &TcpServer::onClientDisconnected);
         connect(socket, &QTcpSocket::readyRead, this, &TcpServer::onClientReadyRead);
+        connect(socket, &QTcpSocket::bytesWritten, this, &TcpServer::onClientBytesWritten);
+        client->scheduler.setWritableHandler([this, clientId]() { pumpClient(clientId); });
+        client->scheduler.setSentHandler([this, clientId](const OutgoingFrame& frame) {
+            if (frame.requestId) {
+                onFrameSent(clientId, frame);
+            }
+        });
         connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
                 this, &TcpServer::onClientError);
         
-        emit logMessage(QString("新客户端连接: %1 (%2)").arg(clientId).arg(client->ipAddress));
+        LOG_INFO("server", "新客户端连接: %1 (%2)", clientId, client->ipAddress);
         emit clientConnected(clientId);
     }
 }
@@ -200,12 +461,29 @@ void TcpServer::onClientDisconnected()
     
     ClientConnection* client = m_clients.value(clientId, nullptr);
     if (client) {
-        emit logMessage(QString("客户端断开连接: %1 (%2)").arg(clientId).arg(client->computerName));
+        LOG_INFO("server", "客户端断开连接: %1 (%2)", clientId, client->computerName);
+        failPendingRequests(clientId, std::numeric_limits<qint64>::max(), "连接已断开");
+        m_closedConnections->inc();
         client->online = false;
         m_clients.remove(clientId);
-        delete client;
-        m_pendingTransfers.remove(clientId);
+        m_pausedReads.remove(clientId);
+        m_memory.add(MEMORY_RECEIVE, -client->receiveCharged);
+        m_memory.add(MEMORY_SEND, -client->sendCharged);
+        m_memory.add(MEMORY_TELEMETRY, -client->telemetryCharged);
+        m_shaper.removeClient(clientId);
+        m_connectionPool.release(client);
+        for (auto it = m_pendingTransfers.begin(); it != m_pendingTransfers.end();) {
+            if (it.key().first == clientId) {
+                it = m_pendingTransfers.erase(it);
+            } else {
+                ++it;
+            }
+        }
         emit clientDisconnected(clientId);
+        
+        // 有客户端离线,恢复快速广播以便旧版客户端尽快重连
+        resetBroadcastInterval();
+        resumePausedReads();
     }
 }
 
@@ -225,9 +503,216 @@ void TcpServer::onClientReadyRead()
         }
     }
     
-    if (client) {
-        client->buffer.append(socket->readAll());
-        processClientData(clientId, client);
+    if (client && !client->readPaused && readClient(clientId, client)) {
+        // 拆出的帧释放了接收缓冲,其他被暂停的连接可以继续
+        resumePausedReads();
+    }
+}
+
+bool TcpServer::readClient(qintptr clientId, ClientConnection* client)
+{
+    QTcpSocket* socket = client->socket;
+    while (socket->bytesAvailable() > 0) {
+        qint64 size = qMin<qint64>(socket->bytesAvailable(), CLIENT_READ_CHUNK);
+        
+        // 单个连接超限(接收缓冲加发送积压)时断开;全局预算不足时暂停读取。
+        // 发送积压随处理产生的响应(如不读取数据的客户端不停发心跳)增长,每次读取前更新记账
+        qint64 backlog = client->scheduler.pendingBytes() + socket->bytesToWrite();
+        m_memory.add(MEMORY_SEND, backlog - client->sendCharged);
+        client->sendCharged = backlog;
+        if (client->reader.available() + backlog + size > m_memory.limits().clientLimit) {
+            dropClient(clientId, client, "client_limit",
+                       QString("接收缓冲 %1 字节, 发送积压 %2 字节").arg(client->reader.available()).arg(backlog));
+            return false;
+        }
+        // 按接收缓冲需要新申请的容量检查预算,另外留出两块读取的余量:
+        // 帧数据缓冲和处理产生的响应在处理之后才计入。
+        // 缓冲要扩大到普通读取用不到的大小(正在拼接大帧)时,还要给其他连接的心跳和命令留出一部分预算
+        qint64 growth = client->reader.growthFor(size);
+        qint64 needed = growth + 2 * CLIENT_READ_CHUNK;
+        if (growth > 4 * CLIENT_READ_CHUNK) {
+            needed += m_memory.smallReadReserve();
+        }
+        if (!reserveMemory(needed)) {
+            if (!client->readPaused) {
+                client->readPaused = true;
+                m_pausedReads.insert(clientId);
+                m_readPauses->inc();
+            }
+            return true;
+        }
+        
+        // 直接读入连接的接收缓冲,不经过临时的 QByteArray
+        qint64 received = client->reader.readFrom(socket, size);
+        if (received <= 0) break;
+        m_bytesIn->inc(quint64(received));
+        chargeReceiveBuffer(client);
+        if (!processClientData(clientId, client)) {
+            return false;
+        }
+    }
+    client->readPaused = false;
+    m_pausedReads.remove(clientId);
+    return true;
+}
+
+void TcpServer::dropClient(qintptr clientId, ClientConnection* client, const char* reason, const QString& detail)
+{
+    m_metrics.counter("lanmgr_memory_disconnects_total", "因内存限制断开的连接数",
+                      QString("reason=\"%1\"").arg(reason))->inc();
+    LOG_WARN("server", "客户端 %1 (%2) 超出内存限制(%3),断开连接: %4",
+             clientId, client->peerAddress, reason, detail);
+    
+    // 立即断开,未发送的数据一并丢弃;disconnected 信号同步触发,client 在返回前已释放
+    client->socket->abort();
+}
+
+void TcpServer::updateMemoryUsage()
+{
+    qint64 send = 0;
+    for (ClientConnection* client : m_clients) {
+        client->sendCharged = client->scheduler.pendingBytes() + (client->socket ? client->socket->bytesToWrite() : 0);
+        send += client->sendCharged;
+    }
+    qint64 exec = 0;
+    for (const QSharedPointer<ExecOutput>& output : m_execJobs) {
+        exec += output->head().size();
+    }
+    m_memory.set(MEMORY_SEND, send);
+    m_memory.set(MEMORY_EXEC, exec);
+    m_memory.set(MEMORY_INVENTORY, m_inventory ? m_inventory->dirtyBytes() : 0);
+    m_memory.set(MEMORY_POOL, m_buffers.freeBytes());
+}
+
+bool TcpServer::reserveMemory(qint64 bytes)
+{
+    m_memory.set(MEMORY_INVENTORY, m_inventory ? m_inventory->dirtyBytes() : 0);
+    m_memory.set(MEMORY_POOL, m_buffers.freeBytes());
+    if (m_memory.canReserve(bytes)) {
+        return true;
+    }
+    
+    // 清单缓存可以随时写盘释放,先于暂停读取;写盘在后台线程进行,完成后的记账里才少掉这部分
+    if (m_inventory && m_inventory->isDirty() && !m_inventory->isSaving()) {
+        LOG_INFO("server", "内存预算不足,提前保存机器清单快照");
+        InventorySnapshot* inventory = m_inventory;
+        inventory->saveAsync([inventory](bool ok) {
+            if (!ok) {
+                LOG_WARN("server", "机器清单快照保存失败: %1", inventory->errorString());
+            }
+        });
+    }
+    
+    // 缓冲池里的空闲缓冲只为减少分配,预算不足时释放
+    if (!m_memory.canReserve(bytes) && m_buffers.freeBytes() > 0) {
+        qint64 others = m_memory.total() - m_memory.used(MEMORY_POOL);
+        m_buffers.trim(qMax<qint64>(0, m_memory.limits().globalBudget - others - bytes));
+        m_memory.set(MEMORY_POOL, m_buffers.freeBytes());
+    }
+    return m_memory.canReserve(bytes);
+}
+
+void TcpServer::resumePausedReads()
+{
+    if (m_pausedReads.isEmpty() || m_resumingReads) return;
+    m_resumingReads = true;
+    
+    // 读取过程中可能有连接被断开或再次暂停,按快照逐个处理。
+    // 占用小的连接(正常发心跳的客户端)优先,不会被大帧和积压长期挤占
+    QList<qintptr> paused = m_pausedReads.values();
+    std::sort(paused.begin(), paused.end(), [this](qintptr a, qintptr b) {
+        return memoryFootprint(m_clients.value(a, nullptr)) < memoryFootprint(m_clients.value(b, nullptr));
+    });
+    for (qintptr clientId : paused) {
+        if (!m_memory.canReserve(2 * CLIENT_READ_CHUNK)) break;
+        ClientConnection* client = m_clients.value(clientId, nullptr);
+        if (!client) {
+            m_pausedReads.remove(clientId);
+            continue;
+        }
+        client->readPaused = false;
+        readClient(clientId, client);
+    }
+    m_resumingReads = false;
+}
+
+void TcpServer::enforceMemoryLimits()
+{
+    updateMemoryUsage();
+    
+    // 不读取数据的客户端让发送积压无限增长,超过单个连接的上限后断开
+    QList<qintptr> ids = m_clients.keys();
+    for (qintptr clientId : ids) {
+        ClientConnection* client = m_clients.value(clientId, nullptr);
+        if (!client || !client->socket) continue;
+        qint64 backlog = client->scheduler.pendingBytes() + client->socket->bytesToWrite();
+        if (backlog + client->reader.available() > m_memory.limits().clientLimit) {
+            dropClient(clientId, client, "send_backlog", QString("发送积压 %1 字节").arg(backlog));
+        }
+    }
+    updateMemoryUsage();
+    resumePausedReads();
+    
+    // 暂停读取后预算仍然用尽: 接收缓冲里都是拼不完整的帧或发送积压无人读取,等待只会
+    // 互相卡住。依次断开占用最大的连接(通常正在发送超大帧或不读取数据),直到留给普通
+    // 读取的预算空出来,其他连接在下次检查前都能继续
+    bool dropped = false;
+    while (!m_pausedReads.isEmpty() && !reserveMemory(m_memory.smallReadReserve())) {
+        qintptr largestId = -1;
+        ClientConnection* largest = nullptr;
+        for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
+            if (!largest || memoryFootprint(it.value()) > memoryFootprint(largest)) {
+                largestId = it.key();
+                largest = it.value();
+            }
+        }
+        // 只剩正常大小的连接时不再断开,预算由其他分类占用
+        if (!largest || memoryFootprint(largest) <= 2 * CLIENT_READ_CHUNK) break;
+        dropClient(largestId, largest, "budget",
+                   QString("全局预算用尽, 接收缓冲 %1 字节, 发送积压 %2 字节")
+                       .arg(largest->receiveCharged).arg(largest->sendCharged));
+        dropped = true;
+    }
+    if (dropped) {
+        resumePausedReads();
+    }
+}
+
+qint64 TcpServer::memoryFootprint(const ClientConnection* client)
+{
+    return client ? client->receiveCharged + client->sendCharged : 0;
+}
+
+void TcpServer::onClientBytesWritten()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) return;
+    
+    // 写完成事件很频繁,直接按套接字描述符查找
+    qintptr clientId = socket->socketDescriptor();
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (client && client->socket == socket) {
+        pumpClient(clientId);
+    }
+}
+
+void TcpServer::pumpClient(qintptr clientId)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return;
+    
+    client->scheduler.flush(client->socket);
+    
+    // 发送缓冲有空位了,给该客户端的文件传输补充数据
+    QList<quint32> transfers;
+    for (auto it = m_pendingTransfers.lowerBound(TransferKey(clientId, 0));
+         it != m_pendingTransfers.end() && it.key().first == clientId; ++it) {
+        if (!it->finished) {
+            transfers.append(it.key().second);
+        }
+    }
+    for (quint32 requestId : transfers) {
+        continueFileTransfer(clientId, requestId);
     }
 }
 
@@ -236,79 +721,153 @@ void TcpServer::onClientError(QAbstractSocket::SocketError error)
     Q_UNUSED(error)
     QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
     if (socket) {
-        emit logMessage("客户端连接错误: " + socket->errorString());
+        LOG_WARN("server", "客户端连接错误: %1", socket->errorString());
     }
 }
 
 void TcpServer::checkHeartbeats()
 {
-    QDateTime now = QDateTime::currentDateTime();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
     QList<qintptr> timeoutClients;
     
     for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
-        if (it.value()->lastHeartbeat.msecsTo(now) > HEARTBEAT_TIMEOUT) {
+        if (now - it.value()->lastHeartbeat > HEARTBEAT_TIMEOUT) {
             timeoutClients.append(it.key());
         }
     }
     
+    // 放弃等待过久的请求
+    qint64 deadline = QDateTime::currentMSecsSinceEpoch() - REQUEST_TIMEOUT;
+    for (qintptr clientId : m_clients.keys()) {
+        failPendingRequests(clientId, deadline, "请求超时");
+    }
+    
     for (qintptr clientId : timeoutClients) {
         ClientConnection* client = m_clients.value(clientId);
         if (client && client->socket) {
-            emit logMessage(QString("客户端 %1 心跳超时,断开连接").arg(clientId));
+            LOG_WARN("server", "客户端 %1 心跳超时,断开连接", clientId);
             client->socket->disconnectFromHost();
         }
     }
+    
+    enforceMemoryLimits();
 }
 
-void TcpServer::processClientData(qintptr clientId, ClientConnection* client)
+bool TcpServer::processClientData(qintptr clientId, ClientConnection* client)
 {
-    while (client->buffer.size() >= Protocol::headerSize()) {
+    // 耗时包含命令处理(及其同步触发的界面更新)
+    QElapsedTimer timer;
+    timer.start();
+    
+    while (true) {
+        quint64 allocs = AllocCounter::count();
         ProtocolHeader header;
-        if (!Protocol::parseHeader(client->buffer, header)) {
+        FrameReader::Status status = client->reader.next(header, m_memory.limits().maxFrameSize);
+        if (status == FrameReader::FRAME_INCOMPLETE) {
             break;
         }
         
-        int packetSize = Protocol::headerSize() + header.dataLength;
-        if (client->buffer.size() < packetSize) {
-            break;
+        // 帧头一到就检查声明的长度,不等数据攒齐
+        if (status == FrameReader::FRAME_TOO_LARGE) {
+            dropClient(clientId, client, "frame_too_large",
+                       QString("命令 0x%1 声明长度 %2 字节").arg(header.cmdType, 0, 16).arg(header.dataLength));
+            m_decodeTime->observe(quint64(timer.nsecsElapsed()));
+            return false;
+        }
+        // 处理期间持有一份引用: 处理函数里再次拆帧时会换用新的缓冲,这里的数据不会被改写
+        const QByteArray data = client->reader.payload();
+        frameCounter(m_framesIn, "in", header.cmdType)->inc();
+        m_capture.write(quint32(clientId), CAPTURE_IN, header.cmdType, header.flags, header.requestId, data);
+        processCommand(clientId, header, data);
+        if (AllocCounter::enabled()) {
+            allocCounter(header.cmdType)->inc(AllocCounter::count() - allocs);
+        }
+    }
+    client->reader.compact();
+    chargeReceiveBuffer(client);
+    
+    m_decodeTime->observe(quint64(timer.nsecsElapsed()));
+    return true;
+}
+
+void TcpServer::chargeReceiveBuffer(ClientConnection* client)
+{
+    // 按缓冲实际占用的容量记账,而不是缓冲中的数据长度
+    qint64 capacity = client->reader.capacity();
+    m_memory.add(MEMORY_RECEIVE, capacity - client->receiveCharged);
+    client->receiveCharged = capacity;
+}
+
+void TcpServer::processCommand(qintptr clientId, const ProtocolHeader& header, const QByteArray& data)
+{
+    // 属于被跟踪请求的响应帧,记录处理耗时
+    quint64 traceId = 0;
+    if (header.requestId && (header.flags & FLAG_RESPONSE)) {
+        ClientConnection* client = m_clients.value(clientId, nullptr);
+        if (client) {
+            traceId = client->requests.value(header.requestId).traceId;
         }
-        
-        QByteArray data = client->buffer.mid(Protocol::headerSize(), header.dataLength);
-        client->buffer.remove(0, packetSize);
-        
-        processCommand(clientId, static_cast<CommandType>(header.cmdType), data);
     }
+    {
+        Trace::Span span(traceId, "server.process");
+        dispatchCommand(clientId, header, data);
+    }
+    flushTraces();
 }
 
-void TcpServer::processCommand(qintptr clientId, CommandType cmd, const QByteArray& data)
+void TcpServer::dispatchCommand(qintptr clientId, const ProtocolHeader& header, const QByteArray& data)
 {
-    switch (cmd) {
+    switch (static_cast<CommandType>(header.cmdType)) {
     case CMD_CLIENT_INFO:
         handleClientInfo(clientId, Protocol::parseJson(data));
         break;
         
+    case CMD_CLIENT_MOVING:
+        handleClientMoving(clientId, Protocol::parseJson(data));
+        break;
+        
     case CMD_HEARTBEAT:
-        handleHeartbeat(clientId);
+        handleHeartbeat(clientId, data);
         break;
         
     case CMD_SYSINFO_RESPONSE:
-        handleSysInfoResponse(clientId, Protocol::parseJson(data));
+        handleSysInfoResponse(clientId, header.requestId, Protocol::parseJson(data));
         break;
         
     case CMD_SOFTWARE_RESPONSE:
-        handleSoftwareResponse(clientId, Protocol::parseJson(data));
+        handleSoftwareResponse(clientId, header.requestId, Protocol::parseJson(data));
+        break;
+        
+    case CMD_INVENTORY_CHANGED:
+        handleInventoryChanged(clientId, Protocol::parseJson(data));
         break;
         
     case CMD_INSTALL_RESPONSE:
-        handleInstallResponse(clientId, Protocol::parseJson(data));
+        handleInstallResponse(clientId, header.requestId, Protocol::parseJson(data));
         break;
         
     case CMD_UNINSTALL_RESPONSE:
-        handleUninstallResponse(clientId, Protocol::parseJson(data));
+        handleUninstallResponse(clientId, header.requestId, Protocol::parseJson(data));
         break;
         
     case CMD_FILE_TRANSFER_ACK:
-        handleFileTransferAck(clientId, Protocol::parseJson(data));
+        handleFileTransferAck(clientId, header.requestId, Protocol::parseJson(data));
+        break;
+        
+    case CMD_TELEMETRY_BATCH:
+        handleTelemetryBatch(clientId, data);
+        break;
+        
+    case CMD_AGENT_STATS:
+        handleAgentStats(clientId, Protocol::parseJson(data));
+        break;
+        
+    case CMD_EXEC_OUTPUT:
+        handleExecOutput(clientId, header.requestId, data);
+        break;
+        
+    case CMD_EXEC_RESULT:
+        handleExecResult(clientId, header.requestId, Protocol::parseJson(data));
         break;
         
     default:
@@ -325,119 +884,868 @@ void TcpServer::handleClientInfo(qintptr clientId, const QJsonObject& json)
     client->ipAddress = json["ipAddress"].toString();
     client->macAddress = json["macAddress"].toString();
     client->osVersion = json["osVersion"].toString();
+    client->protocolVersion = quint8(qBound(1, json["protocolVersion"].toInt(1), PROTOCOL_VERSION));
     
-    emit logMessage(QString("客户端 %1 信息: %2 (%3)")
-        .arg(clientId).arg(client->computerName).arg(client->ipAddress));
+    LOG_INFO("server", "客户端 %1 信息: %2 (%3)", clientId, client->computerName, client->ipAddress);
+    if (json.contains("agent")) {
+        handleAgentStats(clientId, json["agent"].toObject());
+    }
     emit clientInfoUpdated(clientId);
+    
+    // 客户端上线后立即开始推送遥测
+    sendTelemetryConfig(clientId);
+    sendClusterInfo(clientId);
+    
+    QString key = historyKey(client);
+    if (!key.isEmpty()) {
+        m_knownClients.insert(key, QDateTime::currentMSecsSinceEpoch());
+    }
+    
+    if (m_inventory && !key.isEmpty()) {
+        bool known = !m_inventory->softwareHash(key).isEmpty();
+        m_inventory->updateClient(key, client->computerName, client->ipAddress, client->osVersion);
+        // 已知机器上线后用摘要校验清单,未变化时客户端只回一个标记
+        if (known) {
+            requestSoftwareList(clientId);
+        }
+    }
 }
 
-void TcpServer::handleHeartbeat(qintptr clientId)
+void TcpServer::handleClientMoving(qintptr clientId, const QJsonObject& json)
 {
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return;
+    
+    // 主动迁移到其他服务器的客户端不会再连回来,广播退避时不再等它
+    QString key = historyKey(client);
+    m_knownClients.remove(key);
+    LOG_INFO("server", "客户端 %1 (%2) 迁移到服务器 %3", clientId, key, json["server"].toString());
+}
+
+// 心跳数据是客户端按紧凑格式生成的 {"rtt":N},直接解析数字,不构造JSON对象;
+// 其他写法交给JSON解析
+static int parseHeartbeatRtt(const QByteArray& data)
+{
+    static const char prefix[] = "{\"rtt\":";
+    const int prefixSize = int(sizeof(prefix)) - 1;
+    if (data.size() > prefixSize + 1 && data.size() <= prefixSize + 10
+        && data.startsWith(prefix) && data.endsWith('}')) {
+        int value = 0;
+        int i = prefixSize;
+        for (; i < data.size() - 1 && data[i] >= '0' && data[i] <= '9'; ++i) {
+            value = value * 10 + (data[i] - '0');
+        }
+        if (i == data.size() - 1) {
+            return value;
+        }
+    }
+    return Protocol::parseJson(data)["rtt"].toInt(-1);
+}
+
+void TcpServer::handleHeartbeat(qintptr clientId, const QByteArray& data)
+{
+    // 新版客户端在心跳中带上上一次心跳的往返时间,旧版心跳没有数据
+    if (!data.isEmpty()) {
+        int rtt = parseHeartbeatRtt(data);
+        if (rtt >= 0) {
+            m_heartbeatRtt->observe(quint64(rtt));
+        }
+    }
+    
     ClientConnection* client = m_clients.value(clientId, nullptr);
     if (client) {
-        client->lastHeartbeat = QDateTime::currentDateTime();
+        client->lastHeartbeat = QDateTime::currentMSecsSinceEpoch();
         sendToClient(clientId, CMD_HEARTBEAT_ACK, QByteArray());
     }
 }
 
-void TcpServer::handleSysInfoResponse(qintptr clientId, const QJsonObject& json)
+void TcpServer::handleSysInfoResponse(qintptr clientId, quint32 requestId, const QJsonObject& json)
 {
     SystemInfo info = SystemInfo::fromJson(json);
-    emit logMessage(QString("收到客户端 %1 系统信息").arg(clientId));
+    LOG_INFO("server", "收到客户端 %1 系统信息", clientId);
+    
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (client) {
+        takeRequest(client, requestId, CMD_GET_SYSINFO, nullptr, &json);
+    }
+    if (m_inventory && client) {
+        QString key = historyKey(client);
+        if (!key.isEmpty()) {
+            m_inventory->updateSysInfo(key, info);
+        }
+    }
     emit sysInfoReceived(clientId, info);
 }
 
-void TcpServer::handleSoftwareResponse(qintptr clientId, const QJsonObject& json)
+void TcpServer::handleSoftwareResponse(qintptr clientId, quint32 requestId, const QJsonObject& json)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (client) {
+        takeRequest(client, requestId, CMD_GET_SOFTWARE, nullptr, &json);
+    }
+    applySoftwareReport(clientId, json);
+}
+
+void TcpServer::handleInventoryChanged(qintptr clientId, const QJsonObject& json)
 {
+    // 客户端检测到软件安装或卸载后主动推送,格式与软件列表响应相同
+    LOG_INFO("server", "客户端 %1 软件清单已变化", clientId);
+    applySoftwareReport(clientId, json);
+}
+
+void TcpServer::applySoftwareReport(qintptr clientId, const QJsonObject& json)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    QString key = (m_inventory && client) ? historyKey(client) : QString();
+    QByteArray baseHash = key.isEmpty() ? QByteArray() : m_inventory->softwareHash(key);
+    QByteArray hash = json["hash"].toString().toLatin1();
     QList<SoftwareInfo> list;
-    QJsonArray arr = json["software"].toArray();
     
-    for (const QJsonValue& val : arr) {
-        list.append(SoftwareInfo::fromJson(val.toObject()));
+    if (json["unchanged"].toBool() || json.contains("delta")) {
+        // 增量回复必须基于快照中的同一版本,否则重新请求完整列表
+        if (key.isEmpty() || baseHash.isEmpty() ||
+            json["baseHash"].toString().toLatin1() != baseHash) {
+            LOG_WARN("server", "客户端 %1 软件清单版本不一致,重新请求完整列表", clientId);
+            if (client) {
+                sendRequest(clientId, CMD_GET_SOFTWARE, QJsonObject());
+            }
+            return;
+        }
+        m_inventory->software(key, list);
+        
+        if (json["unchanged"].toBool()) {
+            LOG_INFO("server", "客户端 %1 软件列表未变化 (%2 个)", clientId, list.size());
+        } else {
+            QList<SoftwareInfo> added;
+            QStringList removed;
+            Inventory::diffFromJson(json["delta"].toObject(), added, removed);
+            list = Inventory::apply(list, added, removed);
+            m_inventory->updateSoftware(key, list, hash.isEmpty() ? Inventory::hash(list) : hash);
+            LOG_INFO("server", "收到客户端 %1 软件列表变化 (新增/更新 %2 个, 删除 %3 个)",
+                     clientId, added.size(), removed.size());
+        }
+    } else {
+        QJsonArray arr = json["software"].toArray();
+        for (const QJsonValue& val : arr) {
+            list.append(SoftwareInfo::fromJson(val.toObject()));
+        }
+        if (!key.isEmpty()) {
+            m_inventory->updateSoftware(key, list, hash.isEmpty() ? Inventory::hash(list) : hash);
+        }
+        LOG_INFO("server", "收到客户端 %1 软件列表 (%2 个)", clientId, list.size());
     }
     
-    emit logMessage(QString("收到客户端 %1 软件列表 (%2 个)").arg(clientId).arg(list.size()));
     emit softwareListReceived(clientId, list);
 }
 
-void TcpServer::handleInstallResponse(qintptr clientId, const QJsonObject& json)
+void TcpServer::handleInstallResponse(qintptr clientId, quint32 requestId, const QJsonObject& json)
 {
     bool success = json["success"].toBool();
+    int exitCode = json["exitCode"].toInt(NO_EXIT_CODE);
     QString message = json["message"].toString();
-    QString filePath = json["filePath"].toString();
     
-    emit logMessage(QString("客户端 %1 安装结果: %2 - %3")
-        .arg(clientId).arg(success ? "成功" : "失败").arg(message));
-    emit installResult(clientId, success, message);
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    PendingRequest request;
+    if (client && takeRequest(client, requestId, CMD_FILE_TRANSFER_START, &request, &json) && !request.target.isEmpty()) {
+        message = QString("%1: %2").arg(request.target).arg(message);
+    }
+    
+    LOG_INFO("server", "客户端 %1 安装结果: %2 - %3 (退出码 %4)", clientId, success ? "成功" : "失败", message,
+             exitCode == NO_EXIT_CODE ? QString("无") : QString::number(exitCode));
+    emit installResult(clientId, success, exitCode, message);
+    recordEvent(clientId, "install", success);
     
     // 清理传输信息
-    m_pendingTransfers.remove(clientId);
+    m_pendingTransfers.remove(TransferKey(clientId, requestId));
 }
 
-void TcpServer::handleUninstallResponse(qintptr clientId, const QJsonObject& json)
+void TcpServer::handleUninstallResponse(qintptr clientId, quint32 requestId, const QJsonObject& json)
 {
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (client) {
+        takeRequest(client, requestId, CMD_UNINSTALL_SOFTWARE, nullptr, &json);
+    }
+    
     bool success = json["success"].toBool();
+    int exitCode = json["exitCode"].toInt(NO_EXIT_CODE);
     QString message = json["message"].toString();
     QString name = json["name"].toString();
     
-    emit logMessage(QString("客户端 %1 卸载 %2: %3 - %4")
-        .arg(clientId).arg(name).arg(success ? "成功" : "失败").arg(message));
-    emit uninstallResult(clientId, success, message);
+    LOG_INFO("server", "客户端 %1 卸载 %2: %3 - %4 (退出码 %5)", clientId, name, success ? "成功" : "失败", message,
+             exitCode == NO_EXIT_CODE ? QString("无") : QString::number(exitCode));
+    emit uninstallResult(clientId, success, exitCode, message);
+    recordEvent(clientId, "uninstall", success);
 }
 
-void TcpServer::handleFileTransferAck(qintptr clientId, const QJsonObject& json)
+void TcpServer::handleFileTransferAck(qintptr clientId, quint32 requestId, const QJsonObject& json)
 {
     bool success = json["success"].toBool();
+    TransferKey key(clientId, requestId);
     
     if (!success) {
         QString message = json["message"].toString();
-        emit logMessage(QString("文件传输失败: %1").arg(message));
-        emit installResult(clientId, false, message);
-        m_pendingTransfers.remove(clientId);
+        LOG_WARN("server", "文件传输失败: %1", message);
+        ClientConnection* client = m_clients.value(clientId, nullptr);
+        if (client) {
+            takeRequest(client, requestId, CMD_FILE_TRANSFER_START, nullptr, &json);
+        }
+        emit installResult(clientId, false, NO_EXIT_CODE, message);
+        m_pendingTransfers.remove(key);
+        return;
+    }
+    
+    // 继续传输文件(结束帧之后的确认不再触发发送)
+    auto it = m_pendingTransfers.find(key);
+    if (it != m_pendingTransfers.end() && !it->finished) {
+        continueFileTransfer(clientId, requestId);
+    }
+}
+
+void TcpServer::handleTelemetryBatch(qintptr clientId, const QByteArray& data)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return;
+    
+    QVector<TelemetrySample> samples;
+    if (!TelemetryCodec::decodeBatch(data, samples)) {
+        LOG_WARN("server", "客户端 %1 遥测数据格式错误", clientId);
+        return;
+    }
+    if (samples.isEmpty()) return;
+    
+    // 环形缓冲随样本逐个分配,预算不足时停止扩大,在已有范围内覆盖旧样本
+    QString key = m_history ? historyKey(client) : QString();
+    for (const TelemetrySample& sample : samples) {
+        client->telemetry.push(sample, m_memory.canReserve(TelemetryRing::sampleBytes(sample)));
+        m_memory.add(MEMORY_TELEMETRY, client->telemetry.bytes() - client->telemetryCharged);
+        client->telemetryCharged = client->telemetry.bytes();
+        if (m_history && !key.isEmpty()) {
+            m_history->append(key + "/cpu", sample.timestamp, sample.cpuUsage);
+            m_history->append(key + "/freeMemory", sample.timestamp, qint64(sample.freeMemory));
+            m_history->append(key + "/freeDisk", sample.timestamp, qint64(sample.freeDisk));
+            m_history->append(key + "/diskRead", sample.timestamp, qint64(sample.diskReadRate));
+            m_history->append(key + "/diskWrite", sample.timestamp, qint64(sample.diskWriteRate));
+            m_history->append(key + "/netRx", sample.timestamp, qint64(sample.netRxRate));
+            m_history->append(key + "/netTx", sample.timestamp, qint64(sample.netTxRate));
+        }
+    }
+    emit telemetryReceived(clientId, client->telemetry.latest());
+}
+
+void TcpServer::handleAgentStats(qintptr clientId, const QJsonObject& json)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client || json.isEmpty()) return;
+    
+    bool wasThrottled = client->agentStats.value("throttled").toBool();
+    client->agentStats = json;
+    if (json["throttled"].toBool() && !wasThrottled) {
+        LOG_INFO("server", "客户端 %1 自身占用超出预算: CPU %2‰, 内存 %3 KB", clientId,
+                 json["cpu"].toInt(), json["rss"].toVariant().toLongLong());
+    }
+    
+    // 与遥测一起保存,便于对照客户端占用和整机负载
+    QString key = m_history ? historyKey(client) : QString();
+    if (!key.isEmpty()) {
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        m_history->append(key + "/agentCpu", now, json["cpu"].toInt());
+        m_history->append(key + "/agentRss", now, json["rss"].toVariant().toLongLong());
+    }
+    emit agentStatsUpdated(clientId);
+}
+
+void TcpServer::handleExecOutput(qintptr clientId, quint32 requestId, const QByteArray& data)
+{
+    QSharedPointer<ExecOutput> output = m_execJobs.value(JobKey(clientId, requestId));
+    ExecStream stream;
+    QByteArray chunk;
+    if (!output || !ExecOutputFrame::decode(data, stream, chunk)) {
+        return;
+    }
+    output->append(stream, chunk);
+    emit execOutputReceived(clientId, requestId, stream, chunk);
+}
+
+void TcpServer::handleExecResult(qintptr clientId, quint32 requestId, const QJsonObject& json)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client || !takeRequest(client, requestId, CMD_EXEC_START, nullptr, &json)) {
         return;
     }
+    ExecResult result = ExecResult::fromJson(json);
+    QSharedPointer<ExecOutput> output = m_execJobs.take(JobKey(clientId, requestId));
+    if (output) {
+        output->close();
+    }
+    
+    QString status;
+    if (!result.started) {
+        status = QString("启动失败: %1").arg(result.error);
+    } else if (result.canceled) {
+        status = "已取消";
+    } else if (result.timedOut) {
+        status = "超时";
+    } else {
+        status = QString("退出码 %1").arg(result.exitCode);
+    }
+    LOG_INFO("server", "客户端 %1 命令 #%2 %3, 输出 %4 字节%5",
+             clientId, requestId, status, result.outputBytes, result.truncated ? " (已截断)" : "");
+    emit execFinished(clientId, requestId, result, output.data());
+}
+
+QString TcpServer::historyKey(const ClientConnection* client)
+{
+    return client->macAddress.isEmpty() ? client->ipAddress : client->macAddress;
+}
+
+void TcpServer::recordEvent(qintptr clientId, const QString& type, bool success)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!m_history || !client) return;
     
-    // 继续传输文件
-    continueFileTransfer(clientId);
+    QString key = historyKey(client);
+    if (!key.isEmpty()) {
+        m_history->append(key + "/event/" + type, QDateTime::currentMSecsSinceEpoch(), success ? 1 : 0);
+    }
+}
+
+void TcpServer::setTelemetryConfig(int interval, int batchSize)
+{
+    m_telemetryInterval = qMax(0, interval);
+    m_telemetryBatchSize = qBound(1, batchSize, TELEMETRY_MAX_BATCH);
+    
+    for (qintptr clientId : m_clients.keys()) {
+        sendTelemetryConfig(clientId);
+    }
+    if (m_telemetryInterval > 0) {
+        LOG_INFO("server", "遥测采样间隔已设置为 %1 ms", m_telemetryInterval);
+    } else {
+        LOG_INFO("server", "遥测已关闭");
+    }
+}
+
+void TcpServer::sendTelemetryConfig(qintptr clientId)
+{
+    QJsonObject json;
+    json["enabled"] = m_telemetryInterval > 0;
+    json["interval"] = m_telemetryInterval;
+    json["batchSize"] = m_telemetryBatchSize;
+    sendJsonToClient(clientId, CMD_TELEMETRY_CONFIG, json);
+}
+
+ServerAnnounce TcpServer::selfAnnounce() const
+{
+    ServerAnnounce info;
+    info.port = m_tcpPort;
+    info.load = m_clients.size();
+    info.capacity = m_capacity;
+    info.peerPort = m_peers->peerPort();
+    return info;
 }
 
 void TcpServer::sendBroadcast()
 {
-    // 广播格式: LANMGR_SERVER:TCP端口
-    QByteArray data = QString("%1:%2").arg(BROADCAST_MAGIC).arg(m_tcpPort).toUtf8();
-    m_broadcastSocket->writeDatagram(data, QHostAddress::Broadcast, BROADCAST_PORT);
+    QByteArray data = Discovery::announce(selfAnnounce());
+    
+    // 按网卡子网定向广播,多网卡服务器的每个网段都能收到
+    for (const QHostAddress& address : Discovery::broadcastAddresses()) {
+        m_broadcastSocket->writeDatagram(data, address, BROADCAST_PORT);
+    }
+    
+    // 已知客户端全部在线时逐步拉长广播间隔,新客户端通过主动探测发现服务器
+    expireKnownClients();
+    if (allKnownClientsOnline()) {
+        m_broadcastInterval = qMin(m_broadcastInterval * 2, BROADCAST_MAX_INTERVAL);
+    } else {
+        m_broadcastInterval = BROADCAST_INTERVAL;
+    }
+    m_broadcastTimer->start(m_broadcastInterval);
+}
+
+void TcpServer::onProbeReceived()
+{
+    while (m_discoverySocket->hasPendingDatagrams()) {
+        QByteArray data;
+        QHostAddress sender;
+        quint16 senderPort;
+        
+        data.resize(int(m_discoverySocket->pendingDatagramSize()));
+        m_discoverySocket->readDatagram(data.data(), data.size(), &sender, &senderPort);
+        if (!Discovery::isProbe(data)) {
+            continue;
+        }
+        
+        m_discoverySocket->writeDatagram(Discovery::announce(selfAnnounce()), sender, senderPort);
+    }
 }
 
-void TcpServer::continueFileTransfer(qintptr clientId)
+void TcpServer::sendClusterInfo(qintptr clientId)
 {
-    if (!m_pendingTransfers.contains(clientId)) {
+    // 本服务器的地址由客户端按当前连接填写
+    QJsonArray servers;
+    QList<ServerAnnounce> all = m_peers->peers();
+    all.prepend(selfAnnounce());
+    for (const ServerAnnounce& info : all) {
+        QJsonObject obj;
+        obj["host"] = info.host;
+        obj["port"] = info.port;
+        obj["load"] = info.load;
+        obj["capacity"] = info.capacity;
+        servers.append(obj);
+    }
+    
+    QJsonObject json;
+    json["servers"] = servers;
+    sendJsonToClient(clientId, CMD_CLUSTER_INFO, json);
+}
+
+void TcpServer::broadcastClusterInfo()
+{
+    for (qintptr clientId : m_clients.keys()) {
+        sendClusterInfo(clientId);
+    }
+}
+
+void TcpServer::expireKnownClients()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (const ClientConnection* client : m_clients) {
+        auto it = m_knownClients.find(historyKey(client));
+        if (it != m_knownClients.end()) {
+            it.value() = now;
+        }
+    }
+    
+    // 报废、改名或换了服务器而没有通知的机器不会再上线,过期后不再等待
+    for (auto it = m_knownClients.begin(); it != m_knownClients.end();) {
+        if (now - it.value() > KNOWN_CLIENT_TTL) {
+            it = m_knownClients.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool TcpServer::allKnownClientsOnline() const
+{
+    if (m_knownClients.isEmpty()) {
+        return false;
+    }
+    
+    QSet<QString> online;
+    online.reserve(m_clients.size());
+    for (const ClientConnection* client : m_clients) {
+        online.insert(historyKey(client));
+    }
+    for (auto it = m_knownClients.constBegin(); it != m_knownClients.constEnd(); ++it) {
+        if (!online.contains(it.key())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TcpServer::resetBroadcastInterval()
+{
+    m_broadcastInterval = BROADCAST_INTERVAL;
+    if (m_broadcastTimer->isActive() && m_broadcastTimer->remainingTime() > BROADCAST_INTERVAL) {
+        m_broadcastTimer->start(BROADCAST_INTERVAL);
+    }
+}
+
+void TcpServer::setInventorySnapshot(InventorySnapshot* snapshot)
+{
+    m_inventory = snapshot;
+    if (m_inventory) {
+        // 快照中最近上线过的机器都视为应当在线的客户端
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (const QString& key : m_inventory->keys()) {
+            MachineInventory inv;
+            if (m_inventory->summary(key, inv) && now - inv.lastSeen <= KNOWN_CLIENT_TTL &&
+                !m_knownClients.contains(key)) {
+                m_knownClients.insert(key, inv.lastSeen);
+            }
+        }
+    }
+}
+
+void TcpServer::continueFileTransfer(qintptr clientId, quint32 requestId)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return;
+    
+    // 限速时所有数据块都由 onShapingTick 轮流发送,保证各传输公平分享带宽
+    if (m_shaper.isEnabled()) {
+        throttleTransfer(clientId, requestId);
         return;
     }
     
-    FileTransferInfo& transfer = m_pendingTransfers[clientId];
+    // 每个传输只在调度队列里保留少量数据块,其余的等发送缓冲腾出空间
+    // (pumpClient)再排队,控制消息不会排在整个文件后面
+    while (sendNextChunk(client, clientId, requestId, false) == CHUNK_SENT) {
+    }
+}
+
+TcpServer::ChunkResult TcpServer::sendNextChunk(ClientConnection* client, qintptr clientId,
+                                                quint32 requestId, bool shaped)
+{
+    auto it = m_pendingTransfers.find(TransferKey(clientId, requestId));
+    if (it == m_pendingTransfers.end() || it->finished) {
+        return CHUNK_DONE;
+    }
+    if (client->scheduler.pendingFrames(PRIORITY_BULK, requestId) >= FILE_PIPELINE_CHUNKS) {
+        return CHUNK_WINDOW_FULL;
+    }
+    
+    FileTransferInfo& transfer = it.value();
     
-    if (transfer.sentSize >= transfer.fileData.size()) {
+    if (transfer.sentSize >= transfer.fileSize) {
         // 传输完成
-        sendToClient(clientId, CMD_FILE_TRANSFER_END, QByteArray());
-        emit logMessage(QString("文件传输完成,等待客户端安装"));
-        return;
+        transfer.finished = true;
+        transfer.file.reset();
+        sendToClient(clientId, CMD_FILE_TRANSFER_END, QByteArray(), requestId);
+        LOG_INFO("server", "文件传输完成,等待客户端安装");
+        return CHUNK_DONE;
     }
     
-    // 发送下一块数据
-    qint64 remaining = transfer.fileData.size() - transfer.sentSize;
+    qint64 remaining = transfer.fileSize - transfer.sentSize;
     qint64 chunkSize = qMin((qint64)FILE_CHUNK_SIZE, remaining);
     
-    QByteArray chunk = transfer.fileData.mid(transfer.sentSize, chunkSize);
-    sendToClient(clientId, CMD_FILE_TRANSFER_DATA, chunk);
+    if (shaped && !m_shaper.tryConsume(clientId, chunkSize + Protocol::MAX_HEADER_SIZE,
+                                       m_shaperClock.nsecsElapsed() / 1000)) {
+        return CHUNK_NO_TOKENS;
+    }
     
+    // 数据块只记录文件区间,发送时才读取;Linux下由内核直接从文件发送
+    frameCounter(m_framesOut, "out", CMD_FILE_TRANSFER_DATA)->inc();
+    m_bytesOut->inc(quint64(chunkSize + Protocol::MAX_HEADER_SIZE));
+    m_capture.writeLength(quint32(clientId), CAPTURE_OUT, CMD_FILE_TRANSFER_DATA, 0, requestId, chunkSize);
+    client->scheduler.enqueueFile(CMD_FILE_TRANSFER_DATA, transfer.file, transfer.sentSize, chunkSize, requestId);
     transfer.sentSize += chunkSize;
     
     // 计算进度
-    int percent = (int)(transfer.sentSize * 100 / transfer.fileData.size());
+    int percent = (int)(transfer.sentSize * 100 / transfer.fileSize);
     emit fileTransferProgress(clientId, percent);
     
-    // 继续发送
-    QMetaObject::invokeMethod(this, [this, clientId]() {
-        continueFileTransfer(clientId);
-    }, Qt::QueuedConnection);
+    client->scheduler.flush(client->socket);
+    return CHUNK_SENT;
+}
+
+void TcpServer::throttleTransfer(qintptr clientId, quint32 requestId)
+{
+    TransferKey key(clientId, requestId);
+    if (!m_throttledSet.contains(key)) {
+        m_throttledSet.insert(key);
+        m_throttled.append(key);
+    }
+    if (!m_shapingTimer->isActive()) {
+        m_shapingTimer->start(SHAPING_TICK);
+    }
+}
+
+void TcpServer::onShapingTick()
+{
+    // 按轮次给每个等待中的传输各发一块,直到令牌用完或窗口都满。
+    // 本次没拿到令牌的传输排在下次的最前面,全局带宽在活动传输间平均分配
+    QList<TransferKey> waiting;
+    waiting.swap(m_throttled);
+    m_throttledSet.clear();
+    
+    QList<TransferKey> blocked;
+    while (!waiting.isEmpty()) {
+        QList<TransferKey> next;
+        for (const TransferKey& key : waiting) {
+            ClientConnection* client = m_clients.value(key.first, nullptr);
+            if (!client) continue;
+            
+            switch (sendNextChunk(client, key.first, key.second, true)) {
+            case CHUNK_SENT:
+                next.append(key);
+                break;
+            case CHUNK_NO_TOKENS:
+                blocked.append(key);
+                break;
+            default:
+                // 窗口已满的传输在发送缓冲腾出空间后由 pumpClient 重新加入
+                break;
+            }
+        }
+        waiting.swap(next);
+    }
+    
+    for (const TransferKey& key : blocked) {
+        throttleTransfer(key.first, key.second);
+    }
+    if (m_throttled.isEmpty()) {
+        m_shapingTimer->stop();
+    }
+}
+
+void TcpServer::setBandwidthLimits(const BandwidthLimits& limits)
+{
+    m_shaper.setLimits(limits, FILE_CHUNK_SIZE + Protocol::MAX_HEADER_SIZE, m_shaperClock.nsecsElapsed() / 1000);
+    
+    if (limits.isEnabled()) {
+        LOG_INFO("server", "带宽限制: 全局 %1 KB/s, 每子网(/%2) %3 KB/s, 每客户端 %4 KB/s (0表示不限)",
+                 limits.globalRate / 1024, limits.subnetPrefix, limits.subnetRate / 1024, limits.clientRate / 1024);
+    } else {
+        LOG_INFO("server", "带宽限制已关闭");
+    }
+    
+    // 取消限速后把等待中的传输恢复为直接发送
+    if (!limits.isEnabled()) {
+        QList<TransferKey> waiting;
+        waiting.swap(m_throttled);
+        m_throttledSet.clear();
+        m_shapingTimer->stop();
+        for (const TransferKey& key : waiting) {
+            continueFileTransfer(key.first, key.second);
+        }
+    }
+}
+
+void TcpServer::setMemoryLimits(const MemoryLimits& limits)
+{
+    MemoryLimits applied = limits;
+    
+    // 单个连接至少要能放下一个最大的帧;帧放在一个 QByteArray 里,不超过1GB
+    applied.maxFrameSize = qBound<qint64>(64 * 1024, applied.maxFrameSize, 1024 * 1024 * 1024);
+    applied.clientLimit = qMax(applied.clientLimit, applied.maxFrameSize + 2 * CLIENT_READ_CHUNK);
+    applied.globalBudget = qMax(applied.globalBudget, applied.clientLimit);
+    m_memory.setLimits(applied);
+    LOG_INFO("server", "内存限制: 最大帧 %1 KB, 每连接 %2 KB, 全局 %3 KB",
+             applied.maxFrameSize / 1024, applied.clientLimit / 1024, applied.globalBudget / 1024);
+    
+    // 调小后立即检查现有连接,调大后恢复被暂停的读取
+    enforceMemoryLimits();
+}
+
+void TcpServer::setupMetrics()
+{
+    m_metricsServer = new MetricsServer(&m_metrics, this);
+    for (int i = 0; i < METRICS_COMMAND_SLOTS; ++i) {
+        m_framesIn[i] = nullptr;
+        m_framesOut[i] = nullptr;
+        m_frameAllocs[i] = nullptr;
+    }
+    
+    m_acceptedConnections = m_metrics.counter("lanmgr_connections_accepted_total", "接受的客户端连接数");
+    m_closedConnections = m_metrics.counter("lanmgr_connections_closed_total", "断开的客户端连接数");
+    m_bytesIn = m_metrics.counter("lanmgr_bytes_total", "客户端连接收发的字节数(发送按排队时计)",
+                                  "direction=\"in\"");
+    m_bytesOut = m_metrics.counter("lanmgr_bytes_total", "客户端连接收发的字节数(发送按排队时计)",
+                                   "direction=\"out\"");
+    m_decodeTime = m_metrics.histogram("lanmgr_process_client_data_seconds",
+                                       "一次读事件中拆帧和处理命令的耗时", 1e-9);
+    m_heartbeatRtt = m_metrics.histogram("lanmgr_heartbeat_rtt_seconds",
+                                         "客户端测得的心跳往返时间", 1e-3);
+    m_rejectedConnections = m_metrics.counter("lanmgr_connections_rejected_total",
+                                              "内存预算用尽时拒绝的客户端连接数");
+    m_readPauses = m_metrics.counter("lanmgr_memory_read_pauses_total", "因内存预算不足暂停读取客户端数据的次数");
+    
+    // 断开原因先注册为0,未发生过断开时也有序列可查
+    for (const char* reason : {"frame_too_large", "client_limit", "send_backlog", "budget"}) {
+        m_metrics.counter("lanmgr_memory_disconnects_total", "因内存限制断开的连接数",
+                          QString("reason=\"%1\"").arg(reason));
+    }
+    
+    // 以下在抓取时计算,与服务端在同一线程,可以直接读取连接状态
+    m_metrics.addCollector([this](QByteArray& out) {
+        int requests = 0;
+        int throttledAgents = 0;
+        qint64 sendQueued = 0;
+        QByteArray perClientSend;
+        QByteArray perClientReceive;
+        for (auto it = m_clients.constBegin(); it != m_clients.constEnd(); ++it) {
+            const ClientConnection* client = it.value();
+            requests += client->requests.size();
+            if (client->agentStats["throttled"].toBool()) {
+                throttledAgents++;
+            }
+            
+            // 只列出有积压的客户端,空闲的不产生序列
+            qint64 queued = client->scheduler.pendingBytes() + (client->socket ? client->socket->bytesToWrite() : 0);
+            sendQueued += queued;
+            QString key = historyKey(client);
+            QString label = QString("client=\"%1\"").arg(MetricsRegistry::escapeLabel(
+                key.isEmpty() ? QString::number(it.key()) : key));
+            if (queued > 0) {
+                MetricsRegistry::writeSample(perClientSend, "lanmgr_client_send_queue_bytes", label, double(queued));
+            }
+            if (client->reader.available() > 0) {
+                MetricsRegistry::writeSample(perClientReceive, "lanmgr_client_receive_buffer_bytes", label,
+                                             double(client->reader.available()));
+            }
+        }
+        
+        int transfers = 0;
+        qint64 transferRemaining = 0;
+        for (const FileTransferInfo& transfer : m_pendingTransfers) {
+            if (!transfer.finished) {
+                transfers++;
+                transferRemaining += transfer.fileSize - transfer.sentSize;
+            }
+        }
+        
+        MetricsRegistry::writeFamily(out, "lanmgr_connected_clients", "当前连接的客户端数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_connected_clients", QString(), double(m_clients.size()));
+        MetricsRegistry::writeFamily(out, "lanmgr_agents_throttled", "自身占用超出预算、正在降速的客户端数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_agents_throttled", QString(), double(throttledAgents));
+        MetricsRegistry::writeFamily(out, "lanmgr_pending_requests", "等待客户端响应的请求数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_pending_requests", QString(), double(requests));
+        MetricsRegistry::writeFamily(out, "lanmgr_transfers_active", "进行中的文件传输数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_transfers_active", QString(), double(transfers));
+        MetricsRegistry::writeFamily(out, "lanmgr_transfer_pending_bytes", "进行中的文件传输尚未排队发送的字节数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_transfer_pending_bytes", QString(), double(transferRemaining));
+        MetricsRegistry::writeFamily(out, "lanmgr_send_queue_bytes", "所有客户端调度队列和套接字发送缓冲中的字节数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_send_queue_bytes", QString(), double(sendQueued));
+        MetricsRegistry::writeFamily(out, "lanmgr_client_send_queue_bytes", "有积压的客户端的发送积压字节数", "gauge");
+        out += perClientSend;
+        MetricsRegistry::writeFamily(out, "lanmgr_client_receive_buffer_bytes", "有未处理数据的客户端的接收缓冲字节数", "gauge");
+        out += perClientReceive;
+        MetricsRegistry::writeFamily(out, "lanmgr_exec_jobs", "执行中的远程命令数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_exec_jobs", QString(), double(m_execJobs.size()));
+        
+        updateMemoryUsage();
+        MetricsRegistry::writeFamily(out, "lanmgr_memory_bytes", "内存记账的估算占用(按分类)", "gauge");
+        for (int i = 0; i < MEMORY_CATEGORIES; ++i) {
+            MemoryCategory category = static_cast<MemoryCategory>(i);
+            MetricsRegistry::writeSample(out, "lanmgr_memory_bytes",
+                QString("category=\"%1\"").arg(MemoryBudget::categoryName(category)), double(m_memory.used(category)));
+        }
+        MetricsRegistry::writeFamily(out, "lanmgr_memory_peak_bytes", "内存记账的历史最高占用", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_memory_peak_bytes", QString(), double(m_memory.peak()));
+        MetricsRegistry::writeFamily(out, "lanmgr_memory_budget_bytes", "全局内存预算", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_memory_budget_bytes", QString(), double(m_memory.limits().globalBudget));
+        MetricsRegistry::writeFamily(out, "lanmgr_memory_paused_clients", "因内存预算不足暂停读取的连接数", "gauge");
+        MetricsRegistry::writeSample(out, "lanmgr_memory_paused_clients", QString(), double(m_pausedReads.size()));
+    });
+}
+
+void TcpServer::startMetricsServer()
+{
+    m_metricsServer->stop();
+    if (m_metricsPort == 0 || !m_server->isListening()) {
+        return;
+    }
+    if (m_metricsServer->start(QHostAddress::LocalHost, m_metricsPort)) {
+        LOG_INFO("server", "运行指标: http://127.0.0.1:%1/metrics", m_metricsPort);
+    } else {
+        LOG_WARN("server", "无法启动指标端口: %1", m_metricsServer->errorString());
+    }
+}
+
+void TcpServer::setMetricsPort(quint16 port)
+{
+    m_metricsPort = port;
+    startMetricsServer();
+}
+
+static QString commandLabel(quint32 cmd)
+{
+    if (cmd >= METRICS_COMMAND_SLOTS - 1) return QString("other");
+    const char* name = Protocol::commandName(cmd);
+    return *name ? QString(name) : QString("0x%1").arg(cmd, 2, 16, QChar('0'));
+}
+
+MetricCounter* TcpServer::frameCounter(MetricCounter** counters, const char* direction, quint32 cmd)
+{
+    int slot = cmd < METRICS_COMMAND_SLOTS - 1 ? int(cmd) : METRICS_COMMAND_SLOTS - 1;
+    if (!counters[slot]) {
+        counters[slot] = m_metrics.counter("lanmgr_frames_total", "客户端连接收发的帧数(按命令)",
+            QString("direction=\"%1\",cmd=\"%2\"").arg(direction).arg(commandLabel(cmd)));
+    }
+    return counters[slot];
+}
+
+MetricCounter* TcpServer::allocCounter(quint32 cmd)
+{
+    int slot = cmd < METRICS_COMMAND_SLOTS - 1 ? int(cmd) : METRICS_COMMAND_SLOTS - 1;
+    if (!m_frameAllocs[slot]) {
+        m_frameAllocs[slot] = m_metrics.counter("lanmgr_frame_allocations_total",
+            "拆帧和处理收到的帧时的堆分配次数(以 LANMGR_COUNT_ALLOCS 编译时统计)",
+            QString("cmd=\"%1\"").arg(commandLabel(cmd)));
+    }
+    return m_frameAllocs[slot];
+}
+
+void TcpServer::onFrameSent(qintptr clientId, const OutgoingFrame& frame)
+{
+    ClientConnection* client = m_clients.value(clientId, nullptr);
+    if (!client) return;
+    auto it = client->requests.find(frame.requestId);
+    if (it == client->requests.end() || !it->traceId) return;
+    
+    if (frame.cmd == it->cmd && it->sentUs == 0) {
+        it->sentUs = Trace::now();
+        Trace::instant(it->traceId, "server.sent");
+    } else if (frame.cmd == CMD_FILE_TRANSFER_DATA && it->transferStartUs == 0) {
+        it->transferStartUs = Trace::now();
+    } else if (frame.cmd == CMD_FILE_TRANSFER_END && it->transferStartUs) {
+        Trace::complete(it->traceId, "server.transfer", it->transferStartUs);
+    }
+}
+
+void TcpServer::finishTrace(ClientConnection* client, const PendingRequest& request, const QJsonObject* response)
+{
+    Trace::complete(request.traceId, "server.request", request.queuedUs);
+    
+    OperationTrace trace;
+    trace.traceId = request.traceId;
+    trace.machine = client->computerName;
+    trace.operation = QString::fromLatin1(Protocol::commandName(request.cmd));
+    trace.target = request.target;
+    
+    QJsonObject agentTrace = response ? (*response)["trace"].toObject() : QJsonObject();
+    if (!agentTrace.isEmpty()) {
+        // 客户端事件相对于它收到请求的时刻。假设往返两段网络耗时相同,
+        // 客户端收到请求时 ≈ (请求发出 + 响应到达 - 客户端处理耗时) / 2
+        qint64 sentUs = request.sentUs ? request.sentUs : request.queuedUs;
+        qint64 elapsed = qint64(agentTrace["elapsed"].toDouble());
+        trace.agentEvents = agentTrace["events"].toArray();
+        trace.agentBaseUs = (sentUs + Trace::now() - elapsed) / 2;
+    }
+    m_finishedTraces.append(trace);
+}
+
+void TcpServer::flushTraces()
+{
+    for (OperationTrace& trace : m_finishedTraces) {
+        trace.serverEvents = Trace::collect(trace.traceId);
+        m_traceLog.add(trace);
+    }
+    m_finishedTraces.clear();
+}
+
+int TcpServer::exportTraces(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_WARN("server", "无法写入跟踪文件 %1: %2", path, file.errorString());
+        return -1;
+    }
+    file.write(m_traceLog.toChromeJson());
+    return m_traceLog.size();
+}
+
+bool TcpServer::startCapture(const QString& path, bool full)
+{
+    if (!m_capture.open(path, CAPTURE_SERVER, full)) {
+        LOG_WARN("server", "无法记录流量到 %1: %2", path, m_capture.errorString());
+        return false;
+    }
+    LOG_INFO("server", "开始记录流量: %1", path);
+    return true;
+}
+
+void TcpServer::stopCapture()
+{
+    if (!m_capture.isOpen()) return;
+    m_capture.close();
+    if (m_capture.dropped() > 0) {
+        LOG_WARN("server", "流量记录已停止: %1 帧, %2 KB,超过大小上限未记录 %3 帧",
+                 m_capture.records(), m_capture.bytes() / 1024, m_capture.dropped());
+    } else {
+        LOG_INFO("server", "流量记录已停止: %1 帧, %2 KB", m_capture.records(), m_capture.bytes() / 1024);
+    }
 }
@@ -6,25 +6,113 @@
 #include <QTcpSocket>
 #include <QUdpSocket>
 #include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QSharedPointer>
 #include <QTimer>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include "../Common/protocol.h"
+#include "../Common/framescheduler.h"
+#include "../Common/framereader.h"
+#include "../Common/objectpool.h"
+#include "../Common/capture.h"
+#include "telemetryring.h"
+#include "bandwidthshaper.h"
+#include "execoutput.h"
+#include "metrics.h"
+#include "tracelog.h"
+#include "memorybudget.h"
 
-// 客户端连接信息
+// 按命令统计帧数的槽位: 0x00-0xFF 各占一个,其余命令共用最后一个
+#define METRICS_COMMAND_SLOTS 0x101
+
+class QFile;
+class TsStore;
+class InventorySnapshot;
+class PeerLink;
+class MetricsServer;
+struct ServerAnnounce;
+
+// 等待客户端响应的请求
+struct PendingRequest {
+    CommandType cmd;        // 请求命令
+    qint64 sentAt;          // 发送时间(UTC毫秒)
+    QString target;         // 请求对象(文件名/软件名),用于日志和结果提示
+    
+    // 操作跟踪(时间为 Trace::now,0表示尚未发生)
+    quint64 traceId = 0;
+    qint64 queuedUs = 0;
+    qint64 sentUs = 0;              // 请求帧写入套接字
+    qint64 transferStartUs = 0;     // 第一个文件数据块写入套接字
+};
+
+// 客户端连接信息(由服务端的对象池创建)
 struct ClientConnection {
-    QTcpSocket* socket;
+    QTcpSocket* socket = nullptr;
     QString computerName;
-    QString ipAddress;
+    QString peerAddress;            // 套接字的对端地址,带宽整形按它划分子网
+    QString ipAddress;              // 客户端上报的地址,上报前与对端地址相同
     QString macAddress;
     QString osVersion;
-    QDateTime lastHeartbeat;
-    QByteArray buffer;
-    bool online;
+    qint64 lastHeartbeat = 0;       // 最后活动时间(UTC毫秒)
+    FrameReader reader;             // 接收缓冲,从服务端的缓冲池取得
+    bool online = false;
     
     // 文件传输相关
-    bool isTransferring;
-    qint64 fileSize;
-    qint64 sentSize;
+    bool isTransferring = false;
+    qint64 fileSize = 0;
+    qint64 sentSize = 0;
+    
+    // 性能遥测样本
+    TelemetryRing telemetry;
+    
+    // 客户端进程自身的资源占用和预算(最近一次上报,见 CMD_AGENT_STATS),旧版客户端为空
+    QJsonObject agentStats;
+    
+    // 协议版本(版本2起支持请求号)和未完成的请求(按请求号)
+    quint8 protocolVersion = 1;
+    quint32 nextRequestId = 1;
+    QMap<quint32, PendingRequest> requests;
+    
+    // 待发送的帧,按优先级写入套接字
+    FrameScheduler scheduler;
+    
+    // 内存预算用尽时暂停读取,数据留在内核缓冲中
+    bool readPaused = false;
+    
+    // 接收缓冲容量、发送积压和遥测缓冲已计入内存预算的字节数
+    qint64 receiveCharged = 0;
+    qint64 sendCharged = 0;
+    qint64 telemetryCharged = 0;
+    
+    // 交还对象池时调用,恢复到新建时的状态。接收缓冲交还缓冲池;遥测缓冲计入了内存预算,
+    // 一并释放
+    void reset() {
+        socket = nullptr;
+        computerName.clear();
+        peerAddress.clear();
+        ipAddress.clear();
+        macAddress.clear();
+        osVersion.clear();
+        lastHeartbeat = 0;
+        reader.reset();
+        online = false;
+        isTransferring = false;
+        fileSize = 0;
+        sentSize = 0;
+        telemetry.clear();
+        agentStats = QJsonObject();
+        protocolVersion = 1;
+        nextRequestId = 1;
+        requests.clear();
+        scheduler.reset();
+        readPaused = false;
+        receiveCharged = 0;
+        sendCharged = 0;
+        telemetryCharged = 0;
+    }
 };
 
 class TcpServer : public QObject
@@ -49,9 +137,16 @@ public:
     // 获取客户端信息
     ClientConnection* getClient(qintptr clientId);
     
-    // 发送命令到指定客户端
-    void sendToClient(qintptr clientId, CommandType cmd, const QByteArray& data);
-    void sendJsonToClient(qintptr clientId, CommandType cmd, const QJsonObject& json);
+    // 发送命令到指定客户端(requestId 仅在客户端支持版本2协议时发送)
+    void sendToClient(qintptr clientId, CommandType cmd, const QByteArray& data, quint32 requestId = 0);
+    void sendJsonToClient(qintptr clientId, CommandType cmd, const QJsonObject& json, quint32 requestId = 0);
+    
+    // 发送请求并记录为未完成,返回请求号。多个请求可以连续发送,不必等待响应
+    quint32 sendRequest(qintptr clientId, CommandType cmd, const QJsonObject& json,
+                        const QString& target = QString());
+    
+    // 客户端未完成的请求数
+    int pendingRequestCount(qintptr clientId) const;
     
     // 发送命令到所有客户端
     void sendToAll(CommandType cmd, const QByteArray& data);
@@ -68,57 +163,274 @@ public:
     // 卸载软件
     void uninstallSoftware(qintptr clientId, const QString& softwareName, const QString& uninstallCmd);
     
+    // 在客户端上执行命令,输出分批回传(见 execOutputReceived),返回作业号,失败返回0
+    // 需要客户端支持版本2协议
+    quint32 executeCommand(qintptr clientId, const ExecRequest& request);
+    
+    // 取消执行中的命令,结果仍通过 execFinished 通知
+    void cancelCommand(qintptr clientId, quint32 jobId);
+    
+    // 输出超过 EXEC_MEMORY_LIMIT 时转存文件的目录
+    void setExecOutputDir(const QString& dir) { m_execOutputDir = dir; }
+    
+    // 设置遥测采样间隔和批量大小(interval为0表示停止),并下发给所有在线客户端
+    void setTelemetryConfig(int interval, int batchSize = TELEMETRY_BATCH_SIZE);
+    int telemetryInterval() const { return m_telemetryInterval; }
+    
+    // 设置历史数据存储(遥测和安装结果会写入其中),不转移所有权
+    void setHistoryStore(TsStore* store) { m_history = store; }
+    
+    // 设置建议最大连接数(随探测回复和广播通告给客户端)
+    void setCapacity(int capacity) { m_capacity = qMax(0, capacity); }
+    int capacity() const { return m_capacity; }
+    
+    // 设置文件传输的带宽限制(每客户端、每子网、全局),立即生效
+    void setBandwidthLimits(const BandwidthLimits& limits);
+    const BandwidthLimits& bandwidthLimits() const { return m_shaper.limits(); }
+    
+    // 设置最大帧长度、单个连接和全局的内存上限,立即生效
+    void setMemoryLimits(const MemoryLimits& limits);
+    const MemoryLimits& memoryLimits() const { return m_memory.limits(); }
+    
+    // 内存记账的当前值和峰值(与指标 lanmgr_memory_* 相同)
+    const MemoryBudget& memoryUsage() const { return m_memory; }
+    
+    // 同网段的其他服务器(集群列表和清单互查)
+    PeerLink* peers() const { return m_peers; }
+    
+    // 客户端在历史存储中的稳定标识(MAC地址,缺失时使用IP)
+    static QString historyKey(const ClientConnection* client);
+    
+    // 设置机器清单快照(系统信息和软件列表会写入其中),不转移所有权
+    void setInventorySnapshot(InventorySnapshot* snapshot);
+    InventorySnapshot* inventorySnapshot() const { return m_inventory; }
+    
+    // 运行指标,服务器运行期间在本机 http://127.0.0.1:<端口>/metrics 提供(端口为0表示关闭)
+    MetricsRegistry* metrics() { return &m_metrics; }
+    void setMetricsPort(quint16 port);
+    quint16 metricsPort() const { return m_metricsPort; }
+    
+    // 导出最近完成的操作跟踪(Chrome trace-event JSON),返回导出的操作数,失败返回-1
+    int exportTraces(const QString& path);
+    
+    // 记录所有连接的收发帧(见 capture.h),供 Replay 工具回放;full 为 true 时文件数据也完整保存
+    bool startCapture(const QString& path, bool full = false);
+    void stopCapture();
+    bool isCapturing() const { return m_capture.isOpen(); }
+    
+    // 关闭UDP广播、探测回复和服务器互联(回放和基准测试时不让局域网内的客户端连上来),需在 start 前设置
+    void setDiscoveryEnabled(bool enabled) { m_discoveryEnabled = enabled; }
+    
 signals:
     void clientConnected(qintptr clientId);
     void clientDisconnected(qintptr clientId);
     void clientInfoUpdated(qintptr clientId);
     void sysInfoReceived(qintptr clientId, const SystemInfo& info);
     void softwareListReceived(qintptr clientId, const QList<SoftwareInfo>& list);
-    void installResult(qintptr clientId, bool success, const QString& message);
-    void uninstallResult(qintptr clientId, bool success, const QString& message);
+    // exitCode: 安装/卸载程序的退出码,没有时为 NO_EXIT_CODE
+    void installResult(qintptr clientId, bool success, int exitCode, const QString& message);
+    void uninstallResult(qintptr clientId, bool success, int exitCode, const QString& message);
     void fileTransferProgress(qintptr clientId, int percent);
-    void logMessage(const QString& message);
+    void telemetryReceived(qintptr clientId, const TelemetrySample& latest);
+    void agentStatsUpdated(qintptr clientId);
+    void execOutputReceived(qintptr clientId, quint32 jobId, int stream, const QByteArray& data);
+    // output 只在信号处理期间有效
+    void execFinished(qintptr clientId, quint32 jobId, const ExecResult& result, const ExecOutput* output);
     
 private slots:
     void onNewConnection();
     void onClientDisconnected();
     void onClientReadyRead();
     void onClientError(QAbstractSocket::SocketError error);
+    void onClientBytesWritten();
     void checkHeartbeats();
     void sendBroadcast();
+    void onProbeReceived();
+    void broadcastClusterInfo();
+    void onShapingTick();
     
 private:
-    void processClientData(qintptr clientId, ClientConnection* client);
-    void processCommand(qintptr clientId, CommandType cmd, const QByteArray& data);
+    // 分块读取套接字数据并拆帧,连接被断开时返回 false(client 已释放)
+    bool readClient(qintptr clientId, ClientConnection* client);
+    bool processClientData(qintptr clientId, ClientConnection* client);
+    void chargeReceiveBuffer(ClientConnection* client);
+    
+    // 因内存限制断开客户端(reason 用作指标标签),client 随之释放
+    void dropClient(qintptr clientId, ClientConnection* client, const char* reason, const QString& detail);
+    
+    // 汇总发送积压、命令输出和清单缓存的占用
+    void updateMemoryUsage();
+    
+    // 预算不足时先把清单缓存写入快照文件,仍不足返回 false
+    bool reserveMemory(qint64 bytes);
+    
+    // 有空余预算时继续读取被暂停的客户端
+    void resumePausedReads();
+    
+    // 检查发送积压超限的连接;预算长时间用尽时断开占用最大的连接
+    void enforceMemoryLimits();
+    
+    // 连接计入内存预算的字节数(接收缓冲容量加发送积压)
+    static qint64 memoryFootprint(const ClientConnection* client);
+    
+    // 写出调度队列中的帧并给文件传输补充数据
+    void pumpClient(qintptr clientId);
+    void processCommand(qintptr clientId, const ProtocolHeader& header, const QByteArray& data);
+    void dispatchCommand(qintptr clientId, const ProtocolHeader& header, const QByteArray& data);
     
     // 命令处理
     void handleClientInfo(qintptr clientId, const QJsonObject& json);
-    void handleHeartbeat(qintptr clientId);
-    void handleSysInfoResponse(qintptr clientId, const QJsonObject& json);
-    void handleSoftwareResponse(qintptr clientId, const QJsonObject& json);
-    void handleInstallResponse(qintptr clientId, const QJsonObject& json);
-    void handleUninstallResponse(qintptr clientId, const QJsonObject& json);
-    void handleFileTransferAck(qintptr clientId, const QJsonObject& json);
+    void handleHeartbeat(qintptr clientId, const QByteArray& data);
+    void handleSysInfoResponse(qintptr clientId, quint32 requestId, const QJsonObject& json);
+    void handleSoftwareResponse(qintptr clientId, quint32 requestId, const QJsonObject& json);
+    void handleInventoryChanged(qintptr clientId, const QJsonObject& json);
+    void handleClientMoving(qintptr clientId, const QJsonObject& json);
+    void handleInstallResponse(qintptr clientId, quint32 requestId, const QJsonObject& json);
+    void handleUninstallResponse(qintptr clientId, quint32 requestId, const QJsonObject& json);
+    void handleFileTransferAck(qintptr clientId, quint32 requestId, const QJsonObject& json);
+    void handleTelemetryBatch(qintptr clientId, const QByteArray& data);
+    void handleAgentStats(qintptr clientId, const QJsonObject& json);
+    void handleExecOutput(qintptr clientId, quint32 requestId, const QByteArray& data);
+    void handleExecResult(qintptr clientId, quint32 requestId, const QJsonObject& json);
+    
+    // 应用软件清单报告(请求的响应或客户端主动推送的变化),更新快照并通知界面
+    void applySoftwareReport(qintptr clientId, const QJsonObject& json);
+    
+    // 下发遥测配置
+    void sendTelemetryConfig(qintptr clientId);
+    
+    // 记录安装/卸载结果事件(1成功/0失败)到历史存储
+    void recordEvent(qintptr clientId, const QString& type, bool success);
+    
+    // 取出与响应对应的请求。旧版客户端的响应不带请求号,按同类请求的发送顺序匹配
+    // response 为最终响应,其中客户端的跟踪事件会并入该请求的跟踪
+    bool takeRequest(ClientConnection* client, quint32 requestId, CommandType requestCmd,
+                     PendingRequest* out = nullptr, const QJsonObject* response = nullptr);
+    
+    // 放弃早于 before 发送的请求,安装/卸载请求通知失败
+    void failPendingRequests(qintptr clientId, qint64 before, const QString& reason);
     
     // 继续文件传输
-    void continueFileTransfer(qintptr clientId);
+    void continueFileTransfer(qintptr clientId, quint32 requestId);
+    
+    // 发送一个数据块(或结束帧)
+    enum ChunkResult {
+        CHUNK_SENT,           // 已排队一个数据块
+        CHUNK_WINDOW_FULL,    // 该传输排队的数据块已达上限
+        CHUNK_NO_TOKENS,      // 带宽令牌不足
+        CHUNK_DONE            // 传输已结束或不存在
+    };
+    ChunkResult sendNextChunk(ClientConnection* client, qintptr clientId, quint32 requestId, bool shaped);
+    
+    // 加入限速等待队列,由 onShapingTick 轮流发送
+    void throttleTransfer(qintptr clientId, quint32 requestId);
+    
+    // 本服务器的通告信息(端口、负载、容量、互查端口)
+    ServerAnnounce selfAnnounce() const;
+    
+    // 向客户端下发集群中各服务器的地址和负载,客户端据此选择/迁移服务器
+    void sendClusterInfo(qintptr clientId);
+    
+    // 刷新在线客户端的最后在线时间,移除长时间未上线的已知客户端
+    void expireKnownClients();
+    
+    // 已知客户端是否全部在线(决定广播是否退避)
+    bool allKnownClientsOnline() const;
+    
+    // 有客户端离线时恢复快速广播
+    void resetBroadcastInterval();
+    
+    // 请求帧或文件数据帧写入套接字,记录跟踪事件
+    void onFrameSent(qintptr clientId, const OutgoingFrame& frame);
+    
+    // 结束请求的跟踪;事件在当前命令处理完后(flushTraces)才收集,处理耗时也能计入
+    void finishTrace(ClientConnection* client, const PendingRequest& request, const QJsonObject* response);
+    void flushTraces();
+    
+    // 注册指标和抓取时计算的回调
+    void setupMetrics();
+    void startMetricsServer();
+    
+    // 按方向和命令取得帧计数器,首次出现的命令在此时注册
+    MetricCounter* frameCounter(MetricCounter** counters, const char* direction, quint32 cmd);
+    
+    // 按命令取得处理一帧的堆分配计数器
+    MetricCounter* allocCounter(quint32 cmd);
     
 private:
     QTcpServer* m_server;
     QUdpSocket* m_broadcastSocket;
+    QUdpSocket* m_discoverySocket;
     QTimer* m_broadcastTimer;
+    int m_broadcastInterval;
+    int m_capacity;
+    QHash<QString, qint64> m_knownClients;  // 见过的客户端稳定标识 -> 最后在线时间(UTC毫秒)
+    PeerLink* m_peers;
+    QTimer* m_clusterTimer;
     QMap<qintptr, ClientConnection*> m_clients;
     QTimer* m_heartbeatChecker;
     quint16 m_tcpPort;
+    bool m_discoveryEnabled;
+    int m_telemetryInterval;
+    int m_telemetryBatchSize;
+    TsStore* m_history;
+    InventorySnapshot* m_inventory;
     
-    // 文件传输缓存
+    // 文件传输(按客户端和请求号,同一客户端可以同时进行多个传输)
     struct FileTransferInfo {
+        QSharedPointer<QFile> file;   // 按块读取,不把整个文件读入内存
         QString filePath;
         QString installArgs;
-        QByteArray fileData;
+        qint64 fileSize;
         qint64 sentSize;
+        bool finished;                // 已发送结束帧,等待安装结果
     };
-    QMap<qintptr, FileTransferInfo> m_pendingTransfers;
+    typedef QPair<qintptr, quint32> TransferKey;
+    QMap<TransferKey, FileTransferInfo> m_pendingTransfers;
+    
+    // 带宽整形
+    BandwidthShaper m_shaper;
+    QElapsedTimer m_shaperClock;
+    QTimer* m_shapingTimer;
+    QList<TransferKey> m_throttled;       // 等待令牌的传输,按轮转顺序
+    QSet<TransferKey> m_throttledSet;
+    
+    // 连接状态和收发缓冲在连接之间复用,连接风暴和心跳处理不反复申请内存
+    ObjectPool<ClientConnection> m_connectionPool;
+    BufferPool m_buffers;
+    
+    // 内存记账
+    MemoryBudget m_memory;
+    QSet<qintptr> m_pausedReads;
+    bool m_resumingReads;
+    
+    // 远程执行的输出(按客户端和作业号)
+    typedef QPair<qintptr, quint32> JobKey;
+    QMap<JobKey, QSharedPointer<ExecOutput>> m_execJobs;
+    QString m_execOutputDir;
+    
+    // 运行指标
+    MetricsRegistry m_metrics;
+    MetricsServer* m_metricsServer;
+    quint16 m_metricsPort;
+    MetricCounter* m_acceptedConnections;
+    MetricCounter* m_closedConnections;
+    MetricCounter* m_bytesIn;
+    MetricCounter* m_bytesOut;
+    MetricCounter* m_framesIn[METRICS_COMMAND_SLOTS];
+    MetricCounter* m_framesOut[METRICS_COMMAND_SLOTS];
+    MetricCounter* m_frameAllocs[METRICS_COMMAND_SLOTS];   // 以 LANMGR_COUNT_ALLOCS 编译时统计
+    MetricHistogram* m_decodeTime;      // processClientData 耗时(纳秒)
+    MetricHistogram* m_heartbeatRtt;    // 客户端测得的心跳往返时间(毫秒)
+    MetricCounter* m_rejectedConnections;
+    MetricCounter* m_readPauses;
+    
+    // 操作跟踪
+    TraceLog m_traceLog;
+    QList<OperationTrace> m_finishedTraces;   // 已结束、等待收集事件
+    
+    // 流量记录
+    CaptureWriter m_capture;
 };
 
 #endif // TCPSERVER_H
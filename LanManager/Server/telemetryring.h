@@ -0,0 +1,91 @@
+#ifndef TELEMETRYRING_H
+#define TELEMETRYRING_H
+
+#include <QVector>
+#include "../Common/telemetry.h"
+
+// 每个客户端保留的遥测样本数(默认间隔2秒时约24分钟)
+#define TELEMETRY_RING_SIZE 720
+
+// 容量上限固定的遥测环形缓冲区
+// 存储空间随样本到达逐个分配,写满后覆盖最旧的样本。push() 的 grow 为 false 时不再扩大,
+// 在已分配的范围内覆盖,调用方据此在内存预算不足时限制增长。
+class TelemetryRing {
+public:
+    explicit TelemetryRing(int capacity = TELEMETRY_RING_SIZE)
+        : m_capacity(capacity)
+        , m_head(0)
+        , m_count(0)
+        , m_bytes(0)
+    {
+    }
+
+    void push(const TelemetrySample& sample, bool grow = true) {
+        // 只在未回绕时追加,保证已分配部分始终按时间顺序排列
+        if (m_head == m_samples.size() || (m_head == 0 && m_count == m_samples.size())) {
+            if ((grow || m_samples.isEmpty()) && m_samples.size() < m_capacity) {
+                m_samples.append(sample);
+                m_bytes += sampleBytes(sample);
+                m_head = m_samples.size() % m_capacity;
+                ++m_count;
+                return;
+            }
+            m_head = 0;
+        }
+        m_bytes += sampleBytes(sample) - sampleBytes(m_samples[m_head]);
+        m_samples[m_head] = sample;
+        m_head = (m_head + 1) % m_samples.size();
+        if (m_count < m_samples.size()) {
+            ++m_count;
+        }
+    }
+
+    int size() const { return m_count; }
+    int capacity() const { return m_capacity; }
+    bool isEmpty() const { return m_count == 0; }
+
+    // 清空并释放存储
+    void clear() {
+        m_samples = QVector<TelemetrySample>();
+        m_head = 0;
+        m_count = 0;
+        m_bytes = 0;
+    }
+
+    // 已分配样本的估算字节数(样本本身和每核心占用数组)
+    qint64 bytes() const { return m_bytes; }
+
+    static qint64 sampleBytes(const TelemetrySample& sample) {
+        return qint64(sizeof(TelemetrySample)) + qint64(sample.coreUsage.size()) * qint64(sizeof(quint32));
+    }
+
+    // 按时间顺序访问, 0 为最旧的样本
+    const TelemetrySample& at(int index) const {
+        int start = (m_head - m_count + m_samples.size()) % m_samples.size();
+        return m_samples[(start + index) % m_samples.size()];
+    }
+
+    const TelemetrySample& latest() const {
+        return at(m_count - 1);
+    }
+
+    // 取出最近的 count 个样本(按时间顺序)
+    QVector<TelemetrySample> recent(int count) const {
+        count = qMin(count, m_count);
+        QVector<TelemetrySample> result;
+        result.reserve(count);
+        for (int i = m_count - count; i < m_count; ++i) {
+            result.append(at(i));
+        }
+        return result;
+    }
+
+private:
+    QVector<TelemetrySample> m_samples;
+    int m_capacity;  // 样本数上限
+    int m_head;      // 下一个写入位置
+    int m_count;     // 有效样本数
+    qint64 m_bytes;  // 已分配样本的估算字节数
+};
+
+#endif // TELEMETRYRING_H
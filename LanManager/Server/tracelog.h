@@ -0,0 +1,99 @@
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include "../Common/trace.h"
+
+// 保留的已完成操作跟踪数,超过后丢弃最早的
+#define TRACE_LOG_SIZE 2000
+
+// 一个已完成操作的跟踪: 服务端事件在完成时从各线程缓冲复制出来,
+// 客户端事件随最终响应送回,时间换算到服务端时钟
+struct OperationTrace {
+    quint64 traceId = 0;
+    QString machine;          // 客户端计算机名
+    QString operation;        // 请求命令
+    QString target;           // 文件名/软件名/命令
+    QVector<TraceEvent> serverEvents;
+    QJsonArray agentEvents;   // [名称, 开始, 时长, 线程],开始时间相对于客户端收到请求
+    qint64 agentBaseUs = 0;   // 客户端收到请求时对应的服务端时间
+};
+
+// 已完成操作的跟踪记录,导出为 Chrome trace-event JSON
+class TraceLog {
+public:
+    void add(const OperationTrace& trace) {
+        m_traces.append(trace);
+        if (m_traces.size() > TRACE_LOG_SIZE) {
+            m_traces.removeFirst();
+        }
+    }
+
+    int size() const { return m_traces.size(); }
+    void clear() { m_traces.clear(); }
+
+    // 服务端为进程1,每台客户端一个进程;每个操作在两边各占一行,行名为操作和对象
+    QByteArray toChromeJson() const {
+        QJsonArray events;
+        events.append(Trace::chromeProcessName(1, "服务端"));
+        QHash<QString, int> machinePids;
+
+        int row = 0;
+        for (const OperationTrace& trace : m_traces) {
+            row++;
+            QString rowName = QString("%1 %2 @ %3").arg(trace.operation, trace.target, trace.machine);
+            QJsonObject args{{"trace", Trace::idToString(trace.traceId)}};
+
+            events.append(threadName(1, row, rowName));
+            for (const TraceEvent& event : trace.serverEvents) {
+                QJsonObject eventArgs = args;
+                eventArgs["thread"] = event.thread;
+                events.append(Trace::chromeEvent(QString::fromLatin1(event.name), event.startUs,
+                                                 event.durationUs, 1, row, eventArgs));
+            }
+
+            if (trace.agentEvents.isEmpty()) continue;
+            int pid = machinePids.value(trace.machine, 0);
+            if (pid == 0) {
+                pid = machinePids.size() + 2;
+                machinePids.insert(trace.machine, pid);
+                events.append(Trace::chromeProcessName(pid, trace.machine));
+            }
+            events.append(threadName(pid, row, rowName));
+            for (const QJsonValue& value : trace.agentEvents) {
+                QJsonArray event = value.toArray();
+                QJsonObject eventArgs = args;
+                eventArgs["thread"] = event.at(3).toInt();
+                events.append(Trace::chromeEvent(event.at(0).toString(),
+                                                 trace.agentBaseUs + qint64(event.at(1).toDouble()),
+                                                 qint64(event.at(2).toDouble()), pid, row, eventArgs));
+            }
+        }
+
+        QJsonObject root;
+        root["traceEvents"] = events;
+        root["displayTimeUnit"] = "ms";
+        return QJsonDocument(root).toJson(QJsonDocument::Compact);
+    }
+
+private:
+    static QJsonObject threadName(int pid, int tid, const QString& name) {
+        QJsonObject event;
+        event["name"] = "thread_name";
+        event["ph"] = "M";
+        event["pid"] = pid;
+        event["tid"] = tid;
+        event["args"] = QJsonObject{{"name", name}};
+        return event;
+    }
+
+    QList<OperationTrace> m_traces;
+};
+
+#endif // TRACELOG_H
@@ -0,0 +1,51 @@
+QT += core network concurrent
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = LanLoadTest
+TEMPLATE = app
+
+# Windows特定配置
+win32 {
+    LIBS += -liphlpapi -lws2_32
+}
+
+SOURCES += \
+    main.cpp \
+    hostilescenario.cpp \
+    bandwidthscenario.cpp \
+    priorityscenario.cpp \
+    ../../Server/tcpserver.cpp \
+    ../../Server/inventorysnapshot.cpp \
+    ../../Server/peerlink.cpp \
+    ../../Server/metricsserver.cpp
+
+HEADERS += \
+    hostilescenario.h \
+    bandwidthscenario.h \
+    priorityscenario.h \
+    ../../Server/tcpserver.h \
+    ../../Server/inventorysnapshot.h \
+    ../../Server/peerlink.h \
+    ../../Server/metricsserver.h \
+    ../../Server/metrics.h \
+    ../../Server/memorybudget.h \
+    ../../Server/bandwidthshaper.h \
+    ../../Common/protocol.h \
+    ../../Common/logger.h
+
+INCLUDEPATH += ../../Common ../../Server
+
+# 时序存储库
+include(../../TsStore/tsstore.pri)
+
+# 网络条件模拟(priority 场景的慢速链路)
+include(../NetEmu/netemu.pri)
+
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../../pgo.pri)
+
+# 输出目录
+DESTDIR = ../../bin
@@ -0,0 +1,314 @@
+#include "bandwidthscenario.h"
+#include <QFile>
+#include <QJsonObject>
+#include <QDebug>
+#include <cmath>
+#include "tcpserver.h"
+
+// 服务端整形时每个文件数据块的计费字节数(64KB数据加最大协议头),与 tcpserver.cpp 一致
+#define BANDWIDTH_CHUNK_BYTES (64 * 1024 + Protocol::MAX_HEADER_SIZE)
+
+// 第一组限制额外等待客户端连上并开始传输的时间(毫秒)
+#define BANDWIDTH_WARMUP 2000
+
+// 定时器间隔(毫秒),用于发送心跳
+#define BANDWIDTH_TICK 1000
+
+BandwidthScenario::BandwidthScenario(TcpServer* server, const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_server(server)
+    , m_options(options)
+    , m_timer(new QTimer(this))
+{
+    connect(m_timer, &QTimer::timeout, this, &BandwidthScenario::tick);
+    connect(m_server, &TcpServer::clientInfoUpdated, this, &BandwidthScenario::onClientInfoUpdated);
+
+    // 每组限制分别让某一级成为瓶颈,最后一组同时设置三级
+    const qint64 KB = 1024;
+    m_phases.append(Phase{"global", {8192 * KB, 0, 0, 24}});
+    m_phases.append(Phase{"subnet", {0, 1024 * KB, 0, 24}});
+    m_phases.append(Phase{"client", {0, 0, 200 * KB, 24}});
+    m_phases.append(Phase{"combined", {7168 * KB, 2048 * KB, 200 * KB, 24}});
+}
+
+BandwidthScenario::~BandwidthScenario()
+{
+    qDeleteAll(m_peers);
+}
+
+bool BandwidthScenario::start(const QString& host, quint16 port, const QString& filePath)
+{
+    m_host = host;
+    m_port = port;
+    m_filePath = filePath;
+
+    // 文件大小按每个客户端可能收到的最多数据留出一倍余量,传输在场景结束前不会完成
+    qint64 warmup = BANDWIDTH_WARMUP;
+    double maxBytes = 0;
+    openPeers();
+    for (const Phase& phase : m_phases) {
+        QVector<double> rates = expectedRates(phase.limits);
+        double maxRate = 0;
+        for (double rate : rates) {
+            maxRate = qMax(maxRate, rate);
+        }
+        maxBytes += maxRate * (warmup + m_options.settleMs + m_options.measureMs) / 1000.0;
+        warmup = 0;
+    }
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly) || !file.resize(qint64(maxBytes * 2) + BANDWIDTH_CHUNK_BYTES)) {
+        qCritical().noquote() << "无法创建传输用的文件:" << m_filePath;
+        return false;
+    }
+    file.close();
+
+    m_clock.start();
+    m_timer->start(BANDWIDTH_TICK);
+    m_phase = 0;
+    beginPhase();
+    for (Peer* peer : m_peers) {
+        if (!peer->socket->bind(QHostAddress(peer->ipAddress))) {
+            qCritical().noquote() << "无法绑定本地地址" << peer->ipAddress << ":" << peer->socket->errorString();
+            return false;
+        }
+        peer->socket->connectToHost(m_host, m_port);
+    }
+    return true;
+}
+
+void BandwidthScenario::openPeers()
+{
+    // 子网大小依次减半(48个客户端分成24/12/6/6),各级限制的瓶颈落在不同的子网上
+    // 服务端按连接的对端地址划分子网,各客户端绑定 127.77.<子网>.<序号> 再连接本机
+    int remaining = m_options.clients;
+    for (int subnet = 0; subnet < m_options.subnets; ++subnet) {
+        int count = subnet == m_options.subnets - 1 ? remaining : qMax(1, remaining / 2);
+        remaining -= count;
+        for (int i = 0; i < count; ++i) {
+            Peer* peer = new Peer;
+            peer->subnet = subnet;
+            peer->ipAddress = QString("127.77.%1.%2").arg(subnet).arg(i + 1);
+            peer->socket = new QTcpSocket(this);
+            m_peers.append(peer);
+
+            connect(peer->socket, &QTcpSocket::connected, this, [this, peer]() { onConnected(peer); });
+            connect(peer->socket, &QTcpSocket::readyRead, this, [this, peer]() { onReadyRead(peer); });
+            connect(peer->socket, &QTcpSocket::disconnected, this, [peer]() { peer->closed = true; });
+            connect(peer->socket, &QAbstractSocket::errorOccurred, this, [peer](QAbstractSocket::SocketError) {
+                if (peer->socket->state() != QAbstractSocket::ConnectedState) {
+                    peer->closed = true;
+                }
+            });
+        }
+    }
+}
+
+void BandwidthScenario::onConnected(Peer* peer)
+{
+    peer->connected = true;
+    peer->lastHeartbeat = m_clock.elapsed();
+
+    int index = m_peers.indexOf(peer);
+    QJsonObject info;
+    info["computerName"] = QString("bandwidth-%1").arg(index);
+    info["ipAddress"] = peer->ipAddress;
+    info["macAddress"] = QString("02:00:00:01:%1:%2")
+        .arg(index / 256, 2, 16, QChar('0')).arg(index % 256, 2, 16, QChar('0'));
+    info["osVersion"] = "LanLoadTest";
+    info["protocolVersion"] = PROTOCOL_VERSION;
+    peer->socket->write(Protocol::packJson(CMD_CLIENT_INFO, info));
+}
+
+void BandwidthScenario::onClientInfoUpdated(qintptr clientId)
+{
+    // 每个客户端只开始一个传输,文件足够大,整个场景期间一直在发送
+    if (!m_transfers.contains(clientId)) {
+        m_transfers.insert(clientId);
+        m_server->installSoftware(clientId, m_filePath);
+    }
+}
+
+void BandwidthScenario::onReadyRead(Peer* peer)
+{
+    peer->buffer.append(peer->socket->readAll());
+    int offset = 0;
+    while (true) {
+        ProtocolHeader header;
+        if (!Protocol::parseHeader(peer->buffer.constData() + offset, peer->buffer.size() - offset, header)) {
+            break;
+        }
+        int packetSize = header.size + int(header.dataLength);
+        if (peer->buffer.size() - offset < packetSize) {
+            break;
+        }
+        offset += packetSize;
+
+        if (header.cmdType == CMD_FILE_TRANSFER_START) {
+            QJsonObject response;
+            response["success"] = true;
+            peer->socket->write(Protocol::packJson(CMD_FILE_TRANSFER_ACK, response, header.requestId,
+                                                   FLAG_RESPONSE));
+        } else if (header.cmdType == CMD_FILE_TRANSFER_DATA) {
+            // 服务端整形时每块按最大协议头计费
+            peer->received += Protocol::MAX_HEADER_SIZE + header.dataLength;
+        }
+    }
+    peer->buffer.remove(0, offset);
+}
+
+void BandwidthScenario::tick()
+{
+    qint64 now = m_clock.elapsed();
+    for (Peer* peer : m_peers) {
+        if (peer->connected && !peer->closed && now - peer->lastHeartbeat >= HEARTBEAT_INTERVAL) {
+            peer->socket->write(Protocol::pack(CMD_HEARTBEAT, QByteArray()));
+            peer->lastHeartbeat = now;
+        }
+    }
+}
+
+void BandwidthScenario::beginPhase()
+{
+    const Phase& phase = m_phases.at(m_phase);
+    m_server->setBandwidthLimits(phase.limits);
+    int settle = m_options.settleMs + (m_phase == 0 ? BANDWIDTH_WARMUP : 0);
+    QTimer::singleShot(settle, this, &BandwidthScenario::beginMeasure);
+}
+
+void BandwidthScenario::beginMeasure()
+{
+    if (m_phase == 0 && m_transfers.size() < m_peers.size()) {
+        m_failures << QString("%1 个客户端没有开始传输").arg(m_peers.size() - m_transfers.size());
+    }
+    m_measureStart = m_clock.elapsed();
+    for (Peer* peer : m_peers) {
+        peer->measureStart = peer->received;
+    }
+    QTimer::singleShot(m_options.measureMs, this, &BandwidthScenario::endMeasure);
+}
+
+void BandwidthScenario::endMeasure()
+{
+    const Phase& phase = m_phases.at(m_phase);
+    double seconds = (m_clock.elapsed() - m_measureStart) / 1000.0;
+    QVector<double> expected = expectedRates(phase.limits);
+
+    QVector<double> subnetMeasured(m_options.subnets, 0.0);
+    QVector<double> subnetExpected(m_options.subnets, 0.0);
+    double totalMeasured = 0;
+    double totalExpected = 0;
+    double worstClient = 0;
+    for (int i = 0; i < m_peers.size(); ++i) {
+        const Peer* peer = m_peers.at(i);
+        double measured = (peer->received - peer->measureStart) / seconds;
+        subnetMeasured[peer->subnet] += measured;
+        subnetExpected[peer->subnet] += expected.at(i);
+        totalMeasured += measured;
+        totalExpected += expected.at(i);
+        worstClient = qMax(worstClient, std::fabs(measured - expected.at(i)) / expected.at(i));
+    }
+
+    // 计量区间两端各可能差一个数据块
+    double slack = 2.0 * BANDWIDTH_CHUNK_BYTES / seconds;
+    QString prefix = QString::fromLatin1(phase.name);
+    qInfo().noquote() << QString("%1 总速率 %2 KB/s, 期望 %3 KB/s; 客户端最大偏差 %4%")
+        .arg(prefix, -9).arg(totalMeasured / 1024, 0, 'f', 1).arg(totalExpected / 1024, 0, 'f', 1)
+        .arg(worstClient * 100, 0, 'f', 1);
+    check(prefix + " 总速率", totalMeasured, totalExpected, slack);
+    for (int subnet = 0; subnet < m_options.subnets; ++subnet) {
+        qInfo().noquote() << QString("%1   子网 %2: %3 KB/s, 期望 %4 KB/s").arg(prefix, -9).arg(subnet)
+            .arg(subnetMeasured[subnet] / 1024, 0, 'f', 1).arg(subnetExpected[subnet] / 1024, 0, 'f', 1);
+        check(prefix + QString(" 子网 %1").arg(subnet), subnetMeasured[subnet], subnetExpected[subnet], slack);
+    }
+    for (int i = 0; i < m_peers.size(); ++i) {
+        const Peer* peer = m_peers.at(i);
+        check(prefix + QString(" 客户端 %1").arg(peer->ipAddress),
+              (peer->received - peer->measureStart) / seconds, expected.at(i), slack);
+    }
+
+    if (++m_phase < m_phases.size()) {
+        beginPhase();
+    } else {
+        emit finished();
+    }
+}
+
+void BandwidthScenario::check(const QString& what, double measured, double expected, double slack)
+{
+    if (std::fabs(measured - expected) > expected * m_options.tolerance + slack) {
+        m_failures << QString("%1 速率 %2 KB/s, 期望 %3 KB/s, 偏差超过 %4%")
+            .arg(what).arg(measured / 1024, 0, 'f', 1).arg(expected / 1024, 0, 'f', 1)
+            .arg(m_options.tolerance * 100, 0, 'f', 1);
+    }
+}
+
+QVector<double> BandwidthScenario::expectedRates(const BandwidthLimits& limits) const
+{
+    // 最大最小公平分配: 所有客户端的速率同时上升,某一级达到上限时固定受它约束的客户端,
+    // 其余的继续上升,直到全部固定
+    const int count = m_peers.size();
+    QVector<double> rates(count, 0.0);
+    QVector<bool> fixed(count, false);
+    int remaining = count;
+    while (remaining > 0) {
+        QVector<double> subnetUsed(m_options.subnets, 0.0);
+        QVector<int> subnetActive(m_options.subnets, 0);
+        double globalUsed = 0;
+        for (int i = 0; i < count; ++i) {
+            int subnet = m_peers.at(i)->subnet;
+            if (fixed.at(i)) {
+                subnetUsed[subnet] += rates.at(i);
+                globalUsed += rates.at(i);
+            } else {
+                subnetActive[subnet]++;
+            }
+        }
+
+        double globalShare = limits.globalRate > 0 ? (limits.globalRate - globalUsed) / remaining : HUGE_VAL;
+        double level = limits.clientRate > 0 ? double(limits.clientRate) : HUGE_VAL;
+        level = qMin(level, globalShare);
+        QVector<double> subnetShare(m_options.subnets, HUGE_VAL);
+        for (int subnet = 0; subnet < m_options.subnets; ++subnet) {
+            if (limits.subnetRate > 0 && subnetActive.at(subnet) > 0) {
+                subnetShare[subnet] = (limits.subnetRate - subnetUsed.at(subnet)) / subnetActive.at(subnet);
+                level = qMin(level, subnetShare.at(subnet));
+            }
+        }
+
+        const double epsilon = level * 1e-9;
+        for (int i = 0; i < count; ++i) {
+            if (fixed.at(i)) {
+                continue;
+            }
+            bool bound = level == HUGE_VAL || globalShare <= level + epsilon ||
+                         (limits.clientRate > 0 && limits.clientRate <= level + epsilon) ||
+                         subnetShare.at(m_peers.at(i)->subnet) <= level + epsilon;
+            if (bound) {
+                rates[i] = level;
+                fixed[i] = true;
+                remaining--;
+            }
+        }
+    }
+    return rates;
+}
+
+bool BandwidthScenario::report() const
+{
+    QStringList failures = m_failures;
+    int lost = 0;
+    for (const Peer* peer : m_peers) {
+        lost += (!peer->connected || peer->closed) ? 1 : 0;
+    }
+    if (lost > 0) {
+        failures << QString("%1 个客户端未连上或被断开").arg(lost);
+    }
+    if (m_phase < m_phases.size()) {
+        failures << QString("只完成了 %1 组限制中的 %2 组").arg(m_phases.size()).arg(qMax(0, m_phase));
+    }
+
+    for (const QString& failure : failures) {
+        qWarning().noquote() << "失败:" << failure;
+    }
+    return failures.isEmpty();
+}
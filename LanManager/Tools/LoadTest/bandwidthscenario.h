@@ -0,0 +1,92 @@
+#ifndef BANDWIDTHSCENARIO_H
+#define BANDWIDTHSCENARIO_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+#include <QSet>
+#include <QVector>
+#include <QStringList>
+#include "bandwidthshaper.h"
+
+class TcpServer;
+
+// 带宽整形场景
+//
+// 一批客户端按上报的IP地址分布在几个子网中,服务端同时向每个客户端传输一个大文件。
+// 依次切换几组带宽限制(全局、每子网、每客户端及三者组合),每组先稳定一段时间再计量
+// 各客户端实际收到的数据量,与按最大最小公平分配算出的期望速率比较:
+// 总速率、每个子网和每个客户端的偏差都不能超过容差。
+class BandwidthScenario : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        int clients = 48;
+        int subnets = 4;
+        int settleMs = 2000;        // 切换限制后等待稳定的时间
+        int measureMs = 10000;      // 每组限制的计量时间
+        double tolerance = 0.05;    // 允许的相对偏差
+    };
+
+    BandwidthScenario(TcpServer* server, const Options& options, QObject* parent = nullptr);
+    ~BandwidthScenario();
+
+    // 创建传输用的文件并连接服务端,全部阶段结束后发出 finished
+    bool start(const QString& host, quint16 port, const QString& filePath);
+
+    // 输出统计,返回是否通过全部检查
+    bool report() const;
+
+signals:
+    void finished();
+
+private slots:
+    void tick();
+
+private:
+    struct Peer {
+        QTcpSocket* socket = nullptr;
+        QByteArray buffer;
+        int subnet = 0;
+        QString ipAddress;
+        bool connected = false;
+        bool closed = false;
+        qint64 received = 0;        // 收到的文件数据帧字节数(按服务端整形的计费方式)
+        qint64 measureStart = 0;
+        qint64 lastHeartbeat = 0;
+    };
+
+    struct Phase {
+        const char* name;
+        BandwidthLimits limits;
+    };
+
+    void openPeers();
+    void onConnected(Peer* peer);
+    void onReadyRead(Peer* peer);
+    void onClientInfoUpdated(qintptr clientId);
+    void beginPhase();
+    void beginMeasure();
+    void endMeasure();
+    QVector<double> expectedRates(const BandwidthLimits& limits) const;
+    void check(const QString& what, double measured, double expected, double slack);
+
+    TcpServer* m_server;
+    Options m_options;
+    QString m_host;
+    quint16 m_port = 0;
+    QString m_filePath;
+    QList<Peer*> m_peers;
+    QSet<qintptr> m_transfers;
+    QList<Phase> m_phases;
+    int m_phase = -1;
+    QTimer* m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_measureStart = 0;
+    QStringList m_failures;
+};
+
+#endif // BANDWIDTHSCENARIO_H
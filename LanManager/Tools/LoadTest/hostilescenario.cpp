@@ -0,0 +1,263 @@
+#include "hostilescenario.h"
+#include <QJsonObject>
+#include <QStringList>
+#include <QDebug>
+#include "tcpserver.h"
+
+// 定时器间隔(毫秒),慢速发送和读取按它分成小块
+#define HOSTILE_TICK 100
+
+// 正常客户端的心跳间隔(毫秒)
+#define HOSTILE_HEARTBEAT 1000
+
+// 正常客户端全部连上后再发起恶意连接的等待时间(毫秒)
+#define HOSTILE_WARMUP 2000
+
+// 不读取响应的客户端一次写入的心跳字节数
+#define HOSTILE_FLOOD_BYTES (64 * 1024)
+
+HostileScenario::HostileScenario(TcpServer* server, const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_server(server)
+    , m_options(options)
+    , m_timer(new QTimer(this))
+{
+    connect(m_timer, &QTimer::timeout, this, &HostileScenario::tick);
+}
+
+HostileScenario::~HostileScenario()
+{
+    qDeleteAll(m_peers);
+}
+
+void HostileScenario::start(const QString& host, quint16 port)
+{
+    m_host = host;
+    m_port = port;
+    m_clock.start();
+    openPeers(GOOD, m_options.goodClients);
+    m_timer->start(HOSTILE_TICK);
+
+    QTimer::singleShot(HOSTILE_WARMUP, this, [this]() {
+        openPeers(HEADER_ONLY, m_options.headerOnly);
+        openPeers(OVERSIZED, m_options.oversized);
+        openPeers(SLOW_SENDER, m_options.slowSenders);
+        openPeers(NON_READER, m_options.nonReaders);
+        openPeers(SLOW_READER, m_options.slowReaders);
+    });
+}
+
+void HostileScenario::openPeers(Kind kind, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        Peer* peer = new Peer;
+        peer->kind = kind;
+        peer->socket = new QTcpSocket(this);
+        m_peers.append(peer);
+
+        // Qt默认把内核中的数据全部读进自己的缓冲;限制后不读取的一方才会让TCP窗口关闭
+        if (kind == NON_READER) {
+            peer->socket->setReadBufferSize(4096);
+            peer->socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, 4096);
+        } else if (kind == SLOW_READER) {
+            peer->socket->setReadBufferSize(m_options.slowRate * HOSTILE_TICK / 1000);
+        }
+
+        connect(peer->socket, &QTcpSocket::connected, this, [this, peer]() { onConnected(peer); });
+        connect(peer->socket, &QTcpSocket::readyRead, this, [this, peer]() { onReadyRead(peer); });
+        connect(peer->socket, &QTcpSocket::disconnected, this, [peer]() { peer->closed = true; });
+        connect(peer->socket, &QAbstractSocket::errorOccurred, this, [peer](QAbstractSocket::SocketError) {
+            if (peer->socket->state() != QAbstractSocket::ConnectedState) {
+                peer->closed = true;
+            }
+        });
+        peer->socket->connectToHost(m_host, m_port);
+    }
+}
+
+void HostileScenario::onConnected(Peer* peer)
+{
+    peer->connected = true;
+    qint64 now = m_clock.elapsed();
+    qint64 maxFrame = m_server->memoryLimits().maxFrameSize;
+
+    switch (peer->kind) {
+    case GOOD: {
+        int index = m_peers.indexOf(peer);
+        QJsonObject info;
+        info["computerName"] = QString("good-%1").arg(index);
+        info["ipAddress"] = "127.0.0.1";
+        info["macAddress"] = QString("02:00:00:00:%1:%2")
+            .arg(index / 256, 2, 16, QChar('0')).arg(index % 256, 2, 16, QChar('0'));
+        info["osVersion"] = "LanLoadTest";
+        info["protocolVersion"] = PROTOCOL_VERSION;
+        peer->socket->write(Protocol::packJson(CMD_CLIENT_INFO, info));
+        peer->lastHeartbeat = now;
+        peer->lastAck = now;
+        break;
+    }
+    case HEADER_ONLY:
+    case SLOW_SENDER:
+        writeHeader(peer, quint32(maxFrame));
+        break;
+    case OVERSIZED:
+        writeHeader(peer, quint32(maxFrame + 1));
+        break;
+    default:
+        break;
+    }
+}
+
+void HostileScenario::writeHeader(Peer* peer, quint32 dataLength)
+{
+    // 帧数据全为0,拼完整后服务端按空的占用报告处理
+    char header[Protocol::MAX_HEADER_SIZE];
+    int size = Protocol::writeHeader(header, CMD_AGENT_STATS, dataLength);
+    peer->socket->write(header, size);
+    peer->frameSent = 0;
+}
+
+void HostileScenario::floodHeartbeats(Peer* peer)
+{
+    static const QByteArray flood = Protocol::pack(CMD_HEARTBEAT, QByteArray())
+        .repeated(HOSTILE_FLOOD_BYTES / Protocol::headerSize());
+
+    // 只在自己的发送缓冲写完后再写,压力留在服务端而不是本进程
+    if (peer->socket->bytesToWrite() == 0) {
+        peer->socket->write(flood);
+    }
+}
+
+void HostileScenario::onReadyRead(Peer* peer)
+{
+    if (peer->kind != GOOD) {
+        return;
+    }
+
+    peer->buffer.append(peer->socket->readAll());
+    while (true) {
+        ProtocolHeader header;
+        if (!Protocol::parseHeader(peer->buffer, header)) {
+            break;
+        }
+        int packetSize = header.size + int(header.dataLength);
+        if (peer->buffer.size() < packetSize) {
+            break;
+        }
+        peer->buffer.remove(0, packetSize);
+
+        if (header.cmdType == CMD_HEARTBEAT_ACK) {
+            qint64 now = m_clock.elapsed();
+            peer->maxAckGap = qMax(peer->maxAckGap, now - peer->lastAck);
+            peer->lastAck = now;
+            peer->acks++;
+        }
+    }
+}
+
+void HostileScenario::tick()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 slice = m_options.slowRate * HOSTILE_TICK / 1000;
+    qint64 maxFrame = m_server->memoryLimits().maxFrameSize;
+
+    for (Peer* peer : m_peers) {
+        if (!peer->connected || peer->closed) {
+            continue;
+        }
+        switch (peer->kind) {
+        case GOOD:
+            if (now - peer->lastHeartbeat >= HOSTILE_HEARTBEAT) {
+                peer->socket->write(Protocol::pack(CMD_HEARTBEAT, QByteArray()));
+                peer->lastHeartbeat = now;
+            }
+            break;
+        case SLOW_SENDER:
+            if (peer->socket->bytesToWrite() == 0) {
+                if (peer->frameSent >= maxFrame) {
+                    writeHeader(peer, quint32(maxFrame));
+                }
+                qint64 size = qMin(slice, maxFrame - peer->frameSent);
+                peer->socket->write(QByteArray(int(size), '\0'));
+                peer->frameSent += size;
+            }
+            break;
+        case NON_READER:
+            floodHeartbeats(peer);
+            break;
+        case SLOW_READER:
+            floodHeartbeats(peer);
+            peer->socket->read(slice);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool HostileScenario::report() const
+{
+    qint64 now = m_clock.elapsed();
+    QStringList failures;
+
+    int opened[KIND_COUNT] = {};
+    int connected[KIND_COUNT] = {};
+    int closed[KIND_COUNT] = {};
+    qint64 maxAckGap = 0;
+    int goodAcks = 0;
+    int goodLost = 0;
+    for (const Peer* peer : m_peers) {
+        opened[peer->kind]++;
+        connected[peer->kind] += peer->connected ? 1 : 0;
+        closed[peer->kind] += peer->closed ? 1 : 0;
+        if (peer->kind == GOOD) {
+            qint64 gap = qMax(peer->maxAckGap, now - peer->lastAck);
+            maxAckGap = qMax(maxAckGap, gap);
+            goodAcks += peer->acks;
+            goodLost += (!peer->connected || peer->closed) ? 1 : 0;
+        }
+    }
+    for (int kind = 0; kind < KIND_COUNT; ++kind) {
+        qInfo().noquote() << QString("%1 %2 条连接, 连上 %3, 被断开或拒绝 %4")
+            .arg(QString::fromLatin1(kindName(Kind(kind))), -12)
+            .arg(opened[kind]).arg(connected[kind]).arg(closed[kind]);
+    }
+
+    const MemoryBudget& memory = m_server->memoryUsage();
+    qInfo().noquote() << QString("服务端内存记账: 峰值 %1 KB, 全局预算 %2 KB, 当前 %3 KB")
+        .arg(memory.peak() / 1024).arg(memory.limits().globalBudget / 1024).arg(memory.total() / 1024);
+    qInfo().noquote() << QString("正常客户端: 收到 %1 个心跳响应, 最长间隔 %2 ms")
+        .arg(goodAcks).arg(maxAckGap);
+
+    if (memory.peak() > memory.limits().globalBudget) {
+        failures << QString("内存记账峰值 %1 字节超过预算 %2 字节")
+            .arg(memory.peak()).arg(memory.limits().globalBudget);
+    }
+    if (goodLost > 0) {
+        failures << QString("%1 个正常客户端未连上或被断开").arg(goodLost);
+    }
+    if (maxAckGap >= HEARTBEAT_TIMEOUT) {
+        failures << QString("正常客户端的心跳响应间隔 %1 ms 达到心跳超时").arg(maxAckGap);
+    }
+    if (closed[OVERSIZED] < opened[OVERSIZED]) {
+        failures << QString("%1 个帧头超长的连接没有被断开").arg(opened[OVERSIZED] - closed[OVERSIZED]);
+    }
+
+    for (const QString& failure : failures) {
+        qWarning().noquote() << "失败:" << failure;
+    }
+    return failures.isEmpty();
+}
+
+const char* HostileScenario::kindName(Kind kind)
+{
+    switch (kind) {
+    case GOOD: return "good";
+    case HEADER_ONLY: return "header-only";
+    case OVERSIZED: return "oversized";
+    case SLOW_SENDER: return "slow-sender";
+    case NON_READER: return "non-reader";
+    case SLOW_READER: return "slow-reader";
+    default: return "other";
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef HOSTILESCENARIO_H
+#define HOSTILESCENARIO_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+
+class TcpServer;
+
+// 恶意客户端场景
+//
+// 先连上一批正常客户端(上报客户端信息,每秒一次心跳),再发起各种占用服务端内存的连接:
+//   header-only  只发一个声明最大帧长的帧头,之后不再发送
+//   oversized    帧头声明的长度超过最大帧长
+//   slow-sender  以很低的速率发送最大长度的帧
+//   non-reader   不停发送心跳但从不读取响应,服务端的发送积压随之增长
+//   slow-reader  不停发送心跳,以很低的速率读取响应
+// 结束时检查: 服务端内存记账的峰值(lanmgr_memory_peak_bytes)不超过全局预算;
+// 正常客户端始终在线,心跳响应的间隔不超过心跳超时;帧头超长的连接都被断开。
+class HostileScenario : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        int goodClients = 20;
+        int headerOnly = 200;
+        int oversized = 20;
+        int slowSenders = 20;
+        int nonReaders = 50;
+        int slowReaders = 20;
+        qint64 slowRate = 256 * 1024;   // 慢速发送和慢速读取的速率(字节/秒)
+    };
+
+    HostileScenario(TcpServer* server, const Options& options, QObject* parent = nullptr);
+    ~HostileScenario();
+
+    // 连接服务端开始测试,正常客户端全部连上后再发起恶意连接
+    void start(const QString& host, quint16 port);
+
+    // 输出统计,返回是否通过全部检查
+    bool report() const;
+
+private slots:
+    void tick();
+
+private:
+    enum Kind {
+        GOOD,
+        HEADER_ONLY,
+        OVERSIZED,
+        SLOW_SENDER,
+        NON_READER,
+        SLOW_READER,
+        KIND_COUNT
+    };
+
+    struct Peer {
+        Kind kind;
+        QTcpSocket* socket = nullptr;
+        QByteArray buffer;          // 正常客户端的接收缓冲
+        bool connected = false;
+        bool closed = false;        // 连接被服务端断开或拒绝
+        qint64 frameSent = 0;       // 慢速发送者当前帧已发送的数据
+        qint64 lastHeartbeat = 0;   // 正常客户端最近一次发送心跳的时间(毫秒)
+        qint64 lastAck = 0;         // 最近一次收到心跳响应的时间(毫秒)
+        qint64 maxAckGap = 0;
+        int acks = 0;
+    };
+
+    void openPeers(Kind kind, int count);
+    void onConnected(Peer* peer);
+    void onReadyRead(Peer* peer);
+    void writeHeader(Peer* peer, quint32 dataLength);
+    void floodHeartbeats(Peer* peer);
+
+    static const char* kindName(Kind kind);
+
+    TcpServer* m_server;
+    Options m_options;
+    QString m_host;
+    quint16 m_port = 0;
+    QList<Peer*> m_peers;
+    QTimer* m_timer;
+    QElapsedTimer m_clock;
+};
+
+#endif // HOSTILESCENARIO_H
@@ -0,0 +1,193 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QDebug>
+#include "hostilescenario.h"
+#include "bandwidthscenario.h"
+#include "priorityscenario.h"
+#include "netemu.h"
+#include "tcpserver.h"
+#include "inventorysnapshot.h"
+#include "tsstore.h"
+#include "logger.h"
+
+// 负载测试使用的默认端口,避免和正在运行的服务端及回放工具冲突
+#define LOADTEST_PORT 18910
+
+// 服务端负载测试
+// 在进程内启动 TcpServer,用大量本地连接模拟特定的客户端行为,检查服务端是否满足约束。
+// 全部检查通过时返回0,有检查未通过时返回2
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("LanLoadTest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("服务端负载测试");
+    parser.addHelpOption();
+    parser.addPositionalArgument("scenario", "测试场景: hostile(恶意客户端下的内存预算), bandwidth(带宽整形), priority(传输大文件时的心跳延迟)");
+    QCommandLineOption portOption("port", "进程内服务端的端口", "port", QString::number(LOADTEST_PORT));
+    QCommandLineOption durationOption("duration", "hostile: 运行时间(秒)", "sec", "40");
+    QCommandLineOption budgetOption("budget", "服务端全局内存预算(MB)", "MB", "64");
+    QCommandLineOption maxFrameOption("max-frame", "最大帧长度(MB)", "MB", "4");
+    QCommandLineOption clientLimitOption("client-limit", "单个连接的内存上限(MB)", "MB", "6");
+    QCommandLineOption goodOption("good", "hostile: 正常客户端数", "n", "20");
+    QCommandLineOption headerOnlyOption("header-only", "hostile: 只发帧头的连接数", "n", "200");
+    QCommandLineOption oversizedOption("oversized", "hostile: 帧头超长的连接数", "n", "20");
+    QCommandLineOption slowSendersOption("slow-senders", "hostile: 慢速发送最大帧的连接数", "n", "20");
+    QCommandLineOption nonReadersOption("non-readers", "hostile: 不读取响应的连接数", "n", "50");
+    QCommandLineOption slowReadersOption("slow-readers", "hostile: 慢速读取的连接数", "n", "20");
+    QCommandLineOption slowRateOption("slow-rate", "hostile: 慢速发送和读取的速率(KB/s)", "KB/s", "256");
+    QCommandLineOption clientsOption("clients", "bandwidth: 客户端数", "n", "48");
+    QCommandLineOption subnetsOption("subnets", "bandwidth: 子网数", "n", "4");
+    QCommandLineOption settleOption("settle", "bandwidth/priority: 切换限制或开始传输后等待稳定的时间(秒)", "sec", "2");
+    QCommandLineOption measureOption("measure", "bandwidth/priority: 每组限制或传输期间的计量时间(秒)", "sec", "10");
+    QCommandLineOption toleranceOption("tolerance", "bandwidth: 允许的速率偏差(%)", "percent", "5");
+    QCommandLineOption linkOption("link", "priority: 模拟链路的下行带宽(KB/s)", "KB/s", "1024");
+    QCommandLineOption latencyOption("latency", "priority: 模拟链路的单向延迟(毫秒)", "ms", "5");
+    QCommandLineOption idleOption("idle", "priority: 空闲链路的计量时间(秒)", "sec", "5");
+    QCommandLineOption maxRttOption("max-rtt", "priority: 传输期间心跳往返时间p99的上限(毫秒)", "ms", "1000");
+    QCommandLineOption verboseOption("verbose", "输出服务端的日志");
+    parser.addOption(portOption);
+    parser.addOption(durationOption);
+    parser.addOption(budgetOption);
+    parser.addOption(maxFrameOption);
+    parser.addOption(clientLimitOption);
+    parser.addOption(goodOption);
+    parser.addOption(headerOnlyOption);
+    parser.addOption(oversizedOption);
+    parser.addOption(slowSendersOption);
+    parser.addOption(nonReadersOption);
+    parser.addOption(slowReadersOption);
+    parser.addOption(slowRateOption);
+    parser.addOption(clientsOption);
+    parser.addOption(subnetsOption);
+    parser.addOption(settleOption);
+    parser.addOption(measureOption);
+    parser.addOption(toleranceOption);
+    parser.addOption(linkOption);
+    parser.addOption(latencyOption);
+    parser.addOption(idleOption);
+    parser.addOption(maxRttOption);
+    parser.addOption(verboseOption);
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    const QString scenario = parser.positionalArguments().first();
+    if (scenario != "hostile" && scenario != "bandwidth" && scenario != "priority") {
+        qCritical().noquote() << "未知的测试场景:" << scenario;
+        return 1;
+    }
+    const quint16 port = parser.value(portOption).toUShort();
+    const int duration = parser.value(durationOption).toInt();
+    const int clients = parser.value(clientsOption).toInt();
+    const int subnets = parser.value(subnetsOption).toInt();
+    if (port == 0 || duration <= 0 || subnets <= 0 || clients < 2 * subnets || clients > 500 ||
+        parser.value(measureOption).toInt() <= 0 || parser.value(toleranceOption).toDouble() <= 0 ||
+        parser.value(linkOption).toLongLong() <= 0 || parser.value(latencyOption).toInt() < 0 ||
+        parser.value(idleOption).toInt() <= 0 || parser.value(maxRttOption).toInt() <= 0) {
+        qCritical() << "参数无效";
+        return 1;
+    }
+
+    // 服务端的日志经后台线程输出,不加 --verbose 时只输出警告和错误
+    Logger::setLevel(parser.isSet(verboseOption) ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARN);
+    Logger::addSink(new ConsoleLogSink);
+    Logger::start();
+
+    // 进程内服务端使用临时目录中的历史存储和清单快照,与实际运行时走相同的处理路径
+    QTemporaryDir dataDir;
+    TsStore history(dataDir.path() + "/history");
+    InventorySnapshot inventory(dataDir.path() + "/inventory.snap");
+    TcpServer server;
+    if (history.open()) {
+        server.setHistoryStore(&history);
+    }
+    inventory.load();
+    server.setInventorySnapshot(&inventory);
+    server.setDiscoveryEnabled(false);
+    server.setMetricsPort(0);
+
+    MemoryLimits limits;
+    limits.globalBudget = parser.value(budgetOption).toLongLong() * 1024 * 1024;
+    limits.maxFrameSize = parser.value(maxFrameOption).toLongLong() * 1024 * 1024;
+    limits.clientLimit = parser.value(clientLimitOption).toLongLong() * 1024 * 1024;
+    server.setMemoryLimits(limits);
+    if (!server.start(port)) {
+        qCritical() << "无法启动服务端,端口" << port << "可能已被占用";
+        return 1;
+    }
+
+    bool passed = false;
+    if (scenario == "hostile") {
+        HostileScenario::Options options;
+        options.goodClients = parser.value(goodOption).toInt();
+        options.headerOnly = parser.value(headerOnlyOption).toInt();
+        options.oversized = parser.value(oversizedOption).toInt();
+        options.slowSenders = parser.value(slowSendersOption).toInt();
+        options.nonReaders = parser.value(nonReadersOption).toInt();
+        options.slowReaders = parser.value(slowReadersOption).toInt();
+        options.slowRate = parser.value(slowRateOption).toLongLong() * 1024;
+        HostileScenario hostile(&server, options);
+        hostile.start("127.0.0.1", port);
+
+        QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+        app.exec();
+        passed = hostile.report();
+    } else if (scenario == "priority") {
+        // 客户端经过进程内的模拟链路连接服务端,下行带宽受限,文件数据在链路上排队
+        LinkProfile down;
+        down.latencyMs = parser.value(latencyOption).toInt();
+        down.bandwidth = parser.value(linkOption).toLongLong() * 1024;
+        LinkProfile up;
+        up.latencyMs = down.latencyMs;
+        NetEmuStats stats;
+        TcpProxy proxy(up, down, 1, &stats);
+        QString error;
+        if (!proxy.listen(quint16(port + 1), "127.0.0.1", port, &error)) {
+            qCritical().noquote() << "无法启动模拟链路:" << error;
+            server.stop();
+            Logger::stop();
+            return 1;
+        }
+
+        PriorityScenario::Options options;
+        options.linkRate = down.bandwidth;
+        options.idleMs = parser.value(idleOption).toInt() * 1000;
+        options.settleMs = parser.value(settleOption).toInt() * 1000;
+        options.measureMs = parser.value(measureOption).toInt() * 1000;
+        options.maxRttMs = parser.value(maxRttOption).toInt();
+        PriorityScenario priority(&server, options);
+        QObject::connect(&priority, &PriorityScenario::finished, &app, &QCoreApplication::quit);
+        if (priority.start("127.0.0.1", proxy.port(), dataDir.path() + "/priority.bin")) {
+            app.exec();
+            passed = priority.report();
+            qInfo().noquote() << "模拟链路:" << stats.summary();
+        }
+    } else {
+        BandwidthScenario::Options options;
+        options.clients = clients;
+        options.subnets = subnets;
+        options.settleMs = parser.value(settleOption).toInt() * 1000;
+        options.measureMs = parser.value(measureOption).toInt() * 1000;
+        options.tolerance = parser.value(toleranceOption).toDouble() / 100.0;
+        BandwidthScenario bandwidth(&server, options);
+        QObject::connect(&bandwidth, &BandwidthScenario::finished, &app, &QCoreApplication::quit);
+        if (bandwidth.start("127.0.0.1", port, dataDir.path() + "/bandwidth.bin")) {
+            app.exec();
+            passed = bandwidth.report();
+        }
+    }
+
+    server.stop();
+    server.setHistoryStore(nullptr);
+    server.setInventorySnapshot(nullptr);
+    Logger::stop();
+
+    qInfo().noquote() << (passed ? "通过" : "未通过");
+    return passed ? 0 : 2;
+}
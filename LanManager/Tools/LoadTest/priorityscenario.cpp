@@ -0,0 +1,219 @@
+#include "priorityscenario.h"
+#include <QFile>
+#include <QJsonObject>
+#include <QDebug>
+#include <algorithm>
+#include "tcpserver.h"
+
+// 文件数据块的大小,与 tcpserver.cpp 一致
+#define PRIORITY_CHUNK_BYTES (64 * 1024)
+
+// 定时器间隔(毫秒),心跳按它的整数倍发送
+#define PRIORITY_TICK 10
+
+PriorityScenario::PriorityScenario(TcpServer* server, const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_server(server)
+    , m_options(options)
+    , m_socket(new QTcpSocket(this))
+    , m_timer(new QTimer(this))
+{
+    connect(m_timer, &QTimer::timeout, this, &PriorityScenario::tick);
+    connect(m_server, &TcpServer::clientInfoUpdated, this, &PriorityScenario::onClientInfoUpdated);
+    connect(m_socket, &QTcpSocket::connected, this, &PriorityScenario::onConnected);
+    connect(m_socket, &QTcpSocket::readyRead, this, &PriorityScenario::onReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, [this]() { m_closed = true; });
+    connect(m_socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        if (m_socket->state() != QAbstractSocket::ConnectedState) {
+            m_closed = true;
+        }
+    });
+}
+
+bool PriorityScenario::start(const QString& host, quint16 port, const QString& filePath)
+{
+    // 文件按链路带宽留出一倍余量,计量结束前不会传完
+    m_filePath = filePath;
+    qint64 size = m_options.linkRate * (m_options.settleMs + m_options.measureMs) / 1000 * 2 + PRIORITY_CHUNK_BYTES;
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly) || !file.resize(size)) {
+        qCritical().noquote() << "无法创建传输用的文件:" << m_filePath;
+        return false;
+    }
+    file.close();
+
+    m_clock.start();
+    m_timer->start(PRIORITY_TICK);
+    m_socket->connectToHost(host, port);
+    return true;
+}
+
+void PriorityScenario::onConnected()
+{
+    QJsonObject info;
+    info["computerName"] = "priority-0";
+    info["ipAddress"] = "127.0.0.1";
+    info["macAddress"] = "02:00:00:02:00:00";
+    info["osVersion"] = "LanLoadTest";
+    info["protocolVersion"] = PROTOCOL_VERSION;
+    m_socket->write(Protocol::packJson(CMD_CLIENT_INFO, info));
+}
+
+void PriorityScenario::onClientInfoUpdated(qintptr clientId)
+{
+    if (m_phase != CONNECTING) {
+        return;
+    }
+    m_clientId = clientId;
+    m_phase = IDLE;
+    QTimer::singleShot(m_options.idleMs, this, &PriorityScenario::beginTransfer);
+}
+
+void PriorityScenario::beginTransfer()
+{
+    m_phase = SETTLE;
+    m_server->installSoftware(m_clientId, m_filePath);
+    QTimer::singleShot(m_options.settleMs, this, &PriorityScenario::beginMeasure);
+}
+
+void PriorityScenario::beginMeasure()
+{
+    m_phase = TRANSFER;
+    m_measureStart = m_clock.elapsed();
+    m_measureBytes = m_received;
+    QTimer::singleShot(m_options.measureMs, this, &PriorityScenario::endMeasure);
+}
+
+void PriorityScenario::endMeasure()
+{
+    m_phase = DONE;
+    m_measureEnd = m_clock.elapsed();
+    m_measureBytes = m_received - m_measureBytes;
+    emit finished();
+}
+
+void PriorityScenario::onReadyRead()
+{
+    m_buffer.append(m_socket->readAll());
+    int offset = 0;
+    while (true) {
+        ProtocolHeader header;
+        if (!Protocol::parseHeader(m_buffer.constData() + offset, m_buffer.size() - offset, header)) {
+            break;
+        }
+        int packetSize = header.size + int(header.dataLength);
+        if (m_buffer.size() - offset < packetSize) {
+            break;
+        }
+        offset += packetSize;
+
+        switch (header.cmdType) {
+        case CMD_HEARTBEAT_ACK:
+            if (!m_pending.isEmpty()) {
+                QPair<qint64, Phase> sent = m_pending.dequeue();
+                qint64 rtt = m_clock.elapsed() - sent.first;
+                if (sent.second == IDLE) {
+                    m_idleRtt.append(rtt);
+                } else if (sent.second == TRANSFER) {
+                    m_transferRtt.append(rtt);
+                }
+            }
+            break;
+        case CMD_FILE_TRANSFER_START: {
+            QJsonObject response;
+            response["success"] = true;
+            m_socket->write(Protocol::packJson(CMD_FILE_TRANSFER_ACK, response, header.requestId, FLAG_RESPONSE));
+            break;
+        }
+        case CMD_FILE_TRANSFER_DATA:
+            m_received += header.dataLength;
+            break;
+        case CMD_FILE_TRANSFER_END:
+            if (m_phase != DONE) {
+                m_failures << "文件在计量结束前就传完了,没有一直占满链路";
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    m_buffer.remove(0, offset);
+}
+
+void PriorityScenario::tick()
+{
+    if (m_phase == CONNECTING || m_phase == DONE || m_closed) {
+        return;
+    }
+    qint64 now = m_clock.elapsed();
+    if (m_pending.isEmpty() || now - m_pending.last().first >= m_options.heartbeatMs) {
+        m_socket->write(Protocol::pack(CMD_HEARTBEAT, QByteArray()));
+        m_pending.enqueue(qMakePair(now, m_phase));
+    }
+}
+
+qint64 PriorityScenario::percentile(const QVector<qint64>& sorted, double q)
+{
+    if (sorted.isEmpty()) return 0;
+    int index = qBound(0, int(q * sorted.size() + 0.5) - 1, sorted.size() - 1);
+    return sorted.at(index);
+}
+
+QString PriorityScenario::describe(const char* name, QVector<qint64> samples) const
+{
+    std::sort(samples.begin(), samples.end());
+    return QString("%1 心跳 %2 个, 往返时间 p50 %3 ms, p99 %4 ms, 最大 %5 ms")
+        .arg(QString::fromUtf8(name), -6).arg(samples.size())
+        .arg(percentile(samples, 0.5)).arg(percentile(samples, 0.99)).arg(percentile(samples, 1.0));
+}
+
+bool PriorityScenario::report() const
+{
+    QStringList failures = m_failures;
+    if (m_phase != DONE) {
+        failures << "计量没有完成";
+    }
+    if (m_closed) {
+        failures << "客户端连接被断开";
+    }
+
+    qInfo().noquote() << describe("空闲", m_idleRtt);
+    qInfo().noquote() << describe("传输中", m_transferRtt);
+
+    double seconds = qMax<qint64>(1, m_measureEnd - m_measureStart) / 1000.0;
+    double rate = m_measureBytes / seconds;
+    double utilization = rate / m_options.linkRate;
+    qInfo().noquote() << QString("文件传输 %1 KB/s, 链路带宽 %2 KB/s, 利用率 %3%")
+        .arg(rate / 1024, 0, 'f', 1).arg(m_options.linkRate / 1024.0, 0, 'f', 1)
+        .arg(utilization * 100, 0, 'f', 1);
+
+    // 计量结束时还没有响应、且已经等了超过上限的心跳同样计入
+    qint64 now = m_clock.elapsed();
+    int lost = 0;
+    for (const QPair<qint64, Phase>& sent : m_pending) {
+        if (sent.second == TRANSFER && now - sent.first > m_options.maxRttMs) {
+            lost++;
+        }
+    }
+
+    QVector<qint64> sorted = m_transferRtt;
+    std::sort(sorted.begin(), sorted.end());
+    if (sorted.isEmpty()) {
+        failures << "传输期间没有收到心跳响应";
+    } else if (percentile(sorted, 0.99) > m_options.maxRttMs) {
+        failures << QString("传输期间心跳往返时间 p99 %1 ms 超过上限 %2 ms")
+            .arg(percentile(sorted, 0.99)).arg(m_options.maxRttMs);
+    }
+    if (lost > 0) {
+        failures << QString("%1 个传输期间发出的心跳超过 %2 ms 仍未响应").arg(lost).arg(m_options.maxRttMs);
+    }
+    if (utilization < m_options.minUtilization) {
+        failures << QString("链路利用率 %1% 低于 %2%,传输没有占满链路,计量无效")
+            .arg(utilization * 100, 0, 'f', 1).arg(m_options.minUtilization * 100, 0, 'f', 0);
+    }
+
+    for (const QString& failure : failures) {
+        qWarning().noquote() << "失败:" << failure;
+    }
+    return failures.isEmpty();
+}
@@ -0,0 +1,84 @@
+#ifndef PRIORITYSCENARIO_H
+#define PRIORITYSCENARIO_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QPair>
+#include <QVector>
+#include <QStringList>
+
+class TcpServer;
+
+// 发送优先级场景
+//
+// 一个客户端经过模拟的慢速链路(见 Tools/NetEmu)连接服务端,每隔一小段时间发一次心跳,
+// 在客户端一侧计量心跳往返时间。先在空闲的链路上计量一段时间,再让服务端向它传输一个
+// 足以占满链路的大文件,传输期间继续计量。输出两段的往返时间分位数和文件的实际传输速率,
+// 传输没有占满链路时计量无效,传输期间的 p99 超过上限时未通过。
+class PriorityScenario : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        qint64 linkRate = 1024 * 1024;  // 下行链路带宽(字节/秒),只用于计算利用率
+        int idleMs = 5000;              // 空闲链路的计量时间
+        int settleMs = 2000;            // 开始传输后等待链路占满的时间
+        int measureMs = 10000;          // 传输期间的计量时间
+        int heartbeatMs = 100;          // 心跳间隔
+        int maxRttMs = 1000;            // 传输期间心跳往返时间 p99 的上限
+        double minUtilization = 0.8;    // 计量有效所需的链路利用率
+    };
+
+    PriorityScenario(TcpServer* server, const Options& options, QObject* parent = nullptr);
+
+    // 创建传输用的文件并连接(经过代理的)服务端,计量结束后发出 finished
+    bool start(const QString& host, quint16 port, const QString& filePath);
+
+    // 输出计量结果,返回是否通过
+    bool report() const;
+
+signals:
+    void finished();
+
+private slots:
+    void tick();
+
+private:
+    enum Phase { CONNECTING, IDLE, SETTLE, TRANSFER, DONE };
+
+    void onConnected();
+    void onReadyRead();
+    void onClientInfoUpdated(qintptr clientId);
+    void beginTransfer();
+    void beginMeasure();
+    void endMeasure();
+    QString describe(const char* name, QVector<qint64> samples) const;
+    static qint64 percentile(const QVector<qint64>& sorted, double q);
+
+    TcpServer* m_server;
+    Options m_options;
+    QString m_filePath;
+    QTcpSocket* m_socket;
+    QByteArray m_buffer;
+    QTimer* m_timer;
+    QElapsedTimer m_clock;
+    Phase m_phase = CONNECTING;
+    qintptr m_clientId = -1;
+
+    // 等待响应的心跳: (发送时间, 发送时所处的阶段)
+    QQueue<QPair<qint64, Phase>> m_pending;
+    QVector<qint64> m_idleRtt;
+    QVector<qint64> m_transferRtt;
+
+    qint64 m_received = 0;          // 收到的文件数据字节数
+    qint64 m_measureBytes = 0;
+    qint64 m_measureStart = 0;
+    qint64 m_measureEnd = 0;
+    bool m_closed = false;
+    QStringList m_failures;
+};
+
+#endif // PRIORITYSCENARIO_H
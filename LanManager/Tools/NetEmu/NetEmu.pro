@@ -0,0 +1,26 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = LanNetEmu
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../../Common/protocol.h \
+    ../../Common/discovery.h \
+    ../../Server/metrics.h
+
+INCLUDEPATH += ../../Common
+
+include(netemu.pri)
+
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../../pgo.pri)
+
+# 输出目录
+DESTDIR = ../../bin
@@ -0,0 +1,68 @@
+#ifndef LINKEMULATOR_H
+#define LINKEMULATOR_H
+
+#include <QRandomGenerator>
+#include <QtGlobal>
+#include <cmath>
+
+// 链路参数(单个方向)
+struct LinkProfile {
+    int latencyMs = 0;          // 单向延迟
+    int jitterMs = 0;           // 抖动,延迟在 ±jitterMs 内均匀变化
+    qint64 bandwidth = 0;       // 带宽(字节/秒),0表示不限
+    double loss = 0.0;          // 丢包率(0~1),只用于UDP
+    int resetIntervalMs = 0;    // TCP连接被重置的平均间隔,0表示不重置
+
+    bool isPerfect() const {
+        return latencyMs == 0 && jitterMs == 0 && bandwidth == 0 && loss == 0.0 && resetIntervalMs == 0;
+    }
+};
+
+// 单向链路模型
+//
+// 数据先按带宽串行"发送"(经过同一条链路的所有连接共用带宽),发完后再经过延迟和抖动到达。
+// 送达时间只由到达链路的时间和数据量决定,和事件循环的调度精度无关。
+// 随机数使用自己的种子,相同参数和种子下丢包、抖动和重置的序列可以重现。
+class LinkEmulator {
+public:
+    explicit LinkEmulator(const LinkProfile& profile = LinkProfile(), quint32 seed = 1)
+        : m_profile(profile), m_random(seed) {}
+
+    const LinkProfile& profile() const { return m_profile; }
+
+    // bytes 字节在 nowUs 进入链路,返回送达时间(微秒)
+    // 不保证顺序,TCP由调用方保证送达时间不早于同一方向上的前一块
+    qint64 schedule(qint64 nowUs, qint64 bytes) {
+        qint64 start = qMax(nowUs, m_busyUntilUs);
+        if (m_profile.bandwidth > 0) {
+            m_busyUntilUs = start + bytes * 1000000 / m_profile.bandwidth;
+        } else {
+            m_busyUntilUs = start;
+        }
+        qint64 delayUs = qint64(m_profile.latencyMs) * 1000;
+        if (m_profile.jitterMs > 0) {
+            qint64 jitterUs = qint64(m_profile.jitterMs) * 1000;
+            delayUs += qint64(m_random.bounded(quint64(2 * jitterUs + 1))) - jitterUs;
+        }
+        return qMax(nowUs, m_busyUntilUs + qMax<qint64>(0, delayUs));
+    }
+
+    // 这个数据报是否丢弃
+    bool drop() {
+        return m_profile.loss > 0.0 && m_random.generateDouble() < m_profile.loss;
+    }
+
+    // 下一次连接重置前的时间(毫秒,指数分布),不重置时返回0
+    int nextResetMs() {
+        if (m_profile.resetIntervalMs <= 0) return 0;
+        double u = 1.0 - m_random.generateDouble();   // (0, 1]
+        return qMax(1, int(-std::log(u) * m_profile.resetIntervalMs));
+    }
+
+private:
+    LinkProfile m_profile;
+    QRandomGenerator m_random;
+    qint64 m_busyUntilUs = 0;   // 链路上已排队的数据发完的时间
+};
+
+#endif // LINKEMULATOR_H
@@ -0,0 +1,116 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <QDebug>
+#include <csignal>
+#include "netemu.h"
+
+// 代理默认监听端口
+#define NETEMU_PORT 18900
+
+// 网络条件模拟工具
+// 在客户端和服务端之间插入一个代理,按指定的延迟、抖动、带宽、丢包和连接重置转发流量,
+// 用于在局域网内重现慢速或不稳定的网络
+
+static void onSignal(int)
+{
+    QCoreApplication::quit();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("LanNetEmu");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("网络条件模拟代理");
+    parser.addHelpOption();
+    QCommandLineOption listenOption("listen", "代理监听端口,客户端连接到这里", "port", QString::number(NETEMU_PORT));
+    QCommandLineOption serverOption("server", "服务端地址", "host:port", QString("127.0.0.1:%1").arg(DEFAULT_PORT));
+    QCommandLineOption latencyOption("latency", "单向延迟(毫秒)", "ms", "0");
+    QCommandLineOption jitterOption("jitter", "延迟抖动(毫秒)", "ms", "0");
+    QCommandLineOption bandwidthOption("bandwidth", "带宽(KB/s),0表示不限", "KB/s", "0");
+    QCommandLineOption uploadOption("upload", "上行(客户端 -> 服务端)带宽,默认与 --bandwidth 相同", "KB/s");
+    QCommandLineOption lossOption("loss", "UDP丢包率(百分比)", "percent", "0");
+    QCommandLineOption resetsOption("resets", "TCP连接被重置的平均间隔(秒),0表示不重置", "sec", "0");
+    QCommandLineOption udpOption("udp", "转发UDP端口(可重复),服务发现通告中的端口改为 --listen 端口", "listenPort:host:port");
+    QCommandLineOption seedOption("seed", "随机数种子", "n", "1");
+    QCommandLineOption reportOption("report", "统计输出间隔(秒),0表示只在退出时输出", "sec", "10");
+    parser.addOption(listenOption);
+    parser.addOption(serverOption);
+    parser.addOption(latencyOption);
+    parser.addOption(jitterOption);
+    parser.addOption(bandwidthOption);
+    parser.addOption(uploadOption);
+    parser.addOption(lossOption);
+    parser.addOption(resetsOption);
+    parser.addOption(udpOption);
+    parser.addOption(seedOption);
+    parser.addOption(reportOption);
+    parser.process(app);
+
+    const quint16 listenPort = parser.value(listenOption).toUShort();
+    const QString server = parser.value(serverOption);
+    const int colon = server.lastIndexOf(':');
+    const QString serverHost = colon > 0 ? server.left(colon) : server;
+    const quint16 serverPort = colon > 0 ? server.mid(colon + 1).toUShort() : quint16(DEFAULT_PORT);
+
+    LinkProfile down;
+    down.latencyMs = parser.value(latencyOption).toInt();
+    down.jitterMs = parser.value(jitterOption).toInt();
+    down.bandwidth = parser.value(bandwidthOption).toLongLong() * 1024;
+    down.loss = parser.value(lossOption).toDouble() / 100.0;
+    LinkProfile up = down;
+    if (parser.isSet(uploadOption)) {
+        up.bandwidth = parser.value(uploadOption).toLongLong() * 1024;
+    }
+    // 重置由上行链路的随机数决定,每个连接只抽一次
+    up.resetIntervalMs = int(parser.value(resetsOption).toDouble() * 1000);
+    const quint32 seed = parser.value(seedOption).toUInt();
+
+    if (listenPort == 0 || serverPort == 0 || down.latencyMs < 0 || down.jitterMs < 0
+        || down.bandwidth < 0 || up.bandwidth < 0 || down.loss < 0 || down.loss > 1 || up.resetIntervalMs < 0) {
+        qCritical() << "参数无效";
+        return 1;
+    }
+
+    NetEmuStats stats;
+    TcpProxy proxy(up, down, seed, &stats);
+    QString error;
+    if (!proxy.listen(listenPort, serverHost, serverPort, &error)) {
+        qCritical().noquote() << "无法监听端口:" << error;
+        return 1;
+    }
+    qInfo().noquote() << QString("代理 %1 -> %2:%3").arg(listenPort).arg(serverHost).arg(serverPort);
+
+    quint32 udpSeed = seed + 16;
+    for (const QString& spec : parser.values(udpOption)) {
+        const QStringList parts = spec.split(':');
+        if (parts.size() != 3 || parts[0].toUShort() == 0 || parts[2].toUShort() == 0) {
+            qCritical().noquote() << "UDP转发参数无效:" << spec;
+            return 1;
+        }
+        UdpRelay* relay = new UdpRelay(down, udpSeed++, &stats, &app);
+        if (!relay->start(parts[0].toUShort(), parts[1], parts[2].toUShort(), listenPort, &error)) {
+            qCritical().noquote() << "无法启动UDP转发" << spec << ":" << error;
+            return 1;
+        }
+        qInfo().noquote() << QString("UDP %1 -> %2:%3").arg(parts[0], parts[1], parts[2]);
+    }
+
+    const int reportSec = parser.value(reportOption).toInt();
+    QTimer reportTimer;
+    if (reportSec > 0) {
+        QObject::connect(&reportTimer, &QTimer::timeout, [&stats]() {
+            qInfo().noquote() << stats.summary();
+        });
+        reportTimer.start(reportSec * 1000);
+    }
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    app.exec();
+
+    qInfo().noquote() << stats.summary();
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include "netemu.h"
+#include <QHostInfo>
+#include <QPointer>
+#include "../../Common/discovery.h"
+
+QString NetEmuStats::summary() const
+{
+    QString text = QString("连接 %1, 重置 %2, 上行 %3 KB, 下行 %4 KB")
+        .arg(connections).arg(resets).arg(upBytes / 1024).arg(downBytes / 1024);
+    if (datagrams > 0 || droppedDatagrams > 0) {
+        text += QString("\nUDP: 转发 %1, 丢弃 %2").arg(datagrams).arg(droppedDatagrams);
+    }
+    if (heartbeats > 0) {
+        text += QString("\n心跳: %1 次, 往返 p50 %2 ms, p99 %3 ms, 最大 %4 ms, 断开时未响应 %5")
+            .arg(heartbeats)
+            .arg(double(heartbeatRtt.percentile(0.5)) / 1000.0, 0, 'f', 1)
+            .arg(double(heartbeatRtt.percentile(0.99)) / 1000.0, 0, 'f', 1)
+            .arg(double(heartbeatRtt.percentile(1.0)) / 1000.0, 0, 'f', 1)
+            .arg(missedAcks);
+    }
+    if (fileBytes > 0 && fileLastUs > fileFirstUs) {
+        text += QString("\n文件数据: %1 KB, %2 KB/s")
+            .arg(fileBytes / 1024).arg(fileBytes * 1000000 / (fileLastUs - fileFirstUs) / 1024);
+    }
+    return text;
+}
+
+ProxyConnection::ProxyConnection(QTcpSocket* client, const QString& upstreamHost, quint16 upstreamPort,
+                                 LinkEmulator* upLink, LinkEmulator* downLink, int resetMs,
+                                 NetEmuStats* stats, QObject* parent)
+    : QObject(parent)
+    , m_stats(stats)
+{
+    QTcpSocket* upstream = new QTcpSocket(this);
+    client->setParent(this);
+    setup(m_up, client, upstream, upLink, true);
+    setup(m_down, upstream, client, downLink, false);
+
+    // 上游连上之前客户端发来的数据留在队列里
+    connect(upstream, &QTcpSocket::connected, this, [this]() { deliver(m_up); });
+    upstream->connectToHost(upstreamHost, upstreamPort);
+
+    if (resetMs > 0) {
+        QTimer::singleShot(resetMs, this, [this]() {
+            m_stats->resets++;
+            shutdown(true);
+        });
+    }
+    readFrom(m_up);
+}
+
+void ProxyConnection::setup(Direction& d, QTcpSocket* from, QTcpSocket* to, LinkEmulator* link, bool up)
+{
+    d.from = from;
+    d.to = to;
+    d.link = link;
+    d.up = up;
+    d.timer = new QTimer(this);
+    d.timer->setSingleShot(true);
+    d.timer->setTimerType(Qt::PreciseTimer);
+
+    // 限制读缓冲,链路积压时不再读取,背压传回发送方
+    from->setReadBufferSize(NETEMU_WINDOW);
+    from->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    connect(d.timer, &QTimer::timeout, this, [this, &d]() { deliver(d); });
+    connect(from, &QTcpSocket::readyRead, this, [this, &d]() { readFrom(d); });
+    connect(from, &QTcpSocket::disconnected, this, [this, &d]() { onFromClosed(d); });
+    connect(from, &QAbstractSocket::errorOccurred, this, [this, &d](QAbstractSocket::SocketError) {
+        if (d.from->state() != QAbstractSocket::ConnectedState) {
+            onFromClosed(d);
+        }
+    });
+    connect(to, &QTcpSocket::bytesWritten, this, [this, &d]() { deliver(d); });
+}
+
+void ProxyConnection::readFrom(Direction& d)
+{
+    if (m_closed) return;
+
+    qint64 nowUs = m_stats->nowUs();
+    while (d.queuedBytes < NETEMU_WINDOW && d.from->bytesAvailable() > 0) {
+        QByteArray chunk = d.from->read(qMin<qint64>(d.from->bytesAvailable(), NETEMU_CHUNK));
+        if (chunk.isEmpty()) break;
+
+        // TCP按顺序送达,抖动不会让后面的数据先到
+        qint64 deliverUs = qMax(d.link->schedule(nowUs, chunk.size()), d.lastDeliverUs);
+        d.lastDeliverUs = deliverUs;
+        if (d.up) {
+            m_stats->upBytes += chunk.size();
+            d.tap.feed(chunk.constData(), chunk.size(), [this, nowUs](const ProtocolHeader& header) {
+                onFrame(true, header, nowUs);
+            });
+        }
+        d.queuedBytes += chunk.size();
+        d.queue.emplace_back(deliverUs, chunk);
+    }
+    deliver(d);
+}
+
+void ProxyConnection::deliver(Direction& d)
+{
+    if (m_closed || d.to->state() != QAbstractSocket::ConnectedState) return;
+
+    qint64 nowUs = m_stats->nowUs();
+    bool freed = false;
+    while (!d.queue.empty() && d.queue.front().first <= nowUs && d.to->bytesToWrite() < NETEMU_WINDOW) {
+        const QByteArray& chunk = d.queue.front().second;
+        d.to->write(chunk);
+        if (!d.up) {
+            m_stats->downBytes += chunk.size();
+            d.tap.feed(chunk.constData(), chunk.size(), [this, nowUs](const ProtocolHeader& header) {
+                onFrame(false, header, nowUs);
+            });
+        }
+        d.queuedBytes -= chunk.size();
+        d.queue.pop_front();
+        freed = true;
+    }
+
+    if (!d.queue.empty() && d.queue.front().first > nowUs) {
+        d.timer->start(int((d.queue.front().first - nowUs + 999) / 1000));
+    }
+    if (freed && d.from->bytesAvailable() > 0) {
+        readFrom(d);
+        return;
+    }
+    // 来源已关闭且链路中的数据都已送达,关闭另一端
+    if (d.fromClosed && d.queue.empty() && d.from->bytesAvailable() == 0) {
+        d.to->disconnectFromHost();
+    }
+}
+
+void ProxyConnection::onFromClosed(Direction& d)
+{
+    if (m_closed || d.fromClosed) return;
+    d.fromClosed = true;
+    if (m_up.fromClosed && m_down.fromClosed) {
+        shutdown(false);
+        return;
+    }
+    readFrom(d);
+}
+
+void ProxyConnection::onFrame(bool up, const ProtocolHeader& header, qint64 atUs)
+{
+    if (up && header.cmdType == CMD_HEARTBEAT) {
+        m_heartbeats.enqueue(atUs);
+        m_stats->heartbeats++;
+    } else if (!up && header.cmdType == CMD_HEARTBEAT_ACK && !m_heartbeats.isEmpty()) {
+        m_stats->heartbeatRtt.observe(quint64(atUs - m_heartbeats.dequeue()));
+    } else if (!up && header.cmdType == CMD_FILE_TRANSFER_DATA) {
+        m_stats->fileBytes += header.dataLength;
+        if (m_stats->fileFirstUs < 0) {
+            m_stats->fileFirstUs = atUs;
+        }
+        m_stats->fileLastUs = atUs;
+    }
+}
+
+void ProxyConnection::shutdown(bool reset)
+{
+    if (m_closed) return;
+    m_closed = true;
+    m_stats->missedAcks += m_heartbeats.size();
+    m_heartbeats.clear();
+    if (reset) {
+        // 两端都立即断开,链路中的数据丢弃,与中间设备重置连接的效果相同
+        m_up.from->abort();
+        m_down.from->abort();
+    }
+    deleteLater();
+}
+
+TcpProxy::TcpProxy(const LinkProfile& up, const LinkProfile& down, quint32 seed,
+                   NetEmuStats* stats, QObject* parent)
+    : QObject(parent)
+    , m_server(new QTcpServer(this))
+    , m_upLink(up, seed)
+    , m_downLink(down, seed + 1)
+    , m_resetRandom(up, seed + 2)
+    , m_stats(stats)
+{
+    connect(m_server, &QTcpServer::newConnection, this, &TcpProxy::onNewConnection);
+}
+
+bool TcpProxy::listen(quint16 port, const QString& upstreamHost, quint16 upstreamPort, QString* error)
+{
+    m_upstreamHost = upstreamHost;
+    m_upstreamPort = upstreamPort;
+    if (!m_server->listen(QHostAddress::Any, port)) {
+        *error = m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+void TcpProxy::onNewConnection()
+{
+    while (QTcpSocket* socket = m_server->nextPendingConnection()) {
+        m_stats->connections++;
+        new ProxyConnection(socket, m_upstreamHost, m_upstreamPort, &m_upLink, &m_downLink,
+                            m_resetRandom.nextResetMs(), m_stats, this);
+    }
+}
+
+UdpRelay::UdpRelay(const LinkProfile& profile, quint32 seed, NetEmuStats* stats, QObject* parent)
+    : QObject(parent)
+    , m_listen(new QUdpSocket(this))
+    , m_link(profile, seed)
+    , m_stats(stats)
+{
+    connect(m_listen, &QUdpSocket::readyRead, this, &UdpRelay::onListenReadyRead);
+}
+
+bool UdpRelay::start(quint16 listenPort, const QString& targetHost, quint16 targetPort,
+                     quint16 announcePort, QString* error)
+{
+    m_target = QHostAddress(targetHost);
+    if (m_target.isNull()) {
+        const QList<QHostAddress> addresses = QHostInfo::fromName(targetHost).addresses();
+        for (const QHostAddress& address : addresses) {
+            if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+                m_target = address;
+                break;
+            }
+        }
+    }
+    if (m_target.isNull()) {
+        *error = "无法解析地址 " + targetHost;
+        return false;
+    }
+    m_targetPort = targetPort;
+    m_announcePort = announcePort;
+
+    // 与同机上的服务端/客户端共享端口,广播数据报双方都能收到
+    if (!m_listen->bind(QHostAddress::AnyIPv4, listenPort, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
+        *error = m_listen->errorString();
+        return false;
+    }
+    return true;
+}
+
+void UdpRelay::onListenReadyRead()
+{
+    while (m_listen->hasPendingDatagrams()) {
+        QByteArray data(int(m_listen->pendingDatagramSize()), Qt::Uninitialized);
+        QHostAddress sender;
+        quint16 senderPort = 0;
+        if (m_listen->readDatagram(data.data(), data.size(), &sender, &senderPort) < 0) {
+            continue;
+        }
+
+        QUdpSocket*& upstream = m_upstream[sender.toString() + ':' + QString::number(senderPort)];
+        if (!upstream) {
+            QUdpSocket* socket = new QUdpSocket(this);
+            socket->bind(QHostAddress::AnyIPv4, 0);
+            connect(socket, &QUdpSocket::readyRead, this, [this, socket, sender, senderPort]() {
+                while (socket->hasPendingDatagrams()) {
+                    QByteArray reply(int(socket->pendingDatagramSize()), Qt::Uninitialized);
+                    if (socket->readDatagram(reply.data(), reply.size()) >= 0) {
+                        forward(m_listen, reply, sender, senderPort);
+                    }
+                }
+            });
+            upstream = socket;
+        }
+        forward(upstream, data, m_target, m_targetPort);
+    }
+}
+
+void UdpRelay::forward(QUdpSocket* socket, QByteArray data, const QHostAddress& address, quint16 port)
+{
+    if (m_link.drop()) {
+        m_stats->droppedDatagrams++;
+        return;
+    }
+    m_stats->datagrams++;
+
+    // 服务端通告中的TCP端口换成代理端口
+    ServerAnnounce info;
+    if (m_announcePort && Discovery::parseAnnounce(data, info)) {
+        info.port = m_announcePort;
+        data = Discovery::announce(info);
+    }
+
+    qint64 nowUs = m_stats->nowUs();
+    int delayMs = int((m_link.schedule(nowUs, data.size()) - nowUs + 999) / 1000);
+    QPointer<QUdpSocket> target(socket);
+    QTimer::singleShot(delayMs, this, [target, data, address, port]() {
+        if (target) {
+            target->writeDatagram(data, address, port);
+        }
+    });
+}
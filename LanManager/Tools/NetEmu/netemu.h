@@ -0,0 +1,170 @@
+#ifndef NETEMU_H
+#define NETEMU_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QQueue>
+#include <deque>
+#include "linkemulator.h"
+#include "../../Common/protocol.h"
+#include "../../Server/metrics.h"
+
+// 每个方向在模拟链路中最多积压的字节数,超过后停止从来源套接字读取,
+// 对端的TCP窗口随之关闭,发送方感受到的背压与真实的慢速链路相同
+#define NETEMU_WINDOW (64 * 1024)
+
+// 每次从套接字读取的最大字节数,带宽模拟的粒度
+#define NETEMU_CHUNK (16 * 1024)
+
+// 代理观察到的统计
+struct NetEmuStats {
+    NetEmuStats() : heartbeatRtt(1e-6) { clock.start(); }
+
+    qint64 nowUs() const { return clock.nsecsElapsed() / 1000; }
+
+    QElapsedTimer clock;
+    qint64 connections = 0;         // 接受的TCP连接
+    qint64 resets = 0;              // 主动重置的连接
+    qint64 upBytes = 0;             // 客户端 -> 服务端
+    qint64 downBytes = 0;           // 服务端 -> 客户端
+    qint64 datagrams = 0;           // 转发的UDP数据报
+    qint64 droppedDatagrams = 0;
+
+    // 在客户端一侧看到的心跳往返时间(微秒): 心跳进入代理到心跳响应离开代理
+    MetricHistogram heartbeatRtt;
+    qint64 heartbeats = 0;
+    qint64 missedAcks = 0;          // 连接断开时还没等到响应的心跳
+
+    // 服务端发往客户端的文件数据
+    qint64 fileBytes = 0;
+    qint64 fileFirstUs = -1;
+    qint64 fileLastUs = -1;
+
+    // 多行统计文本
+    QString summary() const;
+};
+
+// 从字节流中识别帧头(只取命令和长度,不复制数据)
+class FrameTap {
+public:
+    // 喂入一段数据,每识别出一个帧头调用一次 onFrame(header)
+    template <typename F>
+    void feed(const char* data, qint64 size, F onFrame) {
+        while (size > 0) {
+            if (m_skip > 0) {
+                qint64 n = qMin(m_skip, size);
+                m_skip -= n;
+                data += n;
+                size -= n;
+                continue;
+            }
+            // 版本2的帧头为12字节,命令字段最高字节是版本号
+            int need = m_header.size() < 8 ? 8 : (quint8(m_header[4]) >= 2 ? 12 : 8);
+            int n = int(qMin<qint64>(need - m_header.size(), size));
+            m_header.append(data, n);
+            data += n;
+            size -= n;
+            ProtocolHeader header;
+            if (m_header.size() >= 8 && Protocol::parseHeader(m_header, header) && m_header.size() == header.size) {
+                m_skip = header.dataLength;
+                m_header.clear();
+                onFrame(header);
+            }
+        }
+    }
+
+private:
+    QByteArray m_header;
+    qint64 m_skip = 0;
+};
+
+// 一条被代理的TCP连接
+// 两个方向各有一个待送达队列,按链路模型算出的时间写给另一端
+class ProxyConnection : public QObject {
+public:
+    ProxyConnection(QTcpSocket* client, const QString& upstreamHost, quint16 upstreamPort,
+                    LinkEmulator* upLink, LinkEmulator* downLink, int resetMs,
+                    NetEmuStats* stats, QObject* parent);
+
+private:
+    struct Direction {
+        QTcpSocket* from = nullptr;
+        QTcpSocket* to = nullptr;
+        LinkEmulator* link = nullptr;
+        std::deque<QPair<qint64, QByteArray>> queue;   // (送达时间, 数据)
+        qint64 queuedBytes = 0;
+        qint64 lastDeliverUs = 0;
+        QTimer* timer = nullptr;
+        FrameTap tap;
+        bool up = false;            // 客户端 -> 服务端
+        bool fromClosed = false;
+    };
+
+    void setup(Direction& d, QTcpSocket* from, QTcpSocket* to, LinkEmulator* link, bool up);
+    void readFrom(Direction& d);
+    void deliver(Direction& d);
+    void onFromClosed(Direction& d);
+    void onFrame(bool up, const ProtocolHeader& header, qint64 atUs);
+    void shutdown(bool reset);
+
+    Direction m_up;
+    Direction m_down;
+    NetEmuStats* m_stats;
+    QQueue<qint64> m_heartbeats;    // 等待响应的心跳进入代理的时间
+    bool m_closed = false;
+};
+
+// TCP代理: 在 listen 端口接受连接,每个连接转发到上游服务端
+class TcpProxy : public QObject {
+    Q_OBJECT
+public:
+    TcpProxy(const LinkProfile& up, const LinkProfile& down, quint32 seed,
+             NetEmuStats* stats, QObject* parent = nullptr);
+
+    bool listen(quint16 port, const QString& upstreamHost, quint16 upstreamPort, QString* error);
+    quint16 port() const { return m_server->serverPort(); }
+
+private slots:
+    void onNewConnection();
+
+private:
+    QTcpServer* m_server;
+    QString m_upstreamHost;
+    quint16 m_upstreamPort = 0;
+    LinkEmulator m_upLink;          // 所有连接共用,带宽在连接之间分享
+    LinkEmulator m_downLink;
+    LinkEmulator m_resetRandom;
+    NetEmuStats* m_stats;
+};
+
+// UDP转发: 发到 listen 端口的数据报转发给目标,回复原路返回(按发送方分配上游套接字)
+// 服务发现的通告经过时可以把其中的TCP端口改为代理端口,让客户端连到代理上
+class UdpRelay : public QObject {
+    Q_OBJECT
+public:
+    UdpRelay(const LinkProfile& profile, quint32 seed, NetEmuStats* stats, QObject* parent = nullptr);
+
+    bool start(quint16 listenPort, const QString& targetHost, quint16 targetPort,
+               quint16 announcePort, QString* error);
+
+private slots:
+    void onListenReadyRead();
+
+private:
+    void forward(QUdpSocket* socket, QByteArray data, const QHostAddress& address, quint16 port);
+
+    QUdpSocket* m_listen;
+    QHostAddress m_target;
+    quint16 m_targetPort = 0;
+    quint16 m_announcePort = 0;
+    QHash<QString, QUdpSocket*> m_upstream;     // 发送方 -> 上游套接字
+    LinkEmulator m_link;
+    NetEmuStats* m_stats;
+};
+
+#endif // NETEMU_H
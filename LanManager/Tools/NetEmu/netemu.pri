@@ -0,0 +1,11 @@
+# 网络条件模拟源码引用
+# 使用方式: include(../NetEmu/netemu.pri)
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/netemu.cpp
+
+HEADERS += \
+    $$PWD/netemu.h \
+    $$PWD/linkemulator.h
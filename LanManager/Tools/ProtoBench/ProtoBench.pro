@@ -0,0 +1,32 @@
+QT += core
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = ProtoBench
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    ../../Server/resultaggregator.cpp
+
+HEADERS += \
+    ../../Common/protocol.h \
+    ../../Common/inventory.h \
+    ../../Common/telemetry.h \
+    ../../Common/objectpool.h \
+    ../../Common/framereader.h \
+    ../../Common/alloccounter.h \
+    ../../Server/resultaggregator.h
+
+INCLUDEPATH += ../../Common ../../Server
+
+# qmake CONFIG+=count_allocs: 结果中加上每次操作的堆分配次数
+count_allocs: DEFINES += LANMGR_COUNT_ALLOCS
+
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../../pgo.pri)
+
+# 输出目录
+DESTDIR = ../../bin
@@ -0,0 +1,546 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QSysInfo>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include "protocol.h"
+#include "inventory.h"
+#include "telemetry.h"
+#include "framereader.h"
+#include "resultaggregator.h"
+#define ALLOC_COUNTER_DEFINE
+#include "alloccounter.h"
+
+// 协议基准测试
+// 测量打包、帧头解析、JSON编解码、收包拆帧、大清单编解码和结果汇总的耗时,
+// 结果可以写成JSON,并与保存的基线比较,变慢超过阈值时返回非0
+// 以 CONFIG+=count_allocs 编译时同时统计每次操作的堆分配次数,分配增加也算作变慢
+
+// 防止被测代码被优化掉
+static volatile quint64 g_sink = 0;
+
+// 拆帧测试的帧长度上限
+#define MAX_FRAME_BENCH (16 * 1024 * 1024)
+
+struct BenchResult {
+    QString name;
+    qint64 iterations = 0;      // 每轮的迭代次数
+    double nsPerOp = 0;         // 各轮的中位数
+    qint64 bytesPerOp = 0;      // 每次处理的字节数(0表示不计吞吐)
+    double allocsPerOp = -1;    // 每次操作的堆分配次数(-1表示未统计)
+};
+
+class BenchRunner {
+public:
+    BenchRunner(qint64 minTimeNs, int rounds, const QRegularExpression& filter)
+        : m_minTimeNs(minTimeNs), m_rounds(rounds), m_filter(filter) {}
+
+    // op() 执行一次被测操作,返回值计入 g_sink
+    template <typename F>
+    void run(const QString& name, qint64 bytesPerOp, F op) {
+        if (!m_filter.match(name).hasMatch()) return;
+
+        // 迭代次数翻倍直到一轮耗时超过最短时间的1/10,再按比例放大到最短时间
+        QElapsedTimer timer;
+        qint64 iterations = 1;
+        qint64 elapsed = 0;
+        while (true) {
+            timer.start();
+            for (qint64 i = 0; i < iterations; ++i) {
+                g_sink += quint64(op());
+            }
+            elapsed = timer.nsecsElapsed();
+            if (elapsed >= m_minTimeNs / 10 || iterations >= (qint64(1) << 40)) break;
+            iterations *= 2;
+        }
+        iterations = qMax<qint64>(1, qint64(double(iterations) * m_minTimeNs / qMax<qint64>(1, elapsed)));
+
+        QVector<double> samples;
+        for (int r = 0; r < m_rounds; ++r) {
+            timer.start();
+            for (qint64 i = 0; i < iterations; ++i) {
+                g_sink += quint64(op());
+            }
+            samples.append(double(timer.nsecsElapsed()) / double(iterations));
+        }
+        std::sort(samples.begin(), samples.end());
+
+        BenchResult result;
+        result.name = name;
+        result.iterations = iterations;
+        result.nsPerOp = samples[samples.size() / 2];
+        result.bytesPerOp = bytesPerOp;
+
+        // 分配计数单独跑一轮,计数本身不影响计时
+        if (AllocCounter::enabled()) {
+            quint64 before = AllocCounter::count();
+            for (qint64 i = 0; i < iterations; ++i) {
+                g_sink += quint64(op());
+            }
+            result.allocsPerOp = double(AllocCounter::count() - before) / double(iterations);
+        }
+        m_results.append(result);
+
+        QString line = QString("%1 %2 ns/op").arg(name, -28).arg(result.nsPerOp, 12, 'f', 1);
+        if (bytesPerOp > 0) {
+            line += QString("  %1 MB/s").arg(double(bytesPerOp) * 1000.0 / result.nsPerOp, 9, 'f', 1);
+        }
+        if (result.allocsPerOp >= 0) {
+            line += QString("  %1 allocs/op").arg(result.allocsPerOp, 0, 'f', 2);
+        }
+        qInfo().noquote() << line;
+    }
+
+    const QList<BenchResult>& results() const { return m_results; }
+
+private:
+    qint64 m_minTimeNs;
+    int m_rounds;
+    QRegularExpression m_filter;
+    QList<BenchResult> m_results;
+};
+
+static SystemInfo sampleSystemInfo()
+{
+    SystemInfo info;
+    info.computerName = "LAB-PC-0042";
+    info.osVersion = "Windows 10 专业版 22H2 (19045.3803)";
+    info.cpuInfo = "Intel(R) Core(TM) i5-10400 CPU @ 2.90GHz (6核12线程)";
+    info.totalMemory = 16291;
+    info.freeMemory = 9120;
+    info.diskInfo = "C: 237.9 GB (可用 102.4 GB); D: 931.5 GB (可用 611.0 GB)";
+    info.macAddress = "00:16:3E:5A:1C:42";
+    info.ipAddress = "192.168.1.142";
+    return info;
+}
+
+// 与实际注册表数据相近的软件条目,i 相同时内容相同
+static SoftwareInfo sampleSoftware(int i)
+{
+    SoftwareInfo info;
+    info.name = QString("Sample Application %1 (x64)").arg(i);
+    info.version = QString("%1.%2.%3").arg(i % 17).arg(i % 9).arg(1000 + i);
+    info.publisher = QString("示例软件有限公司 %1").arg(i % 50);
+    info.installDate = QString("2025%1%2").arg(1 + i % 12, 2, 10, QChar('0')).arg(1 + i % 28, 2, 10, QChar('0'));
+    info.installPath = QString("C:\\Program Files\\Sample\\App%1\\").arg(i);
+    info.uninstallCmd = QString("MsiExec.exe /X{%1-0000-4000-8000-000000000000}").arg(i, 8, 16, QChar('0'));
+    return info;
+}
+
+static QJsonObject softwareListJson(const QList<SoftwareInfo>& list)
+{
+    QJsonArray arr;
+    for (const SoftwareInfo& info : list) {
+        arr.append(info.toJson());
+    }
+    QJsonObject json;
+    json["hash"] = QString::fromLatin1(Inventory::hash(list));
+    json["count"] = list.size();
+    json["software"] = arr;
+    return json;
+}
+
+// 服务端收到的典型字节流: 心跳、系统信息响应、文件确认和命令输出交错
+static QByteArray sampleStream(qint64 targetSize)
+{
+    QByteArray sysinfo = QJsonDocument(sampleSystemInfo().toJson()).toJson(QJsonDocument::Compact);
+    QJsonObject ack;
+    ack["success"] = true;
+    ack["received"] = 65536;
+    QByteArray ackData = QJsonDocument(ack).toJson(QJsonDocument::Compact);
+    QByteArray output(4096, 'x');
+
+    QByteArray stream;
+    quint32 requestId = 1;
+    while (stream.size() < targetSize) {
+        stream += Protocol::pack(CMD_HEARTBEAT, QByteArray());
+        stream += Protocol::pack(CMD_SYSINFO_RESPONSE, sysinfo, requestId++, FLAG_RESPONSE);
+        stream += Protocol::pack(CMD_FILE_TRANSFER_ACK, ackData, requestId++, FLAG_RESPONSE);
+        stream += Protocol::pack(CMD_EXEC_OUTPUT, output, requestId++);
+    }
+    return stream;
+}
+
+// 与 Agent::onReadyRead 相同的拆帧方式
+static int splitFrames(QByteArray& buffer)
+{
+    int frames = 0;
+    while (buffer.size() >= Protocol::headerSize()) {
+        ProtocolHeader header;
+        if (!Protocol::parseHeader(buffer, header)) {
+            break;
+        }
+        int packetSize = header.size + header.dataLength;
+        if (buffer.size() < packetSize) {
+            break;
+        }
+        QByteArray data = buffer.mid(header.size, header.dataLength);
+        buffer.remove(0, packetSize);
+        frames += data.isEmpty() ? 1 : 2;
+    }
+    return frames;
+}
+
+// 把字节流按 reads 中的长度分段追加,模拟多次读事件
+static int feedStream(const QByteArray& stream, const QVector<int>& reads)
+{
+    QByteArray buffer;
+    int frames = 0;
+    int pos = 0;
+    for (int i = 0; pos < stream.size(); i = (i + 1) % reads.size()) {
+        int n = qMin(reads[i], stream.size() - pos);
+        buffer.append(stream.constData() + pos, n);
+        pos += n;
+        frames += splitFrames(buffer);
+    }
+    return frames;
+}
+
+// 与 TcpServer::processClientData 相同: FrameReader 拆帧,缓冲从缓冲池取得
+static int readStream(BufferPool& pool, const QByteArray& stream, const QVector<int>& reads)
+{
+    FrameReader reader(&pool);
+    int frames = 0;
+    int pos = 0;
+    for (int i = 0; pos < stream.size(); i = (i + 1) % reads.size()) {
+        int n = qMin(reads[i], stream.size() - pos);
+        reader.append(stream.constData() + pos, n);
+        pos += n;
+        ProtocolHeader header;
+        while (reader.next(header, MAX_FRAME_BENCH) == FrameReader::FRAME_READY) {
+            const QByteArray data = reader.payload();
+            frames += data.isEmpty() ? 1 : 2;
+        }
+        reader.compact();
+    }
+    return frames;
+}
+
+static QJsonObject resultsJson(const QList<BenchResult>& results)
+{
+    QJsonArray arr;
+    for (const BenchResult& r : results) {
+        QJsonObject obj;
+        obj["name"] = r.name;
+        obj["nsPerOp"] = r.nsPerOp;
+        obj["iterations"] = r.iterations;
+        if (r.bytesPerOp > 0) {
+            obj["bytesPerOp"] = r.bytesPerOp;
+        }
+        if (r.allocsPerOp >= 0) {
+            obj["allocsPerOp"] = r.allocsPerOp;
+        }
+        arr.append(obj);
+    }
+    QJsonObject json;
+    json["version"] = 1;
+    json["time"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    json["host"] = QSysInfo::machineHostName();
+    json["os"] = QSysInfo::prettyProductName();
+    json["cpu"] = QSysInfo::currentCpuArchitecture();
+    json["qt"] = QString(qVersion());
+    json["results"] = arr;
+    return json;
+}
+
+// 与基线比较,返回变慢超过阈值的项数
+static int compareBaseline(const QList<BenchResult>& results, const QJsonObject& baseline, double threshold)
+{
+    QHash<QString, double> base;
+    QHash<QString, double> baseAllocs;
+    for (const QJsonValue& val : baseline["results"].toArray()) {
+        QJsonObject obj = val.toObject();
+        base.insert(obj["name"].toString(), obj["nsPerOp"].toDouble());
+        if (obj.contains("allocsPerOp")) {
+            baseAllocs.insert(obj["name"].toString(), obj["allocsPerOp"].toDouble());
+        }
+    }
+    if (baseline["host"].toString() != QSysInfo::machineHostName()) {
+        qWarning().noquote() << QString("注意: 基线来自 %1,与本机不同,比较结果仅供参考")
+            .arg(baseline["host"].toString());
+    }
+
+    int regressions = 0;
+    qInfo().noquote() << QString("\n与基线比较(阈值 %1%):").arg(threshold * 100, 0, 'f', 0);
+    for (const BenchResult& r : results) {
+        double old = base.value(r.name, 0.0);
+        if (old <= 0) {
+            qInfo().noquote() << QString("%1 新增").arg(r.name, -28);
+            continue;
+        }
+        double change = r.nsPerOp / old - 1.0;
+        QString mark;
+        if (change > threshold) {
+            mark = "  变慢";
+            regressions++;
+        } else if (r.allocsPerOp >= 0 && baseAllocs.contains(r.name)
+                   && r.allocsPerOp > baseAllocs.value(r.name) + 0.01) {
+            mark = QString("  分配增加 %1 -> %2").arg(baseAllocs.value(r.name), 0, 'f', 2).arg(r.allocsPerOp, 0, 'f', 2);
+            regressions++;
+        }
+        qInfo().noquote() << QString("%1 %2 -> %3 ns/op  %4%5%6")
+            .arg(r.name, -28).arg(old, 0, 'f', 1).arg(r.nsPerOp, 0, 'f', 1)
+            .arg(change >= 0 ? "+" : "").arg(change * 100, 0, 'f', 1).arg(mark);
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("ProtoBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("协议基准测试");
+    parser.addHelpOption();
+    QCommandLineOption filterOption("filter", "只运行名称匹配的项(正则表达式)", "regex", ".");
+    QCommandLineOption minTimeOption("min-time", "每轮最短运行时间(毫秒)", "ms", "200");
+    QCommandLineOption roundsOption("rounds", "每项运行轮数,取中位数", "n", "5");
+    QCommandLineOption softwareOption("software", "清单测试的软件条目数", "n", "2000");
+    QCommandLineOption jsonOption("json", "把结果写入JSON文件(- 表示标准输出)", "path");
+    QCommandLineOption baselineOption("baseline", "与基线JSON比较", "path");
+    QCommandLineOption thresholdOption("threshold", "比基线慢超过该百分比时返回2", "percent", "10");
+    parser.addOption(filterOption);
+    parser.addOption(minTimeOption);
+    parser.addOption(roundsOption);
+    parser.addOption(softwareOption);
+    parser.addOption(jsonOption);
+    parser.addOption(baselineOption);
+    parser.addOption(thresholdOption);
+    parser.process(app);
+
+    QRegularExpression filter(parser.value(filterOption));
+    const qint64 minTimeNs = parser.value(minTimeOption).toLongLong() * 1000000;
+    const int rounds = parser.value(roundsOption).toInt();
+    const int softwareCount = parser.value(softwareOption).toInt();
+    const double threshold = parser.value(thresholdOption).toDouble() / 100.0;
+    if (!filter.isValid() || minTimeNs <= 0 || rounds <= 0 || softwareCount <= 0 || threshold < 0) {
+        qCritical() << "参数无效";
+        return 1;
+    }
+
+    QJsonObject baseline;
+    if (parser.isSet(baselineOption)) {
+        QFile file(parser.value(baselineOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical().noquote() << "无法读取基线:" << file.errorString();
+            return 1;
+        }
+        baseline = QJsonDocument::fromJson(file.readAll()).object();
+        if (baseline["results"].toArray().isEmpty()) {
+            qCritical() << "基线文件格式无效";
+            return 1;
+        }
+    }
+
+    BenchRunner bench(minTimeNs, rounds, filter);
+
+    // 1. 打包
+    const QByteArray chunk(64 * 1024, 'd');
+    bench.run("pack.heartbeat", 0, []() {
+        return Protocol::pack(CMD_HEARTBEAT, QByteArray()).size();
+    });
+    bench.run("pack.file_data_64k", chunk.size(), [&chunk]() {
+        return Protocol::pack(CMD_FILE_TRANSFER_DATA, chunk, 7).size();
+    });
+    bench.run("pack.write_header", 0, []() {
+        char header[Protocol::MAX_HEADER_SIZE];
+        return Protocol::writeHeader(header, CMD_EXEC_OUTPUT, 4096, 7, FLAG_RESPONSE) + header[3];
+    });
+
+    // 2. 帧头解析
+    const QByteArray frameV1 = Protocol::pack(CMD_HEARTBEAT, QByteArray("x"));
+    const QByteArray frameV2 = Protocol::pack(CMD_SYSINFO_RESPONSE, QByteArray("x"), 42, FLAG_RESPONSE);
+    bench.run("header.parse_v1", 0, [&frameV1]() {
+        ProtocolHeader header;
+        Protocol::parseHeader(frameV1, header);
+        return header.dataLength + header.cmdType;
+    });
+    bench.run("header.parse_v2", 0, [&frameV2]() {
+        ProtocolHeader header;
+        Protocol::parseHeader(frameV2, header);
+        return header.dataLength + header.requestId;
+    });
+
+    // 3. JSON编解码
+    const SystemInfo sysinfo = sampleSystemInfo();
+    const QByteArray sysinfoData = QJsonDocument(sysinfo.toJson()).toJson(QJsonDocument::Compact);
+    const SoftwareInfo software = sampleSoftware(1);
+    const QByteArray softwareData = QJsonDocument(software.toJson()).toJson(QJsonDocument::Compact);
+    bench.run("json.sysinfo_encode", sysinfoData.size(), [&sysinfo]() {
+        return Protocol::packJson(CMD_SYSINFO_RESPONSE, sysinfo.toJson(), 42, FLAG_RESPONSE).size();
+    });
+    bench.run("json.sysinfo_decode", sysinfoData.size(), [&sysinfoData]() {
+        return SystemInfo::fromJson(Protocol::parseJson(sysinfoData)).totalMemory;
+    });
+    bench.run("json.software_roundtrip", softwareData.size(), [&software]() {
+        QByteArray data = QJsonDocument(software.toJson()).toJson(QJsonDocument::Compact);
+        return SoftwareInfo::fromJson(Protocol::parseJson(data)).name.size();
+    });
+
+    // 4. 拆帧: 1 MB字节流,分别按小片段(1~1460字节,随机)和64 KB读取
+    const QByteArray stream = sampleStream(1024 * 1024);
+    QVector<int> smallReads;
+    QRandomGenerator random(1);
+    for (int i = 0; i < 4096; ++i) {
+        smallReads.append(1 + int(random.bounded(1460)));
+    }
+    const QVector<int> largeReads{ 64 * 1024 };
+    bench.run("frame.split_fragmented", stream.size(), [&stream, &smallReads]() {
+        return feedStream(stream, smallReads);
+    });
+    bench.run("frame.split_64k_reads", stream.size(), [&stream, &largeReads]() {
+        return feedStream(stream, largeReads);
+    });
+    BufferPool pool;
+    bench.run("frame.reader_fragmented", stream.size(), [&pool, &stream, &smallReads]() {
+        return readStream(pool, stream, smallReads);
+    });
+    bench.run("frame.reader_64k_reads", stream.size(), [&pool, &stream, &largeReads]() {
+        return readStream(pool, stream, largeReads);
+    });
+
+    // 稳定状态的心跳: 连接的接收缓冲已经建立,每次收到一个带往返时间的心跳并拆出
+    // (以 count_allocs 编译时应为 0 allocs/op)
+    const QByteArray heartbeat = Protocol::pack(CMD_HEARTBEAT, QByteArray("{\"rtt\":3}"));
+    FrameReader heartbeatReader(&pool);
+    bench.run("frame.heartbeat_steady", heartbeat.size(), [&heartbeatReader, &heartbeat]() {
+        heartbeatReader.append(heartbeat.constData(), heartbeat.size());
+        ProtocolHeader header;
+        int size = 0;
+        while (heartbeatReader.next(header, MAX_FRAME_BENCH) == FrameReader::FRAME_READY) {
+            const QByteArray data = heartbeatReader.payload();
+            size += data.size();
+        }
+        heartbeatReader.compact();
+        return size;
+    });
+
+    // 5. 大清单: 客户端完整上报、服务端解析、摘要和差异
+    QList<SoftwareInfo> list;
+    for (int i = 0; i < softwareCount; ++i) {
+        list.append(sampleSoftware(i));
+    }
+    QList<SoftwareInfo> changed = list;
+    for (int i = 0; i < changed.size(); i += 100) {
+        changed[i].version += ".1";
+    }
+    const QByteArray listData = QJsonDocument(softwareListJson(list)).toJson(QJsonDocument::Compact);
+    const QString countName = QString::number(softwareCount);
+    bench.run("inventory.encode_" + countName, listData.size(), [&list]() {
+        return Protocol::packJson(CMD_SOFTWARE_RESPONSE, softwareListJson(list), 9, FLAG_RESPONSE).size();
+    });
+    bench.run("inventory.decode_" + countName, listData.size(), [&listData]() {
+        QJsonArray arr = Protocol::parseJson(listData)["software"].toArray();
+        QList<SoftwareInfo> decoded;
+        for (const QJsonValue& val : arr) {
+            decoded.append(SoftwareInfo::fromJson(val.toObject()));
+        }
+        return decoded.size();
+    });
+    bench.run("inventory.hash_" + countName, 0, [&list]() {
+        return Inventory::hash(list).size();
+    });
+    bench.run("inventory.diff_" + countName, 0, [&list, &changed]() {
+        QList<SoftwareInfo> added;
+        QStringList removed;
+        Inventory::diff(list, changed, added, removed);
+        return added.size() + removed.size();
+    });
+
+    // 6. 遥测批次: 60个样本,8个核心
+    QVector<TelemetrySample> samples;
+    for (int i = 0; i < 60; ++i) {
+        TelemetrySample s;
+        s.timestamp = 1767225600000LL + i * 5000;
+        s.cpuUsage = quint32(random.bounded(1000));
+        for (int c = 0; c < 8; ++c) {
+            s.coreUsage.append(quint32(random.bounded(1000)));
+        }
+        s.totalMemory = 16291;
+        s.freeMemory = 9000 + quint64(random.bounded(200));
+        s.freeDisk = 733000;
+        s.diskReadRate = quint64(random.bounded(5000));
+        s.diskWriteRate = quint64(random.bounded(5000));
+        s.netRxRate = quint64(random.bounded(2000));
+        s.netTxRate = quint64(random.bounded(2000));
+        samples.append(s);
+    }
+    const QByteArray batch = TelemetryCodec::encodeBatch(samples);
+    bench.run("telemetry.encode_60", batch.size(), [&samples]() {
+        return TelemetryCodec::encodeBatch(samples).size();
+    });
+    bench.run("telemetry.decode_60", batch.size(), [&batch]() {
+        QVector<TelemetrySample> decoded;
+        TelemetryCodec::decodeBatch(batch, decoded);
+        return decoded.size();
+    });
+
+    // 7. 结果汇总: 一万台电脑的安装结果逐条加入,再像界面那样刷新一次
+    // 失败消息带有各台电脑自己的路径,退出码只有几种,最后分成少量的组
+    struct SampleResult {
+        QString machine;
+        bool success;
+        int exitCode;
+        QString message;
+    };
+    static const int failureCodes[] = { 1603, 1618, 3010, 5 };
+    QVector<SampleResult> results;
+    for (int i = 0; i < 10000; ++i) {
+        SampleResult r;
+        r.machine = QString("PC-%1").arg(i, 5, 10, QChar('0'));
+        r.success = random.bounded(10) != 0;
+        r.exitCode = r.success ? 0 : failureCodes[random.bounded(4)];
+        r.message = r.success ? QString("安装成功")
+                              : QString("C:\\Users\\%1\\AppData\\Local\\Temp\\setup.exe: 安装失败").arg(r.machine);
+        results.append(r);
+    }
+    bench.run("results.add_10k", 0, [&results]() {
+        ResultAggregator aggregator;
+        for (const SampleResult& r : results) {
+            aggregator.add("安装", r.success, r.machine, r.message, r.exitCode);
+        }
+        // 与 MainWindow::refreshResults 相同: 每组生成一行文字并读取台数
+        int size = 0;
+        for (int i = 0; i < aggregator.groupCount(); ++i) {
+            const ResultGroup& group = aggregator.group(i);
+            QString text = group.exitCode != NO_EXIT_CODE
+                ? QString("%1 (退出码 %2)").arg(group.message).arg(group.exitCode) : group.message;
+            size += text.size() + group.machines.size();
+        }
+        return size;
+    });
+
+    if (bench.results().isEmpty()) {
+        qCritical() << "没有匹配的测试项";
+        return 1;
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QByteArray json = QJsonDocument(resultsJson(bench.results())).toJson();
+        QString path = parser.value(jsonOption);
+        QFile file(path);
+        bool ok = path == "-" ? file.open(stdout, QIODevice::WriteOnly) : file.open(QIODevice::WriteOnly);
+        if (!ok || file.write(json) != json.size()) {
+            qCritical().noquote() << "无法写入结果:" << file.errorString();
+            return 1;
+        }
+    }
+
+    if (!baseline.isEmpty()) {
+        int regressions = compareBaseline(bench.results(), baseline, threshold);
+        if (regressions > 0) {
+            qCritical().noquote() << QString("%1 项比基线慢 %2% 以上").arg(regressions).arg(threshold * 100, 0, 'f', 0);
+            return 2;
+        }
+    }
+    return 0;
+}
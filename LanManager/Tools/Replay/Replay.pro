@@ -0,0 +1,64 @@
+QT += core network concurrent
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = LanReplay
+TEMPLATE = app
+
+# Windows特定配置
+win32 {
+    LIBS += -liphlpapi -lws2_32 -lpsapi
+}
+
+SOURCES += \
+    main.cpp \
+    replayer.cpp \
+    ../../Server/tcpserver.cpp \
+    ../../Server/inventorysnapshot.cpp \
+    ../../Server/peerlink.cpp \
+    ../../Server/metricsserver.cpp \
+    ../../Client/agent.cpp \
+    ../../Client/sysinfo.cpp \
+    ../../Client/softmgr.cpp \
+    ../../Client/inventorysource.cpp \
+    ../../Client/inventorywatcher.cpp \
+    ../../Client/jobrunner.cpp \
+    ../../Client/perfmon.cpp \
+    ../../Client/filewriter.cpp \
+    ../../Client/selfmonitor.cpp
+
+HEADERS += \
+    replayer.h \
+    ../../Server/tcpserver.h \
+    ../../Server/inventorysnapshot.h \
+    ../../Server/peerlink.h \
+    ../../Server/metricsserver.h \
+    ../../Server/metrics.h \
+    ../../Client/agent.h \
+    ../../Client/sysinfo.h \
+    ../../Client/softmgr.h \
+    ../../Client/inventorysource.h \
+    ../../Client/inventorywatcher.h \
+    ../../Client/jobrunner.h \
+    ../../Client/perfmon.h \
+    ../../Client/filewriter.h \
+    ../../Client/selfmonitor.h \
+    ../../Common/protocol.h \
+    ../../Common/capture.h \
+    ../../Common/logger.h
+
+INCLUDEPATH += ../../Common ../../Server ../../Client
+
+# 时序存储库
+include(../../TsStore/tsstore.pri)
+
+# 网络条件模拟
+include(../NetEmu/netemu.pri)
+
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../../pgo.pri)
+
+# 输出目录
+DESTDIR = ../../bin
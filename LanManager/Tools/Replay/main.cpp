@@ -0,0 +1,188 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QDebug>
+#include "replayer.h"
+#include "tcpserver.h"
+#include "inventorysnapshot.h"
+#include "tsstore.h"
+#include "agent.h"
+#include "netemu.h"
+#include "logger.h"
+
+// 回放使用的默认端口,避免和正在运行的服务端冲突
+#define REPLAY_PORT 18899
+
+// 流量回放工具
+// 把服务端或客户端记录的流量(--capture / "文件 → 记录流量")按原节奏或加速回放,
+// 驱动进程内的 TcpServer 或 Agent,得到可重复的处理路径基准
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("LanReplay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("流量记录回放");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "流量记录文件(.lmcap)");
+    QCommandLineOption targetOption("target", "回放目标: server(默认)或 agent", "server|agent", "server");
+    QCommandLineOption speedOption("speed", "回放倍速,max 表示不等待", "n|max", "1");
+    QCommandLineOption hostOption("host", "目标为服务端时回放到该地址的服务端(默认在进程内启动一个)", "address");
+    QCommandLineOption portOption("port", "服务端端口", "port", QString::number(REPLAY_PORT));
+    QCommandLineOption agentsOption("agents", "目标为客户端时在进程内启动的客户端数", "n", "1");
+    QCommandLineOption waitOption("wait", "目标为客户端时另外等待的外部客户端数(LanClient -s <本机> -p <端口>)", "n", "0");
+    QCommandLineOption connectionOption("connection", "目标为客户端时回放的连接编号(默认帧数最多的)", "id");
+    QCommandLineOption allowOption("allow-changes", "目标为客户端时也回放安装、卸载、文件传输和远程执行");
+    QCommandLineOption timeoutOption("timeout", "最长运行时间(秒)", "sec", "600");
+    QCommandLineOption verboseOption("verbose", "输出服务端和客户端的日志");
+    QCommandLineOption latencyOption("latency", "经过网络条件模拟代理回放: 单向延迟(毫秒)", "ms");
+    QCommandLineOption jitterOption("jitter", "延迟抖动(毫秒)", "ms", "0");
+    QCommandLineOption bandwidthOption("bandwidth", "带宽(KB/s)", "KB/s");
+    QCommandLineOption uploadOption("upload", "上行(客户端 -> 服务端)带宽(KB/s)", "KB/s");
+    QCommandLineOption resetsOption("resets", "TCP连接被重置的平均间隔(秒)", "sec");
+    QCommandLineOption seedOption("seed", "网络模拟的随机数种子", "n", "1");
+    parser.addOption(targetOption);
+    parser.addOption(speedOption);
+    parser.addOption(hostOption);
+    parser.addOption(portOption);
+    parser.addOption(agentsOption);
+    parser.addOption(waitOption);
+    parser.addOption(connectionOption);
+    parser.addOption(allowOption);
+    parser.addOption(timeoutOption);
+    parser.addOption(verboseOption);
+    parser.addOption(latencyOption);
+    parser.addOption(jitterOption);
+    parser.addOption(bandwidthOption);
+    parser.addOption(uploadOption);
+    parser.addOption(resetsOption);
+    parser.addOption(seedOption);
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    Replayer::Options options;
+    QString target = parser.value(targetOption);
+    if (target == "agent") {
+        options.target = Replayer::TARGET_AGENT;
+    } else if (target != "server") {
+        qCritical() << "未知的回放目标:" << target;
+        return 1;
+    }
+    options.speed = parser.value(speedOption) == "max" ? 0.0 : parser.value(speedOption).toDouble();
+    options.allowChanges = parser.isSet(allowOption);
+    if (parser.isSet(connectionOption)) {
+        options.connection = parser.value(connectionOption).toLongLong();
+    }
+    const quint16 port = parser.value(portOption).toUShort();
+    const bool verbose = parser.isSet(verboseOption);
+    if (options.speed < 0 || port == 0) {
+        qCritical() << "参数无效";
+        return 1;
+    }
+
+    // 指定了任一链路参数时,回放连接经过进程内的模拟代理(监听 port+1)
+    LinkProfile down;
+    down.latencyMs = parser.value(latencyOption).toInt();
+    down.jitterMs = parser.value(jitterOption).toInt();
+    down.bandwidth = parser.value(bandwidthOption).toLongLong() * 1024;
+    LinkProfile up = down;
+    if (parser.isSet(uploadOption)) {
+        up.bandwidth = parser.value(uploadOption).toLongLong() * 1024;
+    }
+    up.resetIntervalMs = int(parser.value(resetsOption).toDouble() * 1000);
+    const bool emulate = !up.isPerfect() || !down.isPerfect();
+    const quint16 proxyPort = quint16(port + 1);
+    NetEmuStats linkStats;
+    TcpProxy proxy(up, down, parser.value(seedOption).toUInt(), &linkStats);
+
+    // 服务端和客户端的日志经后台线程输出,不加 --verbose 时只输出警告和错误
+    Logger::setLevel(verbose ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARN);
+    Logger::addSink(new ConsoleLogSink);
+    Logger::start();
+    
+    Replayer replayer(options);
+    QString error;
+    if (!replayer.load(parser.positionalArguments().first(), &error)) {
+        qCritical().noquote() << "读取记录失败:" << error;
+        return 1;
+    }
+    qInfo().noquote() << QString("读取 %1 帧, %2 条连接").arg(replayer.frameCount()).arg(replayer.connectionCount());
+
+    QObject::connect(&replayer, &Replayer::finished, &app, &QCoreApplication::quit);
+    QTimer::singleShot(parser.value(timeoutOption).toInt() * 1000, &app, &QCoreApplication::quit);
+
+    // 进程内服务端使用临时目录中的历史存储和清单快照,与实际运行时走相同的处理路径
+    QTemporaryDir dataDir;
+    TsStore history(dataDir.path() + "/history");
+    InventorySnapshot inventory(dataDir.path() + "/inventory.snap");
+    TcpServer server;
+    MetricHistogram* processTime = nullptr;
+    QList<Agent*> agents;
+
+    if (options.target == Replayer::TARGET_SERVER) {
+        QString host = parser.value(hostOption);
+        if (host.isEmpty()) {
+            if (history.open()) {
+                server.setHistoryStore(&history);
+            }
+            inventory.load();
+            server.setInventorySnapshot(&inventory);
+            server.setDiscoveryEnabled(false);
+            server.setMetricsPort(0);
+            if (!server.start(port)) {
+                qCritical() << "无法启动服务端,端口" << port << "可能已被占用";
+                return 1;
+            }
+            // 同名同标签的指标返回服务端已注册的那个
+            processTime = server.metrics()->histogram("lanmgr_process_client_data_seconds", QString(), 1e-9);
+            host = "127.0.0.1";
+        }
+        if (emulate) {
+            if (!proxy.listen(proxyPort, host, port, &error)) {
+                qCritical().noquote() << "无法启动网络模拟代理:" << error;
+                return 1;
+            }
+            replayer.startClients("127.0.0.1", proxyPort);
+        } else {
+            replayer.startClients(host, port);
+        }
+    } else {
+        int count = parser.value(agentsOption).toInt();
+        int expected = count + parser.value(waitOption).toInt();
+        if (expected <= 0) {
+            qCritical() << "没有要回放的客户端";
+            return 1;
+        }
+        if (!replayer.listen(port, expected, &error)) {
+            qCritical().noquote() << "无法监听端口:" << error;
+            return 1;
+        }
+        if (emulate && !proxy.listen(proxyPort, "127.0.0.1", port, &error)) {
+            qCritical().noquote() << "无法启动网络模拟代理:" << error;
+            return 1;
+        }
+        for (int i = 0; i < count; ++i) {
+            Agent* agent = new Agent(&app);
+            agent->connectToServer("127.0.0.1", emulate ? proxyPort : port);
+            agents.append(agent);
+        }
+    }
+
+    app.exec();
+    replayer.report(processTime);
+    if (emulate) {
+        qInfo().noquote() << "网络模拟:" << linkStats.summary();
+    }
+
+    qDeleteAll(agents);
+    server.stop();
+    server.setHistoryStore(nullptr);
+    server.setInventorySnapshot(nullptr);
+    Logger::stop();
+    return 0;
+}
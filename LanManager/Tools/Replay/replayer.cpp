@@ -0,0 +1,368 @@
+#include "replayer.h"
+#include <QDebug>
+#include <limits>
+
+Replayer::Replayer(const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_timer(new QTimer(this))
+{
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &Replayer::pump);
+}
+
+Replayer::~Replayer()
+{
+    qDeleteAll(m_streams);
+}
+
+bool Replayer::load(const QString& path, QString* error)
+{
+    CaptureReader reader;
+    if (!reader.open(path)) {
+        *error = reader.errorString();
+        return false;
+    }
+
+    CaptureRecord record;
+    while (reader.next(record)) {
+        if (!wanted(record, reader.role())) {
+            continue;
+        }
+        m_connections[record.connection].append(m_records.size());
+        m_records.append(record);
+    }
+    if (!reader.errorString().isEmpty()) {
+        // 记录方异常退出时最后一条记录不完整,回放之前的部分
+        qWarning().noquote() << QString("记录文件%1,只回放之前的部分").arg(reader.errorString());
+    }
+    if (m_records.isEmpty()) {
+        *error = "记录中没有可回放的帧";
+        return false;
+    }
+    m_firstUs = m_records.first().timeUs;
+    return true;
+}
+
+bool Replayer::wanted(const CaptureRecord& record, CaptureRole role)
+{
+    // 发往服务端的帧: 服务端记录的接收帧,或客户端记录的发送帧
+    bool toServer = (role == CAPTURE_SERVER) == (record.direction == CAPTURE_IN);
+    if (toServer != (m_options.target == TARGET_SERVER)) {
+        return false;
+    }
+    if (m_options.target == TARGET_SERVER) {
+        return true;
+    }
+
+    switch (record.cmd) {
+    case CMD_HEARTBEAT_ACK:
+        // 心跳响应由本工具按客户端实际发来的心跳回复
+        return false;
+    case CMD_INSTALL_SOFTWARE:
+    case CMD_UNINSTALL_SOFTWARE:
+    case CMD_FILE_TRANSFER_START:
+    case CMD_FILE_TRANSFER_DATA:
+    case CMD_FILE_TRANSFER_END:
+    case CMD_EXEC_START:
+    case CMD_EXEC_CANCEL:
+        if (!m_options.allowChanges) {
+            m_skipped++;
+            return false;
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+void Replayer::startClients(const QString& host, quint16 port)
+{
+    m_clock.start();
+    for (auto it = m_connections.constBegin(); it != m_connections.constEnd(); ++it) {
+        // 各连接共用同一个时间起点,保持连接之间的相对时间
+        Stream* stream = new Stream;
+        stream->frames = it.value();
+        stream->baseUs = m_firstUs;
+        m_streams.append(stream);
+
+        QTcpSocket* socket = new QTcpSocket(this);
+        attach(stream, socket);
+        socket->connectToHost(host, port);
+    }
+}
+
+bool Replayer::listen(quint16 port, int expected, QString* error)
+{
+    auto selected = m_connections.constBegin();
+    if (m_options.connection >= 0) {
+        selected = m_connections.constFind(quint32(m_options.connection));
+        if (selected == m_connections.constEnd()) {
+            *error = QString("记录中没有连接 %1").arg(m_options.connection);
+            return false;
+        }
+    } else {
+        for (auto it = m_connections.constBegin(); it != m_connections.constEnd(); ++it) {
+            if (it->size() > selected->size()) {
+                selected = it;
+            }
+        }
+    }
+    m_agentFrames = selected.value();
+    m_expected = expected;
+    qInfo().noquote() << QString("回放连接 %1 的 %2 帧").arg(selected.key()).arg(m_agentFrames.size());
+
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &Replayer::onNewConnection);
+    if (!m_server->listen(QHostAddress::Any, port)) {
+        *error = m_server->errorString();
+        return false;
+    }
+    m_clock.start();
+    return true;
+}
+
+void Replayer::onNewConnection()
+{
+    while (QTcpSocket* socket = m_server->nextPendingConnection()) {
+        if (m_streams.size() >= m_expected) {
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        // 每个客户端从连上时开始回放
+        Stream* stream = new Stream;
+        stream->frames = m_agentFrames;
+        stream->baseUs = m_records[m_agentFrames.first()].timeUs;
+        stream->originUs = m_clock.nsecsElapsed() / 1000;
+        m_streams.append(stream);
+        attach(stream, socket);
+    }
+    pump();
+}
+
+void Replayer::attach(Stream* stream, QTcpSocket* socket)
+{
+    stream->socket = socket;
+    socket->setParent(this);
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(socket, &QTcpSocket::connected, this, &Replayer::pump);
+    connect(socket, &QTcpSocket::readyRead, this, [this, stream]() { onReadyRead(stream); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, stream]() {
+        if (!stream->done) {
+            qWarning().noquote() << QString("连接在回放完成前断开(已发送 %1/%2 帧)")
+                .arg(stream->next).arg(stream->frames.size());
+            stream->done = true;
+            finishIfDone();
+        }
+    });
+    connect(socket, &QAbstractSocket::errorOccurred, this, [this, stream](QAbstractSocket::SocketError) {
+        if (!stream->done && stream->socket->state() != QAbstractSocket::ConnectedState) {
+            qWarning().noquote() << "连接失败:" << stream->socket->errorString();
+            stream->done = true;
+            finishIfDone();
+        }
+    });
+}
+
+void Replayer::pump()
+{
+    qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+    qint64 nextUs = std::numeric_limits<qint64>::max();
+
+    for (Stream* stream : m_streams) {
+        if (stream->drained || stream->done || stream->socket->state() != QAbstractSocket::ConnectedState) {
+            continue;
+        }
+        while (stream->next < stream->frames.size()) {
+            const CaptureRecord& record = m_records[stream->frames[stream->next]];
+            qint64 offsetUs = m_options.speed > 0 ? qint64(double(record.timeUs - stream->baseUs) / m_options.speed) : 0;
+            qint64 dueUs = stream->originUs + offsetUs;
+            if (dueUs > nowUs) {
+                nextUs = qMin(nextUs, dueUs);
+                break;
+            }
+            writeFrame(stream, record.cmd, record.flags, record.requestId, record.replayPayload());
+            stream->next++;
+        }
+        if (stream->next == stream->frames.size()) {
+            stream->drained = true;
+            if (m_options.target == TARGET_SERVER) {
+                // 服务端按顺序处理同一连接上的帧,这个心跳的响应到达时之前的帧都已处理完
+                writeFrame(stream, CMD_HEARTBEAT, 0, 0, QByteArray());
+            }
+            checkDone(stream);
+        }
+    }
+
+    if (nextUs != std::numeric_limits<qint64>::max()) {
+        m_timer->start(int((nextUs - nowUs + 999) / 1000));
+    }
+}
+
+void Replayer::writeFrame(Stream* stream, quint32 cmd, quint8 flags, quint32 requestId, const QByteArray& data)
+{
+    stream->socket->write(Protocol::pack(CommandType(cmd), data, requestId, flags));
+    m_framesSent++;
+    m_bytesSent += data.size();
+
+    if (cmd == CMD_HEARTBEAT) {
+        stream->heartbeats++;
+    }
+    if (requestId && !(flags & FLAG_RESPONSE) && isRequest(cmd)) {
+        stream->requests.insert(requestId, qMakePair(cmd, m_clock.nsecsElapsed() / 1000));
+    }
+}
+
+void Replayer::onReadyRead(Stream* stream)
+{
+    stream->buffer.append(stream->socket->readAll());
+
+    while (stream->buffer.size() >= Protocol::headerSize()) {
+        ProtocolHeader header;
+        if (!Protocol::parseHeader(stream->buffer, header)) {
+            break;
+        }
+        int packetSize = header.size + int(header.dataLength);
+        if (stream->buffer.size() < packetSize) {
+            break;
+        }
+        QByteArray data = stream->buffer.mid(header.size, int(header.dataLength));
+        stream->buffer.remove(0, packetSize);
+
+        m_framesReceived++;
+        m_bytesReceived += data.size();
+        onResponse(stream, header, data);
+    }
+    checkDone(stream);
+}
+
+void Replayer::onResponse(Stream* stream, const ProtocolHeader& header, const QByteArray& data)
+{
+    if (header.cmdType == CMD_HEARTBEAT_ACK) {
+        stream->acks++;
+        return;
+    }
+    if (header.cmdType == CMD_HEARTBEAT && m_options.target == TARGET_AGENT) {
+        stream->socket->write(Protocol::pack(CMD_HEARTBEAT_ACK, QByteArray()));
+        return;
+    }
+    if (header.requestId == 0 || !isFinalResponse(header.cmdType, data)) {
+        return;
+    }
+
+    auto it = stream->requests.find(header.requestId);
+    if (it == stream->requests.end()) {
+        return;
+    }
+    QSharedPointer<MetricHistogram>& latency = m_latency[it->first];
+    if (!latency) {
+        latency.reset(new MetricHistogram);
+    }
+    latency->observe(quint64(m_clock.nsecsElapsed() / 1000 - it->second));
+    stream->requests.erase(it);
+}
+
+void Replayer::checkDone(Stream* stream)
+{
+    if (stream->done || !stream->drained) {
+        return;
+    }
+    bool complete = m_options.target == TARGET_SERVER ? stream->acks >= stream->heartbeats
+                                                      : stream->requests.isEmpty();
+    if (complete) {
+        stream->done = true;
+        finishIfDone();
+    }
+}
+
+void Replayer::finishIfDone()
+{
+    if (m_finished || m_streams.size() < m_expected) {
+        return;
+    }
+    for (const Stream* stream : m_streams) {
+        if (!stream->done) {
+            return;
+        }
+    }
+    m_finished = true;
+    m_finishedUs = m_clock.nsecsElapsed() / 1000;
+    emit finished();
+}
+
+bool Replayer::isRequest(quint32 cmd)
+{
+    switch (cmd) {
+    case CMD_GET_SYSINFO:
+    case CMD_GET_SOFTWARE:
+    case CMD_INSTALL_SOFTWARE:
+    case CMD_UNINSTALL_SOFTWARE:
+    case CMD_FILE_TRANSFER_START:
+    case CMD_EXEC_START:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Replayer::isFinalResponse(quint32 cmd, const QByteArray& data)
+{
+    switch (cmd) {
+    case CMD_SYSINFO_RESPONSE:
+    case CMD_SOFTWARE_RESPONSE:
+    case CMD_INSTALL_RESPONSE:
+    case CMD_UNINSTALL_RESPONSE:
+    case CMD_EXEC_RESULT:
+        return true;
+    case CMD_FILE_TRANSFER_ACK:
+        // 传输失败的确认就是最终响应,成功时还要等安装结果
+        return !Protocol::parseJson(data)["success"].toBool(true);
+    default:
+        return false;
+    }
+}
+
+void Replayer::report(const MetricHistogram* processTime) const
+{
+    qint64 elapsedUs = m_finished ? m_finishedUs : m_clock.nsecsElapsed() / 1000;
+    double seconds = qMax(1e-6, double(elapsedUs) / 1e6);
+    int unfinished = 0;
+    for (const Stream* stream : m_streams) {
+        if (!stream->done || stream->next < stream->frames.size()) {
+            unfinished++;
+        }
+    }
+
+    qInfo().noquote() << QString("回放 %1 条连接: 发送 %2 帧 (%3 KB), 收到 %4 帧 (%5 KB), 耗时 %6 ms, %7 帧/秒")
+        .arg(m_streams.size()).arg(m_framesSent).arg(m_bytesSent / 1024)
+        .arg(m_framesReceived).arg(m_bytesReceived / 1024)
+        .arg(elapsedUs / 1000).arg(qint64(double(m_framesSent) / seconds));
+    if (unfinished > 0) {
+        qInfo().noquote() << QString("%1 条连接未完成(断开或超时)").arg(unfinished);
+    }
+    if (m_skipped > 0) {
+        qInfo().noquote() << QString("跳过 %1 个会修改客户端的帧(安装、卸载、文件传输、远程执行),"
+                                     "需要时加 --allow-changes").arg(m_skipped);
+    }
+
+    if (processTime && processTime->count() > 0) {
+        qInfo().noquote() << QString("服务端处理: %1 次读事件, 平均 %2 us, p50 %3 us, p99 %4 us, 最大 %5 us")
+            .arg(processTime->count())
+            .arg(double(processTime->sum()) / double(processTime->count()) / 1000.0, 0, 'f', 1)
+            .arg(processTime->percentile(0.5) / 1000)
+            .arg(processTime->percentile(0.99) / 1000)
+            .arg(processTime->percentile(1.0) / 1000);
+    }
+
+    for (auto it = m_latency.constBegin(); it != m_latency.constEnd(); ++it) {
+        const MetricHistogram& latency = *it.value();
+        qInfo().noquote() << QString("%1: %2 次, p50 %3 ms, p99 %4 ms, 最大 %5 ms")
+            .arg(QString::fromLatin1(Protocol::commandName(it.key())), -20)
+            .arg(latency.count())
+            .arg(double(latency.percentile(0.5)) / 1000.0, 0, 'f', 1)
+            .arg(double(latency.percentile(0.99)) / 1000.0, 0, 'f', 1)
+            .arg(double(latency.percentile(1.0)) / 1000.0, 0, 'f', 1);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QSharedPointer>
+#include <QVector>
+#include "../../Common/capture.h"
+#include "../../Server/metrics.h"
+
+// 流量回放
+//
+// 从记录文件中取出发往目标一方的帧,按记录时的间隔(除以倍速)重新发送:
+//   目标为服务端时,每个记录的连接对应一条到服务端的TCP连接,发送客户端发出的帧;
+//   每条连接发完后再发一个心跳,收到对应的心跳响应说明之前的帧都已处理完。
+//   目标为客户端时,本工具充当服务端,把选定连接上服务端发出的帧发给连上来的每个客户端,
+//   按请求号统计各类请求的响应时间。
+// 同一连接上的帧保持原有顺序,倍速为0时不等待,尽快发送。
+class Replayer : public QObject
+{
+    Q_OBJECT
+public:
+    enum Target {
+        TARGET_SERVER,
+        TARGET_AGENT
+    };
+
+    struct Options {
+        Target target = TARGET_SERVER;
+        double speed = 1.0;         // 0表示不按时间间隔,尽快发送
+        bool allowChanges = false;  // 目标为客户端时是否回放安装、卸载、文件传输和远程执行
+        qint64 connection = -1;     // 目标为客户端时回放的连接编号,-1表示帧数最多的连接
+    };
+
+    explicit Replayer(const Options& options, QObject* parent = nullptr);
+    ~Replayer();
+
+    // 读取记录文件,选出要回放的帧
+    bool load(const QString& path, QString* error);
+
+    // 目标为服务端: 开始回放
+    void startClients(const QString& host, quint16 port);
+
+    // 目标为客户端: 在端口上等待 expected 个客户端连接,每个连上后开始回放
+    bool listen(quint16 port, int expected, QString* error);
+
+    // 输出统计,processTime 为进程内服务端的处理耗时直方图(纳秒),没有时为空
+    void report(const MetricHistogram* processTime) const;
+
+    int frameCount() const { return m_records.size(); }
+    int connectionCount() const { return m_connections.size(); }
+    int skippedCount() const { return m_skipped; }
+
+signals:
+    void finished();
+
+private slots:
+    void pump();
+    void onNewConnection();
+
+private:
+    // 一条回放连接
+    struct Stream {
+        QTcpSocket* socket = nullptr;
+        QVector<int> frames;            // m_records 中的下标
+        int next = 0;
+        qint64 originUs = 0;            // 本连接开始回放的时间(m_clock)
+        qint64 baseUs = 0;              // 对应的记录时间
+        QByteArray buffer;              // 接收缓冲
+        int heartbeats = 0;             // 已发送的心跳
+        int acks = 0;                   // 已收到的心跳响应
+        bool drained = false;           // 所有帧已发出
+        bool done = false;
+        QHash<quint32, QPair<quint32, qint64>> requests;   // 请求号 -> (命令, 发送时间)
+    };
+
+    bool wanted(const CaptureRecord& record, CaptureRole role);
+    void attach(Stream* stream, QTcpSocket* socket);
+    void writeFrame(Stream* stream, quint32 cmd, quint8 flags, quint32 requestId, const QByteArray& data);
+    void onReadyRead(Stream* stream);
+    void onResponse(Stream* stream, const ProtocolHeader& header, const QByteArray& data);
+    void checkDone(Stream* stream);
+    void finishIfDone();
+
+    // 等待响应的请求和对应的最终响应
+    static bool isRequest(quint32 cmd);
+    static bool isFinalResponse(quint32 cmd, const QByteArray& data);
+
+    Options m_options;
+    QVector<CaptureRecord> m_records;
+    QMap<quint32, QVector<int>> m_connections;   // 连接编号 -> 帧下标
+    int m_skipped = 0;
+    qint64 m_firstUs = 0;
+
+    QList<Stream*> m_streams;
+    QTcpServer* m_server = nullptr;
+    QVector<int> m_agentFrames;                  // 目标为客户端时回放的帧
+    int m_expected = 0;
+    QTimer* m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_finishedUs = 0;
+    bool m_finished = false;
+
+    // 统计
+    qint64 m_framesSent = 0;
+    qint64 m_bytesSent = 0;
+    qint64 m_framesReceived = 0;
+    qint64 m_bytesReceived = 0;
+    QMap<quint32, QSharedPointer<MetricHistogram>> m_latency;  // 请求命令 -> 响应时间(微秒)
+};
+
+#endif // REPLAYER_H
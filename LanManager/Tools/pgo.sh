@@ -0,0 +1,93 @@
+#!/usr/bin/env bash
+# 剖析引导优化(PGO)流程,只用于Linux
+#
+# 1. 普通发布构建(链接时优化),作为比较的基准
+# 2. 插桩构建,运行训练场景: ProtoBench 全部测试项,以及用 LanReplay 把给出的流量记录
+#    尽快回放给进程内的服务端(拆帧、JSON解析、清单和遥测处理都在其中)
+# 3. 按剖析数据重新编译
+# 4. 两种构建分别运行 ProtoBench(默认只测拆帧、协议头和JSON)和回放,输出对比
+#
+# 用法: Tools/pgo.sh [选项] [流量记录.lmcap ...]
+#   -b <目录>      构建目录,默认 build-pgo
+#   -s <mkspec>    qmake 的 -spec,如 linux-clang
+#   -f <正则>      比较的测试项,默认 "frame|header|json"
+#   -j <n>         并行编译数,默认CPU核数
+#   -q <qmake>     qmake 路径,默认 qmake
+
+set -euo pipefail
+
+SRC="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD=build-pgo
+SPEC=
+FILTER="frame|header|json"
+JOBS="$(nproc)"
+QMAKE=qmake
+
+while getopts "b:s:f:j:q:h" opt; do
+    case $opt in
+        b) BUILD="$OPTARG" ;;
+        s) SPEC="$OPTARG" ;;
+        f) FILTER="$OPTARG" ;;
+        j) JOBS="$OPTARG" ;;
+        q) QMAKE="$OPTARG" ;;
+        *) sed -n '2,16p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+CAPTURES=("$@")
+
+mkdir -p "$BUILD"
+BUILD="$(cd "$BUILD" && pwd)"
+PROFILE="$BUILD/profile"
+QMAKE_ARGS=(CONFIG+=release CONFIG+=ltcg "PGO_DIR=$PROFILE")
+if [ -n "$SPEC" ]; then
+    QMAKE_ARGS+=(-spec "$SPEC")
+fi
+
+# 编译到 $BUILD/<子目录>,附加的 qmake 参数跟在后面
+build() {
+    local dir="$BUILD/$1"
+    shift
+    mkdir -p "$dir"
+    (cd "$dir" && "$QMAKE" "$SRC/LanManager.pro" "${QMAKE_ARGS[@]}" "$@" && make -s clean && make -s -j"$JOBS")
+}
+
+# 训练和测量共用的场景
+replay_all() {
+    local bin="$1"
+    for capture in ${CAPTURES[@]+"${CAPTURES[@]}"}; do
+        echo "== 回放 $capture"
+        "$bin/LanReplay" --speed max "$capture"
+    done
+}
+
+echo "== 基准构建"
+build base
+
+echo "== 插桩构建"
+rm -rf "$PROFILE"
+mkdir -p "$PROFILE"
+build pgo CONFIG+=pgo_generate
+
+echo "== 训练"
+"$BUILD/pgo/bin/ProtoBench" --min-time 50 --rounds 1 > /dev/null
+replay_all "$BUILD/pgo/bin" > /dev/null
+
+# Clang 的剖析数据要合并后才能使用
+if compgen -G "$PROFILE/*.profraw" > /dev/null; then
+    llvm-profdata merge -o "$PROFILE/lanmgr.profdata" "$PROFILE"/*.profraw
+fi
+
+# 插桩构建和优化构建在同一目录,GCC 才能按目标文件路径找到剖析数据
+echo "== 优化构建"
+build pgo CONFIG+=pgo_use
+
+echo "== 比较"
+"$BUILD/base/bin/ProtoBench" --filter "$FILTER" --json "$BUILD/base.json" > /dev/null
+# 只看变化,不因个别项变慢而中止
+"$BUILD/pgo/bin/ProtoBench" --filter "$FILTER" --baseline "$BUILD/base.json" || true
+
+for variant in base pgo; do
+    echo "== 回放($variant)"
+    replay_all "$BUILD/$variant/bin"
+done
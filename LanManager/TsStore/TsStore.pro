@@ -0,0 +1,15 @@
+QT += core
+QT -= gui
+
+CONFIG += c++17 staticlib
+
+TARGET = tsstore
+TEMPLATE = lib
+
+include(tsstore.pri)
+
+# 链接时优化和剖析引导优化(CONFIG+=ltcg / pgo_generate / pgo_use)
+include(../pgo.pri)
+
+# 输出目录
+DESTDIR = ../bin
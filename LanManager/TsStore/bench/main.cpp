@@ -0,0 +1,130 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QRandomGenerator>
+#include <QDateTime>
+#include <QDebug>
+#include "tsstore.h"
+
+// 写入时每隔多少模拟时间刷新一次(毫秒),与服务端刷新历史数据的间隔一致
+#define BENCH_FLUSH_INTERVAL 10000
+
+// 时序存储基准测试
+// 模拟 N 台电脑 D 天的空闲磁盘数据,测量写入、重新打开、原始查询和降采样耗时
+
+static QString seriesName(int client)
+{
+    return QString("00:16:3E:%1:%2:%3/freeDisk")
+        .arg((client >> 16) & 0xFF, 2, 16, QChar('0'))
+        .arg((client >> 8) & 0xFF, 2, 16, QChar('0'))
+        .arg(client & 0xFF, 2, 16, QChar('0')).toUpper();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("TsBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("时序存储基准测试");
+    parser.addHelpOption();
+    QCommandLineOption clientsOption("clients", "模拟的电脑数量", "n", "2000");
+    QCommandLineOption daysOption("days", "数据天数", "n", "30");
+    QCommandLineOption intervalOption("interval", "采样间隔(秒)", "sec", "300");
+    QCommandLineOption dirOption("dir", "数据目录(默认使用临时目录)", "path");
+    parser.addOption(clientsOption);
+    parser.addOption(daysOption);
+    parser.addOption(intervalOption);
+    parser.addOption(dirOption);
+    parser.process(app);
+
+    const int clients = parser.value(clientsOption).toInt();
+    const int days = parser.value(daysOption).toInt();
+    const qint64 intervalMs = parser.value(intervalOption).toLongLong() * 1000;
+    if (clients <= 0 || days <= 0 || intervalMs <= 0) {
+        qCritical() << "参数无效";
+        return 1;
+    }
+
+    QTemporaryDir tempDir;
+    QString dir = parser.isSet(dirOption) ? parser.value(dirOption) : tempDir.path();
+
+    const qint64 end = QDateTime::currentMSecsSinceEpoch();
+    const qint64 start = end - qint64(days) * 24 * 3600 * 1000;
+    const qint64 pointsPerClient = (end - start) / intervalMs;
+
+    QElapsedTimer timer;
+
+    // 1. 写入: 按时间顺序交错写入所有序列,每10秒(模拟时间)刷新一次,与服务器实际写入模式一致
+    {
+        TsStore store(dir);
+        if (!store.open()) {
+            qCritical() << "打开失败:" << store.errorString();
+            return 1;
+        }
+        QVector<QString> names(clients);
+        QVector<qint64> values(clients);
+        for (int c = 0; c < clients; ++c) {
+            names[c] = seriesName(c);
+            values[c] = 50000 + QRandomGenerator::global()->bounded(200000);
+        }
+
+        timer.start();
+        qint64 lastFlush = start;
+        int flushes = 0;
+        for (qint64 i = 0; i < pointsPerClient; ++i) {
+            qint64 ts = start + i * intervalMs;
+            for (int c = 0; c < clients; ++c) {
+                values[c] += QRandomGenerator::global()->bounded(21) - 10;
+                store.append(names[c], ts, values[c]);
+            }
+            if (ts - lastFlush >= BENCH_FLUSH_INTERVAL) {
+                store.flush();
+                lastFlush = ts;
+                ++flushes;
+            }
+        }
+        store.flush();
+        qint64 ms = timer.elapsed();
+        qint64 total = pointsPerClient * clients;
+        qInfo().noquote() << QString("写入 %1 点: %2 ms (%3 点/秒), 刷新 %4 次, %5 个段, %6 个块")
+            .arg(total).arg(ms).arg(ms > 0 ? total * 1000 / ms : total).arg(flushes + 1)
+            .arg(store.segmentCount()).arg(store.blockCount());
+    }
+
+    // 2. 重新打开(重建块索引,从日志恢复未写满的块)
+    TsStore store(dir);
+    timer.start();
+    if (!store.open()) {
+        qCritical() << "重新打开失败:" << store.errorString();
+        return 1;
+    }
+    qInfo().noquote() << QString("重新打开: %1 ms").arg(timer.elapsed());
+
+    // 3. 单序列最近1天原始点
+    timer.start();
+    QVector<TsStore::Point> raw = store.query(seriesName(0), end - 24LL * 3600 * 1000, end);
+    qInfo().noquote() << QString("单序列1天原始查询: %1 点, %2 us")
+        .arg(raw.size()).arg(timer.nsecsElapsed() / 1000);
+
+    // 4. 全部电脑最近 D 天按天降采样
+    timer.start();
+    qint64 buckets = 0;
+    for (int c = 0; c < clients; ++c) {
+        buckets += store.downsample(seriesName(c), start, end, 24LL * 3600 * 1000).size();
+    }
+    qInfo().noquote() << QString("%1 台电脑 %2 天按天降采样: %3 个桶, %4 ms")
+        .arg(clients).arg(days).arg(buckets).arg(timer.elapsed());
+
+    // 5. 全部电脑按小时降采样(部分块需要解压)
+    timer.start();
+    buckets = 0;
+    for (int c = 0; c < clients; ++c) {
+        buckets += store.downsample(seriesName(c), start, end, 3600LL * 1000).size();
+    }
+    qInfo().noquote() << QString("%1 台电脑 %2 天按小时降采样: %3 个桶, %4 ms")
+        .arg(clients).arg(days).arg(buckets).arg(timer.elapsed());
+
+    return 0;
+}
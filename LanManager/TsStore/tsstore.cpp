@@ -0,0 +1,750 @@
+#include "tsstore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+
+const quint32 SEGMENT_MAGIC = 0x31535354;  // "TSS1"
+const quint32 BLOCK_MAGIC = 0x31425354;    // "TSB1"
+const quint32 SEGMENT_VERSION = 1;
+const int SEGMENT_HEADER_SIZE = 16;        // magic + version + start
+const int BLOCK_HEADER_SIZE = 56;          // 4 * u32 + 5 * i64
+
+const quint32 WAL_MAGIC = 0x31575354;      // "TSW1"
+const quint32 WAL_VERSION = 1;
+const int WAL_HEADER_SIZE = 8;             // magic + version
+const int WAL_RECORD_SIZE = 24;            // id + kind + timestamp + value
+const quint32 WAL_POINT = 0;               // 追加一个点
+const quint32 WAL_CLEAR = 1;               // 序列的缓冲点已写入段文件或被丢弃
+const qint64 WAL_CHECKPOINT_SLACK = 65536; // 日志记录数超过有效点数两倍再加这么多时重写
+
+void encodeWalRecord(uchar* r, quint32 id, quint32 kind, qint64 timestamp, qint64 value)
+{
+    qToLittleEndian<quint32>(id, r);
+    qToLittleEndian<quint32>(kind, r + 4);
+    qToLittleEndian<qint64>(timestamp, r + 8);
+    qToLittleEndian<qint64>(value, r + 16);
+}
+
+void putVarUInt(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+void putVarInt(QByteArray& out, qint64 value)
+{
+    putVarUInt(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+bool getVarUInt(const uchar*& p, const uchar* end, quint64& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uchar byte = *p++;
+        value |= quint64(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool getVarInt(const uchar*& p, const uchar* end, qint64& value)
+{
+    quint64 raw;
+    if (!getVarUInt(p, end, raw)) return false;
+    value = qint64(raw >> 1) ^ -qint64(raw & 1);
+    return true;
+}
+
+} // namespace
+
+TsStore::TsStore(const QString& dirPath)
+    : m_dirPath(dirPath)
+    , m_open(false)
+    , m_catalog(nullptr)
+    , m_wal(nullptr)
+    , m_walRecords(0)
+    , m_openPoints(0)
+{
+}
+
+TsStore::~TsStore()
+{
+    close();
+}
+
+bool TsStore::open()
+{
+    if (m_open) return true;
+
+    QDir dir(m_dirPath);
+    if (!dir.exists() && !QDir().mkpath(m_dirPath)) {
+        m_error = "无法创建目录: " + m_dirPath;
+        return false;
+    }
+
+    // 读取序列目录: 每行 "id\t序列名"
+    m_catalog = new QFile(dir.filePath("series.cat"));
+    if (!m_catalog->open(QIODevice::ReadWrite | QIODevice::Append)) {
+        m_error = "无法打开序列目录: " + m_catalog->errorString();
+        delete m_catalog;
+        m_catalog = nullptr;
+        return false;
+    }
+    m_catalog->seek(0);
+    for (const QByteArray& line : m_catalog->readAll().split('\n')) {
+        int tab = line.indexOf('\t');
+        if (tab <= 0) continue;
+        quint32 id = line.left(tab).toUInt();
+        QString name = QString::fromUtf8(line.mid(tab + 1));
+        if (int(id) >= m_seriesNames.size()) {
+            m_seriesNames.resize(int(id) + 1);
+        }
+        m_seriesNames[int(id)] = name;
+        m_seriesIds.insert(name, id);
+    }
+
+    // 加载全部段文件的块索引
+    const QStringList files = dir.entryList(QStringList() << "seg-*.tss", QDir::Files, QDir::Name);
+    for (const QString& fileName : files) {
+        bool ok = false;
+        qint64 index = fileName.mid(4, fileName.size() - 8).toLongLong(&ok);
+        if (!ok) continue;
+        if (!loadSegment(dir.filePath(fileName), index * SEGMENT_SPAN)) {
+            // 一个段损坏不影响其他段,改名保留以便排查,之后的数据写入新的段文件
+            quarantineSegment(dir.filePath(fileName));
+        }
+    }
+
+    if (!openWal()) {
+        return false;
+    }
+    m_open = true;
+
+    // 块写入段文件后、清空记录写入日志前中断时,恢复出的块可能已满
+    for (auto it = m_openBlocks.begin(); it != m_openBlocks.end(); ++it) {
+        if (it.value().points.size() >= BLOCK_POINTS && !writeBlock(it.key(), it.value())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TsStore::openWal()
+{
+    m_wal = new QFile(QDir(m_dirPath).filePath("head.wal"));
+    if (!m_wal->open(QIODevice::ReadWrite)) {
+        m_error = "无法打开日志: " + m_wal->errorString();
+        delete m_wal;
+        m_wal = nullptr;
+        return false;
+    }
+
+    // 按顺序重放: 点记录追加到序列的缓冲块,清空记录丢弃该序列之前的缓冲点
+    const QByteArray data = m_wal->readAll();
+    const uchar* base = reinterpret_cast<const uchar*>(data.constData());
+    qint64 valid = 0;
+    if (data.size() >= WAL_HEADER_SIZE && qFromLittleEndian<quint32>(base) == WAL_MAGIC) {
+        valid = WAL_HEADER_SIZE;
+        for (; valid + WAL_RECORD_SIZE <= data.size(); valid += WAL_RECORD_SIZE) {
+            const uchar* r = base + valid;
+            quint32 id = qFromLittleEndian<quint32>(r);
+            quint32 kind = qFromLittleEndian<quint32>(r + 4);
+            qint64 timestamp = qFromLittleEndian<qint64>(r + 8);
+            qint64 value = qFromLittleEndian<qint64>(r + 16);
+            ++m_walRecords;
+            if (int(id) >= m_seriesNames.size()) continue;
+
+            OpenBlock& block = m_openBlocks[id];
+            if (kind == WAL_CLEAR) {
+                m_openPoints -= block.points.size();
+                block.points.resize(0);
+                continue;
+            }
+            if (block.points.isEmpty()) {
+                block.segmentStart = segmentStartOf(timestamp);
+                block.points.reserve(BLOCK_POINTS);
+            }
+            block.points.append(Point{timestamp, value});
+            ++m_openPoints;
+        }
+    }
+
+    // 新建的日志写入文件头,写入中途崩溃留下的不完整记录截掉
+    if (valid == 0) {
+        uchar header[WAL_HEADER_SIZE];
+        qToLittleEndian<quint32>(WAL_MAGIC, header);
+        qToLittleEndian<quint32>(WAL_VERSION, header + 4);
+        m_wal->resize(0);
+        m_wal->seek(0);
+        m_wal->write(reinterpret_cast<const char*>(header), WAL_HEADER_SIZE);
+    } else if (valid < data.size()) {
+        m_wal->resize(valid);
+    }
+    m_wal->seek(m_wal->size());
+    return true;
+}
+
+void TsStore::writeWal(quint32 id, quint32 kind, qint64 timestamp, qint64 value)
+{
+    uchar record[WAL_RECORD_SIZE];
+    encodeWalRecord(record, id, kind, timestamp, value);
+    m_wal->write(reinterpret_cast<const char*>(record), WAL_RECORD_SIZE);
+    ++m_walRecords;
+}
+
+bool TsStore::checkpointWal()
+{
+    // 新日志只包含当前的缓冲点,写完后替换旧日志
+    QSaveFile out(m_wal->fileName());
+    if (!out.open(QIODevice::WriteOnly)) {
+        m_error = "无法重写日志: " + out.errorString();
+        return false;
+    }
+    QByteArray data(int(WAL_HEADER_SIZE), Qt::Uninitialized);
+    qToLittleEndian<quint32>(WAL_MAGIC, data.data());
+    qToLittleEndian<quint32>(WAL_VERSION, data.data() + 4);
+    out.write(data);
+    for (auto it = m_openBlocks.constBegin(); it != m_openBlocks.constEnd(); ++it) {
+        const QVector<Point>& pts = it.value().points;
+        if (pts.isEmpty()) continue;
+        data.resize(pts.size() * WAL_RECORD_SIZE);
+        uchar* r = reinterpret_cast<uchar*>(data.data());
+        for (const Point& p : pts) {
+            encodeWalRecord(r, it.key(), WAL_POINT, p.timestamp, p.value);
+            r += WAL_RECORD_SIZE;
+        }
+        out.write(data);
+    }
+
+    // 替换前先关闭旧日志,Windows下不能替换仍打开着的文件
+    m_wal->close();
+    bool ok = out.commit();
+    if (!ok) {
+        m_error = "无法重写日志: " + out.errorString();
+    } else {
+        m_walRecords = m_openPoints;
+    }
+    if (!m_wal->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        m_error = "无法打开日志: " + m_wal->errorString();
+        return false;
+    }
+    return ok;
+}
+
+void TsStore::close()
+{
+    if (m_open) {
+        flush();
+    }
+    for (Segment* seg : m_segments) {
+        if (seg->file) {
+            if (seg->map) {
+                seg->file->unmap(const_cast<uchar*>(seg->map));
+            }
+            seg->file->close();
+            delete seg->file;
+        }
+        delete seg;
+    }
+    m_segments.clear();
+    m_openBlocks.clear();
+    if (m_wal) {
+        m_wal->close();
+        delete m_wal;
+        m_wal = nullptr;
+    }
+    m_walRecords = 0;
+    m_openPoints = 0;
+    m_seriesIds.clear();
+    m_seriesNames.clear();
+    if (m_catalog) {
+        m_catalog->close();
+        delete m_catalog;
+        m_catalog = nullptr;
+    }
+    m_open = false;
+}
+
+bool TsStore::loadSegment(const QString& path, qint64 start)
+{
+    Segment* seg = new Segment;
+    seg->start = start;
+    seg->path = path;
+    seg->file = new QFile(path);
+    if (!seg->file->open(QIODevice::ReadWrite)) {
+        m_error = "无法打开段文件: " + path;
+        delete seg->file;
+        delete seg;
+        return false;
+    }
+    seg->fileSize = seg->file->size();
+
+    const uchar* base = seg->fileSize >= SEGMENT_HEADER_SIZE ? mapSegment(*seg) : nullptr;
+    if (!base || qFromLittleEndian<quint32>(base) != SEGMENT_MAGIC) {
+        m_error = "段文件格式错误: " + path;
+        if (seg->map) {
+            seg->file->unmap(const_cast<uchar*>(seg->map));
+        }
+        seg->file->close();
+        delete seg->file;
+        delete seg;
+        return false;
+    }
+    m_segments.insert(start, seg);
+
+    // 顺序扫描块头,遇到不完整的尾部(写入中途崩溃)时截断
+    qint64 offset = SEGMENT_HEADER_SIZE;
+    while (offset + BLOCK_HEADER_SIZE <= seg->fileSize) {
+        const uchar* h = base + offset;
+        if (qFromLittleEndian<quint32>(h) != BLOCK_MAGIC) break;
+
+        BlockRef ref;
+        ref.offset = offset;
+        quint32 id = qFromLittleEndian<quint32>(h + 4);
+        ref.count = qFromLittleEndian<quint32>(h + 8);
+        ref.payloadSize = qFromLittleEndian<quint32>(h + 12);
+        ref.minTs = qFromLittleEndian<qint64>(h + 16);
+        ref.maxTs = qFromLittleEndian<qint64>(h + 24);
+        ref.minValue = qFromLittleEndian<qint64>(h + 32);
+        ref.maxValue = qFromLittleEndian<qint64>(h + 40);
+        ref.sumValue = qFromLittleEndian<qint64>(h + 48);
+
+        qint64 next = offset + BLOCK_HEADER_SIZE + ref.payloadSize;
+        if (next > seg->fileSize) break;
+        offset = next;
+
+        // 每个点的时间戳和数值至少各占一个字节,点数与数据长度不符的块不可信,跳过
+        if (ref.count == 0 || ref.count > ref.payloadSize / 2 || ref.minTs > ref.maxTs) continue;
+        seg->blocks[id].append(ref);
+    }
+
+    if (offset < seg->fileSize) {
+        seg->file->unmap(const_cast<uchar*>(seg->map));
+        seg->map = nullptr;
+        seg->mapSize = 0;
+        seg->file->resize(offset);
+        seg->fileSize = offset;
+    }
+    return true;
+}
+
+void TsStore::quarantineSegment(const QString& path)
+{
+    QString badPath = path + ".bad";
+    QFile::remove(badPath);
+    QFile::rename(path, badPath);
+}
+
+const uchar* TsStore::mapSegment(Segment& seg) const
+{
+    // 段文件在映射之后可能又被追加,需要重新映射
+    if (seg.map && seg.mapSize == seg.fileSize) {
+        return seg.map;
+    }
+    if (seg.map) {
+        seg.file->unmap(const_cast<uchar*>(seg.map));
+        seg.map = nullptr;
+    }
+    seg.file->flush();
+    seg.map = seg.file->map(0, seg.fileSize);
+    seg.mapSize = seg.map ? seg.fileSize : 0;
+    return seg.map;
+}
+
+qint64 TsStore::segmentStartOf(qint64 timestamp)
+{
+    qint64 index = timestamp >= 0 ? timestamp / SEGMENT_SPAN
+                                  : (timestamp - SEGMENT_SPAN + 1) / SEGMENT_SPAN;
+    return index * SEGMENT_SPAN;
+}
+
+QString TsStore::segmentPath(qint64 start) const
+{
+    return QDir(m_dirPath).filePath(QString("seg-%1.tss").arg(start / SEGMENT_SPAN, 8, 10, QChar('0')));
+}
+
+TsStore::Segment* TsStore::segmentFor(qint64 segmentStart, bool create)
+{
+    Segment* seg = m_segments.value(segmentStart, nullptr);
+    if (seg || !create) {
+        return seg;
+    }
+
+    seg = new Segment;
+    seg->start = segmentStart;
+    seg->path = segmentPath(segmentStart);
+    seg->file = new QFile(seg->path);
+    if (!seg->file->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        m_error = "无法创建段文件: " + seg->path;
+        delete seg->file;
+        delete seg;
+        return nullptr;
+    }
+
+    uchar header[SEGMENT_HEADER_SIZE];
+    qToLittleEndian<quint32>(SEGMENT_MAGIC, header);
+    qToLittleEndian<quint32>(SEGMENT_VERSION, header + 4);
+    qToLittleEndian<qint64>(segmentStart, header + 8);
+    seg->file->write(reinterpret_cast<const char*>(header), SEGMENT_HEADER_SIZE);
+    seg->fileSize = SEGMENT_HEADER_SIZE;
+
+    m_segments.insert(segmentStart, seg);
+    return seg;
+}
+
+quint32 TsStore::seriesId(const QString& series, bool create)
+{
+    auto it = m_seriesIds.constFind(series);
+    if (it != m_seriesIds.constEnd()) {
+        return it.value();
+    }
+    if (!create) {
+        return quint32(-1);
+    }
+
+    quint32 id = quint32(m_seriesNames.size());
+    m_seriesNames.append(series);
+    m_seriesIds.insert(series, id);
+    m_catalog->write(QByteArray::number(id) + '\t' + series.toUtf8() + '\n');
+    m_catalog->flush();
+    return id;
+}
+
+bool TsStore::append(const QString& series, qint64 timestamp, qint64 value)
+{
+    if (!m_open || series.isEmpty() ||
+        series.contains('\n') || series.contains('\t')) {
+        return false;
+    }
+
+    quint32 id = seriesId(series, true);
+    OpenBlock& block = m_openBlocks[id];
+    qint64 segStart = segmentStartOf(timestamp);
+
+    // 一个块只属于一个段
+    if (!block.points.isEmpty() && block.segmentStart != segStart) {
+        if (!writeBlock(id, block)) return false;
+    }
+    if (block.points.isEmpty()) {
+        block.segmentStart = segStart;
+        block.points.reserve(BLOCK_POINTS);
+    }
+    block.points.append(Point{timestamp, value});
+    ++m_openPoints;
+    writeWal(id, WAL_POINT, timestamp, value);
+
+    if (block.points.size() >= BLOCK_POINTS) {
+        return writeBlock(id, block);
+    }
+    return true;
+}
+
+bool TsStore::flush()
+{
+    if (!m_open) return false;
+
+    bool ok = true;
+    for (Segment* seg : m_segments) {
+        ok = seg->file->flush() && ok;
+    }
+    if (!m_wal->flush()) {
+        m_error = "写入日志失败: " + m_wal->errorString();
+        ok = false;
+    }
+
+    // 日志中大部分点已写入段文件时重写,日志大小与缓冲点数保持同一量级
+    if (m_walRecords > 2 * m_openPoints + WAL_CHECKPOINT_SLACK) {
+        ok = checkpointWal() && ok;
+    }
+    return ok;
+}
+
+bool TsStore::writeBlock(quint32 id, OpenBlock& block)
+{
+    Segment* seg = segmentFor(block.segmentStart, true);
+    if (!seg) return false;
+
+    const QVector<Point>& pts = block.points;
+    BlockRef ref;
+    ref.offset = seg->fileSize;
+    ref.count = quint32(pts.size());
+    ref.minTs = ref.maxTs = pts.first().timestamp;
+    ref.minValue = ref.maxValue = pts.first().value;
+    ref.sumValue = 0;
+    for (const Point& p : pts) {
+        ref.minTs = qMin(ref.minTs, p.timestamp);
+        ref.maxTs = qMax(ref.maxTs, p.timestamp);
+        ref.minValue = qMin(ref.minValue, p.value);
+        ref.maxValue = qMax(ref.maxValue, p.value);
+        ref.sumValue += p.value;
+    }
+
+    // 时间戳列: 首点相对minTs的偏移,之后为二阶差分
+    // 数值列: 首值,之后为一阶差分
+    QByteArray payload;
+    payload.reserve(pts.size() * 3);
+    putVarUInt(payload, quint64(pts.first().timestamp - ref.minTs));
+    qint64 prevDelta = 0;
+    for (int i = 1; i < pts.size(); ++i) {
+        qint64 delta = pts[i].timestamp - pts[i - 1].timestamp;
+        putVarInt(payload, delta - prevDelta);
+        prevDelta = delta;
+    }
+    putVarInt(payload, pts.first().value);
+    for (int i = 1; i < pts.size(); ++i) {
+        putVarInt(payload, pts[i].value - pts[i - 1].value);
+    }
+    ref.payloadSize = quint32(payload.size());
+
+    uchar header[BLOCK_HEADER_SIZE];
+    qToLittleEndian<quint32>(BLOCK_MAGIC, header);
+    qToLittleEndian<quint32>(id, header + 4);
+    qToLittleEndian<quint32>(ref.count, header + 8);
+    qToLittleEndian<quint32>(ref.payloadSize, header + 12);
+    qToLittleEndian<qint64>(ref.minTs, header + 16);
+    qToLittleEndian<qint64>(ref.maxTs, header + 24);
+    qToLittleEndian<qint64>(ref.minValue, header + 32);
+    qToLittleEndian<qint64>(ref.maxValue, header + 40);
+    qToLittleEndian<qint64>(ref.sumValue, header + 48);
+
+    seg->file->seek(seg->fileSize);
+    if (seg->file->write(reinterpret_cast<const char*>(header), BLOCK_HEADER_SIZE) != BLOCK_HEADER_SIZE ||
+        seg->file->write(payload) != payload.size()) {
+        m_error = "写入段文件失败: " + seg->file->errorString();
+        return false;
+    }
+    seg->fileSize += BLOCK_HEADER_SIZE + payload.size();
+    seg->blocks[id].append(ref);
+
+    // 块写到文件后日志里才能丢弃这些点
+    seg->file->flush();
+    writeWal(id, WAL_CLEAR, 0, 0);
+    m_openPoints -= block.points.size();
+    block.points.resize(0);
+    return true;
+}
+
+bool TsStore::decodeBlock(const uchar* base, const BlockRef& ref, QVector<Point>& out) const
+{
+    if (ref.count == 0) return false;
+
+    const uchar* p = base + ref.offset + BLOCK_HEADER_SIZE;
+    const uchar* end = p + ref.payloadSize;
+    int first = out.size();
+    out.resize(first + int(ref.count));
+    Point* pts = out.data() + first;
+
+    quint64 firstOffset;
+    if (!getVarUInt(p, end, firstOffset)) return false;
+    qint64 ts = ref.minTs + qint64(firstOffset);
+    qint64 delta = 0;
+    pts[0].timestamp = ts;
+    for (quint32 i = 1; i < ref.count; ++i) {
+        qint64 dod;
+        if (!getVarInt(p, end, dod)) return false;
+        delta += dod;
+        ts += delta;
+        pts[i].timestamp = ts;
+    }
+
+    qint64 value;
+    if (!getVarInt(p, end, value)) return false;
+    pts[0].value = value;
+    for (quint32 i = 1; i < ref.count; ++i) {
+        qint64 d;
+        if (!getVarInt(p, end, d)) return false;
+        value += d;
+        pts[i].value = value;
+    }
+    return true;
+}
+
+QVector<TsStore::Point> TsStore::query(const QString& series, qint64 from, qint64 to) const
+{
+    QVector<Point> result;
+    auto idIt = m_seriesIds.constFind(series);
+    if (!m_open || idIt == m_seriesIds.constEnd() || from >= to) {
+        return result;
+    }
+    quint32 id = idIt.value();
+
+    QVector<Point> scratch;
+    for (auto it = m_segments.lowerBound(segmentStartOf(from));
+         it != m_segments.end() && it.key() < to; ++it) {
+        Segment* seg = it.value();
+        auto blocksIt = seg->blocks.constFind(id);
+        if (blocksIt == seg->blocks.constEnd()) continue;
+
+        const uchar* base = mapSegment(*seg);
+        if (!base) continue;
+        for (const BlockRef& ref : blocksIt.value()) {
+            if (ref.maxTs < from || ref.minTs >= to) continue;
+            scratch.resize(0);
+            if (!decodeBlock(base, ref, scratch)) continue;
+            for (const Point& p : scratch) {
+                if (p.timestamp >= from && p.timestamp < to) {
+                    result.append(p);
+                }
+            }
+        }
+    }
+
+    // 未落盘的点
+    auto openIt = m_openBlocks.constFind(id);
+    if (openIt != m_openBlocks.constEnd()) {
+        for (const Point& p : openIt.value().points) {
+            if (p.timestamp >= from && p.timestamp < to) {
+                result.append(p);
+            }
+        }
+    }
+
+    std::stable_sort(result.begin(), result.end(), [](const Point& a, const Point& b) {
+        return a.timestamp < b.timestamp;
+    });
+    return result;
+}
+
+QVector<TsStore::Bucket> TsStore::downsample(const QString& series, qint64 from, qint64 to,
+                                             qint64 bucketSize) const
+{
+    QVector<Bucket> result;
+    auto idIt = m_seriesIds.constFind(series);
+    if (!m_open || idIt == m_seriesIds.constEnd() || from >= to || bucketSize <= 0) {
+        return result;
+    }
+    quint32 id = idIt.value();
+
+    qint64 bucketCount = (to - from + bucketSize - 1) / bucketSize;
+    if (bucketCount > 10000000) {
+        return result;
+    }
+    QVector<Bucket> buckets(int(bucketCount));
+    for (int i = 0; i < buckets.size(); ++i) {
+        buckets[i] = Bucket{from + i * bucketSize, 0, 0, 0, 0};
+    }
+
+    auto addPoint = [&](qint64 ts, qint64 value) {
+        if (ts < from || ts >= to) return;
+        Bucket& b = buckets[int((ts - from) / bucketSize)];
+        if (b.count == 0) {
+            b.min = b.max = value;
+        } else {
+            b.min = qMin(b.min, value);
+            b.max = qMax(b.max, value);
+        }
+        b.sum += value;
+        ++b.count;
+    };
+
+    QVector<Point> scratch;
+    for (auto it = m_segments.lowerBound(segmentStartOf(from));
+         it != m_segments.end() && it.key() < to; ++it) {
+        Segment* seg = it.value();
+        auto blocksIt = seg->blocks.constFind(id);
+        if (blocksIt == seg->blocks.constEnd()) continue;
+
+        const uchar* base = nullptr;
+        for (const BlockRef& ref : blocksIt.value()) {
+            if (ref.maxTs < from || ref.minTs >= to) continue;
+
+            // 整块落在同一个桶内时直接合并块摘要
+            if (ref.minTs >= from && ref.maxTs < to &&
+                (ref.minTs - from) / bucketSize == (ref.maxTs - from) / bucketSize) {
+                Bucket& b = buckets[int((ref.minTs - from) / bucketSize)];
+                if (b.count == 0) {
+                    b.min = ref.minValue;
+                    b.max = ref.maxValue;
+                } else {
+                    b.min = qMin(b.min, ref.minValue);
+                    b.max = qMax(b.max, ref.maxValue);
+                }
+                b.sum += ref.sumValue;
+                b.count += ref.count;
+                continue;
+            }
+
+            if (!base && !(base = mapSegment(*seg))) break;
+            scratch.resize(0);
+            if (!decodeBlock(base, ref, scratch)) continue;
+            for (const Point& p : scratch) {
+                addPoint(p.timestamp, p.value);
+            }
+        }
+    }
+
+    auto openIt = m_openBlocks.constFind(id);
+    if (openIt != m_openBlocks.constEnd()) {
+        for (const Point& p : openIt.value().points) {
+            addPoint(p.timestamp, p.value);
+        }
+    }
+
+    for (const Bucket& b : buckets) {
+        if (b.count > 0) {
+            result.append(b);
+        }
+    }
+    return result;
+}
+
+QStringList TsStore::seriesKeys(const QString& prefix) const
+{
+    QStringList keys;
+    for (const QString& name : m_seriesNames) {
+        if (!name.isEmpty() && name.startsWith(prefix)) {
+            keys.append(name);
+        }
+    }
+    return keys;
+}
+
+int TsStore::removeSegmentsBefore(qint64 timestamp)
+{
+    int removed = 0;
+    auto it = m_segments.begin();
+    while (it != m_segments.end() && it.key() + SEGMENT_SPAN <= timestamp) {
+        Segment* seg = it.value();
+        if (seg->map) {
+            seg->file->unmap(const_cast<uchar*>(seg->map));
+        }
+        seg->file->close();
+        QFile::remove(seg->path);
+        delete seg->file;
+        delete seg;
+        it = m_segments.erase(it);
+        ++removed;
+    }
+
+    // 丢弃属于已删除段的缓冲点
+    for (auto ob = m_openBlocks.begin(); ob != m_openBlocks.end(); ++ob) {
+        if (!ob.value().points.isEmpty() &&
+            ob.value().segmentStart + SEGMENT_SPAN <= timestamp) {
+            writeWal(ob.key(), WAL_CLEAR, 0, 0);
+            m_openPoints -= ob.value().points.size();
+            ob.value().points.resize(0);
+        }
+    }
+    return removed;
+}
+
+qint64 TsStore::blockCount() const
+{
+    qint64 total = 0;
+    for (const Segment* seg : m_segments) {
+        for (const QVector<BlockRef>& refs : seg->blocks) {
+            total += refs.size();
+        }
+    }
+    return total;
+}
@@ -0,0 +1,145 @@
+#ifndef TSSTORE_H
+#define TSSTORE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+
+class QFile;
+
+// 嵌入式时序存储
+//
+// 数据按时间切分为段文件(默认每天一个),段内只追加写入数据块。
+// 每个数据块只包含一个序列的最多 BLOCK_POINTS 个点,按列存储:
+// 时间戳列为二阶差分变长编码,数值列为一阶差分ZigZag变长编码。
+// 块头中保存时间范围和 min/max/sum 摘要,降采样时完整落在桶内的块
+// 直接使用摘要,不需要解压数据。
+//
+// 未写满的块留在内存中,每个点同时追加到预写日志(head.wal),刷新时只把日志写到磁盘;
+// 块写满或序列进入下一个段时才写入段文件,段中不会留下很小的块。
+// 重新打开时按日志恢复未写满的块,日志在超过有效点数若干倍后重写。
+//
+// 读取通过内存映射段文件完成。本类不是线程安全的。
+class TsStore {
+public:
+    // 每个数据块最多包含的点数
+    static constexpr int BLOCK_POINTS = 1024;
+
+    // 每个段文件覆盖的时间跨度(毫秒)
+    static constexpr qint64 SEGMENT_SPAN = 24LL * 3600 * 1000;
+
+    struct Point {
+        qint64 timestamp;  // UTC毫秒
+        qint64 value;
+    };
+
+    // 降采样结果
+    struct Bucket {
+        qint64 start;   // 桶起始时间
+        qint64 min;
+        qint64 max;
+        qint64 sum;
+        quint32 count;
+
+        double avg() const { return count ? double(sum) / count : 0.0; }
+    };
+
+    explicit TsStore(const QString& dirPath);
+    ~TsStore();
+
+    // 打开存储目录,重建块索引并从日志恢复未写满的块。
+    // 损坏的段文件改名为 *.bad 后跳过
+    bool open();
+
+    // 刷新日志并关闭,未写满的块下次打开时恢复
+    void close();
+
+    bool isOpen() const { return m_open; }
+    QString errorString() const { return m_error; }
+
+    // 追加一个点(序列名如 "AA:BB:CC:DD:EE:FF/freeDisk")
+    bool append(const QString& series, qint64 timestamp, qint64 value);
+
+    // 把段文件和日志写到磁盘,未写满的块仍留在内存中
+    bool flush();
+
+    // 查询 [from, to) 内的原始点
+    QVector<Point> query(const QString& series, qint64 from, qint64 to) const;
+
+    // 按 bucketSize 毫秒降采样 [from, to),只返回非空桶
+    QVector<Bucket> downsample(const QString& series, qint64 from, qint64 to,
+                               qint64 bucketSize) const;
+
+    // 列出以 prefix 开头的序列名
+    QStringList seriesKeys(const QString& prefix = QString()) const;
+
+    // 删除早于 timestamp 的整段数据(数据保留策略)
+    int removeSegmentsBefore(qint64 timestamp);
+
+    // 统计信息
+    int segmentCount() const { return m_segments.size(); }
+    qint64 blockCount() const;
+
+private:
+    // 块索引项(即块头的内存副本)
+    struct BlockRef {
+        qint64 offset;      // 块头在段文件中的偏移
+        quint32 count;
+        quint32 payloadSize;
+        qint64 minTs;
+        qint64 maxTs;
+        qint64 minValue;
+        qint64 maxValue;
+        qint64 sumValue;
+    };
+
+    struct Segment {
+        qint64 start = 0;                        // 段起始时间
+        QString path;
+        QFile* file = nullptr;                   // 追加写入句柄
+        const uchar* map = nullptr;              // 只读映射
+        qint64 mapSize = 0;
+        qint64 fileSize = 0;
+        QHash<quint32, QVector<BlockRef>> blocks;
+    };
+
+    // 某个序列尚未落盘的点
+    struct OpenBlock {
+        qint64 segmentStart = 0;
+        QVector<Point> points;
+    };
+
+    quint32 seriesId(const QString& series, bool create);
+    Segment* segmentFor(qint64 segmentStart, bool create);
+    bool loadSegment(const QString& path, qint64 start);
+    void quarantineSegment(const QString& path);
+    bool writeBlock(quint32 id, OpenBlock& block);
+    bool openWal();
+    void writeWal(quint32 id, quint32 kind, qint64 timestamp, qint64 value);
+    bool checkpointWal();
+    const uchar* mapSegment(Segment& seg) const;
+    bool decodeBlock(const uchar* base, const BlockRef& ref, QVector<Point>& out) const;
+
+    static qint64 segmentStartOf(qint64 timestamp);
+    QString segmentPath(qint64 start) const;
+
+private:
+    QString m_dirPath;
+    bool m_open;
+    QString m_error;
+
+    QHash<QString, quint32> m_seriesIds;
+    QVector<QString> m_seriesNames;
+    QFile* m_catalog;
+
+    QMap<qint64, Segment*> m_segments;   // 按起始时间排序
+    QHash<quint32, OpenBlock> m_openBlocks;
+
+    QFile* m_wal;                        // 未写满块的预写日志
+    qint64 m_walRecords;                 // 日志中的记录数
+    qint64 m_openPoints;                 // 全部未写满块中的点数
+};
+
+#endif // TSSTORE_H
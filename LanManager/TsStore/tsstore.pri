@@ -0,0 +1,10 @@
+# 时序存储库源码引用
+# 使用方式: include(../TsStore/tsstore.pri)
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/tsstore.cpp
+
+HEADERS += \
+    $$PWD/tsstore.h
@@ -0,0 +1,53 @@
+# 剖析引导优化(PGO)和链接时优化的编译选项,与 pgo.pri 相同
+#
+#   -DLANMGR_LTO=ON                          链接时优化
+#   -DLANMGR_LTO=ON -DLANMGR_PGO=GENERATE    插桩构建,运行后写出剖析数据
+#   -DLANMGR_LTO=ON -DLANMGR_PGO=USE         按剖析数据优化
+#
+# 剖析数据放在 LANMGR_PGO_DIR(默认源码目录下的 pgo/)。GCC 按目标文件的路径记录,每个目标一个
+# 子目录,插桩构建和优化构建须在同一个构建目录;服务端核心库和客户端库的剖析数据由所有链接它们的
+# 程序共同写入。Clang 按函数记录,运行后用 llvm-profdata 把所有 .profraw 合并为 lanmgr.profdata,
+# 所有目标共用。只支持 GCC 和 Clang。
+
+if(LANMGR_LTO)
+    include(CheckIPOSupported)
+    check_ipo_supported(RESULT LANMGR_LTO_SUPPORTED OUTPUT LANMGR_LTO_ERROR)
+    if(NOT LANMGR_LTO_SUPPORTED)
+        message(WARNING "编译器不支持链接时优化,忽略 LANMGR_LTO: ${LANMGR_LTO_ERROR}")
+    endif()
+endif()
+
+if(NOT LANMGR_PGO STREQUAL "OFF" AND NOT LANMGR_PGO STREQUAL "GENERATE" AND NOT LANMGR_PGO STREQUAL "USE")
+    message(FATAL_ERROR "LANMGR_PGO 只能是 OFF、GENERATE 或 USE")
+endif()
+if(NOT LANMGR_PGO STREQUAL "OFF" AND NOT CMAKE_CXX_COMPILER_ID MATCHES "Clang|GNU")
+    message(WARNING "PGO只支持GCC和Clang,忽略 LANMGR_PGO")
+    set(LANMGR_PGO OFF)
+endif()
+
+function(lanmgr_optimize target)
+    if(LANMGR_LTO AND LANMGR_LTO_SUPPORTED)
+        set_property(TARGET ${target} PROPERTY INTERPROCEDURAL_OPTIMIZATION ON)
+    endif()
+
+    if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+        if(LANMGR_PGO STREQUAL "GENERATE")
+            target_compile_options(${target} PRIVATE -fprofile-instr-generate=${LANMGR_PGO_DIR}/${target}-%p.profraw)
+            target_link_options(${target} PRIVATE -fprofile-instr-generate)
+        elseif(LANMGR_PGO STREQUAL "USE")
+            target_compile_options(${target} PRIVATE
+                -fprofile-instr-use=${LANMGR_PGO_DIR}/lanmgr.profdata -Wno-profile-instr-unprofiled)
+        endif()
+    elseif(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        # 服务端和回放工具在多个线程里运行插桩代码,计数须原子更新
+        if(LANMGR_PGO STREQUAL "GENERATE")
+            target_compile_options(${target} PRIVATE
+                -fprofile-generate=${LANMGR_PGO_DIR}/${target} -fprofile-update=atomic)
+            target_link_options(${target} PRIVATE -fprofile-generate=${LANMGR_PGO_DIR}/${target})
+        # 训练没有覆盖到的函数(如界面代码)按普通方式优化,不当作从未执行
+        elseif(LANMGR_PGO STREQUAL "USE")
+            target_compile_options(${target} PRIVATE
+                -fprofile-use=${LANMGR_PGO_DIR}/${target} -fprofile-partial-training -Wno-missing-profile)
+        endif()
+    endif()
+endfunction()
@@ -0,0 +1,40 @@
+# 剖析引导优化(PGO)和链接时优化的编译选项,各工程在 TARGET 之后 include
+#
+#   qmake CONFIG+=release CONFIG+=ltcg                       链接时优化(qmake自带)
+#   qmake CONFIG+=release CONFIG+=ltcg CONFIG+=pgo_generate  插桩构建,运行后写出剖析数据
+#   qmake CONFIG+=release CONFIG+=ltcg CONFIG+=pgo_use       按剖析数据优化
+#
+# 剖析数据放在 PGO_DIR(默认源码目录下的 pgo/,可用 qmake PGO_DIR=<目录> 指定)。
+# GCC 按目标文件的路径记录,每个程序一个子目录,插桩构建和优化构建须在同一个构建目录;
+# Clang 按函数记录,运行后用 llvm-profdata 把所有 .profraw 合并为 lanmgr.profdata,
+# 所有程序共用。完整流程见 Tools/pgo.sh。只支持 GCC 和 Clang。
+
+isEmpty(PGO_DIR): PGO_DIR = $$PWD/pgo
+
+pgo_generate|pgo_use {
+    contains(QMAKE_COMPILER, clang) {
+        pgo_generate {
+            QMAKE_CFLAGS += -fprofile-instr-generate=$$PGO_DIR/$$TARGET-%p.profraw
+            QMAKE_CXXFLAGS += -fprofile-instr-generate=$$PGO_DIR/$$TARGET-%p.profraw
+            QMAKE_LFLAGS += -fprofile-instr-generate
+        }
+        pgo_use {
+            QMAKE_CFLAGS += -fprofile-instr-use=$$PGO_DIR/lanmgr.profdata -Wno-profile-instr-unprofiled
+            QMAKE_CXXFLAGS += -fprofile-instr-use=$$PGO_DIR/lanmgr.profdata -Wno-profile-instr-unprofiled
+        }
+    } else: contains(QMAKE_COMPILER, gcc) {
+        # 服务端和回放工具在多个线程里运行插桩代码,计数须原子更新
+        pgo_generate {
+            QMAKE_CFLAGS += -fprofile-generate=$$PGO_DIR/$$TARGET -fprofile-update=atomic
+            QMAKE_CXXFLAGS += -fprofile-generate=$$PGO_DIR/$$TARGET -fprofile-update=atomic
+            QMAKE_LFLAGS += -fprofile-generate=$$PGO_DIR/$$TARGET
+        }
+        # 训练没有覆盖到的函数(如界面代码)按普通方式优化,不当作从未执行
+        pgo_use {
+            QMAKE_CFLAGS += -fprofile-use=$$PGO_DIR/$$TARGET -fprofile-partial-training -Wno-missing-profile
+            QMAKE_CXXFLAGS += -fprofile-use=$$PGO_DIR/$$TARGET -fprofile-partial-training -Wno-missing-profile
+        }
+    } else {
+        warning("PGO只支持GCC和Clang,忽略 pgo_generate/pgo_use")
+    }
+}